@@ -62,6 +62,9 @@
 /* the default branching probability for random trees */
 #define GPR_DEFAULT_BRANCHING_PROB 0.5
 
+/* number of random crossover points tried before giving up */
+#define GPR_CROSSOVER_ATTEMPTS 4
+
 /* values returned by conditional nodes (and, or, not) */
 #define GPR_TRUE  1
 #define GPR_FALSE 0
@@ -96,6 +99,16 @@
 /* maximum nodes when loading or saving a function */
 #define GPR_MAX_NODES 5096
 
+/* number of program nodes allocated together within a slab */
+#define GPR_POOL_SLAB_SIZE 1024
+
+/* number of nodes freed on other threads which are gathered
+   before being returned to the thread which owns them */
+#define GPR_POOL_BATCH_SIZE 64
+
+/* maximum number of threads which can own program nodes */
+#define GPR_POOL_MAX_OWNERS 65535
+
 /* return values when loading a function */
 #define GPR_LOAD_OK                        0
 #define GPR_LOAD_MAX_NODES_REACHED        -1
@@ -108,6 +121,21 @@
 #define GPR_LOAD_NODE_NOT_FOUND           -8
 #define GPR_LOAD_ARGC_NOT_FOUND           -9
 #define GPR_LOAD_POPULATION_SIZE          -10
+#define GPR_LOAD_BINARY_FORMAT            -11
+#define GPR_LOAD_BINARY_VERSION           -12
+#define GPR_LOAD_BINARY_SECTION           -13
+
+/* return values when compiling programs into native code */
+#define GPR_JIT_OK                         0
+#define GPR_JIT_NOT_SUPPORTED             -1
+#define GPR_JIT_COMPILE_FAILED            -2
+#define GPR_JIT_LOAD_FAILED               -3
+
+/* the C compiler used for native code, unless CC is set */
+#define GPR_JIT_COMPILER "cc"
+
+/* default number of compiled programs kept loaded at any time */
+#define GPR_JIT_CACHE_LIMIT 1024
 
 /* maximum number of trials during unit tests */
 #define GPR_MAX_TESTS 100
@@ -66,6 +66,25 @@ int rand_num(unsigned int * seed)
 	return abs((int)v);
 }
 
+/* Returns the seed for an independent random number stream,
+   derived from a base seed and a stream index.
+   Consecutive Lehmer seeds give overlapping sequences, so the
+   bits are mixed before use */
+unsigned int rand_stream_seed(unsigned int seed, unsigned int index)
+{
+	unsigned int v = seed ^ (index * 0x9E3779B9U);
+
+	v ^= v >> 16;
+	v *= 0x85EBCA6BU;
+	v ^= v >> 13;
+	v *= 0xC2B2AE35U;
+	v ^= v >> 16;
+
+	v %= 4294967291U;
+	if (v == 0) v = 1;
+	return v;
+}
+
 /* is the given function type a terminal ? */
 static unsigned char is_terminal(unsigned char function_type)
 {
@@ -548,13 +567,16 @@ static float gpr_custom_function(gpr_function * f, gpr_state * state,
 								 float (*custom_function)
 								 (float,float,float))
 {
-	return (*custom_function)(f->value,
-							  gpr_run_function((gpr_function*)f->argv[0],
-											   state, call_depth,
-											   (*custom_function)),
-							  gpr_run_function((gpr_function*)f->argv[1],
-											   state, call_depth,
-											   (*custom_function)));
+	float v1, v2;
+
+	/* arguments are evaluated in order */
+	v1 = gpr_run_function((gpr_function*)f->argv[0],
+						  state, call_depth,
+						  (*custom_function));
+	v2 = gpr_run_function((gpr_function*)f->argv[1],
+						  state, call_depth,
+						  (*custom_function));
+	return (*custom_function)(f->value, v1, v2);
 }
 
 static void gpr_average_c(FILE * fp, int argc)
@@ -1228,7 +1250,7 @@ static void gpr_store_c(FILE * fp, int argc)
 }
 
 /* stores a value in a register or actuator */
-static float store(float v1, float v2, gpr_state * state)
+float gpr_state_store(float v1, float v2, gpr_state * state)
 {
 	int index, v;
 
@@ -1255,17 +1277,20 @@ static float gpr_set(gpr_function * f,
 					 gpr_state * state, int call_depth,
 					 float (*custom_function)(float,float,float))
 {
-	return store(gpr_run_function((gpr_function*)f->argv[0], state,
-								  call_depth,
-								  (*custom_function)),
-				 gpr_run_function((gpr_function*)f->argv[1], state,
-								  call_depth,
-								  (*custom_function)),
-				 state);
+	float v1, v2;
+
+	/* arguments are evaluated in order */
+	v1 = gpr_run_function((gpr_function*)f->argv[0], state,
+						  call_depth,
+						  (*custom_function));
+	v2 = gpr_run_function((gpr_function*)f->argv[1], state,
+						  call_depth,
+						  (*custom_function));
+	return gpr_state_store(v1, v2, state);
 }
 
 /* push a value to a particular field */
-static float push(float v1, float v2, gpr_state * state)
+float gpr_state_push(float v1, float v2, gpr_state * state)
 {
 	if (state->data.fields == 0) return 0;
 	gpr_data_set_head(&state->data,
@@ -1287,17 +1312,20 @@ static float gpr_push(gpr_function * f,
 					  gpr_state * state, int call_depth,
 					  float (*custom_function)(float,float,float))
 {
-	return push(gpr_run_function((gpr_function*)f->argv[0], state,
-								 call_depth,
-								 (*custom_function)),
-				gpr_run_function((gpr_function*)f->argv[1], state,
-								 call_depth,
-								 (*custom_function)),
-				state);
+	float v1, v2;
+
+	/* arguments are evaluated in order */
+	v1 = gpr_run_function((gpr_function*)f->argv[0], state,
+						  call_depth,
+						  (*custom_function));
+	v2 = gpr_run_function((gpr_function*)f->argv[1], state,
+						  call_depth,
+						  (*custom_function));
+	return gpr_state_push(v1, v2, state);
 }
 
 /* returns a value at the tail of the data store and removes that entry */
-static float pop(float v1, gpr_state * state)
+float gpr_state_pop(float v1, gpr_state * state)
 {
 	float real = 0, imaginary = 0;
 	/* return a value at the tail */
@@ -1322,14 +1350,14 @@ static float gpr_pop(gpr_function * f,
 					 gpr_state * state, int call_depth,
 					 float (*custom_function)(float,float,float))
 {
-	return pop(gpr_run_function((gpr_function*)f->argv[0],
-								state, call_depth,
-								(*custom_function)),
-			   state);
+	return gpr_state_pop(gpr_run_function((gpr_function*)f->argv[0],
+										  state, call_depth,
+										  (*custom_function)),
+						 state);
 }
 
 /* returns a value from the data store in the given field */
-static float data_get(float v1, float v2, gpr_state * state)
+float gpr_state_data_get(float v1, float v2, gpr_state * state)
 {
 	float real = 0, imaginary = 0;
 	if (state->data.fields == 0) return 0;
@@ -1352,17 +1380,20 @@ static float gpr_data_get(gpr_function * f,
 						  gpr_state * state, int call_depth,
 						  float (*custom_function)(float,float,float))
 {
-	return data_get(gpr_run_function((gpr_function*)f->argv[0],
-									 state, call_depth,
-									 (*custom_function)),
-					gpr_run_function((gpr_function*)f->argv[1],
-									 state, call_depth,
-									 (*custom_function)),
-					state);
+	float v1, v2;
+
+	/* arguments are evaluated in order */
+	v1 = gpr_run_function((gpr_function*)f->argv[0],
+						  state, call_depth,
+						  (*custom_function));
+	v2 = gpr_run_function((gpr_function*)f->argv[1],
+						  state, call_depth,
+						  (*custom_function));
+	return gpr_state_data_get(v1, v2, state);
 }
 
 /* returns a value from the data store in the given field */
-static float data_set(float v1, float v2, gpr_state * state)
+float gpr_state_data_set(float v1, float v2, gpr_state * state)
 {
 	gpr_data_set_elem(&state->data,
 					  (unsigned int)v1,
@@ -1382,13 +1413,16 @@ static float gpr_data_set(gpr_function * f,
 						  gpr_state * state, int call_depth,
 						  float (*custom_function)(float,float,float))
 {
-	return data_set(gpr_run_function((gpr_function*)f->argv[0], state,
-									 call_depth,
-									 (*custom_function)),
-					gpr_run_function((gpr_function*)f->argv[0], state,
-									 call_depth,
-									 (*custom_function)),
-					state);
+	float v1, v2;
+
+	/* arguments are evaluated in order */
+	v1 = gpr_run_function((gpr_function*)f->argv[0], state,
+						  call_depth,
+						  (*custom_function));
+	v2 = gpr_run_function((gpr_function*)f->argv[0], state,
+						  call_depth,
+						  (*custom_function));
+	return gpr_state_data_set(v1, v2, state);
 }
 
 static void gpr_fetch_c(FILE * fp, int argc)
@@ -1421,7 +1455,7 @@ static void gpr_fetch_c(FILE * fp, int argc)
 }
 
 /* retrieves a value from register, sensor or actuator */
-static float fetch(float v1, float v2, gpr_state * state)
+float gpr_state_fetch(float v1, float v2, gpr_state * state)
 {
 	int oracle_type = (int)v1 % GPR_ORACLES;
 	int index, v =	abs((int)v2);
@@ -1453,13 +1487,16 @@ static float gpr_get(gpr_function * f,
 					 gpr_state * state, int call_depth,
 					 float (*custom_function)(float,float,float))
 {
-	return fetch(gpr_run_function((gpr_function*)f->argv[0], state,
-								  call_depth,
-								  (*custom_function)),
-				 gpr_run_function((gpr_function*)f->argv[1], state,
-								  call_depth,
-								  (*custom_function)),
-				 state);
+	float v1, v2;
+
+	/* arguments are evaluated in order */
+	v1 = gpr_run_function((gpr_function*)f->argv[0], state,
+						  call_depth,
+						  (*custom_function));
+	v2 = gpr_run_function((gpr_function*)f->argv[1], state,
+						  call_depth,
+						  (*custom_function));
+	return gpr_state_fetch(v1, v2, state);
 }
 
 /* Used to check that the two functions are the same.
@@ -1503,13 +1540,263 @@ void gpr_functions_are_equal(gpr_function * f1, gpr_function * f2,
 	}
 }
 
+/* Program nodes are allocated from slabs and recycled through
+   a free list belonging to each thread, so that breeding in parallel
+   doesn't contend on the system allocator.
+   Each node belongs to the thread which allocated its slab.  Nodes
+   freed on any other thread are gathered into batches and returned
+   to the thread which owns them, so that slabs don't drift between
+   threads when trees are freed elsewhere, for example after the
+   population has been sorted */
+static gpr_function * gpr_pool_free_list = 0;
+static unsigned int gpr_pool_thread_generation = 0;
+static int gpr_pool_owner = -1;
+/* nodes freed by this thread which belong to another thread */
+static gpr_function * gpr_pool_batch = 0, * gpr_pool_batch_tail = 0;
+static int gpr_pool_batch_owner = 0, gpr_pool_batch_size = 0;
+#pragma omp threadprivate(gpr_pool_free_list, gpr_pool_thread_generation, \
+						  gpr_pool_owner, gpr_pool_batch, \
+						  gpr_pool_batch_tail, gpr_pool_batch_owner, \
+						  gpr_pool_batch_size)
+
+/* Indexes used for selecting crossover points.
+   These are kept for each thread so that the arrays are only
+   reallocated when a larger tree is encountered */
+static gpr_index gpr_crossover_child_index;
+static gpr_index gpr_crossover_parent_index;
+#pragma omp threadprivate(gpr_crossover_child_index, \
+						  gpr_crossover_parent_index)
+
+/* slabs allocated by all threads, and the nodes which other
+   threads have returned to each owner */
+static gpr_function ** gpr_pool_slab = 0;
+static int gpr_pool_slabs = 0, gpr_pool_max_slabs = 0;
+static gpr_function ** gpr_pool_returned = 0;
+static int gpr_pool_owners = 0, gpr_pool_max_owners = 0;
+/* incremented whenever the pool is released, and read by
+   every thread, so always accessed atomically */
+static unsigned int gpr_pool_generation = 1;
+
+/* discards the free list and batch of the calling thread
+   if they refer to slabs which have since been released */
+static void gpr_pool_thread_update()
+{
+	unsigned int generation;
+
+#pragma omp atomic read
+	generation = gpr_pool_generation;
+
+	if (gpr_pool_thread_generation != generation) {
+		gpr_pool_free_list = 0;
+		gpr_pool_owner = -1;
+		gpr_pool_batch = 0;
+		gpr_pool_batch_tail = 0;
+		gpr_pool_batch_size = 0;
+		gpr_pool_thread_generation = generation;
+	}
+}
+
+/* returns the batch of nodes freed by this thread
+   to the thread which owns them */
+static void gpr_pool_flush_batch()
+{
+	if (gpr_pool_batch == 0) return;
+
+#pragma omp critical (gpr_pool)
+	{
+		gpr_pool_batch_tail->argv[0] =
+			gpr_pool_returned[gpr_pool_batch_owner];
+		gpr_pool_returned[gpr_pool_batch_owner] = gpr_pool_batch;
+	}
+	gpr_pool_batch = 0;
+	gpr_pool_batch_tail = 0;
+	gpr_pool_batch_size = 0;
+}
+
+/* returns an unused node from the pool */
+static gpr_function * gpr_node_alloc()
+{
+	int i;
+	gpr_function * node, * slab;
+
+	gpr_pool_thread_update();
+
+	if (gpr_pool_owner == -1) {
+		/* this thread hasn't allocated any nodes before */
+#pragma omp critical (gpr_pool)
+		{
+			if (gpr_pool_owners >= gpr_pool_max_owners) {
+				gpr_pool_max_owners = gpr_pool_max_owners*2 + 16;
+				gpr_pool_returned =
+					(gpr_function**)realloc(gpr_pool_returned,
+											gpr_pool_max_owners*
+											sizeof(gpr_function*));
+#ifdef DEBUG
+				assert(gpr_pool_returned!=0);
+#endif
+			}
+#ifdef DEBUG
+			assert(gpr_pool_owners < GPR_POOL_MAX_OWNERS);
+#endif
+			gpr_pool_owner = gpr_pool_owners++;
+			gpr_pool_returned[gpr_pool_owner] = 0;
+		}
+	}
+
+	if (gpr_pool_free_list == 0) {
+		/* take any nodes which other threads have returned */
+#pragma omp critical (gpr_pool)
+		{
+			gpr_pool_free_list = gpr_pool_returned[gpr_pool_owner];
+			gpr_pool_returned[gpr_pool_owner] = 0;
+		}
+	}
+
+	if (gpr_pool_free_list == 0) {
+		/* allocate a new slab */
+		slab = (gpr_function*)malloc(GPR_POOL_SLAB_SIZE*
+									 sizeof(gpr_function));
+#ifdef DEBUG
+		assert(slab!=0);
+#endif
+
+#pragma omp critical (gpr_pool)
+		{
+			if (gpr_pool_slabs >= gpr_pool_max_slabs) {
+				gpr_pool_max_slabs = gpr_pool_max_slabs*2 + 16;
+				gpr_pool_slab =
+					(gpr_function**)realloc(gpr_pool_slab,
+											gpr_pool_max_slabs*
+											sizeof(gpr_function*));
+			}
+			gpr_pool_slab[gpr_pool_slabs++] = slab;
+		}
+
+		/* link the nodes together */
+		for (i = 0; i < GPR_POOL_SLAB_SIZE-1; i++) {
+			slab[i].pool = (unsigned short)gpr_pool_owner;
+			slab[i].argv[0] = &slab[i+1];
+		}
+		slab[GPR_POOL_SLAB_SIZE-1].pool = (unsigned short)gpr_pool_owner;
+		slab[GPR_POOL_SLAB_SIZE-1].argv[0] = 0;
+		gpr_pool_free_list = slab;
+	}
+
+	node = gpr_pool_free_list;
+	gpr_pool_free_list = node->argv[0];
+	return node;
+}
+
+/* Returns a node to the pool.
+   Nodes belonging to another thread are added to a batch, which is
+   returned to that thread once it is full or when a node belonging
+   to a different thread is freed */
+static void gpr_node_free(gpr_function * node)
+{
+	gpr_pool_thread_update();
+
+	if ((int)node->pool == gpr_pool_owner) {
+		node->argv[0] = gpr_pool_free_list;
+		gpr_pool_free_list = node;
+		return;
+	}
+
+	if ((gpr_pool_batch != 0) &&
+		(gpr_pool_batch_owner != (int)node->pool)) {
+		gpr_pool_flush_batch();
+	}
+	if (gpr_pool_batch == 0) {
+		gpr_pool_batch_tail = node;
+		gpr_pool_batch_owner = (int)node->pool;
+	}
+	node->argv[0] = gpr_pool_batch;
+	gpr_pool_batch = node;
+	gpr_pool_batch_size++;
+	if (gpr_pool_batch_size >= GPR_POOL_BATCH_SIZE) {
+		gpr_pool_flush_batch();
+	}
+}
+
+/* returns the number of nodes which have been allocated
+   within the pool */
+int gpr_pool_size()
+{
+	int size;
+
+#pragma omp critical (gpr_pool)
+	{
+		size = gpr_pool_slabs*GPR_POOL_SLAB_SIZE;
+	}
+	return size;
+}
+
+/* Releases all memory used by program nodes, together with
+   the crossover indexes of the calling thread.
+   This should only be called after all programs have been freed */
+void gpr_pool_release()
+{
+	int i;
+
+#pragma omp critical (gpr_pool)
+	{
+		for (i = 0; i < gpr_pool_slabs; i++) {
+			free(gpr_pool_slab[i]);
+		}
+		if (gpr_pool_slab != 0) {
+			free(gpr_pool_slab);
+		}
+		gpr_pool_slab = 0;
+		gpr_pool_slabs = 0;
+		gpr_pool_max_slabs = 0;
+		if (gpr_pool_returned != 0) {
+			free(gpr_pool_returned);
+		}
+		gpr_pool_returned = 0;
+		gpr_pool_owners = 0;
+		gpr_pool_max_owners = 0;
+#pragma omp atomic update
+		gpr_pool_generation++;
+	}
+	gpr_pool_thread_update();
+
+	gpr_free_index(&gpr_crossover_child_index);
+	gpr_free_index(&gpr_crossover_parent_index);
+}
+
+/* returns a new node containing no function */
+static gpr_function * gpr_new_node()
+{
+	int i;
+	gpr_function * f = gpr_node_alloc();
+
+	f->function_type = GPR_FUNCTION_NONE;
+	f->value = 0;
+	f->argc = GPR_DEFAULT_ARGUMENTS;
+	for (i = 0; i < GPR_MAX_ARGUMENTS; i++) {
+		f->argv[i] = 0;
+	}
+	return f;
+}
+
+/* ensures that nodes exist for the given number of arguments */
+static void gpr_allocate_args(gpr_function * f, int argc)
+{
+	int i;
+
+	for (i = 0; i < argc; i++) {
+		if (f->argv[i] == 0) {
+			f->argv[i] = gpr_new_node();
+		}
+	}
+}
+
 /* deallocate memory */
 void gpr_free(gpr_function * f)
 {
 	for (int i = 0; i < GPR_MAX_ARGUMENTS; i++) {
 		if (f->argv[i]!=0) {
 			gpr_free((gpr_function*)f->argv[i]);
-			free(f->argv[i]);
+			gpr_node_free(f->argv[i]);
 			f->argv[i]=0;
 		}
 	}
@@ -1534,6 +1821,90 @@ void gpr_nodes(gpr_function * f, int * ctr)
 	}
 }
 
+/* initialise an index of program nodes */
+void gpr_init_index(gpr_index * index)
+{
+	index->size = 0;
+	index->max_size = 0;
+	index->node = 0;
+	index->depth = 0;
+	index->subtree_size = 0;
+	index->height = 0;
+}
+
+/* deallocate memory for an index of program nodes */
+void gpr_free_index(gpr_index * index)
+{
+	if (index->max_size > 0) {
+		free(index->node);
+		free(index->depth);
+		free(index->subtree_size);
+		free(index->height);
+	}
+	gpr_init_index(index);
+}
+
+/* adds the given node and its subtree to the index,
+   and returns the height of the subtree */
+static int gpr_index_node(gpr_function * f, int depth,
+						  gpr_index * index)
+{
+	int i, position = -1, height = 0, h;
+
+	/* nodes are numbered in the same way as gpr_nodes */
+	if (f->function_type != GPR_FUNCTION_NONE) {
+		if (index->size >= index->max_size) {
+			index->max_size = index->max_size*2 + 64;
+			index->node =
+				(gpr_function**)realloc(index->node,
+										index->max_size*
+										sizeof(gpr_function*));
+			index->depth =
+				(int*)realloc(index->depth,
+							  index->max_size*sizeof(int));
+			index->subtree_size =
+				(int*)realloc(index->subtree_size,
+							  index->max_size*sizeof(int));
+			index->height =
+				(int*)realloc(index->height,
+							  index->max_size*sizeof(int));
+#ifdef DEBUG
+			assert(index->node!=0);
+			assert(index->depth!=0);
+			assert(index->subtree_size!=0);
+			assert(index->height!=0);
+#endif
+		}
+		position = index->size++;
+		index->node[position] = f;
+		index->depth[position] = depth;
+	}
+
+	for (i = 0; i < f->argc; i++) {
+		if (f->argv[i]!=0) {
+			h = 1 + gpr_index_node((gpr_function*)f->argv[i],
+								   depth+1, index);
+			if (h > height) height = h;
+		}
+	}
+
+	if (position > -1) {
+		index->subtree_size[position] = index->size - position;
+		index->height[position] = height;
+	}
+	return height;
+}
+
+/* Builds a preorder index of the nodes within the given tree.
+   Subtrees are contiguous within the index, so a node at position i
+   has its subtree within i..i+subtree_size[i]-1.
+   The index is only valid until the tree is changed */
+void gpr_build_index(gpr_function * f, gpr_index * index)
+{
+	index->size = 0;
+	gpr_index_node(f, 0, index);
+}
+
 /* returns the maximum depth of the tree */
 void gpr_max_depth(gpr_function * f, int depth, int * max_depth)
 {
@@ -1618,13 +1989,16 @@ void gpr_init_actuator_destinations(gpr_system * system,
 	}
 }							 
 
-/* initialise machine state */
-void gpr_init_state(gpr_state * state,
-					int registers,
-					int sensors,
-					int actuators,
-					int data_size, int data_fields,
-					unsigned int * random_seed)
+/* Initialise machine state.  If a data block is given then it
+   holds gpr_data_length(data_size,data_fields) values which are
+   used as the data store, otherwise the data store is allocated */
+static void gpr_init_state_block(gpr_state * state,
+								 int registers,
+								 int sensors,
+								 int actuators,
+								 int data_size, int data_fields,
+								 float * data_block,
+								 unsigned int * random_seed)
 {
 	int i;
 
@@ -1680,7 +2054,41 @@ void gpr_init_state(gpr_state * state,
 	}
 
 	/* initialise the data source */
-	gpr_data_init(&state->data, data_size, data_fields);
+	if (data_block != 0) {
+		gpr_data_init_block(&state->data, data_size, data_fields,
+							data_block);
+	}
+	else {
+		gpr_data_init(&state->data, data_size, data_fields);
+	}
+}
+
+/* initialise machine state */
+void gpr_init_state(gpr_state * state,
+					int registers,
+					int sensors,
+					int actuators,
+					int data_size, int data_fields,
+					unsigned int * random_seed)
+{
+	gpr_init_state_block(state, registers, sensors, actuators,
+						 data_size, data_fields, 0, random_seed);
+}
+
+/* Allocates a single block for the data stores of the given
+   number of states, or returns null if there is no data store */
+static float * gpr_alloc_data_blocks(int states,
+									 int data_size, int data_fields)
+{
+	float * block;
+	size_t length = gpr_data_length(data_size, data_fields);
+
+	if (length == 0) return 0;
+	block = (float*)malloc(states*length*sizeof(float));
+#ifdef DEBUG
+	assert(block!=0);
+#endif
+	return block;
 }
 
 void gpr_free_state(gpr_state * state)
@@ -1700,28 +2108,20 @@ void gpr_free_state(gpr_state * state)
 	if (state->no_of_actuator_destinations>0) {
 		free(state->actuator_destination);
 	}
-	gpr_data_clear(&state->data);
+	gpr_data_free(&state->data);
 }
 
-/* initialise a function */
+/* initialise a function.
+   Arguments are only allocated when they are needed */
 void gpr_init(gpr_function * f)
 {
-	int i, j;
+	int i;
 
 	f->function_type = GPR_FUNCTION_VALUE;
 	f->value = 0;
 	f->argc = GPR_DEFAULT_ARGUMENTS;
 	for (i = 0; i < GPR_MAX_ARGUMENTS; i++) {
-		f->argv[i] = (gpr_function*)malloc(sizeof(gpr_function));
-#ifdef DEBUG
-		assert(f->argv[i]!=0);
-#endif
-		f->argv[i]->function_type = GPR_FUNCTION_NONE;
-		f->argv[i]->value=0;
-		f->argv[i]->argc=GPR_DEFAULT_ARGUMENTS;
-		for (j = 0; j < GPR_MAX_ARGUMENTS; j++) {
-			f->argv[i]->argv[j]=0;
-		}
+		f->argv[i] = 0;
 	}
 }
 
@@ -1737,15 +2137,10 @@ void gpr_copy(gpr_function * source, gpr_function * dest)
 
 	for (i = 0; i < source->argc; i++) {
 		if (source->argv[i]!=0) {
+			dest->argv[i] = gpr_new_node();
 			gpr_copy((gpr_function*)source->argv[i],
 					 (gpr_function*)dest->argv[i]);
 		}
-		else {
-			if (dest->argv[i]!=0) {
-				free(dest->argv[i]);
-				dest->argv[i]=0;
-			}
-		}
 	}
 }
 
@@ -2057,6 +2452,7 @@ void gpr_random(gpr_function * f, int depth,
 	}
 
 	if (is_terminal(f->function_type)==0) {
+		gpr_allocate_args(f, f->argc);
 		for (i = 0; i < f->argc; i++) {
 			gpr_random((gpr_function*)f->argv[i],depth+1,
 					   min_depth,max_depth,
@@ -2067,30 +2463,6 @@ void gpr_random(gpr_function * f, int depth,
 	}
 }
 
-/* returns the node with the given index number */
-static void get_node(gpr_function * f, int index, int * ctr,
-					 gpr_function ** node,
-					 int depth, int * returned_depth)
-{
-	int i=0;
-
-	if (f->function_type != GPR_FUNCTION_NONE) {
-		if (*ctr == index) {
-			*node = (gpr_function*)f;
-			*returned_depth = depth;
-		}
-
-		*ctr = *ctr + 1;
-	}
-
-	for (i = 0; i < f->argc; i++) {
-		if (f->argv[i]!=0) {
-			get_node((gpr_function*)f->argv[i], index, ctr, node,
-					 depth+1, returned_depth);
-		}
-	}
-}
-
 /* crossover the sensor sources and actuator destinations */
 void gpr_crossover_sources(gpr_state * parent1,gpr_state * parent2,
 						   gpr_state * child,
@@ -2228,12 +2600,11 @@ int gpr_crossover(gpr_function * parent1, gpr_function * parent2,
 				  unsigned int * random_seed)
 {
 	gpr_function * first_parent, * second_parent;
-	int crossed=0;
-	int first_parent_nodes=0;
-	int second_parent_nodes=0;
-	int first_parent_crossover_node=0;
-	int second_parent_crossover_node=0;
-	int ctr=0, depth, returned_depth_child, returned_depth_parent2;
+	gpr_index * child_index = &gpr_crossover_child_index;
+	gpr_index * parent_index = &gpr_crossover_parent_index;
+	int crossed=0, attempt;
+	int child_crossover_node, second_parent_crossover_node;
+	int child_depth;
 	gpr_function * child_node;
 	gpr_function * second_parent_node;
 
@@ -2250,65 +2621,63 @@ int gpr_crossover(gpr_function * parent1, gpr_function * parent2,
 	/* child is a copy of the first parent */
 	gpr_copy(first_parent,child);
 
-	/* get the number of nodes */
-	gpr_nodes(first_parent, &first_parent_nodes);
-	gpr_nodes(second_parent, &second_parent_nodes);
+	/* index the nodes of the child and the second parent,
+	   so that crossover points can be looked up directly */
+	gpr_build_index(child, child_index);
+	gpr_build_index(second_parent, parent_index);
+
+	if ((child_index->size>1) && (parent_index->size>1)) {
+		for (attempt = 0; attempt < GPR_CROSSOVER_ATTEMPTS; attempt++) {
+			/* identify crossover points */
+			child_crossover_node =
+				1 + (rand_num(random_seed)%(child_index->size-1));
+			second_parent_crossover_node =
+				1 + (rand_num(random_seed)%(parent_index->size-1));
+
+			/* the points must not be too deep */
+			child_depth = child_index->depth[child_crossover_node];
+			if ((child_depth >= max_depth-3) ||
+				(parent_index->depth[second_parent_crossover_node] >=
+				 max_depth-3)) {
+				continue;
+			}
 
-	if ((first_parent_nodes>1) && (second_parent_nodes>1)) {
-		/* identify crossover points */
-		first_parent_crossover_node =
-			1 + (rand_num(random_seed)%(first_parent_nodes-1));
-		second_parent_crossover_node =
-			1 + (rand_num(random_seed)%(second_parent_nodes-1));
+			/* don't cross over terminal nodes */
+			child_node = child_index->node[child_crossover_node];
+			second_parent_node =
+				parent_index->node[second_parent_crossover_node];
+			if ((is_terminal(child_node->function_type)!=0) ||
+				(is_terminal(second_parent_node->function_type)!=0)) {
+				continue;
+			}
 
-		/* get nodes for the two points */
-		ctr = 0;
-		child_node = 0;
-		depth = 0;
-		returned_depth_child = 0;
-		get_node(child, first_parent_crossover_node, &ctr, &child_node,
-				 depth, &returned_depth_child);
-		ctr = 0;
-		second_parent_node = 0;
-		depth = 0;
-		returned_depth_parent2 = 0;
-		get_node(second_parent, second_parent_crossover_node,
-				 &ctr, &second_parent_node,
-				 depth, &returned_depth_parent2);
-
-		if ((child_node!=0) && (second_parent_node!=0)) {
-			if ((returned_depth_child < max_depth-3) &&
-				(returned_depth_parent2 < max_depth-3)) {
-				/* don't cross over terminal nodes */
-				if ((is_terminal(child_node->function_type)==0) &&
-					(is_terminal(second_parent_node->function_type)==0)) {
-
-					/* clear the parent1 subtree */
-					gpr_free(child_node);
-				
-					/* copy the parent2 subtree */
-					gpr_copy(second_parent_node,child_node);
+			/* clear the parent1 subtree */
+			gpr_free(child_node);
 
-					/* ensure that the child tree
-					   doesn't exceed the maximum depth */
-					depth = 0;
-					gpr_prune(child, depth, max_depth,
-							  min_value, max_value,
-							  random_seed);
-					crossed=1;
-				}
-			}
+			/* copy the parent2 subtree */
+			gpr_copy(second_parent_node,child_node);
 
-			/* child is a clone of one parent or the other */
-			if (crossed==0) {
-				if (rand_num(random_seed)%10000>5000) {
-					gpr_free(child);
-					gpr_copy(second_parent,child);
-				}
+			/* ensure that the child tree
+			   doesn't exceed the maximum depth */
+			if (child_depth +
+				parent_index->height[second_parent_crossover_node] >=
+				max_depth-1) {
+				gpr_prune(child_node, child_depth, max_depth,
+						  min_value, max_value,
+						  random_seed);
 			}
+			crossed=1;
+			break;
+		}
 
-			return 1;
+		/* child is a clone of one parent or the other */
+		if (crossed==0) {
+			if (rand_num(random_seed)%10000>5000) {
+				gpr_free(child);
+				gpr_copy(second_parent,child);
+			}
 		}
+		return 1;
 	}
 	/* child is a clone of one parent or the other */
 	if (rand_num(random_seed)%10000>5000) {
@@ -2368,6 +2737,7 @@ static void gpr_insert_argument(gpr_function * f,
 	if (f->argc>=GPR_MAX_ARGUMENTS-1) return;
 
 	temp = f->argv[f->argc];
+	if (temp == 0) temp = gpr_new_node();
 
 	for (i = f->argc; i >= index+1; i--) {
 		f->argv[i] = f->argv[i-1];
@@ -2498,6 +2868,7 @@ void gpr_mutate(gpr_function * f, int depth, int max_depth, float prob,
 							else {
 								fn->argc = min_args;
 							}
+							gpr_allocate_args(fn, fn->argc);
 						}
 						else {
 							/* randomly change the terminal value */
@@ -2848,68 +3219,380 @@ float gpr_run(gpr_function * f, gpr_state * state,
 	return 0;
 }
 
-/* When the population is initialised make some random
-   function calls within the main program */
-static void gpr_ADF_calls(gpr_function * f, float prob,
-						  unsigned int * random_seed)
+/* returns 1 if the given argument is a constant.
+   Missing arguments are evaluated as zero */
+static int gpr_is_constant(gpr_function * f)
+{
+	if (f == 0) return 1;
+	if (f->function_type == GPR_FUNCTION_VALUE) return 1;
+	return 0;
+}
+
+/* returns the value of a constant argument */
+static float gpr_constant_value(gpr_function * f)
+{
+	if (f == 0) return 0;
+	return f->value;
+}
+
+/* returns 1 if running the given program could change the state */
+static int gpr_has_side_effects(gpr_function * f)
 {
 	int i;
 
-	if (f==0) return;
+	if (f == 0) return 0;
+
+	switch(f->function_type) {
+	case GPR_FUNCTION_SET:
+	case GPR_FUNCTION_DATA_PUSH:
+	case GPR_FUNCTION_DATA_POP:
+	case GPR_FUNCTION_DATA_SET:
+	case GPR_FUNCTION_CUSTOM:
+	case GPR_FUNCTION_ADF: {
+		return 1;
+	}
+	}
+
+	if (is_terminal(f->function_type)==1) return 0;
 
 	for (i = 0; i < f->argc; i++) {
-		if (f->argv[i]!=0) {
-			if (is_terminal(f->argv[i]->function_type)==0) {
-				if (rand_num(random_seed)%10000 < prob*10000) {
-					f->argv[i]->function_type =	GPR_FUNCTION_ADF;
-					f->argv[i]->value =
-						rand_num(random_seed)%(GPR_MAX_ARGUMENTS-1);
-				}
-			}
-			gpr_ADF_calls((gpr_function*)f->argv[i],
-						  prob, random_seed);
-		}
+		if (gpr_has_side_effects(f->argv[i])==1) return 1;
 	}
+	return 0;
 }
 
-void gpr_init_population(gpr_population * population,
-						 int size,
-						 int registers,
-						 int sensors,
-						 int actuators,
-						 int max_tree_depth,
-						 float min_value, float max_value,
-						 int integers_only,
-						 int ADFs,
-						 int data_size, int data_fields,
-						 unsigned int * random_seed,
-						 int * instruction_set, int no_of_instructions)
+/* returns 1 if the result of the given function type depends only
+   upon its arguments */
+static int gpr_is_pure_function(int function_type)
 {
-	int i, j, depth;
-	gpr_function * f;
-	gpr_state * state;
-
-	/* check that the instruction set is valid */
-	if (gpr_validate_instruction_set(instruction_set,
-									 no_of_instructions)==-1) {
-		printf("\nInstruction set contains invalid functions\n");
-		return;
+	switch(function_type) {
+	case GPR_FUNCTION_NEGATE:
+	case GPR_FUNCTION_AVERAGE:
+	case GPR_FUNCTION_POW:
+	case GPR_FUNCTION_EXP:
+	case GPR_FUNCTION_SIGMOID:
+	case GPR_FUNCTION_MIN:
+	case GPR_FUNCTION_MAX:
+	case GPR_FUNCTION_ADD:
+	case GPR_FUNCTION_SUBTRACT:
+	case GPR_FUNCTION_MULTIPLY:
+	case GPR_FUNCTION_WEIGHT:
+	case GPR_FUNCTION_DIVIDE:
+	case GPR_FUNCTION_MODULUS:
+	case GPR_FUNCTION_FLOOR:
+	case GPR_FUNCTION_SQUARE_ROOT:
+	case GPR_FUNCTION_ABS:
+	case GPR_FUNCTION_SINE:
+	case GPR_FUNCTION_ARCSINE:
+	case GPR_FUNCTION_COSINE:
+	case GPR_FUNCTION_ARCCOSINE:
+	case GPR_FUNCTION_GREATER_THAN:
+	case GPR_FUNCTION_LESS_THAN:
+	case GPR_FUNCTION_EQUALS:
+	case GPR_FUNCTION_AND:
+	case GPR_FUNCTION_OR:
+	case GPR_FUNCTION_XOR:
+	case GPR_FUNCTION_NOT: {
+		return 1;
+	}
 	}
+	return 0;
+}
 
-	population->data_size = data_size;
-	population->data_fields = data_fields;
+/* returns 1 if the given program can never return NaN.
+   Most functions replace a NaN result with zero, so wrapping
+   them in an identity operation has no effect */
+static int gpr_is_nan_free(gpr_function * f)
+{
+	if (f == 0) return 1;
 
-	population->size = size;
-	population->history.index = 0;
-	population->history.interval = 1;
-	population->history.tick = 0;
+	switch(f->function_type) {
+	case GPR_FUNCTION_VALUE: {
+		return (is_nan(f->value)==0);
+	}
+	case GPR_FUNCTION_SIGMOID:
+	case GPR_FUNCTION_MIN:
+	case GPR_FUNCTION_MAX: {
+		return 0;
+	}
+	}
+	if ((gpr_is_pure_function(f->function_type)==1) ||
+		(f->function_type==GPR_FUNCTION_NOOP1) ||
+		(f->function_type==GPR_FUNCTION_NOOP2) ||
+		(f->function_type==GPR_FUNCTION_NOOP3) ||
+		(f->function_type==GPR_FUNCTION_NOOP4)) {
+		return 1;
+	}
+	return 0;
+}
 
-	/* the program for each individual */
-	population->individual =
-		(gpr_function*)malloc(sizeof(gpr_function)*size);
+/* turns the given function into a constant */
+static void gpr_simplify_to_value(gpr_function * f, float value)
+{
+	gpr_free(f);
+	gpr_init(f);
+	f->value = value;
+}
 
-	/* the retained state for each individual */
-	population->state = (gpr_state*)malloc(sizeof(gpr_state)*size);
+/* replaces the given function with one of its arguments */
+static void gpr_simplify_to_argument(gpr_function * f, int index)
+{
+	int i;
+	gpr_function * arg = f->argv[index];
+
+	f->argv[index] = 0;
+	gpr_free(f);
+
+	f->function_type = arg->function_type;
+	f->value = arg->value;
+	f->argc = arg->argc;
+	for (i = 0; i < GPR_MAX_ARGUMENTS; i++) {
+		f->argv[i] = arg->argv[i];
+	}
+	gpr_node_free(arg);
+}
+
+/* removes constant arguments which have no effect upon the result,
+   such as adding zero or multiplying by one */
+static void gpr_simplify_identity(gpr_function * f, int start,
+								  float identity)
+{
+	int i, remaining = 0, last = -1, min_args=0, max_args=0;
+
+	for (i = 0; i < f->argc; i++) {
+		if ((i < start) ||
+			(gpr_is_constant(f->argv[i])==0) ||
+			(gpr_constant_value(f->argv[i]) != identity)) {
+			remaining++;
+			last = i;
+		}
+	}
+	if ((remaining == f->argc) || (last < 0)) return;
+
+	if (remaining == 1) {
+		/* the function only passes its argument through */
+		if (gpr_is_nan_free(f->argv[last])==1) {
+			gpr_simplify_to_argument(f, last);
+		}
+		return;
+	}
+
+	gpr_function_args(f->function_type, &min_args, &max_args);
+	if (remaining < min_args) return;
+
+	remaining = 0;
+	for (i = 0; i < f->argc; i++) {
+		if ((i < start) ||
+			(gpr_is_constant(f->argv[i])==0) ||
+			(gpr_constant_value(f->argv[i]) != identity)) {
+			f->argv[remaining++] = f->argv[i];
+		}
+		else if (f->argv[i] != 0) {
+			gpr_free(f->argv[i]);
+			gpr_node_free(f->argv[i]);
+		}
+	}
+	for (i = remaining; i < f->argc; i++) {
+		f->argv[i] = 0;
+	}
+	f->argc = remaining;
+}
+
+/* returns 1 if the arguments within the given range are all constant,
+   and if so their sum */
+static int gpr_constant_sum(gpr_function * f, int start, int end,
+							float * sum)
+{
+	int i;
+
+	*sum = 0;
+	for (i = start; i < end; i++) {
+		if (gpr_is_constant(f->argv[i])==0) return 0;
+		*sum += gpr_constant_value(f->argv[i]);
+	}
+	return 1;
+}
+
+static void gpr_simplify_function(gpr_function * f)
+{
+	int i;
+	float v;
+	gpr_function * arg;
+
+	for (i = 0; i < f->argc; i++) {
+		if (f->argv[i] != 0) {
+			gpr_simplify_function(f->argv[i]);
+		}
+	}
+
+	/* fold constant subtrees by running them, so that the result
+	   is exactly what the program would have returned */
+	if (gpr_is_pure_function(f->function_type)==1) {
+		for (i = 0; i < f->argc; i++) {
+			if (gpr_is_constant(f->argv[i])==0) break;
+		}
+		if (i == f->argc) {
+			v = gpr_run_function(f, 0, 0, 0);
+			if (isinf(v)==0) {
+				gpr_simplify_to_value(f, v);
+			}
+			return;
+		}
+	}
+
+	switch(f->function_type) {
+	case GPR_FUNCTION_NOOP1:
+	case GPR_FUNCTION_NOOP2:
+	case GPR_FUNCTION_NOOP3:
+	case GPR_FUNCTION_NOOP4: {
+		/* arguments only need to be kept if they change the state */
+		if (gpr_has_side_effects(f)==0) {
+			gpr_simplify_to_value(f, 0);
+		}
+		break;
+	}
+	case GPR_FUNCTION_ADD: {
+		gpr_simplify_identity(f, 0, 0);
+		break;
+	}
+	case GPR_FUNCTION_SUBTRACT: {
+		gpr_simplify_identity(f, 1, 0);
+		break;
+	}
+	case GPR_FUNCTION_MULTIPLY: {
+		/* multiplying infinity by zero is NaN, which is
+		   also returned as zero */
+		for (i = 0; i < f->argc; i++) {
+			if ((gpr_is_constant(f->argv[i])==1) &&
+				(gpr_constant_value(f->argv[i]) == 0)) {
+				break;
+			}
+		}
+		if ((i < f->argc) && (gpr_has_side_effects(f)==0)) {
+			gpr_simplify_to_value(f, 0);
+			break;
+		}
+		gpr_simplify_identity(f, 0, 1);
+		break;
+	}
+	case GPR_FUNCTION_WEIGHT: {
+		if ((f->value == 0) && (gpr_has_side_effects(f)==0)) {
+			gpr_simplify_to_value(f, 0);
+		}
+		else if ((f->value == 1) && (gpr_is_nan_free(f->argv[0])==1)) {
+			gpr_simplify_to_argument(f, 0);
+		}
+		break;
+	}
+	case GPR_FUNCTION_DIVIDE:
+	case GPR_FUNCTION_MODULUS: {
+		/* protected division returns zero for small divisors,
+		   and a zero numerator always gives a zero result */
+		if (gpr_has_side_effects(f)==1) break;
+		if ((gpr_constant_sum(f, f->argc/2, f->argc, &v)==1) &&
+			(fabs(v) <= 0.01f)) {
+			gpr_simplify_to_value(f, 0);
+		}
+		else if ((gpr_constant_sum(f, 0, f->argc/2, &v)==1) &&
+				 (v == 0)) {
+			gpr_simplify_to_value(f, 0);
+		}
+		break;
+	}
+	case GPR_FUNCTION_NEGATE: {
+		/* double negation becomes a sum of the inner arguments */
+		arg = f->argv[0];
+		if ((f->argc == 1) && (arg != 0) &&
+			(arg->function_type == GPR_FUNCTION_NEGATE)) {
+			gpr_simplify_to_argument(f, 0);
+			f->function_type = GPR_FUNCTION_ADD;
+			gpr_simplify_identity(f, 0, 0);
+		}
+		break;
+	}
+	}
+}
+
+/* Simplifies a program by folding constant subtrees, removing
+   no-ops without side effects and applying identities such as
+   multiplying by one or adding zero.
+   The results of the program are unchanged, other than possibly
+   the sign of zero values, so this can be used to remove bloat
+   before evaluation or before exporting the program as code */
+void gpr_simplify(gpr_function * f)
+{
+	gpr_simplify_function(f);
+}
+
+/* When the population is initialised make some random
+   function calls within the main program */
+static void gpr_ADF_calls(gpr_function * f, float prob,
+						  unsigned int * random_seed)
+{
+	int i;
+
+	if (f==0) return;
+
+	for (i = 0; i < f->argc; i++) {
+		if (f->argv[i]!=0) {
+			if (is_terminal(f->argv[i]->function_type)==0) {
+				if (rand_num(random_seed)%10000 < prob*10000) {
+					f->argv[i]->function_type =	GPR_FUNCTION_ADF;
+					f->argv[i]->value =
+						rand_num(random_seed)%(GPR_MAX_ARGUMENTS-1);
+				}
+			}
+			gpr_ADF_calls((gpr_function*)f->argv[i],
+						  prob, random_seed);
+		}
+	}
+}
+
+void gpr_init_population(gpr_population * population,
+						 int size,
+						 int registers,
+						 int sensors,
+						 int actuators,
+						 int max_tree_depth,
+						 float min_value, float max_value,
+						 int integers_only,
+						 int ADFs,
+						 int data_size, int data_fields,
+						 unsigned int * random_seed,
+						 int * instruction_set, int no_of_instructions)
+{
+	int i, j, depth;
+	gpr_function * f;
+	gpr_state * state;
+
+	/* check that the instruction set is valid */
+	if (gpr_validate_instruction_set(instruction_set,
+									 no_of_instructions)==-1) {
+		printf("\nInstruction set contains invalid functions\n");
+		return;
+	}
+
+	population->data_size = data_size;
+	population->data_fields = data_fields;
+
+	population->size = size;
+	population->history.index = 0;
+	population->history.interval = 1;
+	population->history.tick = 0;
+	population->fitness_cache = 0;
+	population->simplify = 0;
+	gpr_selection_init(&population->selection);
+
+	/* the program for each individual */
+	population->individual =
+		(gpr_function*)malloc(sizeof(gpr_function)*size);
+
+	/* the retained state for each individual */
+	population->state = (gpr_state*)malloc(sizeof(gpr_state)*size);
+
+	/* the data stores for every individual */
+	population->data_block =
+		gpr_alloc_data_blocks(size, data_size, data_fields);
 
 	/* fitness values */
 	population->fitness = (float*)malloc(sizeof(float)*size);
@@ -2917,9 +3600,13 @@ void gpr_init_population(gpr_population * population,
 	/* initialise */
 	for (i = 0; i < size; i++) {
 		state = &population->state[i];
-		gpr_init_state(state,registers,sensors,actuators,
-					   data_size, data_fields,
-					   random_seed);
+		gpr_init_state_block(state,registers,sensors,actuators,
+							 data_size, data_fields,
+							 population->data_block == 0 ? 0 :
+							 &population->data_block[
+								 i*gpr_data_length(data_size,
+												   data_fields)],
+							 random_seed);
 
 		depth = 0;
 		f = &population->individual[i];
@@ -2992,12 +3679,21 @@ void gpr_init_environment(gpr_environment * population,
 	population->state = (gpr_state*)malloc(sizeof(gpr_state)*
 										   max_population_size);
 
+	/* the data stores for every individual */
+	population->data_block =
+		gpr_alloc_data_blocks(max_population_size,
+							  data_size, data_fields);
+
 	/* initialise */
 	for (i = 0; i < max_population_size; i++) {
 		state = &population->state[i];
-		gpr_init_state(state,registers,sensors,actuators,
-					   data_size, data_fields,
-					   random_seed);
+		gpr_init_state_block(state,registers,sensors,actuators,
+							 data_size, data_fields,
+							 population->data_block == 0 ? 0 :
+							 &population->data_block[
+								 i*gpr_data_length(data_size,
+												   data_fields)],
+							 random_seed);
 
 		depth = 0;
 		f = &population->individual[i];
@@ -3078,6 +3774,7 @@ void gpr_init_system(gpr_system * system,
 		/* clear the average fitness for the population */
 		system->fitness[i] = 0;
 	}
+	system->fitness_cache = 0;
 }
 
 /* frees memory for a system */
@@ -3105,7 +3802,9 @@ void gpr_free_population(gpr_population * population)
 
 	free(population->individual);
 	free(population->state);
+	free(population->data_block);
 	free(population->fitness);
+	gpr_selection_free(&population->selection);
 }
 
 /* frees memory for an environment */
@@ -3120,6 +3819,7 @@ void gpr_free_environment(gpr_environment * population)
 
 	free(population->individual);
 	free(population->state);
+	free(population->data_block);
 	free(population->mating);
 }
 
@@ -3142,27 +3842,252 @@ void gpr_clear_state(gpr_state * state)
 	}
 }
 
+/* mixes a value into a hash */
+static unsigned long long gpr_hash_mix(unsigned long long hash,
+									   unsigned int value)
+{
+	hash ^= value;
+	hash *= 1099511628211ULL;
+	hash ^= hash >> 29;
+	return hash;
+}
+
+/* adds the structure of a tree to a hash */
+static unsigned long long gpr_hash_node(gpr_function * f,
+										unsigned long long hash)
+{
+	int i;
+	union {
+		float value;
+		unsigned int bits;
+	} v;
+
+	if (f == 0) return gpr_hash_mix(hash, 0xffffffff);
+
+	/* positive and negative zero behave the same way */
+	v.value = (f->value == 0) ? 0 : f->value;
+
+	hash = gpr_hash_mix(hash, f->function_type);
+	hash = gpr_hash_mix(hash, v.bits);
+	hash = gpr_hash_mix(hash, (unsigned int)f->argc);
+	for (i = 0; i < f->argc; i++) {
+		hash = gpr_hash_node(f->argv[i], hash);
+	}
+	return hash;
+}
+
+/* Returns a hash of the structure of the given program.
+   When ADFs are used they are part of the tree, so are also
+   included.  Programs with the same hash are structurally the same,
+   to a very high probability.  The hash is never zero */
+unsigned long long gpr_hash(gpr_function * f)
+{
+	unsigned long long hash = gpr_hash_node(f, 14695981039346656037ULL);
+
+	if (hash == 0) hash = 1;
+	return hash;
+}
+
+/* Returns a hash of the given program together with the mapping of
+   its sensors and actuators, which also affect its fitness.
+   This is the key used within the fitness cache */
+static unsigned long long gpr_hash_state(gpr_function * f,
+										 gpr_state * state)
+{
+	int i;
+	unsigned long long hash = gpr_hash_node(f, 14695981039346656037ULL);
+
+	hash = gpr_hash_mix(hash, (unsigned int)state->no_of_sensor_sources);
+	for (i = 0; i < state->no_of_sensors; i++) {
+		if (state->no_of_sensor_sources <= 0) break;
+		hash = gpr_hash_mix(hash, (unsigned int)state->sensor_source[i]);
+	}
+	hash = gpr_hash_mix(hash,
+						(unsigned int)state->no_of_actuator_destinations);
+	for (i = 0; i < state->no_of_actuators; i++) {
+		if (state->no_of_actuator_destinations <= 0) break;
+		hash = gpr_hash_mix(hash,
+							(unsigned int)state->actuator_destination[i]);
+	}
+
+	if (hash == 0) hash = 1;
+	return hash;
+}
+
+/* initialises a cache of fitness values with the given
+   number of entries */
+void gpr_init_fitness_cache(gpr_fitness_cache * cache, int size)
+{
+	cache->size = size;
+	cache->hash =
+		(unsigned long long*)malloc(size*sizeof(unsigned long long));
+#ifdef DEBUG
+	assert(cache->hash!=0);
+#endif
+	cache->fitness = (float*)malloc(size*sizeof(float));
+#ifdef DEBUG
+	assert(cache->fitness!=0);
+#endif
+	gpr_clear_fitness_cache(cache);
+}
+
+/* removes all entries and statistics from the cache.
+   This should be called if the fitness function changes */
+void gpr_clear_fitness_cache(gpr_fitness_cache * cache)
+{
+	memset((void*)cache->hash,'\0',
+		   cache->size*sizeof(unsigned long long));
+	memset((void*)cache->fitness,'\0',cache->size*sizeof(float));
+	cache->hits = 0;
+	cache->misses = 0;
+}
+
+/* deallocate memory */
+void gpr_free_fitness_cache(gpr_fitness_cache * cache)
+{
+	free(cache->hash);
+	free(cache->fitness);
+	cache->size = 0;
+}
+
+/* returns the percentage of lookups which found a fitness */
+float gpr_fitness_cache_hit_rate(gpr_fitness_cache * cache)
+{
+	unsigned int lookups = cache->hits + cache->misses;
+
+	if (lookups == 0) return 0;
+	return cache->hits * 100.0f / lookups;
+}
+
+/* Looks up the fitness of a program with the given hash.
+   Each hash has a single place in the cache, so that the cache
+   remains bounded and newer entries replace older ones */
+static int gpr_fitness_cache_get(gpr_fitness_cache * cache,
+								 unsigned long long hash,
+								 float * fitness)
+{
+	int found = 0, index = (int)(hash % (unsigned long long)cache->size);
+
+#pragma omp critical (gpr_fitness_cache)
+	{
+		if (cache->hash[index] == hash) {
+			*fitness = cache->fitness[index];
+			cache->hits++;
+			found = 1;
+		}
+		else {
+			cache->misses++;
+		}
+	}
+	return found;
+}
+
+/* stores the fitness of a program with the given hash */
+static void gpr_fitness_cache_set(gpr_fitness_cache * cache,
+								  unsigned long long hash,
+								  float fitness)
+{
+	int index = (int)(hash % (unsigned long long)cache->size);
+
+#pragma omp critical (gpr_fitness_cache)
+	{
+		cache->hash[index] = hash;
+		cache->fitness[index] = fitness;
+	}
+}
+
 /* Evaluates the fitness of all individuals in the population.
    Here we use openmp to speed up the process, since each
-   evaluation is independent */
+   evaluation is independent.
+   If the population has a fitness cache then programs which
+   have been evaluated before are given their previous fitness,
+   unless everything is being reevaluated.
+   Simplifying programs first allows equivalent programs to
+   share the same cache entry */
 void gpr_evaluate(gpr_population * population,
 				  int time_steps, int reevaluate,
 				  float (*evaluate_program)(int,
 											gpr_function*,
 											gpr_state*,int))
 {
+	gpr_fitness_cache * cache = population->fitness_cache;
+
+	if ((cache != 0) && (cache->size <= 0)) cache = 0;
+
 #pragma omp parallel for
 	for (int i = 0; i < population->size; i++) {
+		unsigned long long hash = 0;
+		float fitness;
+
 		if ((population->fitness[i]==0) ||
 			(reevaluate>0)) {
 			/* clear the retained state */
 			gpr_clear_state(&population->state[i]);
 
+			if (population->simplify > 0) {
+				gpr_simplify(&population->individual[i]);
+			}
+
+			if ((cache != 0) && (reevaluate<=0)) {
+				hash = gpr_hash_state(&population->individual[i],
+									  &population->state[i]);
+			}
+
+			if ((hash == 0) ||
+				(gpr_fitness_cache_get(cache, hash, &fitness) == 0)) {
+				/* run the evaluation function */
+				fitness =
+					(*evaluate_program)(time_steps,
+										&population->individual[i],
+										&population->state[i], 0);
+				if (hash != 0) {
+					gpr_fitness_cache_set(cache, hash, fitness);
+				}
+			}
+			population->fitness[i] = fitness;
+		}
+		/* population gets older */
+		(&population->state[i])->age++;
+		if ((&population->state[i])->age > GPR_MAX_AGE) {
+			population->fitness[i] = 0;
+		}
+	}
+}
+
+/* Evaluates the fitness of all individuals in the population,
+   also storing the error of each individual on each of the given
+   number of cases, which is used by lexicase selection.
+   The fitness cache isn't used, since it doesn't store errors */
+void gpr_evaluate_cases(gpr_population * population,
+						int time_steps, int reevaluate, int cases,
+						float (*evaluate_program)(int,gpr_function*,
+												  gpr_state*,int,
+												  float*))
+{
+	gpr_selection * selection = &population->selection;
+
+	/* if the errors are new then every individual needs them */
+	if (gpr_selection_cases(selection, population->size, cases) != 0) {
+		reevaluate = 1;
+	}
+
+#pragma omp parallel for
+	for (int i = 0; i < population->size; i++) {
+		if ((population->fitness[i]==0) ||
+			(reevaluate>0)) {
+			/* clear the retained state */
+			gpr_clear_state(&population->state[i]);
+
+			if (population->simplify > 0) {
+				gpr_simplify(&population->individual[i]);
+			}
+
 			/* run the evaluation function */
 			population->fitness[i] =
 				(*evaluate_program)(time_steps,
 									&population->individual[i],
-									&population->state[i], 0);
+									&population->state[i], 0,
+									gpr_selection_errors(selection, i));
 		}
 		/* population gets older */
 		(&population->state[i])->age++;
@@ -3183,6 +4108,10 @@ void gpr_evaluate_system(gpr_system * system,
 
 #pragma omp parallel for
 	for (i = 0; i < system->size; i++) {
+		/* islands share the same cache */
+		if (system->fitness_cache != 0) {
+			system->island[i].fitness_cache = system->fitness_cache;
+		}
 		/* evaluate the island population */
 		gpr_evaluate(&system->island[i],
 					 time_steps, reevaluate,
@@ -3192,70 +4121,173 @@ void gpr_evaluate_system(gpr_system * system,
 	}
 }
 
-/* sorts individuals in order of fitness */
-void gpr_sort(gpr_population * population)
+/* merges two ranked runs of indexes in descending order of fitness.
+   On equal fitness the left run comes first, so ranking is stable */
+static void gpr_rank_merge(float * fitness, int * index, int * buffer,
+						   int start, int mid, int end)
 {
-	int i, j, best;
-	float max, temp_fitness;
-	gpr_function temp_individual;
-	gpr_state temp_state;
-
-	for (i = 0; i < population->size-1; i++) {
-		max = population->fitness[i];
-		best = i;
-		for (j = i+1; j < population->size; j++) {
-			if (population->fitness[j] > max) {
-				max = population->fitness[j];
-				best = j;
+	int i = start, j = mid, k = start;
+
+	while ((i < mid) && (j < end)) {
+		if (fitness[index[j]] > fitness[index[i]]) {
+			buffer[k++] = index[j++];
+		}
+		else {
+			buffer[k++] = index[i++];
+		}
+	}
+	while (i < mid) buffer[k++] = index[i++];
+	while (j < end) buffer[k++] = index[j++];
+
+	memcpy((void*)&index[start], (void*)&buffer[start],
+		   (end-start)*sizeof(int));
+}
+
+/* Returns the indexes of the given fitness values in
+   descending order of fitness.  This is a stable merge sort,
+   so items with equal fitness keep their original order */
+void gpr_rank(float * fitness, int size, int * index)
+{
+	int i, width, start, mid, end;
+	int * buffer;
+
+	for (i = 0; i < size; i++) {
+		index[i] = i;
+	}
+	if (size < 2) return;
+
+	buffer = (int*)malloc(size*sizeof(int));
+#ifdef DEBUG
+	assert(buffer!=0);
+#endif
+
+	for (width = 1; width < size; width *= 2) {
+		for (start = 0; start < size - width; start += width*2) {
+			mid = start + width;
+			end = start + width*2;
+			if (end > size) end = size;
+			/* skip runs which are already in order */
+			if (!(fitness[index[mid]] > fitness[index[mid-1]])) {
+				continue;
 			}
+			gpr_rank_merge(fitness, index, buffer, start, mid, end);
 		}
-		if (best != i) {
-			/* swap fitness */
-			temp_fitness = population->fitness[i];
-			population->fitness[i] = population->fitness[best];
-			population->fitness[best] = temp_fitness;
+	}
 
-			/* swap individual */
-			temp_individual = population->individual[i];
-			population->individual[i] = population->individual[best];
-			population->individual[best] = temp_individual;
+	free(buffer);
+}
 
-			/* swap state */
-			temp_state = population->state[i];
-			population->state[i] = population->state[best];
-			population->state[best] = temp_state;
+/* Rearranges an array of items so that item i becomes the
+   item previously at index[i].  Each cycle of the permutation
+   is followed so that every item is only moved once */
+void gpr_permute(void * items, int item_size, int * index, int size)
+{
+	int i, j, k;
+	char * item = (char*)items;
+	char * temp, * done;
+
+	temp = (char*)malloc(item_size);
+	done = (char*)malloc(size);
+#ifdef DEBUG
+	assert(temp!=0);
+	assert(done!=0);
+#endif
+	memset((void*)done,'\0',size);
+
+	for (i = 0; i < size; i++) {
+		if ((done[i] != 0) || (index[i] == i)) continue;
+
+		memcpy((void*)temp, (void*)&item[i*item_size], item_size);
+		j = i;
+		while (1) {
+			done[j] = 1;
+			k = index[j];
+			if (k == i) {
+				memcpy((void*)&item[j*item_size], (void*)temp,
+					   item_size);
+				break;
+			}
+			memcpy((void*)&item[j*item_size], (void*)&item[k*item_size],
+				   item_size);
+			j = k;
 		}
 	}
+
+	free(done);
+	free(temp);
+}
+
+/* sorts individuals in order of fitness */
+void gpr_sort(gpr_population * population)
+{
+	int * index;
+
+	if (population->size < 2) return;
+
+	index = (int*)malloc(population->size*sizeof(int));
+#ifdef DEBUG
+	assert(index!=0);
+#endif
+
+	gpr_rank(population->fitness, population->size, index);
+	gpr_permute((void*)population->fitness, sizeof(float),
+				index, population->size);
+	gpr_permute((void*)population->individual, sizeof(gpr_function),
+				index, population->size);
+	gpr_permute((void*)population->state, sizeof(gpr_state),
+				index, population->size);
+	gpr_selection_permute(&population->selection, index);
+
+	free(index);
+}
+
+/* Moves the given number of fittest individuals to the start of the
+   population, with the fittest first and the least fit last.
+   This is cheaper than sorting the whole population */
+static void gpr_partition_population(gpr_population * population,
+									 int survivors)
+{
+	int * index;
+
+	if (population->size < 2) return;
+
+	index = (int*)malloc(population->size*sizeof(int));
+#ifdef DEBUG
+	assert(index!=0);
+#endif
+
+	gpr_partition(population->fitness, population->size,
+				  survivors, index);
+	gpr_permute((void*)population->fitness, sizeof(float),
+				index, population->size);
+	gpr_permute((void*)population->individual, sizeof(gpr_function),
+				index, population->size);
+	gpr_permute((void*)population->state, sizeof(gpr_state),
+				index, population->size);
+	gpr_selection_permute(&population->selection, index);
+
+	free(index);
 }
 
 /* sorts populations in order of average fitness */
 void gpr_sort_system(gpr_system * system)
 {
-	int i, j, best;
-	float max, temp_fitness;
-	gpr_population temp_island;
-
-	for (i = 0; i < system->size-1; i++) {
-		max = system->fitness[i];
-		best = i;
-		for (j = i+1; j < system->size; j++) {
-			if (system->fitness[j] > max) {
-				max = system->fitness[j];
-				best = j;
-			}
-		}
-		if (best != i) {
-			/* swap fitness */
-			temp_fitness = system->fitness[i];
-			system->fitness[i] = system->fitness[best];
-			system->fitness[best] = temp_fitness;
+	int * index;
 
-			/* swap island */
-			temp_island = system->island[i];
-			system->island[i] = system->island[best];
-			system->island[best] = temp_island;
-		}
-	}
+	if (system->size < 2) return;
+
+	index = (int*)malloc(system->size*sizeof(int));
+#ifdef DEBUG
+	assert(index!=0);
+#endif
+
+	gpr_rank(system->fitness, system->size, index);
+	gpr_permute((void*)system->fitness, sizeof(float),
+				index, system->size);
+	gpr_permute((void*)system->island, sizeof(gpr_population),
+				index, system->size);
+
+	free(index);
 }
 
 /* Returns a fitness histogram for the given population */
@@ -3497,9 +4529,25 @@ void gpr_generation(gpr_population * population,
 {
 	int i, threshold;
 	float diversity,mutation_prob_range;
+	gpr_selection * selection = &population->selection;
+
+	/* range checking */
+	if ((elitism < 0.1f) || (elitism > 0.9f)) {
+		elitism = 0.3f;
+	}
+
+	/* index setting the threshold for the fittest individuals */
+	threshold = (int)((1.0f - elitism)*(population->size-1));
 
-	/* sort the population in order of fitness */
-	gpr_sort(population);
+	if (selection->method == GPR_SELECTION_TRUNCATION) {
+		/* sort the population in order of fitness */
+		gpr_sort(population);
+	}
+	else {
+		/* only the survivors need to be found */
+		gpr_partition_population(population, threshold);
+	}
+	gpr_selection_prepare(selection, &population->state[0].random_seed);
 
 	diversity = gpr_diversity(population);
 	mutation_prob_range = (1.0f-mutation_prob)/2;
@@ -3533,24 +4581,25 @@ void gpr_generation(gpr_population * population,
 		}
 	}
 
-	/* range checking */
-	if ((elitism < 0.1f) || (elitism > 0.9f)) {
-		elitism = 0.3f;
-	}
-
-	/* index setting the threshold for the fittest individuals */
-	threshold = (int)((1.0f - elitism)*(population->size-1));
-
-	/*#pragma omp parallel for*/
+	/* Each child only uses the random number stream of its own slot,
+	   so the result doesn't depend upon the number of threads */
+#pragma omp parallel for
 	for (i = 0; i < population->size - threshold; i++) {
-		/* randomly choose parents from the fittest
-		   section of the population */
 		gpr_state * state = &population->state[threshold + i];
 		unsigned int * random_seed = &state->random_seed;
-		unsigned int index1 = rand_num(random_seed)%threshold;
-		unsigned int index2 = rand_num(random_seed)%threshold;
-		gpr_function * parent1 = &population->individual[index1];
-		gpr_function * parent2 = &population->individual[index2];
+		unsigned int index1, index2;
+		gpr_function * parent1, * parent2;
+
+		*random_seed = rand_stream_seed(*random_seed, threshold + i);
+
+		/* choose parents from the fittest section of the
+		   population, which isn't overwritten by children */
+		index1 = gpr_select(selection, population->fitness,
+							threshold, random_seed);
+		index2 = gpr_select(selection, population->fitness,
+							threshold, random_seed);
+		parent1 = &population->individual[index1];
+		parent2 = &population->individual[index2];
 
 		/* just born */
 		state->age = 0;
@@ -3566,7 +4615,7 @@ void gpr_generation(gpr_population * population,
 				 pure_mutant_prob,
 				 integers_only,
 				 ADFs,
-				 &population->state[i].random_seed,
+				 random_seed,
 				 instruction_set, no_of_instructions,
 				 &population->individual[threshold + i],
 				 &population->state[threshold + i]);
@@ -3652,6 +4701,9 @@ void gpr_generation_system(gpr_system * system,
 
 			population2->fitness[population2->size-1] =
 				population1->fitness[migrant_index];
+			gpr_selection_copy(&population1->selection, migrant_index,
+							   &population2->selection,
+							   population2->size-1);
 
 			/* free the original */
 			gpr_free(&population1->individual[migrant_index]);
@@ -4541,6 +5593,382 @@ void gpr_load_system(gpr_system * system,
 	}
 }
 
+/* bytes used to store each node in a binary file */
+#define GPR_BINARY_NODE_SIZE 8
+
+/* saves a program tree in preorder to a buffer */
+static void gpr_save_binary_node(gpr_function * f,
+								 gpr_binary_buffer * buffer)
+{
+	int i;
+	unsigned char node[GPR_BINARY_NODE_SIZE];
+	unsigned short function_type = f->function_type;
+
+	/* function type, number of arguments, which arguments
+	   exist and the value */
+	memcpy(&node[0], &function_type, sizeof(unsigned short));
+	node[2] = (unsigned char)f->argc;
+	node[3] = 0;
+	for (i = 0; i < f->argc; i++) {
+		if (f->argv[i] != 0) node[3] |= 1<<i;
+	}
+	memcpy(&node[4], &f->value, sizeof(float));
+	gpr_binary_put(buffer, node, GPR_BINARY_NODE_SIZE);
+
+	for (i = 0; i < f->argc; i++) {
+		if (f->argv[i] != 0) {
+			gpr_save_binary_node(f->argv[i], buffer);
+		}
+	}
+}
+
+/* loads a program tree in preorder from a binary file */
+static int gpr_load_binary_node(gpr_function * f,
+								gpr_binary_reader * reader,
+								int * nodes)
+{
+	int i, retval;
+	unsigned char children;
+	unsigned short function_type;
+	const unsigned char * node =
+		gpr_binary_get(reader, GPR_BINARY_NODE_SIZE);
+
+	if ((node == 0) || (*nodes <= 0)) return GPR_LOAD_BINARY_SECTION;
+	*nodes = *nodes - 1;
+
+	memcpy(&function_type, &node[0], sizeof(unsigned short));
+	f->function_type = function_type;
+	f->argc = node[2];
+	children = node[3];
+	memcpy(&f->value, &node[4], sizeof(float));
+	if (f->argc > GPR_MAX_ARGUMENTS) return GPR_LOAD_ARGC_NOT_FOUND;
+
+	for (i = 0; i < GPR_MAX_ARGUMENTS; i++) {
+		f->argv[i] = 0;
+	}
+	for (i = 0; i < f->argc; i++) {
+		if (children & (1<<i)) {
+			f->argv[i] = gpr_new_node();
+			retval = gpr_load_binary_node(f->argv[i], reader, nodes);
+			if (retval != GPR_LOAD_OK) return retval;
+		}
+	}
+	return GPR_LOAD_OK;
+}
+
+/* writes the sections describing a population */
+static int gpr_save_population_sections(gpr_population * population,
+										FILE * fp, int compress)
+{
+	int i, nodes, retval = 0;
+	unsigned long start;
+	gpr_state * state;
+	gpr_binary_buffer buffer;
+
+	gpr_binary_init(&buffer);
+
+	/* population parameters */
+	state = &population->state[0];
+	gpr_binary_put_int(&buffer, population->size);
+	gpr_binary_put_int(&buffer, state->no_of_registers);
+	gpr_binary_put_int(&buffer, state->no_of_sensors);
+	gpr_binary_put_int(&buffer, state->no_of_actuators);
+	gpr_binary_put_int(&buffer, (state->ADF[0] != 0));
+	gpr_binary_put_int(&buffer, population->data_size);
+	gpr_binary_put_int(&buffer, population->data_fields);
+	if (gpr_binary_write_section(fp, GPR_BINARY_SECTION_PARAMETERS,
+								 &buffer, compress) != 0) retval = -1;
+
+	/* fitness history */
+	gpr_binary_clear(&buffer);
+	gpr_binary_put(&buffer, &population->history, sizeof(gpr_history));
+	if (gpr_binary_write_section(fp, GPR_BINARY_SECTION_HISTORY,
+								 &buffer, compress) != 0) retval = -1;
+
+	/* programs and their states */
+	gpr_binary_clear(&buffer);
+	for (i = 0; i < population->size; i++) {
+		state = &population->state[i];
+		gpr_binary_put_float(&buffer, population->fitness[i]);
+		gpr_binary_put_int(&buffer, state->age);
+
+		/* the number of nodes is filled in afterwards */
+		start = buffer.length;
+		gpr_binary_put_int(&buffer, 0);
+		gpr_save_binary_node(&population->individual[i], &buffer);
+		nodes = (buffer.length - start - sizeof(int)) /
+			GPR_BINARY_NODE_SIZE;
+		memcpy(&buffer.data[start], &nodes, sizeof(int));
+
+		gpr_binary_put_int(&buffer, state->no_of_sensor_sources);
+		if (state->no_of_sensor_sources > 0) {
+			gpr_binary_put(&buffer, state->sensor_source,
+						   state->no_of_sensors*sizeof(int));
+		}
+		gpr_binary_put_int(&buffer, state->no_of_actuator_destinations);
+		if (state->no_of_actuator_destinations > 0) {
+			gpr_binary_put(&buffer, state->actuator_destination,
+						   state->no_of_actuators*sizeof(int));
+		}
+	}
+	if (gpr_binary_write_section(fp, GPR_BINARY_SECTION_INDIVIDUALS,
+								 &buffer, compress) != 0) retval = -1;
+
+	gpr_binary_free(&buffer);
+	return retval;
+}
+
+/* Reads the sections describing a population.
+   If this fails then the population is left unallocated */
+static int gpr_load_population_sections(gpr_population * population,
+										gpr_binary_reader * reader)
+{
+	int i, nodes, retval;
+	int size, registers, sensors, actuators;
+	int ADFs, data_size, data_fields;
+	int instruction_set[64], no_of_instructions=0;
+	unsigned int random_seed = 123;
+	gpr_state * state;
+	const int max = GPR_BINARY_MAX_DIMENSION;
+
+	/* population parameters */
+	retval = gpr_binary_next_section(reader,
+									 GPR_BINARY_SECTION_PARAMETERS);
+	if (retval != GPR_LOAD_OK) return retval;
+	size = gpr_binary_get_int(reader);
+	registers = gpr_binary_get_int(reader);
+	sensors = gpr_binary_get_int(reader);
+	actuators = gpr_binary_get_int(reader);
+	ADFs = gpr_binary_get_int(reader);
+	data_size = gpr_binary_get_int(reader);
+	data_fields = gpr_binary_get_int(reader);
+	if ((reader->overrun != 0) ||
+		(gpr_binary_in_range(size, 1, max) == 0) ||
+		(gpr_binary_in_range(registers, 0, max) == 0) ||
+		(gpr_binary_in_range(sensors, 1, max) == 0) ||
+		(gpr_binary_in_range(actuators, 1, max) == 0) ||
+		(gpr_binary_in_range(ADFs, 0, GPR_MAX_ARGUMENTS) == 0) ||
+		(gpr_binary_in_range(data_size, 0, max) == 0) ||
+		(gpr_binary_in_range(data_fields, 0, max) == 0) ||
+		((data_size > 0) && (data_fields == 0))) {
+		return GPR_LOAD_BINARY_SECTION;
+	}
+
+	/* the instruction set is only used to create the initial
+	   individuals, which are then overwritten */
+	no_of_instructions =
+		gpr_default_instruction_set((int*)instruction_set);
+	gpr_init_population(population,size,
+						registers,sensors,actuators,
+						5,-1,1, 0,ADFs,
+						data_size, data_fields,
+						&random_seed,
+						(int*)instruction_set, no_of_instructions);
+
+	/* fitness history */
+	retval = gpr_binary_next_section(reader, GPR_BINARY_SECTION_HISTORY);
+	if (retval == GPR_LOAD_OK) {
+		gpr_binary_get_array(reader, &population->history,
+							 sizeof(gpr_history));
+
+		/* programs and their states */
+		retval = gpr_binary_next_section(reader,
+										 GPR_BINARY_SECTION_INDIVIDUALS);
+	}
+	for (i = 0; (i < size) && (retval == GPR_LOAD_OK); i++) {
+		state = &population->state[i];
+		population->fitness[i] = gpr_binary_get_float(reader);
+		state->age = gpr_binary_get_int(reader);
+		nodes = gpr_binary_get_int(reader);
+
+		gpr_free(&population->individual[i]);
+		retval = gpr_load_binary_node(&population->individual[i],
+									  reader, &nodes);
+		if (retval != GPR_LOAD_OK) break;
+
+		state->no_of_sensor_sources = gpr_binary_get_int(reader);
+		if (state->no_of_sensor_sources > 0) {
+			if (state->sensor_source == 0) {
+				state->sensor_source =
+					(int*)malloc(sensors*sizeof(int));
+			}
+			gpr_binary_get_array(reader, state->sensor_source,
+								 sensors*sizeof(int));
+		}
+		state->no_of_actuator_destinations = gpr_binary_get_int(reader);
+		if (state->no_of_actuator_destinations > 0) {
+			if (state->actuator_destination == 0) {
+				state->actuator_destination =
+					(int*)malloc(actuators*sizeof(int));
+			}
+			gpr_binary_get_array(reader, state->actuator_destination,
+								 actuators*sizeof(int));
+		}
+		if (reader->overrun != 0) {
+			retval = GPR_LOAD_BINARY_SECTION;
+			break;
+		}
+
+		if (ADFs > 0) {
+			/* enforce ADF structure */
+			gpr_enforce_ADFs(&population->individual[i], state);
+		}
+	}
+	if (retval != GPR_LOAD_OK) {
+		gpr_free_population(population);
+	}
+	return retval;
+}
+
+/* Saves a population to a binary file.
+   Sections are compressed if compress is non-zero.
+   Returns zero on success */
+int gpr_save_population_binary(gpr_population * population,
+							   FILE * fp, int compress)
+{
+	if (gpr_binary_write_header(fp, GPR_BINARY_GPR_POPULATION) != 0) {
+		return -1;
+	}
+	if (gpr_save_population_sections(population, fp, compress) != 0) {
+		return -1;
+	}
+	return gpr_binary_write_end(fp);
+}
+
+/* Loads a population from a binary file.
+   If this fails then the population is left unallocated */
+int gpr_load_population_binary(gpr_population * population, FILE * fp)
+{
+	gpr_binary_reader reader;
+	int retval;
+
+	retval = gpr_binary_open(&reader, fp, GPR_BINARY_GPR_POPULATION);
+	if (retval == GPR_LOAD_OK) {
+		retval = gpr_load_population_sections(population, &reader);
+		if (retval == GPR_LOAD_OK) {
+			retval = gpr_binary_next_section(&reader,
+											 GPR_BINARY_SECTION_END);
+			if (retval != GPR_LOAD_OK) {
+				gpr_free_population(population);
+			}
+		}
+	}
+	gpr_binary_close(&reader);
+	return retval;
+}
+
+/* Saves a system to a binary file.
+   Returns zero on success */
+int gpr_save_system_binary(gpr_system * system, FILE * fp, int compress)
+{
+	int i, retval = 0;
+	gpr_binary_buffer buffer;
+
+	if (gpr_binary_write_header(fp, GPR_BINARY_GPR_SYSTEM) != 0) {
+		return -1;
+	}
+
+	gpr_binary_init(&buffer);
+	gpr_binary_put_int(&buffer, system->size);
+	gpr_binary_put_int(&buffer, system->migration_tick);
+	gpr_binary_put(&buffer, &system->history, sizeof(gpr_history));
+	gpr_binary_put(&buffer, system->fitness, system->size*sizeof(float));
+	retval = gpr_binary_write_section(fp, GPR_BINARY_SECTION_SYSTEM,
+									  &buffer, compress);
+	gpr_binary_free(&buffer);
+
+	for (i = 0; i < system->size; i++) {
+		if (retval != 0) return retval;
+		retval = gpr_save_population_sections(&system->island[i],
+											  fp, compress);
+	}
+	if (retval != 0) return retval;
+	return gpr_binary_write_end(fp);
+}
+
+/* Loads a system from a binary file.
+   If this fails then the system is left unallocated */
+int gpr_load_system_binary(gpr_system * system, FILE * fp,
+						   int * instruction_set, int no_of_instructions)
+{
+	gpr_binary_reader reader;
+	int i, j, islands, migration_tick, retval;
+	int population_per_island=10, registers=4;
+	int sensors=1, actuators=1, max_tree_depth=6;
+	float min_value=-10, max_value=10;
+	unsigned int random_seed = 123;
+
+	retval = gpr_binary_open(&reader, fp, GPR_BINARY_GPR_SYSTEM);
+	if (retval == GPR_LOAD_OK) {
+		retval = gpr_binary_next_section(&reader,
+										 GPR_BINARY_SECTION_SYSTEM);
+	}
+	if (retval != GPR_LOAD_OK) {
+		gpr_binary_close(&reader);
+		return retval;
+	}
+
+	islands = gpr_binary_get_int(&reader);
+	migration_tick = gpr_binary_get_int(&reader);
+	if ((reader.overrun != 0) ||
+		(gpr_binary_in_range(islands, 1,
+							 GPR_BINARY_MAX_DIMENSION) == 0)) {
+		gpr_binary_close(&reader);
+		return GPR_LOAD_BINARY_SECTION;
+	}
+
+	/* create a system.
+	   It doesn't matter what the parameters are here, because
+	   they will be overwritten later */
+	gpr_init_system(system, islands, population_per_island,
+					registers, sensors, actuators,
+					max_tree_depth, min_value, max_value,
+					0, 0, 0, 0, &random_seed,
+					instruction_set, no_of_instructions);
+	system->migration_tick = migration_tick;
+	gpr_binary_get_array(&reader, &system->history, sizeof(gpr_history));
+	gpr_binary_get_array(&reader, system->fitness,
+						 islands*sizeof(float));
+
+	/* load each population */
+	for (i = 0; i < islands; i++) {
+		gpr_free_population(&system->island[i]);
+		retval = gpr_load_population_sections(&system->island[i],
+											  &reader);
+		if (retval != GPR_LOAD_OK) break;
+	}
+	if (retval == GPR_LOAD_OK) {
+		retval = gpr_binary_next_section(&reader,
+										 GPR_BINARY_SECTION_END);
+	}
+	if (retval != GPR_LOAD_OK) {
+		/* an island which failed to load has already been freed */
+		for (j = i+1; j < islands; j++) {
+			gpr_free_population(&system->island[j]);
+		}
+		system->size = i;
+		gpr_free_system(system);
+	}
+	gpr_binary_close(&reader);
+	return retval;
+}
+
+/* Takes a snapshot of a system and writes it to the given file
+   in the background as a binary checkpoint.  Evolution can continue
+   as soon as this returns, and gpr_checkpoint_wait can be used to
+   find out whether the checkpoint was written */
+int gpr_checkpoint_system(gpr_system * system,
+						  gpr_checkpoint * checkpoint,
+						  char * filename, int compress)
+{
+	FILE * fp = gpr_checkpoint_begin(checkpoint);
+
+	if (fp == 0) return -1;
+	return gpr_checkpoint_end(checkpoint,
+							  gpr_save_system_binary(system, fp, 0),
+							  filename, compress);
+}
+
 /* load a program from file */
 int gpr_load(gpr_function *f, FILE * fp)
 {
@@ -4564,8 +5992,7 @@ int gpr_load(gpr_function *f, FILE * fp)
 						fn[no_of_nodes] = f;
 					}
 					else {
-						fn[no_of_nodes] =
-							(gpr_function*)malloc(sizeof(gpr_function));
+						fn[no_of_nodes] = gpr_node_alloc();
 					}
 #ifdef DEBUG
 					assert(fn[no_of_nodes] != 0);
@@ -4653,7 +6080,7 @@ int gpr_load(gpr_function *f, FILE * fp)
 					if (no_of_nodes >= GPR_MAX_NODES) {
 						/* free allocated memory */
 						for (i = 1; i < no_of_nodes; i++) {
-							free(fn[i]);
+							gpr_node_free(fn[i]);
 						}
 						result = GPR_LOAD_MAX_NODES_REACHED;
 						break;
@@ -45,6 +45,9 @@
 #include <zlib.h>
 #include "pnglite.h"
 #include "gpr_data.h"
+#include "gpr_binary.h"
+#include "gpr_checkpoint.h"
+#include "gpr_selection.h"
 
 /* types of function */
 enum {
@@ -141,6 +144,8 @@ typedef struct gpr_val gpr_value;*/
 struct gpr_func {
 	/* the type of function */
 	unsigned short function_type;
+	/* the thread which owns this node, if it came from the pool */
+	unsigned short pool;
 	/* if this is a terminal then this is the value */
 	float value;
 	/* the number of function arguments */
@@ -150,6 +155,24 @@ struct gpr_func {
 };
 typedef struct gpr_func gpr_function;
 
+/* preorder index of the nodes within a program tree */
+struct gpr_idx {
+	/* the number of indexed nodes */
+	int size;
+	/* the allocated length of the arrays */
+	int max_size;
+	/* nodes in preorder */
+	struct gpr_func ** node;
+	/* depth of each node within the tree */
+	int * depth;
+	/* number of indexed nodes within the subtree of each node,
+	   including the node itself */
+	int * subtree_size;
+	/* depth of the deepest node below each node, relative to it */
+	int * height;
+};
+typedef struct gpr_idx gpr_index;
+
 /* machine state */
 struct gpr_st {
 	/* the number of registers available to the program */
@@ -206,6 +229,19 @@ struct gpr_hist {
 };
 typedef struct gpr_hist gpr_history;
 
+/* fitness values of previously evaluated programs */
+struct gpr_fit_cache {
+	/* the number of entries */
+	int size;
+	/* hash of the program within each entry, or zero if empty */
+	unsigned long long * hash;
+	/* the fitness of the program within each entry */
+	float * fitness;
+	/* the number of lookups which did or did not find a fitness */
+	unsigned int hits, misses;
+};
+typedef struct gpr_fit_cache gpr_fitness_cache;
+
 /* represents a population */
 struct gpr_pop {
 	/* the number of individuals in the population */
@@ -214,12 +250,20 @@ struct gpr_pop {
 	struct gpr_func * individual;
 	/* the states for each program */
 	struct gpr_st * state;
+	/* the data stores of every state, in a single block */
+	float * data_block;
 	/* the fitness of each program */
 	float * fitness;
 	/* data store parameters */
 	int data_size, data_fields;
 	/* the fitness history for the population */
 	struct gpr_hist history;
+	/* optional cache of previously evaluated programs */
+	struct gpr_fit_cache * fitness_cache;
+	/* if non-zero programs are simplified before evaluation */
+	int simplify;
+	/* how parents are selected */
+	gpr_selection selection;
 };
 typedef struct gpr_pop gpr_population;
 
@@ -232,6 +276,8 @@ struct gpr_env {
 	struct gpr_func * individual;
 	/* the states for each program */
 	struct gpr_st * state;
+	/* the data stores of every state, in a single block */
+	float * data_block;
 	/* the number of matings */
 	int matings;
 	/* index numbers of mating parents */
@@ -254,6 +300,8 @@ struct gpr_sys {
 	float * fitness;
 	/* the fitness history for the system */
 	struct gpr_hist history;
+	/* optional cache shared by all islands */
+	struct gpr_fit_cache * fitness_cache;
 };
 typedef struct gpr_sys gpr_system;
 
@@ -263,6 +311,7 @@ float gpr_mutate_value(float value,
 					   unsigned int * random_seed);
 int is_nan(float v);
 int rand_num(unsigned int * seed);
+unsigned int rand_stream_seed(unsigned int seed, unsigned int index);
 void gpr_validate(gpr_function * f, int depth,
 				  int min_depth, int max_depth,
 				  int ADFs,
@@ -274,7 +323,11 @@ void gpr_prune(gpr_function * f, int depth, int max_depth,
 			   unsigned int * random_seed);
 float gpr_run(gpr_function * f, gpr_state * state,
 			  float (*custom_function)(float,float,float));
+void gpr_simplify(gpr_function * f);
 void gpr_nodes(gpr_function * f, int * ctr);
+void gpr_init_index(gpr_index * index);
+void gpr_free_index(gpr_index * index);
+void gpr_build_index(gpr_function * f, gpr_index * index);
 void gpr_init(gpr_function * f);
 void gpr_init_state(gpr_state * state,
 					int registers,
@@ -316,6 +369,8 @@ void gpr_init_environment(gpr_environment * population,
 						  int * instruction_set,
 						  int no_of_instructions);
 void gpr_free(gpr_function * f);
+int gpr_pool_size();
+void gpr_pool_release();
 void gpr_free_state(gpr_state * state);
 void gpr_free_population(gpr_population * population);
 void gpr_free_environment(gpr_environment * population);
@@ -361,9 +416,21 @@ void gpr_mate(gpr_function * parent1, gpr_function * parent2,
 			  int * instruction_set, int no_of_instructions,
 			  gpr_function * child,
 			  gpr_state * child_state);
+unsigned long long gpr_hash(gpr_function * f);
+void gpr_init_fitness_cache(gpr_fitness_cache * cache, int size);
+void gpr_clear_fitness_cache(gpr_fitness_cache * cache);
+void gpr_free_fitness_cache(gpr_fitness_cache * cache);
+float gpr_fitness_cache_hit_rate(gpr_fitness_cache * cache);
 void gpr_evaluate(gpr_population * population,
 				  int time_steps, int reevaluate,
 				  float (*evaluate_program)(int,gpr_function*,gpr_state*,int));
+void gpr_evaluate_cases(gpr_population * population,
+						int time_steps, int reevaluate, int cases,
+						float (*evaluate_program)(int,gpr_function*,
+												  gpr_state*,int,
+												  float*));
+void gpr_rank(float * fitness, int size, int * index);
+void gpr_permute(void * items, int item_size, int * index, int size);
 void gpr_sort(gpr_population * population);
 void gpr_generation(gpr_population * population,
 					float elitism,
@@ -430,6 +497,15 @@ void gpr_load_system(gpr_system * system,
 					 FILE * fp,
 					 int * instruction_set, int no_of_instructions);
 void gpr_save_system(gpr_system *system, FILE * fp);
+int gpr_save_population_binary(gpr_population * population,
+							   FILE * fp, int compress);
+int gpr_load_population_binary(gpr_population * population, FILE * fp);
+int gpr_save_system_binary(gpr_system * system, FILE * fp, int compress);
+int gpr_load_system_binary(gpr_system * system, FILE * fp,
+						   int * instruction_set, int no_of_instructions);
+int gpr_checkpoint_system(gpr_system * system,
+						  gpr_checkpoint * checkpoint,
+						  char * filename, int compress);
 void gpr_arduino(gpr_function * f,
 				 int baud_rate,
 				 int digital_high,
@@ -487,6 +563,12 @@ void gpr_death(gpr_environment * population,
 			   int victim_index);
 void gpr_save_environment(gpr_environment *population, FILE * fp);
 int gpr_load_environment(gpr_environment * population, FILE * fp);
+float gpr_state_store(float v1, float v2, gpr_state * state);
+float gpr_state_fetch(float v1, float v2, gpr_state * state);
+float gpr_state_push(float v1, float v2, gpr_state * state);
+float gpr_state_pop(float v1, gpr_state * state);
+float gpr_state_data_get(float v1, float v2, gpr_state * state);
+float gpr_state_data_set(float v1, float v2, gpr_state * state);
 int write_png_file(char * filename,
 				   int width, int height,
 				   unsigned char * buffer);
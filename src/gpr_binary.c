@@ -0,0 +1,428 @@
+/*
+ libgpr - a library for genetic programming
+ Copyright (C) 2013  Bob Mottram <bob@robotics.uk.to>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* needed for fileno and mmap */
+#define _POSIX_C_SOURCE 200809L
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "gpr_binary.h"
+
+/* length of the file header */
+#define GPR_BINARY_HEADER_LENGTH  16
+
+/* length of the header at the start of each section */
+#define GPR_BINARY_SECTION_HEADER 24
+
+/* initialise a buffer */
+void gpr_binary_init(gpr_binary_buffer * buffer)
+{
+	buffer->length = 0;
+	buffer->max_length = 0;
+	buffer->data = 0;
+}
+
+/* deallocate memory for a buffer */
+void gpr_binary_free(gpr_binary_buffer * buffer)
+{
+	if (buffer->data != 0) {
+		free(buffer->data);
+	}
+	gpr_binary_init(buffer);
+}
+
+/* empties a buffer so that it can be reused */
+void gpr_binary_clear(gpr_binary_buffer * buffer)
+{
+	buffer->length = 0;
+}
+
+/* appends bytes to a buffer */
+void gpr_binary_put(gpr_binary_buffer * buffer,
+					const void * data, unsigned long length)
+{
+	if (buffer->length + length > buffer->max_length) {
+		buffer->max_length = (buffer->length + length)*2 + 256;
+		buffer->data =
+			(unsigned char*)realloc(buffer->data, buffer->max_length);
+#ifdef DEBUG
+		assert(buffer->data!=0);
+#endif
+	}
+	memcpy((void*)&buffer->data[buffer->length], data, length);
+	buffer->length += length;
+}
+
+/* appends an integer to a buffer */
+void gpr_binary_put_int(gpr_binary_buffer * buffer, int value)
+{
+	gpr_binary_put(buffer, &value, sizeof(int));
+}
+
+/* appends a float to a buffer */
+void gpr_binary_put_float(gpr_binary_buffer * buffer, float value)
+{
+	gpr_binary_put(buffer, &value, sizeof(float));
+}
+
+/* writes the header at the start of a binary file */
+int gpr_binary_write_header(FILE * fp, unsigned int content)
+{
+	unsigned int version = GPR_BINARY_VERSION;
+	unsigned int byte_order = GPR_BINARY_BYTE_ORDER;
+
+	if (fwrite(GPR_BINARY_MAGIC, 1, 4, fp) != 4) return -1;
+	if (fwrite(&byte_order, sizeof(unsigned int), 1, fp) != 1) return -1;
+	if (fwrite(&version, sizeof(unsigned int), 1, fp) != 1) return -1;
+	if (fwrite(&content, sizeof(unsigned int), 1, fp) != 1) return -1;
+	return 0;
+}
+
+/* Writes the contents of a buffer as a section.
+   If compression is requested then the section is compressed,
+   unless that doesn't make it any smaller */
+int gpr_binary_write_section(FILE * fp, unsigned int section,
+							 gpr_binary_buffer * buffer,
+							 int compress)
+{
+	unsigned int flags = 0;
+	unsigned long long length = buffer->length;
+	unsigned long long stored_length = buffer->length;
+	const unsigned char * stored = buffer->data;
+	unsigned char * compressed = 0;
+	uLongf compressed_length;
+	int retval = 0;
+
+	if ((compress > 0) && (buffer->length > 0)) {
+		compressed_length = compressBound(buffer->length);
+		compressed = (unsigned char*)malloc(compressed_length);
+#ifdef DEBUG
+		assert(compressed!=0);
+#endif
+		if ((compress2(compressed, &compressed_length,
+					   buffer->data, buffer->length,
+					   Z_DEFAULT_COMPRESSION) == Z_OK) &&
+			(compressed_length < buffer->length)) {
+			flags |= GPR_BINARY_COMPRESSED;
+			stored = compressed;
+			stored_length = compressed_length;
+		}
+	}
+
+	if ((fwrite(&section, sizeof(unsigned int), 1, fp) != 1) ||
+		(fwrite(&flags, sizeof(unsigned int), 1, fp) != 1) ||
+		(fwrite(&length, sizeof(unsigned long long), 1, fp) != 1) ||
+		(fwrite(&stored_length,
+				sizeof(unsigned long long), 1, fp) != 1)) {
+		retval = -1;
+	}
+	else if (stored_length > 0) {
+		if (fwrite(stored, 1, stored_length, fp) != stored_length) {
+			retval = -1;
+		}
+	}
+
+	if (compressed != 0) free(compressed);
+	return retval;
+}
+
+/* writes the section which marks the end of a binary file */
+int gpr_binary_write_end(FILE * fp)
+{
+	gpr_binary_buffer buffer;
+
+	gpr_binary_init(&buffer);
+	return gpr_binary_write_section(fp, GPR_BINARY_SECTION_END,
+									&buffer, 0);
+}
+
+/* Writes a binary file which was encoded in memory without
+   compression, compressing each of its sections if requested */
+int gpr_binary_write_image(FILE * fp, const unsigned char * image,
+						   unsigned long length, int compress)
+{
+	unsigned long position = GPR_BINARY_HEADER_LENGTH;
+	unsigned int section, flags;
+	unsigned long long section_length, stored_length;
+	gpr_binary_buffer buffer;
+
+	if ((length < GPR_BINARY_HEADER_LENGTH) ||
+		(memcmp(image, GPR_BINARY_MAGIC, 4) != 0)) {
+		return -1;
+	}
+	if (compress == 0) {
+		if (fwrite(image, 1, length, fp) != length) return -1;
+		return 0;
+	}
+	if (fwrite(image, 1, GPR_BINARY_HEADER_LENGTH, fp) !=
+		GPR_BINARY_HEADER_LENGTH) {
+		return -1;
+	}
+
+	while (position + GPR_BINARY_SECTION_HEADER <= length) {
+		memcpy(&section, &image[position], sizeof(unsigned int));
+		memcpy(&flags, &image[position+4], sizeof(unsigned int));
+		memcpy(&section_length, &image[position+8],
+			   sizeof(unsigned long long));
+		memcpy(&stored_length, &image[position+16],
+			   sizeof(unsigned long long));
+		position += GPR_BINARY_SECTION_HEADER;
+		if ((flags != 0) || (section_length != stored_length) ||
+			(stored_length > length - position)) {
+			return -1;
+		}
+
+		/* the buffer refers directly to the image */
+		buffer.data = (unsigned char*)&image[position];
+		buffer.length = stored_length;
+		buffer.max_length = stored_length;
+		if (gpr_binary_write_section(fp, section, &buffer,
+									 compress) != 0) {
+			return -1;
+		}
+		position += stored_length;
+		if (section == GPR_BINARY_SECTION_END) break;
+	}
+	return 0;
+}
+
+/* Opens a binary file for reading from its current position.
+   The file is mapped into memory if possible, so that sections can
+   be read directly from the mapping */
+int gpr_binary_open(gpr_binary_reader * reader, FILE * fp,
+					unsigned int content)
+{
+	struct stat st;
+	long start;
+	unsigned long n;
+	unsigned int byte_order;
+	unsigned char * header;
+
+	memset((void*)reader,'\0',sizeof(gpr_binary_reader));
+	reader->fp = fp;
+
+	start = ftell(fp);
+	if ((start >= 0) && (fstat(fileno(fp), &st) == 0) &&
+		(S_ISREG(st.st_mode)) && (st.st_size > start)) {
+		reader->file =
+			(unsigned char*)mmap(NULL, st.st_size, PROT_READ,
+								 MAP_PRIVATE, fileno(fp), 0);
+		if (reader->file != (unsigned char*)MAP_FAILED) {
+			reader->mapped = 1;
+			reader->file_length = st.st_size;
+			reader->position = start;
+		}
+		else {
+			reader->file = 0;
+		}
+	}
+
+	if (reader->mapped == 0) {
+		/* read the rest of the file into memory */
+		reader->file_length = 0;
+		n = 65536;
+		reader->file = (unsigned char*)malloc(n);
+		while (reader->file != 0) {
+			reader->file_length +=
+				fread(&reader->file[reader->file_length], 1,
+					  n - reader->file_length, fp);
+			if (reader->file_length < n) break;
+			n *= 2;
+			reader->file = (unsigned char*)realloc(reader->file, n);
+		}
+		if (reader->file == 0) return GPR_LOAD_BINARY_FORMAT;
+	}
+
+	/* check the header */
+	header = &reader->file[reader->position];
+	if ((reader->position + GPR_BINARY_HEADER_LENGTH >
+		 reader->file_length) ||
+		(memcmp(header, GPR_BINARY_MAGIC, 4) != 0)) {
+		return GPR_LOAD_BINARY_FORMAT;
+	}
+	memcpy(&byte_order, &header[4], sizeof(unsigned int));
+	memcpy(&reader->version, &header[8], sizeof(unsigned int));
+	memcpy(&reader->content, &header[12], sizeof(unsigned int));
+	reader->position += GPR_BINARY_HEADER_LENGTH;
+
+	/* written on a host with a different byte order */
+	if (byte_order != GPR_BINARY_BYTE_ORDER) {
+		return GPR_LOAD_BINARY_FORMAT;
+	}
+	if (reader->version != GPR_BINARY_VERSION) {
+		return GPR_LOAD_BINARY_VERSION;
+	}
+	if (reader->content != content) {
+		return GPR_LOAD_BINARY_FORMAT;
+	}
+	return GPR_LOAD_OK;
+}
+
+/* Moves on to the next section, which should be of the given type.
+   Compressed sections are expanded, otherwise the data is read
+   directly from the file contents */
+int gpr_binary_next_section(gpr_binary_reader * reader,
+							unsigned int section)
+{
+	unsigned int flags;
+	unsigned long long length, stored_length;
+	unsigned char * header;
+	uLongf uncompressed_length;
+
+	if (reader->uncompressed != 0) {
+		free(reader->uncompressed);
+		reader->uncompressed = 0;
+	}
+	reader->data = 0;
+	reader->length = 0;
+	reader->index = 0;
+	reader->overrun = 0;
+
+	if (reader->position + GPR_BINARY_SECTION_HEADER >
+		reader->file_length) {
+		return GPR_LOAD_BINARY_SECTION;
+	}
+
+	header = &reader->file[reader->position];
+	memcpy(&reader->section, &header[0], sizeof(unsigned int));
+	memcpy(&flags, &header[4], sizeof(unsigned int));
+	memcpy(&length, &header[8], sizeof(unsigned long long));
+	memcpy(&stored_length, &header[16], sizeof(unsigned long long));
+	reader->position += GPR_BINARY_SECTION_HEADER;
+
+	if ((reader->section != section) ||
+		(stored_length > reader->file_length - reader->position)) {
+		return GPR_LOAD_BINARY_SECTION;
+	}
+
+	/* a corrupt length shouldn't cause a huge allocation, and the
+	   lengths must fit within the types used by zlib */
+	if ((length > GPR_BINARY_MAX_SECTION) ||
+		(length > (unsigned long long)((uLong)-1)) ||
+		(stored_length > (unsigned long long)((uLong)-1))) {
+		return GPR_LOAD_BINARY_SECTION;
+	}
+
+	if (flags & GPR_BINARY_COMPRESSED) {
+		reader->uncompressed = (unsigned char*)malloc(length);
+		if (reader->uncompressed == 0) return GPR_LOAD_BINARY_SECTION;
+		uncompressed_length = (uLongf)length;
+		if ((uncompress(reader->uncompressed, &uncompressed_length,
+						&reader->file[reader->position],
+						(uLong)stored_length) != Z_OK) ||
+			(uncompressed_length != length)) {
+			return GPR_LOAD_BINARY_SECTION;
+		}
+		reader->data = reader->uncompressed;
+	}
+	else {
+		if (stored_length != length) return GPR_LOAD_BINARY_SECTION;
+		reader->data = &reader->file[reader->position];
+	}
+	reader->length = length;
+	reader->position += stored_length;
+	return GPR_LOAD_OK;
+}
+
+/* Returns a pointer to the given number of bytes within
+   the current section, or zero if the section is too short */
+const unsigned char * gpr_binary_get(gpr_binary_reader * reader,
+									 unsigned long length)
+{
+	const unsigned char * data;
+
+	if ((reader->overrun != 0) ||
+		(length > reader->length - reader->index)) {
+		reader->overrun = 1;
+		return 0;
+	}
+	data = &reader->data[reader->index];
+	reader->index += length;
+	return data;
+}
+
+/* reads an integer from the current section */
+int gpr_binary_get_int(gpr_binary_reader * reader)
+{
+	int value = 0;
+	const unsigned char * data = gpr_binary_get(reader, sizeof(int));
+
+	if (data != 0) memcpy(&value, data, sizeof(int));
+	return value;
+}
+
+/* reads a float from the current section */
+float gpr_binary_get_float(gpr_binary_reader * reader)
+{
+	float value = 0;
+	const unsigned char * data = gpr_binary_get(reader, sizeof(float));
+
+	if (data != 0) memcpy(&value, data, sizeof(float));
+	return value;
+}
+
+/* copies an array of the given number of bytes
+   from the current section */
+void gpr_binary_get_array(gpr_binary_reader * reader,
+						  void * data, unsigned long length)
+{
+	const unsigned char * source = gpr_binary_get(reader, length);
+
+	if (source != 0) {
+		memcpy(data, source, length);
+	}
+	else {
+		memset(data,'\0',length);
+	}
+}
+
+/* Returns non-zero if a value read from a binary file is
+   within the given range */
+int gpr_binary_in_range(int value, int min, int max)
+{
+	return ((value >= min) && (value <= max));
+}
+
+/* Finishes reading a binary file, leaving the file position
+   after the last section which was read */
+void gpr_binary_close(gpr_binary_reader * reader)
+{
+	if (reader->uncompressed != 0) {
+		free(reader->uncompressed);
+	}
+	if (reader->mapped != 0) {
+		munmap(reader->file, reader->file_length);
+		fseek(reader->fp, reader->position, SEEK_SET);
+	}
+	else if (reader->file != 0) {
+		free(reader->file);
+	}
+	memset((void*)reader,'\0',sizeof(gpr_binary_reader));
+}
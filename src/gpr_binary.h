@@ -0,0 +1,144 @@
+/*
+ libgpr - a library for genetic programming
+ Copyright (C) 2013  Bob Mottram <bob@robotics.uk.to>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef GPR_BINARY_H
+#define GPR_BINARY_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <zlib.h>
+#include "globals.h"
+
+/* identifies a binary file */
+#define GPR_BINARY_MAGIC   "GPRB"
+
+/* incremented whenever the layout of a section changes */
+#define GPR_BINARY_VERSION 3
+
+/* Values are stored in the byte order of the host which wrote the
+   file.  This is written into the header, so that files written on
+   a host with a different byte order are rejected */
+#define GPR_BINARY_BYTE_ORDER 0x01020304
+
+/* the largest uncompressed section which will be loaded */
+#define GPR_BINARY_MAX_SECTION (1024UL*1024UL*1024UL)
+
+/* section flags */
+#define GPR_BINARY_COMPRESSED 1
+
+/* The largest population dimensions accepted when loading, so that
+   a corrupt file is rejected rather than causing huge allocations */
+#define GPR_BINARY_MAX_DIMENSION 65536
+#define GPR_BINARY_MAX_GENES     (1024*1024)
+
+/* the types of content within a binary file */
+enum {
+	GPR_BINARY_GPR_POPULATION = 1,
+	GPR_BINARY_GPR_SYSTEM,
+	GPR_BINARY_GPRC_POPULATION,
+	GPR_BINARY_GPRC_SYSTEM,
+	GPR_BINARY_GPRCM_POPULATION,
+	GPR_BINARY_GPRCM_SYSTEM
+};
+
+/* the types of section within a binary file */
+enum {
+	GPR_BINARY_SECTION_END = 0,
+	GPR_BINARY_SECTION_SYSTEM,
+	GPR_BINARY_SECTION_PARAMETERS,
+	GPR_BINARY_SECTION_HISTORY,
+	GPR_BINARY_SECTION_INDIVIDUALS
+};
+
+/* the contents of a section being written */
+struct gpr_bin_buf {
+	/* the number of bytes */
+	unsigned long length;
+	/* the number of allocated bytes */
+	unsigned long max_length;
+	unsigned char * data;
+};
+typedef struct gpr_bin_buf gpr_binary_buffer;
+
+/* reads sections from a binary file */
+struct gpr_bin_reader {
+	/* the file being read */
+	FILE * fp;
+	/* contents of the file, which are either mapped or,
+	   if the file can't be mapped, read into memory */
+	unsigned char * file;
+	unsigned long file_length;
+	/* non-zero if the file was mapped */
+	int mapped;
+	/* the position of the next section within the contents */
+	unsigned long position;
+	/* the type of content and the version of the file */
+	unsigned int content, version;
+	/* the current section */
+	unsigned int section;
+	unsigned char * data;
+	unsigned long length;
+	unsigned long index;
+	/* uncompressed contents of the current section */
+	unsigned char * uncompressed;
+	/* set if a read went beyond the end of the section */
+	int overrun;
+};
+typedef struct gpr_bin_reader gpr_binary_reader;
+
+void gpr_binary_init(gpr_binary_buffer * buffer);
+void gpr_binary_free(gpr_binary_buffer * buffer);
+void gpr_binary_clear(gpr_binary_buffer * buffer);
+void gpr_binary_put(gpr_binary_buffer * buffer,
+					const void * data, unsigned long length);
+void gpr_binary_put_int(gpr_binary_buffer * buffer, int value);
+void gpr_binary_put_float(gpr_binary_buffer * buffer, float value);
+int gpr_binary_write_header(FILE * fp, unsigned int content);
+int gpr_binary_write_section(FILE * fp, unsigned int section,
+							 gpr_binary_buffer * buffer,
+							 int compress);
+int gpr_binary_write_end(FILE * fp);
+int gpr_binary_write_image(FILE * fp, const unsigned char * image,
+						   unsigned long length, int compress);
+
+int gpr_binary_open(gpr_binary_reader * reader, FILE * fp,
+					unsigned int content);
+int gpr_binary_next_section(gpr_binary_reader * reader,
+							unsigned int section);
+const unsigned char * gpr_binary_get(gpr_binary_reader * reader,
+									 unsigned long length);
+int gpr_binary_get_int(gpr_binary_reader * reader);
+float gpr_binary_get_float(gpr_binary_reader * reader);
+void gpr_binary_get_array(gpr_binary_reader * reader,
+						  void * data, unsigned long length);
+int gpr_binary_in_range(int value, int min, int max);
+void gpr_binary_close(gpr_binary_reader * reader);
+
+#endif
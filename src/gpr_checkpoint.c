@@ -0,0 +1,170 @@
+/*
+ libgpr - a library for genetic programming
+ Copyright (C) 2013  Bob Mottram <bob@robotics.uk.to>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* needed for open_memstream, fileno and fsync */
+#define _POSIX_C_SOURCE 200809L
+
+#include <unistd.h>
+#include "gpr_checkpoint.h"
+
+/* initialise a checkpoint */
+void gpr_checkpoint_init(gpr_checkpoint * checkpoint)
+{
+	memset((void*)checkpoint,'\0',sizeof(gpr_checkpoint));
+	pthread_mutex_init(&checkpoint->lock, NULL);
+}
+
+/* waits for any checkpoint being written and deallocates memory */
+void gpr_checkpoint_free(gpr_checkpoint * checkpoint)
+{
+	gpr_checkpoint_wait(checkpoint);
+	if (checkpoint->stream != 0) {
+		fclose(checkpoint->stream);
+		checkpoint->stream = 0;
+	}
+	if (checkpoint->snapshot != 0) {
+		free(checkpoint->snapshot);
+		checkpoint->snapshot = 0;
+	}
+	pthread_mutex_destroy(&checkpoint->lock);
+}
+
+/* compresses the snapshot and writes it to a temporary file,
+   which then replaces the previous checkpoint */
+static void * gpr_checkpoint_write(void * arg)
+{
+	gpr_checkpoint * checkpoint = (gpr_checkpoint*)arg;
+	char temp_filename[268];
+	FILE * fp;
+	int status = -1;
+
+	sprintf(temp_filename,"%s.tmp",checkpoint->filename);
+	fp = fopen(temp_filename,"wb");
+	if (fp != 0) {
+		status = gpr_binary_write_image(fp,
+										(unsigned char*)checkpoint->snapshot,
+										checkpoint->snapshot_length,
+										checkpoint->compress);
+		/* make sure that the contents are on disk before renaming */
+		if ((fflush(fp) != 0) || (fsync(fileno(fp)) != 0)) {
+			status = -1;
+		}
+		if (fclose(fp) != 0) status = -1;
+		if (status == 0) {
+			if (rename(temp_filename, checkpoint->filename) != 0) {
+				status = -1;
+			}
+		}
+		if (status != 0) remove(temp_filename);
+	}
+
+	free(checkpoint->snapshot);
+	checkpoint->snapshot = 0;
+	checkpoint->snapshot_length = 0;
+
+	pthread_mutex_lock(&checkpoint->lock);
+	checkpoint->status = status;
+	checkpoint->finished = 1;
+	pthread_mutex_unlock(&checkpoint->lock);
+	return 0;
+}
+
+/* Begins a new checkpoint, returning a stream into which the
+   snapshot should be saved uncompressed.  If a previous checkpoint
+   is still being written then this waits for it to finish */
+FILE * gpr_checkpoint_begin(gpr_checkpoint * checkpoint)
+{
+	gpr_checkpoint_wait(checkpoint);
+	if (checkpoint->stream != 0) {
+		fclose(checkpoint->stream);
+		if (checkpoint->snapshot != 0) free(checkpoint->snapshot);
+	}
+	checkpoint->snapshot = 0;
+	checkpoint->snapshot_length = 0;
+	checkpoint->stream = open_memstream(&checkpoint->snapshot,
+										&checkpoint->snapshot_length);
+	return checkpoint->stream;
+}
+
+/* Finishes taking a snapshot and starts writing it to the given file
+   in the background.  If the snapshot could not be taken then it is
+   discarded and the existing checkpoint file is left unchanged.
+   Returns zero if the writer was started */
+int gpr_checkpoint_end(gpr_checkpoint * checkpoint, int snapshot_status,
+					   char * filename, int compress)
+{
+	if (checkpoint->stream == 0) return -1;
+	if ((fclose(checkpoint->stream) != 0) || (snapshot_status != 0) ||
+		(strlen(filename) >= 256)) {
+		snapshot_status = -1;
+	}
+	checkpoint->stream = 0;
+	if (snapshot_status != 0) {
+		if (checkpoint->snapshot != 0) free(checkpoint->snapshot);
+		checkpoint->snapshot = 0;
+		checkpoint->status = -1;
+		return -1;
+	}
+
+	sprintf(checkpoint->filename,"%s",filename);
+	checkpoint->compress = compress;
+	checkpoint->status = 0;
+	checkpoint->finished = 0;
+	if (pthread_create(&checkpoint->thread, NULL,
+					   gpr_checkpoint_write, (void*)checkpoint) != 0) {
+		/* write the checkpoint in the foreground instead */
+		gpr_checkpoint_write((void*)checkpoint);
+		return checkpoint->status;
+	}
+	checkpoint->running = 1;
+	return 0;
+}
+
+/* returns non-zero if no checkpoint is currently being written */
+int gpr_checkpoint_done(gpr_checkpoint * checkpoint)
+{
+	int finished;
+
+	if (checkpoint->running == 0) return 1;
+	pthread_mutex_lock(&checkpoint->lock);
+	finished = checkpoint->finished;
+	pthread_mutex_unlock(&checkpoint->lock);
+	return finished;
+}
+
+/* Waits for any checkpoint being written to finish.
+   Returns zero if the last checkpoint was written successfully */
+int gpr_checkpoint_wait(gpr_checkpoint * checkpoint)
+{
+	if (checkpoint->running != 0) {
+		pthread_join(checkpoint->thread, NULL);
+		checkpoint->running = 0;
+	}
+	return checkpoint->status;
+}
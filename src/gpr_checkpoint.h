@@ -0,0 +1,74 @@
+/*
+ libgpr - a library for genetic programming
+ Copyright (C) 2013  Bob Mottram <bob@robotics.uk.to>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef GPR_CHECKPOINT_H
+#define GPR_CHECKPOINT_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "globals.h"
+#include "gpr_binary.h"
+
+/* A checkpoint which is written to disk in the background.
+   A snapshot of the system is first encoded into memory, then
+   compressed and written to a temporary file by a separate thread.
+   The temporary file is renamed over the checkpoint only once it
+   has been completely written, so the checkpoint on disk is always
+   consistent */
+struct gpr_checkpt {
+	/* the in-memory snapshot being written */
+	FILE * stream;
+	char * snapshot;
+	size_t snapshot_length;
+	/* where the checkpoint is written */
+	char filename[256];
+	int compress;
+	/* the background writer */
+	pthread_t thread;
+	/* non-zero while a writer thread has not yet been joined */
+	int running;
+	/* set by the writer when it has finished */
+	int finished;
+	pthread_mutex_t lock;
+	/* zero if the last checkpoint was written successfully */
+	int status;
+};
+typedef struct gpr_checkpt gpr_checkpoint;
+
+void gpr_checkpoint_init(gpr_checkpoint * checkpoint);
+void gpr_checkpoint_free(gpr_checkpoint * checkpoint);
+FILE * gpr_checkpoint_begin(gpr_checkpoint * checkpoint);
+int gpr_checkpoint_end(gpr_checkpoint * checkpoint, int snapshot_status,
+					   char * filename, int compress);
+int gpr_checkpoint_done(gpr_checkpoint * checkpoint);
+int gpr_checkpoint_wait(gpr_checkpoint * checkpoint);
+
+#endif
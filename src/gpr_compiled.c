@@ -0,0 +1,1121 @@
+/*
+ libgpr - a library for genetic programming
+ Copyright (C) 2013  Bob Mottram <bob@robotics.uk.to>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "gpr_compiled.h"
+
+/* appends an instruction and returns its position */
+static int gpr_compiled_emit(gpr_compiled * program,
+							 int function_type, int argc,
+							 float value)
+{
+	gpr_instruction * instr;
+
+	if (program->length >= program->max_length) {
+		program->max_length = program->max_length*2 + 16;
+		program->code =
+			(gpr_instruction*)realloc(program->code,
+									  program->max_length*
+									  sizeof(gpr_instruction));
+#ifdef DEBUG
+		assert(program->code!=0);
+#endif
+	}
+	instr = &program->code[program->length];
+	instr->function_type = (unsigned short)function_type;
+	instr->argc = (unsigned short)argc;
+	instr->value = value;
+	instr->jump = 0;
+	return program->length++;
+}
+
+/* keeps track of the maximum stack depth during compilation */
+static void gpr_compiled_stack(int change, int * sp, int * max_sp)
+{
+	*sp += change;
+	if (*sp > *max_sp) *max_sp = *sp;
+}
+
+/* returns non-zero if the function type takes a variable
+   number of arguments which are all evaluated in order */
+static int gpr_compiled_nary(int function_type)
+{
+	switch(function_type) {
+	case GPR_FUNCTION_NEGATE:
+	case GPR_FUNCTION_AVERAGE:
+	case GPR_FUNCTION_POW:
+	case GPR_FUNCTION_EXP:
+	case GPR_FUNCTION_SIGMOID:
+	case GPR_FUNCTION_MIN:
+	case GPR_FUNCTION_MAX:
+	case GPR_FUNCTION_ADD:
+	case GPR_FUNCTION_SUBTRACT:
+	case GPR_FUNCTION_MULTIPLY:
+	case GPR_FUNCTION_DIVIDE:
+	case GPR_FUNCTION_MODULUS:
+	case GPR_FUNCTION_FLOOR:
+	case GPR_FUNCTION_SQUARE_ROOT:
+	case GPR_FUNCTION_ABS:
+	case GPR_FUNCTION_SINE:
+	case GPR_FUNCTION_ARCSINE:
+	case GPR_FUNCTION_COSINE:
+	case GPR_FUNCTION_ARCCOSINE:
+	case GPR_FUNCTION_GREATER_THAN:
+	case GPR_FUNCTION_LESS_THAN:
+	case GPR_FUNCTION_EQUALS:
+	case GPR_FUNCTION_AND:
+	case GPR_FUNCTION_OR:
+	case GPR_FUNCTION_XOR:
+	case GPR_FUNCTION_NOT:
+	case GPR_FUNCTION_NOOP1:
+	case GPR_FUNCTION_NOOP2:
+	case GPR_FUNCTION_NOOP3:
+	case GPR_FUNCTION_NOOP4:
+	case GPR_FUNCTION_DEFUN:
+	case GPR_FUNCTION_MAIN:
+	case GPR_FUNCTION_PROGRAM: {
+		return 1;
+	}
+	}
+	return 0;
+}
+
+/* flattens the given tree into postfix order.
+   The order in which arguments are evaluated is the same
+   as within gpr_run */
+static void gpr_compile_node(gpr_function * f, gpr_state * state,
+							 gpr_compiled * program,
+							 int * sp, int * max_sp)
+{
+	int i, argc, ADF_index, enter;
+
+	if (f == 0) {
+		gpr_compiled_emit(program, GPR_FUNCTION_VALUE, 0, 0);
+		gpr_compiled_stack(1, sp, max_sp);
+		return;
+	}
+
+	switch(f->function_type) {
+	case GPR_FUNCTION_VALUE:
+	case GPR_FUNCTION_ARG: {
+		gpr_compiled_emit(program, f->function_type, 0, f->value);
+		gpr_compiled_stack(1, sp, max_sp);
+		return;
+	}
+	case GPR_FUNCTION_WEIGHT:
+	case GPR_FUNCTION_DATA_POP: {
+		gpr_compile_node(f->argv[0], state, program, sp, max_sp);
+		gpr_compiled_emit(program, f->function_type, 1, f->value);
+		return;
+	}
+	case GPR_FUNCTION_CUSTOM:
+	case GPR_FUNCTION_SET:
+	case GPR_FUNCTION_GET:
+	case GPR_FUNCTION_DATA_PUSH:
+	case GPR_FUNCTION_DATA_GET: {
+		gpr_compile_node(f->argv[0], state, program, sp, max_sp);
+		gpr_compile_node(f->argv[1], state, program, sp, max_sp);
+		gpr_compiled_emit(program, f->function_type, 2, f->value);
+		gpr_compiled_stack(-1, sp, max_sp);
+		return;
+	}
+	case GPR_FUNCTION_DATA_SET: {
+		/* the first argument is used for both index and value */
+		gpr_compile_node(f->argv[0], state, program, sp, max_sp);
+		gpr_compile_node(f->argv[0], state, program, sp, max_sp);
+		gpr_compiled_emit(program, f->function_type, 2, f->value);
+		gpr_compiled_stack(-1, sp, max_sp);
+		return;
+	}
+	case GPR_FUNCTION_ADF: {
+		ADF_index = abs(((int)f->value))%GPR_MAX_ARGUMENTS;
+		if (state->ADF[ADF_index] == 0) {
+			/* calls to undefined ADFs return zero */
+			gpr_compiled_emit(program, GPR_FUNCTION_VALUE, 0, 0);
+			gpr_compiled_stack(1, sp, max_sp);
+			return;
+		}
+		enter = gpr_compiled_emit(program, GPR_OP_ADF_ENTER,
+								  0, ADF_index);
+		for (i = 0; i < f->argc; i++) {
+			gpr_compile_node(f->argv[i], state, program, sp, max_sp);
+			gpr_compiled_emit(program, GPR_OP_ADF_ARG, 1, i);
+			gpr_compiled_stack(-1, sp, max_sp);
+		}
+		gpr_compiled_emit(program, GPR_OP_ADF_CALL, 0, ADF_index);
+		gpr_compiled_stack(1, sp, max_sp);
+		/* skip to the instruction following the call */
+		program->code[enter].jump = program->length - 1 - enter;
+		return;
+	}
+	}
+
+	if (gpr_compiled_nary(f->function_type) == 0) {
+		/* unknown functions return zero */
+		gpr_compiled_emit(program, GPR_FUNCTION_VALUE, 0, 0);
+		gpr_compiled_stack(1, sp, max_sp);
+		return;
+	}
+
+	argc = f->argc;
+	if ((argc < 1) &&
+		((f->function_type == GPR_FUNCTION_SUBTRACT) ||
+		 (f->function_type == GPR_FUNCTION_MULTIPLY))) {
+		/* the first argument is always evaluated */
+		argc = 1;
+	}
+	for (i = 0; i < argc; i++) {
+		gpr_compile_node(f->argv[i], state, program, sp, max_sp);
+	}
+	gpr_compiled_emit(program, f->function_type, argc, f->value);
+	gpr_compiled_stack(1 - argc, sp, max_sp);
+}
+
+/* compiles a segment of the program and returns
+   the maximum stack depth */
+static int gpr_compile_segment(gpr_function * f, gpr_state * state,
+							   gpr_compiled * program,
+							   int * start, int * end)
+{
+	int sp = 0, max_sp = 0;
+
+	*start = program->length;
+	if (f != 0) {
+		gpr_compile_node(f, state, program, &sp, &max_sp);
+	}
+	*end = program->length;
+	return max_sp;
+}
+
+/* Compiles the given program into a flat array of instructions.
+   The compiled program remains valid until the tree or the
+   ADFs within the state are changed.  It isn't updated when the
+   tree is mutated, crossed over or simplified, so callers must
+   compile it again after any such change */
+void gpr_compile(gpr_function * f, gpr_state * state,
+				 gpr_compiled * program)
+{
+	int i, main_stack, ADF_stack = 0, max_sp;
+
+	program->length = 0;
+	program->max_length = 0;
+	program->code = 0;
+	program->hash = gpr_hash(f);
+
+	/* the main program */
+	if (state->ADF[0] == 0) {
+		main_stack =
+			gpr_compile_segment(f, state, program,
+								&program->start, &program->end);
+	}
+	else {
+		main_stack =
+			gpr_compile_segment(f->argv[f->argc-1], state, program,
+								&program->start, &program->end);
+	}
+
+	/* automatically defined functions */
+	for (i = 0; i < GPR_MAX_ARGUMENTS; i++) {
+		max_sp =
+			gpr_compile_segment(state->ADF[i], state, program,
+								&program->ADF_start[i],
+								&program->ADF_end[i]);
+		if (max_sp > ADF_stack) ADF_stack = max_sp;
+	}
+
+	/* nested ADF calls share the same stack */
+	program->stack_size =
+		main_stack + (ADF_stack*GPR_MAX_CALL_DEPTH) + 1;
+	program->stack =
+		(float*)malloc(program->stack_size*sizeof(float));
+#ifdef DEBUG
+	assert(program->stack!=0);
+#endif
+}
+
+/* deallocate memory */
+void gpr_free_compiled(gpr_compiled * program)
+{
+	if (program->code != 0) {
+		free(program->code);
+		program->code = 0;
+	}
+	if (program->stack != 0) {
+		free(program->stack);
+		program->stack = 0;
+	}
+	program->length = 0;
+	program->max_length = 0;
+}
+
+/* returns the sum of a range of stack values */
+static float gpr_compiled_sum(float * v, int start, int end)
+{
+	int i;
+	float sum = 0;
+
+	for (i = start; i < end; i++) {
+		sum += v[i];
+	}
+	return sum;
+}
+
+/* runs a range of instructions and returns the result */
+static float gpr_run_segment(gpr_compiled * program,
+							 int start, int end,
+							 float * stack,
+							 gpr_state * state,
+							 int call_depth,
+							 float (*custom_function)
+							 (float,float,float))
+{
+	int pc, sp = 0, i, argc, itt, ADF_index;
+	float v=0, v1, v2, * args;
+	gpr_instruction * instr;
+
+	for (pc = start; pc < end; pc++) {
+		instr = &program->code[pc];
+		argc = instr->argc;
+		args = &stack[sp - argc];
+
+		switch(instr->function_type) {
+		case GPR_FUNCTION_VALUE: {
+			v = instr->value;
+			break;
+		}
+		case GPR_FUNCTION_ARG: {
+			v = state->temp_ADF_arg[call_depth][abs((int)instr->value)];
+			break;
+		}
+		case GPR_FUNCTION_CUSTOM: {
+			v = (*custom_function)(instr->value, args[0], args[1]);
+			break;
+		}
+		case GPR_FUNCTION_NEGATE: {
+			v = gpr_compiled_sum(args, 0, argc);
+			v = (is_nan(v)==0) ? -v : 0;
+			break;
+		}
+		case GPR_FUNCTION_AVERAGE: {
+			v1 = gpr_compiled_sum(args, 0, argc);
+			v = (is_nan(v1)==0) ? v1 / argc : 0;
+			break;
+		}
+		case GPR_FUNCTION_POW: {
+			v1 = gpr_compiled_sum(args, 0, argc/2);
+			v2 = gpr_compiled_sum(args, argc/2, argc);
+			itt = 2+(abs((int)v2)%3);
+			v = v1;
+			for (i = 0; i < itt; i++) v *= v1;
+			if (is_nan(v)!=0) v = 0;
+			break;
+		}
+		case GPR_FUNCTION_EXP: {
+			v = (float)exp(gpr_compiled_sum(args, 0, argc));
+			if (is_nan(v)!=0) v = 0;
+			break;
+		}
+		case GPR_FUNCTION_SIGMOID: {
+			v = 1.0f / (1.0f + exp(gpr_compiled_sum(args, 0, argc)));
+			break;
+		}
+		case GPR_FUNCTION_MIN: {
+			v = 0;
+			for (i = 0; i < argc; i++) {
+				if ((i == 0) || (args[i] < v)) v = args[i];
+			}
+			break;
+		}
+		case GPR_FUNCTION_MAX: {
+			v = 0;
+			for (i = 0; i < argc; i++) {
+				if ((i == 0) || (args[i] > v)) v = args[i];
+			}
+			break;
+		}
+		case GPR_FUNCTION_DEFUN:
+		case GPR_FUNCTION_ADD: {
+			v = gpr_compiled_sum(args, 0, argc);
+			if (is_nan(v)!=0) v = 0;
+			break;
+		}
+		case GPR_FUNCTION_SUBTRACT: {
+			v = args[0];
+			for (i = 1; i < argc; i++) v -= args[i];
+			if (is_nan(v)!=0) v = 0;
+			break;
+		}
+		case GPR_FUNCTION_MULTIPLY: {
+			v = args[0];
+			for (i = 1; i < argc; i++) v *= args[i];
+			if (is_nan(v)!=0) v = 0;
+			break;
+		}
+		case GPR_FUNCTION_WEIGHT: {
+			v = args[0] * instr->value;
+			if (is_nan(v)!=0) v = 0;
+			break;
+		}
+		case GPR_FUNCTION_DIVIDE: {
+			v1 = gpr_compiled_sum(args, 0, argc/2);
+			v2 = gpr_compiled_sum(args, argc/2, argc);
+			v = 0;
+			if (fabs(v2) > 0.01f) {
+				v = v1 / v2;
+				if (is_nan(v)!=0) v = 0;
+			}
+			break;
+		}
+		case GPR_FUNCTION_MODULUS: {
+			v1 = gpr_compiled_sum(args, 0, argc/2);
+			v2 = gpr_compiled_sum(args, argc/2, argc);
+			v = 0;
+			if (fabs(v2) > 0.01f) {
+				v = fmod(v1, v2);
+				if (is_nan(v)!=0) v = 0;
+			}
+			break;
+		}
+		case GPR_FUNCTION_FLOOR: {
+			v = floor(gpr_compiled_sum(args, 0, argc));
+			if (is_nan(v)!=0) v = 0;
+			break;
+		}
+		case GPR_FUNCTION_ABS: {
+			v = fabs(gpr_compiled_sum(args, 0, argc));
+			if (is_nan(v)!=0) v = 0;
+			break;
+		}
+		case GPR_FUNCTION_SQUARE_ROOT: {
+			v = fabs(gpr_compiled_sum(args, 0, argc));
+			if (is_nan(v)!=0) v = 0;
+			v = (float)sqrt(v);
+			if (is_nan(v)!=0) v = 0;
+			break;
+		}
+		case GPR_FUNCTION_SINE: {
+			v = (float)sin(gpr_compiled_sum(args, 0, argc));
+			if (is_nan(v)!=0) v = 0;
+			break;
+		}
+		case GPR_FUNCTION_ARCSINE: {
+			v = (float)asin(gpr_compiled_sum(args, 0, argc));
+			if (is_nan(v)!=0) v = 0;
+			break;
+		}
+		case GPR_FUNCTION_COSINE: {
+			v = (float)cos(gpr_compiled_sum(args, 0, argc));
+			if (is_nan(v)!=0) v = 0;
+			break;
+		}
+		case GPR_FUNCTION_ARCCOSINE: {
+			v = (float)acos(gpr_compiled_sum(args, 0, argc));
+			if (is_nan(v)!=0) v = 0;
+			break;
+		}
+		case GPR_FUNCTION_GREATER_THAN: {
+			v1 = gpr_compiled_sum(args, 0, argc/2);
+			v2 = gpr_compiled_sum(args, argc/2, argc);
+			v = (v1 > v2) ? GPR_TRUE : GPR_FALSE;
+			break;
+		}
+		case GPR_FUNCTION_LESS_THAN: {
+			v1 = gpr_compiled_sum(args, 0, argc/2);
+			v2 = gpr_compiled_sum(args, argc/2, argc);
+			v = (v1 < v2) ? GPR_TRUE : GPR_FALSE;
+			break;
+		}
+		case GPR_FUNCTION_EQUALS: {
+			v1 = gpr_compiled_sum(args, 0, argc/2);
+			v2 = gpr_compiled_sum(args, argc/2, argc);
+			v = ((int)v1 == (int)v2) ? GPR_TRUE : GPR_FALSE;
+			break;
+		}
+		case GPR_FUNCTION_AND: {
+			v1 = gpr_compiled_sum(args, 0, argc/2);
+			v2 = gpr_compiled_sum(args, argc/2, argc);
+			v = ((v1>0) && (v2>0)) ? GPR_TRUE : GPR_FALSE;
+			break;
+		}
+		case GPR_FUNCTION_OR: {
+			v1 = gpr_compiled_sum(args, 0, argc/2);
+			v2 = gpr_compiled_sum(args, argc/2, argc);
+			v = ((v1>0) || (v2>0)) ? GPR_TRUE : GPR_FALSE;
+			break;
+		}
+		case GPR_FUNCTION_XOR: {
+			v1 = gpr_compiled_sum(args, 0, argc/2);
+			v2 = gpr_compiled_sum(args, argc/2, argc);
+			v = ((v1>0) != (v2>0)) ? GPR_TRUE : GPR_FALSE;
+			break;
+		}
+		case GPR_FUNCTION_NOT: {
+			v1 = gpr_compiled_sum(args, 0, argc/2);
+			v2 = gpr_compiled_sum(args, argc/2, argc);
+			v = (((int)v1) != ((int)v2)) ? GPR_TRUE : GPR_FALSE;
+			break;
+		}
+		case GPR_FUNCTION_DATA_PUSH: {
+			v = gpr_state_push(args[0], args[1], state);
+			break;
+		}
+		case GPR_FUNCTION_DATA_POP: {
+			v = gpr_state_pop(args[0], state);
+			break;
+		}
+		case GPR_FUNCTION_DATA_GET: {
+			v = gpr_state_data_get(args[0], args[1], state);
+			break;
+		}
+		case GPR_FUNCTION_DATA_SET: {
+			v = gpr_state_data_set(args[0], args[1], state);
+			break;
+		}
+		case GPR_FUNCTION_SET: {
+			v = gpr_state_store(args[0], args[1], state);
+			break;
+		}
+		case GPR_FUNCTION_GET: {
+			v = gpr_state_fetch(args[0], args[1], state);
+			break;
+		}
+		case GPR_OP_ADF_ENTER: {
+			if (call_depth >= GPR_MAX_CALL_DEPTH-1) {
+				/* too deep, so don't evaluate the arguments */
+				stack[sp++] = 0;
+				pc += instr->jump;
+			}
+			else {
+				call_depth++;
+			}
+			continue;
+		}
+		case GPR_OP_ADF_ARG: {
+			sp--;
+			state->temp_ADF_arg[call_depth][(int)instr->value] =
+				stack[sp];
+			continue;
+		}
+		case GPR_OP_ADF_CALL: {
+			ADF_index = (int)instr->value;
+			stack[sp] =
+				gpr_run_segment(program,
+								program->ADF_start[ADF_index],
+								program->ADF_end[ADF_index],
+								&stack[sp], state, call_depth,
+								(*custom_function));
+			sp++;
+			call_depth--;
+			continue;
+		}
+		default: {
+			/* no operation */
+			v = 0;
+		}
+		}
+
+		/* replace the arguments with the result */
+		sp -= argc;
+		stack[sp++] = v;
+	}
+
+	if (sp > 0) return stack[sp-1];
+	return 0;
+}
+
+/* Runs a compiled program.
+   This gives the same result as calling gpr_run on the original tree,
+   provided that the tree hasn't changed since it was compiled */
+float gpr_run_compiled(gpr_compiled * program, gpr_state * state,
+					   float (*custom_function)(float,float,float))
+{
+	return gpr_run_segment(program, program->start, program->end,
+						   program->stack, state, 0,
+						   (*custom_function));
+}
+
+/* Returns non-zero if the given tree has changed since the program
+   was compiled from it, in which case it needs to be compiled again */
+int gpr_compiled_changed(gpr_compiled * program, gpr_function * f)
+{
+	return (gpr_hash(f) != program->hash);
+}
+
+/* Returns non-zero if the compiled program can be evaluated
+   over many samples at once.  Programs which change the state,
+   call a custom function or pass ADF arguments which depend upon
+   earlier runs must be evaluated one sample at a time */
+static int gpr_compiled_batchable(gpr_compiled * program)
+{
+	int pc, i, index, argc, args_end = 0;
+	int start[GPR_MAX_ARGUMENTS+1], end[GPR_MAX_ARGUMENTS+1];
+	int min_argc[GPR_MAX_ARGUMENTS], max_arg[GPR_MAX_ARGUMENTS];
+	gpr_instruction * instr;
+
+	start[0] = program->start;
+	end[0] = program->end;
+	for (i = 0; i < GPR_MAX_ARGUMENTS; i++) {
+		start[i+1] = program->ADF_start[i];
+		end[i+1] = program->ADF_end[i];
+		min_argc[i] = GPR_MAX_ARGUMENTS;
+		max_arg[i] = -1;
+	}
+
+	for (i = 0; i <= GPR_MAX_ARGUMENTS; i++) {
+		args_end = 0;
+		for (pc = start[i]; pc < end[i]; pc++) {
+			instr = &program->code[pc];
+			switch(instr->function_type) {
+			case GPR_FUNCTION_SET:
+			case GPR_FUNCTION_CUSTOM:
+			case GPR_FUNCTION_DATA_PUSH:
+			case GPR_FUNCTION_DATA_POP:
+			case GPR_FUNCTION_DATA_GET:
+			case GPR_FUNCTION_DATA_SET: {
+				return 0;
+			}
+			case GPR_FUNCTION_ARG: {
+				/* arguments read while evaluating the
+				   arguments of another ADF call */
+				if (pc < args_end) return 0;
+				if (i > 0) {
+					index = abs((int)instr->value);
+					if (index > max_arg[i-1]) max_arg[i-1] = index;
+				}
+				break;
+			}
+			case GPR_OP_ADF_ENTER: {
+				if (pc + instr->jump > args_end) {
+					args_end = pc + instr->jump;
+				}
+				/* the last argument is stored just before the call */
+				argc = 0;
+				if (program->code[pc + instr->jump - 1].function_type ==
+					GPR_OP_ADF_ARG) {
+					argc =
+						(int)program->code[pc + instr->jump - 1].value + 1;
+				}
+				index = (int)instr->value;
+				if (argc < min_argc[index]) min_argc[index] = argc;
+				break;
+			}
+			}
+		}
+	}
+
+	/* ADFs should only read arguments which were passed to them */
+	for (i = 0; i < GPR_MAX_ARGUMENTS; i++) {
+		if (max_arg[i] >= min_argc[i]) return 0;
+	}
+	return 1;
+}
+
+/* sums a range of stack vectors */
+static void gpr_batch_sum(float * args, int start, int end, float * v)
+{
+	int i, lane;
+
+	for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+		v[lane] = 0;
+	}
+	for (i = start; i < end; i++) {
+		for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+			v[lane] += args[i*GPR_BATCH_LANES + lane];
+		}
+	}
+}
+
+/* version of gpr_state_fetch in which sensor values
+   are obtained from a block of samples */
+static float gpr_batch_fetch(float v1, float v2, gpr_state * state,
+							 float * sensors, int no_of_samples,
+							 int sample)
+{
+	int oracle_type = (int)v1 % GPR_ORACLES;
+	int index, v = abs((int)v2);
+
+	switch(oracle_type) {
+	case GPR_ORACLE_REGISTER: {
+		if (state->no_of_registers > 0) {
+			index = v % state->no_of_registers;
+			return state->registers[index];
+		}
+	}
+	case GPR_ORACLE_SENSOR: {
+		if (state->no_of_sensors > 0) {
+			index = v % state->no_of_sensors;
+			return sensors[index*no_of_samples + sample];
+		}
+	}
+	case GPR_ORACLE_ACTUATOR: {
+		if (state->no_of_actuators > 0) {
+			index = v % state->no_of_actuators;
+			return state->actuators[index];
+		}
+	}
+	}
+	return 0;
+}
+
+/* Runs a range of instructions over a number of samples.
+   Each stack entry is a vector of GPR_BATCH_LANES values */
+static void gpr_run_segment_batch(gpr_compiled * program,
+								  int start, int end,
+								  float * stack,
+								  float temp_ADF_arg[GPR_MAX_CALL_DEPTH]
+								  [GPR_MAX_ARGUMENTS][GPR_BATCH_LANES],
+								  gpr_state * state,
+								  int call_depth,
+								  float * sensors, int no_of_samples,
+								  int sample, int lanes,
+								  float * result)
+{
+	int pc, sp = 0, i, lane, argc, itt, index;
+	float v[GPR_BATCH_LANES], v1[GPR_BATCH_LANES], v2[GPR_BATCH_LANES];
+	float * args, x;
+	gpr_instruction * instr;
+
+	for (pc = start; pc < end; pc++) {
+		instr = &program->code[pc];
+		argc = instr->argc;
+		args = &stack[(sp - argc)*GPR_BATCH_LANES];
+
+		switch(instr->function_type) {
+		case GPR_FUNCTION_VALUE: {
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				v[lane] = instr->value;
+			}
+			break;
+		}
+		case GPR_FUNCTION_ARG: {
+			index = abs((int)instr->value);
+			memcpy((void*)v, (void*)temp_ADF_arg[call_depth][index],
+				   GPR_BATCH_LANES*sizeof(float));
+			break;
+		}
+		case GPR_FUNCTION_NEGATE: {
+			gpr_batch_sum(args, 0, argc, v);
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				v[lane] = (v[lane] == v[lane]) ? -v[lane] : 0;
+			}
+			break;
+		}
+		case GPR_FUNCTION_AVERAGE: {
+			gpr_batch_sum(args, 0, argc, v);
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				v[lane] = (v[lane] == v[lane]) ? v[lane] / argc : 0;
+			}
+			break;
+		}
+		case GPR_FUNCTION_POW: {
+			gpr_batch_sum(args, 0, argc/2, v1);
+			gpr_batch_sum(args, argc/2, argc, v2);
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				itt = 2+(abs((int)v2[lane])%3);
+				x = v1[lane];
+				for (i = 0; i < itt; i++) x *= v1[lane];
+				v[lane] = (x == x) ? x : 0;
+			}
+			break;
+		}
+		case GPR_FUNCTION_EXP: {
+			gpr_batch_sum(args, 0, argc, v);
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				x = (float)exp(v[lane]);
+				v[lane] = (x == x) ? x : 0;
+			}
+			break;
+		}
+		case GPR_FUNCTION_SIGMOID: {
+			gpr_batch_sum(args, 0, argc, v);
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				v[lane] = 1.0f / (1.0f + exp(v[lane]));
+			}
+			break;
+		}
+		case GPR_FUNCTION_MIN: {
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				v[lane] = 0;
+			}
+			for (i = 0; i < argc; i++) {
+				for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+					x = args[i*GPR_BATCH_LANES + lane];
+					if ((i == 0) || (x < v[lane])) v[lane] = x;
+				}
+			}
+			break;
+		}
+		case GPR_FUNCTION_MAX: {
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				v[lane] = 0;
+			}
+			for (i = 0; i < argc; i++) {
+				for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+					x = args[i*GPR_BATCH_LANES + lane];
+					if ((i == 0) || (x > v[lane])) v[lane] = x;
+				}
+			}
+			break;
+		}
+		case GPR_FUNCTION_DEFUN:
+		case GPR_FUNCTION_ADD: {
+			gpr_batch_sum(args, 0, argc, v);
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				v[lane] = (v[lane] == v[lane]) ? v[lane] : 0;
+			}
+			break;
+		}
+		case GPR_FUNCTION_SUBTRACT: {
+			memcpy((void*)v, (void*)args, GPR_BATCH_LANES*sizeof(float));
+			for (i = 1; i < argc; i++) {
+				for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+					v[lane] -= args[i*GPR_BATCH_LANES + lane];
+				}
+			}
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				v[lane] = (v[lane] == v[lane]) ? v[lane] : 0;
+			}
+			break;
+		}
+		case GPR_FUNCTION_MULTIPLY: {
+			memcpy((void*)v, (void*)args, GPR_BATCH_LANES*sizeof(float));
+			for (i = 1; i < argc; i++) {
+				for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+					v[lane] *= args[i*GPR_BATCH_LANES + lane];
+				}
+			}
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				v[lane] = (v[lane] == v[lane]) ? v[lane] : 0;
+			}
+			break;
+		}
+		case GPR_FUNCTION_WEIGHT: {
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				x = args[lane] * instr->value;
+				v[lane] = (x == x) ? x : 0;
+			}
+			break;
+		}
+		case GPR_FUNCTION_DIVIDE: {
+			gpr_batch_sum(args, 0, argc/2, v1);
+			gpr_batch_sum(args, argc/2, argc, v2);
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				v[lane] = 0;
+				if (fabs(v2[lane]) > 0.01f) {
+					x = v1[lane] / v2[lane];
+					v[lane] = (x == x) ? x : 0;
+				}
+			}
+			break;
+		}
+		case GPR_FUNCTION_MODULUS: {
+			gpr_batch_sum(args, 0, argc/2, v1);
+			gpr_batch_sum(args, argc/2, argc, v2);
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				v[lane] = 0;
+				if (fabs(v2[lane]) > 0.01f) {
+					x = fmod(v1[lane], v2[lane]);
+					v[lane] = (x == x) ? x : 0;
+				}
+			}
+			break;
+		}
+		case GPR_FUNCTION_FLOOR: {
+			gpr_batch_sum(args, 0, argc, v);
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				x = floor(v[lane]);
+				v[lane] = (x == x) ? x : 0;
+			}
+			break;
+		}
+		case GPR_FUNCTION_ABS: {
+			gpr_batch_sum(args, 0, argc, v);
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				x = fabs(v[lane]);
+				v[lane] = (x == x) ? x : 0;
+			}
+			break;
+		}
+		case GPR_FUNCTION_SQUARE_ROOT: {
+			gpr_batch_sum(args, 0, argc, v);
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				x = fabs(v[lane]);
+				x = (x == x) ? x : 0;
+				x = (float)sqrt(x);
+				v[lane] = (x == x) ? x : 0;
+			}
+			break;
+		}
+		case GPR_FUNCTION_SINE: {
+			gpr_batch_sum(args, 0, argc, v);
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				x = (float)sin(v[lane]);
+				v[lane] = (x == x) ? x : 0;
+			}
+			break;
+		}
+		case GPR_FUNCTION_ARCSINE: {
+			gpr_batch_sum(args, 0, argc, v);
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				x = (float)asin(v[lane]);
+				v[lane] = (x == x) ? x : 0;
+			}
+			break;
+		}
+		case GPR_FUNCTION_COSINE: {
+			gpr_batch_sum(args, 0, argc, v);
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				x = (float)cos(v[lane]);
+				v[lane] = (x == x) ? x : 0;
+			}
+			break;
+		}
+		case GPR_FUNCTION_ARCCOSINE: {
+			gpr_batch_sum(args, 0, argc, v);
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				x = (float)acos(v[lane]);
+				v[lane] = (x == x) ? x : 0;
+			}
+			break;
+		}
+		case GPR_FUNCTION_GREATER_THAN: {
+			gpr_batch_sum(args, 0, argc/2, v1);
+			gpr_batch_sum(args, argc/2, argc, v2);
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				v[lane] = (v1[lane] > v2[lane]) ? GPR_TRUE : GPR_FALSE;
+			}
+			break;
+		}
+		case GPR_FUNCTION_LESS_THAN: {
+			gpr_batch_sum(args, 0, argc/2, v1);
+			gpr_batch_sum(args, argc/2, argc, v2);
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				v[lane] = (v1[lane] < v2[lane]) ? GPR_TRUE : GPR_FALSE;
+			}
+			break;
+		}
+		case GPR_FUNCTION_EQUALS: {
+			gpr_batch_sum(args, 0, argc/2, v1);
+			gpr_batch_sum(args, argc/2, argc, v2);
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				v[lane] = ((int)v1[lane] == (int)v2[lane]) ?
+					GPR_TRUE : GPR_FALSE;
+			}
+			break;
+		}
+		case GPR_FUNCTION_AND: {
+			gpr_batch_sum(args, 0, argc/2, v1);
+			gpr_batch_sum(args, argc/2, argc, v2);
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				v[lane] = ((v1[lane]>0) && (v2[lane]>0)) ?
+					GPR_TRUE : GPR_FALSE;
+			}
+			break;
+		}
+		case GPR_FUNCTION_OR: {
+			gpr_batch_sum(args, 0, argc/2, v1);
+			gpr_batch_sum(args, argc/2, argc, v2);
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				v[lane] = ((v1[lane]>0) || (v2[lane]>0)) ?
+					GPR_TRUE : GPR_FALSE;
+			}
+			break;
+		}
+		case GPR_FUNCTION_XOR: {
+			gpr_batch_sum(args, 0, argc/2, v1);
+			gpr_batch_sum(args, argc/2, argc, v2);
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				v[lane] = ((v1[lane]>0) != (v2[lane]>0)) ?
+					GPR_TRUE : GPR_FALSE;
+			}
+			break;
+		}
+		case GPR_FUNCTION_NOT: {
+			gpr_batch_sum(args, 0, argc/2, v1);
+			gpr_batch_sum(args, argc/2, argc, v2);
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				v[lane] = ((int)v1[lane] != (int)v2[lane]) ?
+					GPR_TRUE : GPR_FALSE;
+			}
+			break;
+		}
+		case GPR_FUNCTION_GET: {
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				v[lane] = 0;
+			}
+			for (lane = 0; lane < lanes; lane++) {
+				v[lane] =
+					gpr_batch_fetch(args[lane],
+									args[GPR_BATCH_LANES + lane],
+									state, sensors, no_of_samples,
+									sample + lane);
+			}
+			break;
+		}
+		case GPR_OP_ADF_ENTER: {
+			if (call_depth >= GPR_MAX_CALL_DEPTH-1) {
+				/* too deep, so don't evaluate the arguments */
+				memset((void*)&stack[sp*GPR_BATCH_LANES], '\0',
+					   GPR_BATCH_LANES*sizeof(float));
+				sp++;
+				pc += instr->jump;
+			}
+			else {
+				call_depth++;
+			}
+			continue;
+		}
+		case GPR_OP_ADF_ARG: {
+			sp--;
+			memcpy((void*)temp_ADF_arg[call_depth][(int)instr->value],
+				   (void*)&stack[sp*GPR_BATCH_LANES],
+				   GPR_BATCH_LANES*sizeof(float));
+			continue;
+		}
+		case GPR_OP_ADF_CALL: {
+			index = (int)instr->value;
+			gpr_run_segment_batch(program,
+								  program->ADF_start[index],
+								  program->ADF_end[index],
+								  &stack[(sp+1)*GPR_BATCH_LANES],
+								  temp_ADF_arg, state, call_depth,
+								  sensors, no_of_samples,
+								  sample, lanes,
+								  &stack[sp*GPR_BATCH_LANES]);
+			sp++;
+			call_depth--;
+			continue;
+		}
+		default: {
+			/* no operation */
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				v[lane] = 0;
+			}
+		}
+		}
+
+		/* replace the arguments with the result */
+		sp -= argc;
+		memcpy((void*)&stack[sp*GPR_BATCH_LANES], (void*)v,
+			   GPR_BATCH_LANES*sizeof(float));
+		sp++;
+	}
+
+	if (sp > 0) {
+		memcpy((void*)result, (void*)&stack[(sp-1)*GPR_BATCH_LANES],
+			   GPR_BATCH_LANES*sizeof(float));
+	}
+	else {
+		memset((void*)result, '\0', GPR_BATCH_LANES*sizeof(float));
+	}
+}
+
+/* Evaluates a compiled program over a number of samples.
+   Sensor values are stored column-major, such that the value of
+   sensor s for sample i is sensors[s*no_of_samples + i].
+   The result of the program for each sample is written to outputs
+   and, if not null, actuator values are written to actuators using
+   the same column-major layout.  This gives the same results as
+   calling gpr_run once for each sample in turn */
+void gpr_run_batch(gpr_compiled * program, gpr_state * state,
+				   float * sensors, int no_of_samples,
+				   float * outputs, float * actuators,
+				   float (*custom_function)(float,float,float))
+{
+	int i, j, d, lane, lanes;
+	float * stack, result[GPR_BATCH_LANES];
+	float temp_ADF_arg[GPR_MAX_CALL_DEPTH]
+		[GPR_MAX_ARGUMENTS][GPR_BATCH_LANES];
+
+	if (no_of_samples <= 0) return;
+
+	if (gpr_compiled_batchable(program) == 0) {
+		/* evaluate one sample at a time */
+		for (i = 0; i < no_of_samples; i++) {
+			for (j = 0; j < state->no_of_sensors; j++) {
+				state->sensors[j] = sensors[j*no_of_samples + i];
+			}
+			outputs[i] = gpr_run_compiled(program, state,
+										  (*custom_function));
+			if (actuators != 0) {
+				for (j = 0; j < state->no_of_actuators; j++) {
+					actuators[j*no_of_samples + i] = state->actuators[j];
+				}
+			}
+		}
+		return;
+	}
+
+	/* each nested ADF call also needs space for its result */
+	stack = (float*)malloc((program->stack_size+GPR_MAX_CALL_DEPTH)*
+						   GPR_BATCH_LANES*sizeof(float));
+#ifdef DEBUG
+	assert(stack!=0);
+#endif
+
+	/* ADF arguments begin with their current values */
+	for (d = 0; d < GPR_MAX_CALL_DEPTH; d++) {
+		for (j = 0; j < GPR_MAX_ARGUMENTS; j++) {
+			for (lane = 0; lane < GPR_BATCH_LANES; lane++) {
+				temp_ADF_arg[d][j][lane] = state->temp_ADF_arg[d][j];
+			}
+		}
+	}
+
+	for (i = 0; i < no_of_samples; i += GPR_BATCH_LANES) {
+		lanes = no_of_samples - i;
+		if (lanes > GPR_BATCH_LANES) lanes = GPR_BATCH_LANES;
+
+		gpr_run_segment_batch(program, program->start, program->end,
+							  stack, temp_ADF_arg, state, 0,
+							  sensors, no_of_samples, i, lanes,
+							  result);
+		memcpy((void*)&outputs[i], (void*)result, lanes*sizeof(float));
+	}
+
+	/* the state is left as it would be after the final sample */
+	for (d = 0; d < GPR_MAX_CALL_DEPTH; d++) {
+		for (j = 0; j < GPR_MAX_ARGUMENTS; j++) {
+			state->temp_ADF_arg[d][j] = temp_ADF_arg[d][j][lanes-1];
+		}
+	}
+	for (j = 0; j < state->no_of_sensors; j++) {
+		state->sensors[j] = sensors[j*no_of_samples + no_of_samples-1];
+	}
+
+	/* actuators can't change without SET instructions */
+	if (actuators != 0) {
+		for (j = 0; j < state->no_of_actuators; j++) {
+			for (i = 0; i < no_of_samples; i++) {
+				actuators[j*no_of_samples + i] = state->actuators[j];
+			}
+		}
+	}
+
+	free(stack);
+}
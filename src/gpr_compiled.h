@@ -0,0 +1,95 @@
+/*
+ libgpr - a library for genetic programming
+ Copyright (C) 2013  Bob Mottram <bob@robotics.uk.to>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef GPR_COMPILED_H
+#define GPR_COMPILED_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include "globals.h"
+#include "gpr.h"
+
+/* the number of samples evaluated together in batch mode */
+#define GPR_BATCH_LANES 64
+
+/* operations which only exist within compiled programs */
+enum {
+	GPR_OP_ADF_ENTER = GPR_FUNCTION_CUSTOM + 1,
+	GPR_OP_ADF_ARG,
+	GPR_OP_ADF_CALL
+};
+
+/* a single instruction within a compiled program */
+struct gpr_instr {
+	/* the type of function or compiled operation */
+	unsigned short function_type;
+	/* the number of values taken from the stack */
+	unsigned short argc;
+	/* terminal value, ADF index or argument index */
+	float value;
+	/* instructions skipped when an ADF call is too deep */
+	int jump;
+};
+typedef struct gpr_instr gpr_instruction;
+
+/* a program tree flattened into postfix order */
+struct gpr_comp {
+	/* the number of instructions */
+	int length;
+	/* the number of allocated instructions */
+	int max_length;
+	/* array of instructions */
+	gpr_instruction * code;
+	/* range of instructions for the main program */
+	int start, end;
+	/* range of instructions for each ADF */
+	int ADF_start[GPR_MAX_ARGUMENTS];
+	int ADF_end[GPR_MAX_ARGUMENTS];
+	/* stack used during evaluation */
+	int stack_size;
+	float * stack;
+	/* hash of the program tree when it was compiled */
+	unsigned long long hash;
+};
+typedef struct gpr_comp gpr_compiled;
+
+void gpr_compile(gpr_function * f, gpr_state * state,
+				 gpr_compiled * program);
+void gpr_free_compiled(gpr_compiled * program);
+float gpr_run_compiled(gpr_compiled * program, gpr_state * state,
+					   float (*custom_function)(float,float,float));
+int gpr_compiled_changed(gpr_compiled * program, gpr_function * f);
+void gpr_run_batch(gpr_compiled * program, gpr_state * state,
+				   float * sensors, int no_of_samples,
+				   float * outputs, float * actuators,
+				   float (*custom_function)(float,float,float));
+
+#endif
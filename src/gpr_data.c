@@ -29,18 +29,61 @@
 
 #include "gpr_data.h"
 
+/* returns the smallest power of two which can hold size entries */
+static unsigned int gpr_data_capacity(unsigned int size)
+{
+	unsigned int capacity = 1;
+
+	while (capacity < size) {
+		capacity <<= 1;
+	}
+	return capacity;
+}
+
+/* returns the number of values needed to store a data set
+   of the given size, including real and imaginary parts */
+unsigned int gpr_data_length(unsigned int size, unsigned int fields)
+{
+	if (size == 0) return 0;
+	return gpr_data_capacity(size)*fields*2;
+}
+
 /* create a data structure */
 void gpr_data_init(gpr_data * data,
 				   unsigned int size, unsigned int fields)
+{
+	float * block = 0;
+
+    if (size > 0) {
+		block = (float*)malloc(gpr_data_length(size, fields)*
+							   sizeof(float));
+	}
+	gpr_data_init_block(data, size, fields, block);
+	data->owner = (block != 0);
+}
+
+/* Create a data structure which uses the given block of
+   gpr_data_length(size,fields) values.  The block belongs to the
+   caller, and is not deallocated by gpr_data_free */
+void gpr_data_init_block(gpr_data * data,
+						 unsigned int size, unsigned int fields,
+						 float * block)
 {
 	data->size = size;
 	data->fields = fields;
+	data->capacity = 0;
+	data->mask = 0;
+	data->imaginary = 0;
+	if (size > 0) {
+		data->capacity = gpr_data_capacity(size);
+		data->mask = data->capacity - 1;
+		data->imaginary = &block[data->capacity*fields];
+	}
 	data->head = 0;
 	data->tail = 0;
-    if (size > 0) {
-		data->block = (float*)malloc(size*fields*2*sizeof(float));
-		gpr_data_clear(data);
-	}
+	data->block = block;
+	data->owner = 0;
+	gpr_data_clear(data);
 }
 
 /* clear the data */
@@ -48,7 +91,7 @@ void gpr_data_clear(gpr_data * data)
 {
 	if (data->size > 0) {
 		memset((void*)data->block,'\0',
-			   data->size*data->fields*2*sizeof(float));
+			   gpr_data_length(data->size, data->fields)*sizeof(float));
 	}
 }
 
@@ -56,72 +99,66 @@ void gpr_data_clear(gpr_data * data)
 /* deallocate data structure */
 void gpr_data_free(gpr_data * data)
 {
-	if (data->size > 0) {
+	if (data->owner != 0) {
 		free(data->block);
+		data->block = 0;
+		data->imaginary = 0;
+		data->owner = 0;
 	}
 }
 
+/* returns the number of entries */
+unsigned int gpr_data_entries(gpr_data * data)
+{
+	return (data->head - data->tail) & data->mask;
+}
+
 /* pushes a value to the head */
 void gpr_data_push(gpr_data * data)
 {
-	unsigned short next;
-
 	if (data->size == 0) return;
 
-	/* increment the position of the head */
-	next = data->head+1;
-	if (next >= data->size) {
-		next = 0;
-	}
-	if (next != data->tail) {
-		data->head = next;
-	}
-	else {
-		data->tail++;
-		if (data->tail >= data->size) {
-			data->tail = 0;
-		}
-		data->head = next;
+	/* if full then the oldest entry is lost */
+	if (gpr_data_entries(data) >= data->size - 1) {
+		data->tail = (data->tail + 1) & data->mask;
 	}
+	/* increment the position of the head */
+	data->head = (data->head + 1) & data->mask;
 }
 
 void gpr_data_pop(gpr_data * data)
 {
-	unsigned short next;
-
 	if (data->size == 0) return;
 
-	/* increment the position of the tail */
-	if (data->tail == data->head) return;
-	next = data->tail+1;
-	if (next >= data->size) {
-		next = 0;
-	}
-	if (next != data->head) {
-		data->tail = next;
+	/* increment the position of the tail,
+	   leaving at least one entry */
+	if (gpr_data_entries(data) > 1) {
+		data->tail = (data->tail + 1) & data->mask;
 	}
 }
 
-static unsigned short get_data_index(unsigned short size,
-									 unsigned short head,
-									 unsigned short tail,
-									 unsigned short field,
-									 unsigned short fields,
-									 unsigned short index)
+/* Returns the position of the given entry, counting from the tail.
+   Indexes beyond the number of entries wrap around.  As in earlier
+   versions an index of zero refers to the start of the block, so that
+   evolved programs behave as they did before */
+static unsigned int get_data_index(gpr_data * data,
+								   unsigned int field,
+								   unsigned int index)
 {
-	unsigned short n;
+	unsigned int entries;
 
 	if (index == 0) return 0;
-	if (head > tail) {
-		n = tail + (index % (head - tail));
-	}
-	else {
-		n = tail + (index % ((size - tail) + head));
-		if (n >= size) {
-			n -= size;
+	entries = gpr_data_entries(data);
+	if (index >= entries) {
+		if ((entries & (entries - 1)) == 0) {
+			index &= entries - 1;
+		}
+		else {
+			index %= entries;
 		}
 	}
-	return GPR_FIELD_POS(n,field,fields);
+	return GPR_FIELD_POS((data->tail + index) & data->mask,
+						 field, data->fields);
 }
 
 /* returns a value at the head of the list */
@@ -129,7 +166,7 @@ void gpr_data_get_head(gpr_data * data,
 					   unsigned int field,
 					   float * real, float * imaginary)
 {
-	unsigned short idx;
+	unsigned int idx;
 
 	if ((data->size == 0) ||
 		(data->head == data->tail)) {
@@ -139,7 +176,7 @@ void gpr_data_get_head(gpr_data * data,
 	}
 	idx = GPR_FIELD_POS(data->head,field,data->fields);
 	*real = data->block[idx];
-	*imaginary = data->block[idx+1];
+	*imaginary = data->imaginary[idx];
 }
 
 /* set a value for a field at the head of the data set */
@@ -147,7 +184,7 @@ void gpr_data_set_head(gpr_data * data,
 					   unsigned int field,
 					   float real, float imaginary)
 {
-	unsigned short idx;
+	unsigned int idx;
 
 	if ((data->size == 0) ||
 		(data->head == data->tail)) {
@@ -155,7 +192,7 @@ void gpr_data_set_head(gpr_data * data,
 	}
 	idx = GPR_FIELD_POS(data->head,field,data->fields);
 	data->block[idx] = real;
-	data->block[idx+1] = imaginary;
+	data->imaginary[idx] = imaginary;
 }
 
 /* returns a value at the tail of the list */
@@ -163,7 +200,7 @@ void gpr_data_get_tail(gpr_data * data,
 					   unsigned int field,
 					   float * real, float * imaginary)
 {
-	unsigned short idx;
+	unsigned int idx;
 
 	if ((data->size == 0) ||
 		(data->head == data->tail)) {
@@ -173,7 +210,7 @@ void gpr_data_get_tail(gpr_data * data,
 	}
 	idx = GPR_FIELD_POS(data->tail,field,data->fields);
 	*real = data->block[idx];
-	*imaginary = data->block[idx+1];
+	*imaginary = data->imaginary[idx];
 }
 
 /* set the value of a field at the tail of the data set */
@@ -181,7 +218,7 @@ void gpr_data_set_tail(gpr_data * data,
 					   unsigned int field,
 					   float real, float imaginary)
 {
-	unsigned short idx;
+	unsigned int idx;
 
 	if ((data->size == 0) ||
 		(data->head == data->tail)) {
@@ -189,7 +226,7 @@ void gpr_data_set_tail(gpr_data * data,
 	}
 	idx = GPR_FIELD_POS(data->tail,field,data->fields);
 	data->block[idx] = real;
-	data->block[idx+1] = imaginary;
+	data->imaginary[idx] = imaginary;
 }
 
 /* get an element from the data set */
@@ -197,7 +234,7 @@ void gpr_data_get_elem(gpr_data * data,
 					   unsigned int index, unsigned int field,
 					   float * real, float * imaginary)
 {
-	unsigned short i;
+	unsigned int i;
 
 	if ((data->size == 0) ||
 		(data->head == data->tail)) {
@@ -205,11 +242,9 @@ void gpr_data_get_elem(gpr_data * data,
 		*imaginary = 0;
 		return;
 	}
-	i = get_data_index(data->size, data->head, data->tail,
-					   (unsigned short)field, data->fields,
-					   (unsigned short)index);
+	i = get_data_index(data, field, index);
 	*real = data->block[i];
-	*imaginary = data->block[i+1];
+	*imaginary = data->imaginary[i];
 }
 
 /* set an element from the data set */
@@ -217,15 +252,42 @@ void gpr_data_set_elem(gpr_data * data,
 					   unsigned int index, unsigned int field,
 					   float real, float imaginary)
 {
-	unsigned short i;
+	unsigned int i;
 
 	if ((data->size == 0) ||
 		(data->head == data->tail)) {
 		return;
 	}
-	i = get_data_index(data->size, data->head, data->tail,
-					   (unsigned short)field, data->fields,
-					   (unsigned short)index);
+	i = get_data_index(data, field, index);
 	data->block[i] = real;
-	data->block[i+1] = imaginary;
+	data->imaginary[i] = imaginary;
+}
+
+/* Saves the first size entries, with the real and imaginary values of
+   each field interleaved, in the same layout as earlier versions.
+   Returns the number of values written */
+int gpr_data_save(gpr_data * data, FILE * fp)
+{
+	unsigned int i, n = data->size*data->fields;
+	int retval = 0;
+
+	for (i = 0; i < n; i++) {
+		retval += fwrite(&data->block[i], sizeof(float), 1, fp);
+		retval += fwrite(&data->imaginary[i], sizeof(float), 1, fp);
+	}
+	return retval;
+}
+
+/* Loads values saved with gpr_data_save.
+   Returns the number of values read */
+int gpr_data_load(gpr_data * data, FILE * fp)
+{
+	unsigned int i, n = data->size*data->fields;
+	int retval = 0;
+
+	for (i = 0; i < n; i++) {
+		retval += fread(&data->block[i], sizeof(float), 1, fp);
+		retval += fread(&data->imaginary[i], sizeof(float), 1, fp);
+	}
+	return retval;
 }
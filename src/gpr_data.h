@@ -37,20 +37,38 @@
 #define GPR_DATA_MAX_ENTRIES  20
 #define GPR_DATA_MAX_FIELDS    3
 
+/* position of a field within the real or imaginary values */
 #define GPR_FIELD_POS(index,field,fields) \
-	((((index)*(fields))+(field))*2)
+	(((index)*(fields))+(field))
 
+/* A first in first out store of up to size-1 entries, each
+   having a number of complex valued fields.
+   Entries are held within a ring whose capacity is a power of two,
+   so that positions wrap with a mask.  The real values of every
+   field are followed by the imaginary values */
 struct gpr_data_struct {
-	unsigned short size;
-	unsigned short fields;
-	unsigned short head, tail;
+	unsigned int size;
+	unsigned int fields;
+	/* the number of entries within the ring and capacity-1 */
+	unsigned int capacity, mask;
+	/* positions of the entry being written and the oldest entry */
+	unsigned int head, tail;
+	/* real values, followed by the imaginary values */
 	float * block;
+	float * imaginary;
+	/* non-zero if the block belongs to this data store */
+	unsigned int owner;
 };
 typedef struct gpr_data_struct gpr_data;
 
+unsigned int gpr_data_length(unsigned int size, unsigned int fields);
 void gpr_data_init(gpr_data * data,
 				   unsigned int size, unsigned int fields);
+void gpr_data_init_block(gpr_data * data,
+						 unsigned int size, unsigned int fields,
+						 float * block);
 void gpr_data_clear(gpr_data * data);
+unsigned int gpr_data_entries(gpr_data * data);
 void gpr_data_free(gpr_data * data);
 void gpr_data_get_head(gpr_data * data,
 					   unsigned int field,
@@ -72,5 +90,7 @@ void gpr_data_set_head(gpr_data * data,
 void gpr_data_set_tail(gpr_data * data,
 					   unsigned int field,
 					   float real, float imaginary);
+int gpr_data_save(gpr_data * data, FILE * fp);
+int gpr_data_load(gpr_data * data, FILE * fp);
 
 #endif
@@ -0,0 +1,904 @@
+/*
+ libgpr - a library for genetic programming
+ Copyright (C) 2013  Bob Mottram <bob@robotics.uk.to>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* needed for mkdtemp and dlopen */
+#define _POSIX_C_SOURCE 200809L
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <dlfcn.h>
+#include "gpr_jit.h"
+
+/* a previously compiled piece of source code */
+struct gpr_jit_ent {
+	unsigned int hash;
+	char * text;
+	void * handle;
+	void * function;
+	/* non-zero while the source is being compiled */
+	int pending;
+	/* result of compiling */
+	int status;
+	/* changes whenever the entry is reused for other source */
+	unsigned int id;
+	/* when the entry was last loaded, used for eviction */
+	unsigned int last_used;
+};
+typedef struct gpr_jit_ent gpr_jit_entry;
+
+/* cache of compiled code, shared between threads */
+static gpr_jit_entry * gpr_jit_cache = 0;
+static int gpr_jit_cache_entries = 0;
+static int gpr_jit_cache_max = 0;
+static int gpr_jit_cache_limit = GPR_JIT_CACHE_LIMIT;
+static unsigned int gpr_jit_clock = 0;
+
+/* initialise some source code */
+void gpr_source_init(gpr_source * source)
+{
+	source->length = 0;
+	source->max_length = 256;
+	source->text = (char*)malloc(source->max_length);
+#ifdef DEBUG
+	assert(source->text!=0);
+#endif
+	source->text[0] = 0;
+}
+
+/* deallocate memory */
+void gpr_source_free(gpr_source * source)
+{
+	free(source->text);
+	source->text = 0;
+	source->length = 0;
+	source->max_length = 0;
+}
+
+/* appends formatted text to the source */
+void gpr_source_printf(gpr_source * source, const char * format, ...)
+{
+	va_list args;
+	int n;
+
+	va_start(args, format);
+	n = vsnprintf(&source->text[source->length],
+				  source->max_length - source->length,
+				  format, args);
+	va_end(args);
+
+	if (source->length + n >= source->max_length) {
+		/* not enough space, so expand and try again */
+		while (source->length + n >= source->max_length) {
+			source->max_length *= 2;
+		}
+		source->text = (char*)realloc(source->text, source->max_length);
+#ifdef DEBUG
+		assert(source->text!=0);
+#endif
+		va_start(args, format);
+		vsnprintf(&source->text[source->length],
+				  source->max_length - source->length,
+				  format, args);
+		va_end(args);
+	}
+	source->length += n;
+}
+
+/* appends a floating point constant which has exactly
+   the same value when compiled */
+void gpr_source_float(gpr_source * source, float value)
+{
+	if (value != value) {
+		gpr_source_printf(source, "%s", "(0.0f/0.0f)");
+	}
+	else if (value > FLT_MAX) {
+		gpr_source_printf(source, "%s", "(1.0f/0.0f)");
+	}
+	else if (value < -FLT_MAX) {
+		gpr_source_printf(source, "%s", "(-1.0f/0.0f)");
+	}
+	else {
+		gpr_source_printf(source, "(%af)", (double)value);
+	}
+}
+
+/* returns a hash of the source code */
+unsigned int gpr_source_hash(gpr_source * source)
+{
+	int i;
+	unsigned int hash = 2166136261u;
+
+	for (i = 0; i < source->length; i++) {
+		hash ^= (unsigned char)source->text[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/* Compiles the source into a shared library and loads it.
+   Files are created within a new directory which only this user
+   can access, so that they can't be replaced by anyone else
+   before the library is loaded */
+static int gpr_jit_compile(gpr_source * source,
+						   const char * entry_point,
+						   void ** handle, void ** function)
+{
+	char directory[256], source_filename[256], library_filename[256];
+	char command[1024];
+	const char * compiler = getenv("CC");
+	FILE * fp;
+	int fd, n, m, retval;
+
+	*handle = 0;
+	*function = 0;
+
+	if ((compiler == 0) || (strlen(compiler) == 0)) {
+		compiler = GPR_JIT_COMPILER;
+	}
+
+	n = snprintf(directory, sizeof(directory), "%slibgpr_jit_XXXXXX",
+				 GPR_TEMP_DIRECTORY);
+	if ((n < 0) || (n >= (int)sizeof(directory))) {
+		return GPR_JIT_COMPILE_FAILED;
+	}
+	if (mkdtemp(directory) == 0) return GPR_JIT_COMPILE_FAILED;
+	n = snprintf(source_filename, sizeof(source_filename),
+				 "%s/program.c", directory);
+	m = snprintf(library_filename, sizeof(library_filename),
+				 "%s/program.so", directory);
+	if ((n < 0) || (n >= (int)sizeof(source_filename)) ||
+		(m < 0) || (m >= (int)sizeof(library_filename))) {
+		rmdir(directory);
+		return GPR_JIT_COMPILE_FAILED;
+	}
+
+	fd = open(source_filename, O_WRONLY | O_CREAT | O_EXCL,
+			  S_IRUSR | S_IWUSR);
+	if (fd < 0) {
+		rmdir(directory);
+		return GPR_JIT_COMPILE_FAILED;
+	}
+	fp = fdopen(fd, "w");
+	if (!fp) {
+		close(fd);
+		remove(source_filename);
+		rmdir(directory);
+		return GPR_JIT_COMPILE_FAILED;
+	}
+	fwrite(source->text, 1, source->length, fp);
+	fclose(fp);
+
+	n = snprintf(command, sizeof(command),
+				 "%s -std=c99 -O2 -fPIC -shared -o %s %s -lm",
+				 compiler, library_filename, source_filename);
+	if ((n < 0) || (n >= (int)sizeof(command))) {
+		/* a truncated command could do something else entirely */
+		remove(source_filename);
+		rmdir(directory);
+		return GPR_JIT_COMPILE_FAILED;
+	}
+	retval = system(command);
+	remove(source_filename);
+	if (retval != 0) {
+		remove(library_filename);
+		rmdir(directory);
+		return GPR_JIT_COMPILE_FAILED;
+	}
+
+	/* the library stays mapped after its file is removed */
+	*handle = dlopen(library_filename, RTLD_NOW | RTLD_LOCAL);
+	remove(library_filename);
+	rmdir(directory);
+	if (*handle == 0) return GPR_JIT_LOAD_FAILED;
+
+	*function = dlsym(*handle, entry_point);
+	if (*function == 0) {
+		dlclose(*handle);
+		*handle = 0;
+		return GPR_JIT_LOAD_FAILED;
+	}
+	return GPR_JIT_OK;
+}
+
+/* Returns a cache entry which can be used for new source code.
+   Entries whose source failed to compile are reused first, then
+   new entries are added up to the cache limit, after which the
+   least recently loaded program is unloaded.
+   This must be called within the gpr_jit critical section */
+static int gpr_jit_new_entry()
+{
+	int i, index = -1;
+	gpr_jit_entry * entry;
+
+	for (i = 0; i < gpr_jit_cache_entries; i++) {
+		entry = &gpr_jit_cache[i];
+		if ((entry->text == 0) && (entry->pending == 0)) {
+			return i;
+		}
+	}
+
+	if (gpr_jit_cache_entries >= gpr_jit_cache_limit) {
+		for (i = 0; i < gpr_jit_cache_entries; i++) {
+			entry = &gpr_jit_cache[i];
+			if (entry->pending != 0) continue;
+			if ((index == -1) ||
+				(gpr_jit_clock - entry->last_used >
+				 gpr_jit_clock - gpr_jit_cache[index].last_used)) {
+				index = i;
+			}
+		}
+		if (index != -1) {
+			entry = &gpr_jit_cache[index];
+			if (entry->handle != 0) {
+				dlclose(entry->handle);
+				entry->handle = 0;
+			}
+			entry->function = 0;
+			free(entry->text);
+			entry->text = 0;
+			return index;
+		}
+	}
+
+	/* everything is being compiled, or the limit hasn't
+	   been reached, so add a new entry */
+	if (gpr_jit_cache_entries >= gpr_jit_cache_max) {
+		gpr_jit_cache_max = gpr_jit_cache_max*2 + 16;
+		gpr_jit_cache =
+			(gpr_jit_entry*)realloc(gpr_jit_cache,
+									gpr_jit_cache_max*
+									sizeof(gpr_jit_entry));
+#ifdef DEBUG
+		assert(gpr_jit_cache!=0);
+#endif
+	}
+	index = gpr_jit_cache_entries++;
+	entry = &gpr_jit_cache[index];
+	entry->text = 0;
+	entry->handle = 0;
+	entry->function = 0;
+	entry->pending = 0;
+	entry->id = 0;
+	return index;
+}
+
+/* Returns the named function within the given source code,
+   compiling it if it has not been seen before.
+   Compiled code is cached by the hash of its source, so that
+   the same program is only ever compiled once while it remains
+   within the cache.
+   The cache is only locked while it is searched or updated.
+   A new entry is marked as pending while it is compiled, and
+   any other thread wanting the same source waits for it.
+   Once the cache is full the least recently loaded program is
+   unloaded, and any native program obtained from it becomes
+   invalid, so native programs should be obtained again rather
+   than kept while many other programs are being compiled */
+int gpr_jit_load(gpr_source * source, const char * entry_point,
+				 void ** function)
+{
+	int i, index, pending, compile, reused, retval = GPR_JIT_OK;
+	unsigned int id = 0, hash = gpr_source_hash(source);
+	gpr_jit_entry * entry;
+	void * handle = 0;
+
+	*function = 0;
+
+	index = -1;
+	compile = 0;
+#pragma omp critical (gpr_jit)
+	{
+		for (i = 0; i < gpr_jit_cache_entries; i++) {
+			entry = &gpr_jit_cache[i];
+			if ((entry->text != 0) && (entry->hash == hash) &&
+				(strcmp(entry->text, source->text) == 0)) {
+				index = i;
+				entry->last_used = ++gpr_jit_clock;
+				id = entry->id;
+				break;
+			}
+		}
+
+		if (index == -1) {
+			/* add a pending entry, which this thread compiles */
+			index = gpr_jit_new_entry();
+			entry = &gpr_jit_cache[index];
+			entry->hash = hash;
+			entry->text = (char*)malloc(source->length+1);
+#ifdef DEBUG
+			assert(entry->text!=0);
+#endif
+			memcpy((void*)entry->text, (void*)source->text,
+				   source->length+1);
+			entry->handle = 0;
+			entry->function = 0;
+			entry->pending = 1;
+			entry->status = GPR_JIT_OK;
+			entry->id++;
+			entry->last_used = ++gpr_jit_clock;
+			compile = 1;
+		}
+	}
+
+	if (compile != 0) {
+		retval = gpr_jit_compile(source, entry_point,
+								 &handle, function);
+
+#pragma omp critical (gpr_jit)
+		{
+			entry = &gpr_jit_cache[index];
+			entry->handle = handle;
+			entry->function = *function;
+			entry->status = retval;
+			if (retval != GPR_JIT_OK) {
+				/* this source may be compiled again later,
+				   and the entry can be reused */
+				free(entry->text);
+				entry->text = 0;
+			}
+			entry->pending = 0;
+		}
+		return retval;
+	}
+
+	/* wait for another thread to finish compiling */
+	pending = 1;
+	reused = 0;
+	while (pending != 0) {
+#pragma omp critical (gpr_jit)
+		{
+			entry = &gpr_jit_cache[index];
+			if (entry->id != id) {
+				/* the entry was reused before it could be read */
+				pending = 0;
+				reused = 1;
+			}
+			else {
+				pending = entry->pending;
+				if (pending == 0) {
+					*function = entry->function;
+					retval = entry->status;
+				}
+			}
+		}
+		if (pending != 0) sched_yield();
+	}
+	if (reused != 0) {
+		return gpr_jit_load(source, entry_point, function);
+	}
+	return retval;
+}
+
+/* Sets the maximum number of programs which are kept within the
+   cache before the least recently loaded are unloaded */
+void gpr_jit_set_cache_limit(int limit)
+{
+#pragma omp critical (gpr_jit)
+	{
+		gpr_jit_cache_limit = (limit > 0) ? limit : 1;
+	}
+}
+
+/* returns the number of compiled programs within the cache */
+int gpr_jit_cache_size()
+{
+	int i, size;
+
+#pragma omp critical (gpr_jit)
+	{
+		size = 0;
+		for (i = 0; i < gpr_jit_cache_entries; i++) {
+			if (gpr_jit_cache[i].function != 0) size++;
+		}
+	}
+	return size;
+}
+
+/* Unloads all compiled programs.
+   Any native programs obtained previously become invalid.
+   This shouldn't be called while programs are being compiled */
+void gpr_jit_release()
+{
+	int i;
+
+#pragma omp critical (gpr_jit)
+	{
+		for (i = 0; i < gpr_jit_cache_entries; i++) {
+			if (gpr_jit_cache[i].handle != 0) {
+				dlclose(gpr_jit_cache[i].handle);
+			}
+			free(gpr_jit_cache[i].text);
+		}
+		free(gpr_jit_cache);
+		gpr_jit_cache = 0;
+		gpr_jit_cache_entries = 0;
+		gpr_jit_cache_max = 0;
+	}
+}
+
+/* functions called by compiled tree programs to change the state */
+static float gpr_jit_store(float v1, float v2, void * state)
+{
+	return gpr_state_store(v1, v2, (gpr_state*)state);
+}
+
+static float gpr_jit_fetch(float v1, float v2, void * state)
+{
+	return gpr_state_fetch(v1, v2, (gpr_state*)state);
+}
+
+static float gpr_jit_push(float v1, float v2, void * state)
+{
+	return gpr_state_push(v1, v2, (gpr_state*)state);
+}
+
+static float gpr_jit_pop(float v1, float v2, void * state)
+{
+	return gpr_state_pop(v1, (gpr_state*)state);
+}
+
+static float gpr_jit_data_get(float v1, float v2, void * state)
+{
+	return gpr_state_data_get(v1, v2, (gpr_state*)state);
+}
+
+static float gpr_jit_data_set(float v1, float v2, void * state)
+{
+	return gpr_state_data_set(v1, v2, (gpr_state*)state);
+}
+
+static gpr_jit_call gpr_jit_calls[GPR_JIT_CALLS] = {
+	gpr_jit_store, gpr_jit_fetch, gpr_jit_push,
+	gpr_jit_pop, gpr_jit_data_get, gpr_jit_data_set
+};
+
+/* appends code which sums a range of stack values into a variable */
+static void gpr_jit_sum(gpr_source * source, const char * variable,
+						int start, int end)
+{
+	int i;
+
+	gpr_source_printf(source, "  %s = 0;\n", variable);
+	for (i = start; i < end; i++) {
+		gpr_source_printf(source, "  %s += s[%d];\n", variable, i);
+	}
+}
+
+/* appends code which replaces NaN values with zero */
+static void gpr_jit_not_nan(gpr_source * source, const char * variable)
+{
+	gpr_source_printf(source, "  if (%s != %s) %s = 0;\n",
+					  variable, variable, variable);
+}
+
+/* returns the maximum stack depth for a range of instructions */
+static int gpr_jit_stack_size(gpr_compiled * program, int start, int end)
+{
+	int pc, sp = 0, max_sp = 0;
+	gpr_instruction * instr;
+
+	for (pc = start; pc < end; pc++) {
+		instr = &program->code[pc];
+		switch(instr->function_type) {
+		case GPR_OP_ADF_ENTER: {
+			sp++;
+			if (sp > max_sp) max_sp = sp;
+			sp--;
+			break;
+		}
+		case GPR_OP_ADF_ARG: {
+			sp--;
+			break;
+		}
+		case GPR_OP_ADF_CALL: {
+			sp++;
+			break;
+		}
+		default: {
+			sp += 1 - instr->argc;
+		}
+		}
+		if (sp > max_sp) max_sp = sp;
+	}
+	return max_sp;
+}
+
+/* Appends a function which runs a range of instructions.
+   Instructions become straight line code operating upon a stack
+   whose positions are all known in advance, and which does the
+   same as gpr_run_segment */
+static void gpr_jit_segment(gpr_source * source, gpr_compiled * program,
+							const char * name, int start, int end)
+{
+	int pc, sp = 0, i, argc, r, stack_size;
+	gpr_instruction * instr;
+
+	stack_size = gpr_jit_stack_size(program, start, end);
+
+	gpr_source_printf(source,
+					  "static float %s(void * st, float * arg, int depth,\n"
+					  "  gpr_call * call, float (*custom)(float,float,float))\n"
+					  "{\n", name);
+	gpr_source_printf(source,
+					  "  float s[%d], v = 0, v1, v2;\n  int i, itt;\n\n",
+					  stack_size + 1);
+
+	for (pc = start; pc < end; pc++) {
+		instr = &program->code[pc];
+		argc = instr->argc;
+		/* position of the first argument and of the result */
+		r = sp - argc;
+
+		switch(instr->function_type) {
+		case GPR_FUNCTION_VALUE: {
+			gpr_source_printf(source, "%s", "  v = ");
+			gpr_source_float(source, instr->value);
+			gpr_source_printf(source, "%s", ";\n");
+			break;
+		}
+		case GPR_FUNCTION_ARG: {
+			gpr_source_printf(source, "  v = arg[depth*%d + %d];\n",
+							  GPR_MAX_ARGUMENTS,
+							  abs((int)instr->value));
+			break;
+		}
+		case GPR_FUNCTION_CUSTOM: {
+			gpr_source_printf(source, "%s", "  v = (*custom)(");
+			gpr_source_float(source, instr->value);
+			gpr_source_printf(source, ", s[%d], s[%d]);\n", r, r+1);
+			break;
+		}
+		case GPR_FUNCTION_NEGATE: {
+			gpr_jit_sum(source, "v", r, sp);
+			gpr_source_printf(source, "%s",
+							  "  v = (v == v) ? -v : 0;\n");
+			break;
+		}
+		case GPR_FUNCTION_AVERAGE: {
+			gpr_jit_sum(source, "v1", r, sp);
+			gpr_source_printf(source,
+							  "  v = (v1 == v1) ? v1 / %d : 0;\n", argc);
+			break;
+		}
+		case GPR_FUNCTION_POW: {
+			gpr_jit_sum(source, "v1", r, r + argc/2);
+			gpr_jit_sum(source, "v2", r + argc/2, sp);
+			gpr_source_printf(source, "%s",
+							  "  itt = 2+(abs((int)v2)%3);\n"
+							  "  v = v1;\n"
+							  "  for (i = 0; i < itt; i++) v *= v1;\n");
+			gpr_jit_not_nan(source, "v");
+			break;
+		}
+		case GPR_FUNCTION_EXP: {
+			gpr_jit_sum(source, "v1", r, sp);
+			gpr_source_printf(source, "%s", "  v = (float)exp(v1);\n");
+			gpr_jit_not_nan(source, "v");
+			break;
+		}
+		case GPR_FUNCTION_SIGMOID: {
+			gpr_jit_sum(source, "v1", r, sp);
+			gpr_source_printf(source, "%s",
+							  "  v = 1.0f / (1.0f + exp(v1));\n");
+			break;
+		}
+		case GPR_FUNCTION_MIN:
+		case GPR_FUNCTION_MAX: {
+			gpr_source_printf(source, "%s", "  v = 0;\n");
+			for (i = 0; i < argc; i++) {
+				if (i == 0) {
+					gpr_source_printf(source, "  v = s[%d];\n", r);
+				}
+				else {
+					gpr_source_printf(source,
+									  "  if (s[%d] %c v) v = s[%d];\n",
+									  r+i,
+									  (instr->function_type ==
+									   GPR_FUNCTION_MIN) ? '<' : '>',
+									  r+i);
+				}
+			}
+			break;
+		}
+		case GPR_FUNCTION_DEFUN:
+		case GPR_FUNCTION_ADD: {
+			gpr_jit_sum(source, "v", r, sp);
+			gpr_jit_not_nan(source, "v");
+			break;
+		}
+		case GPR_FUNCTION_SUBTRACT:
+		case GPR_FUNCTION_MULTIPLY: {
+			gpr_source_printf(source, "  v = s[%d];\n", r);
+			for (i = 1; i < argc; i++) {
+				gpr_source_printf(source, "  v %c= s[%d];\n",
+								  (instr->function_type ==
+								   GPR_FUNCTION_SUBTRACT) ? '-' : '*',
+								  r+i);
+			}
+			gpr_jit_not_nan(source, "v");
+			break;
+		}
+		case GPR_FUNCTION_WEIGHT: {
+			gpr_source_printf(source, "  v = s[%d] * ", r);
+			gpr_source_float(source, instr->value);
+			gpr_source_printf(source, "%s", ";\n");
+			gpr_jit_not_nan(source, "v");
+			break;
+		}
+		case GPR_FUNCTION_DIVIDE:
+		case GPR_FUNCTION_MODULUS: {
+			gpr_jit_sum(source, "v1", r, r + argc/2);
+			gpr_jit_sum(source, "v2", r + argc/2, sp);
+			gpr_source_printf(source, "%s",
+							  "  v = 0;\n"
+							  "  if (fabs(v2) > 0.01f) {\n");
+			if (instr->function_type == GPR_FUNCTION_DIVIDE) {
+				gpr_source_printf(source, "%s", "    v = v1 / v2;\n");
+			}
+			else {
+				gpr_source_printf(source, "%s", "    v = fmod(v1, v2);\n");
+			}
+			gpr_source_printf(source, "%s",
+							  "    if (v != v) v = 0;\n"
+							  "  }\n");
+			break;
+		}
+		case GPR_FUNCTION_FLOOR:
+		case GPR_FUNCTION_ABS:
+		case GPR_FUNCTION_SINE:
+		case GPR_FUNCTION_ARCSINE:
+		case GPR_FUNCTION_COSINE:
+		case GPR_FUNCTION_ARCCOSINE: {
+			gpr_jit_sum(source, "v1", r, sp);
+			switch(instr->function_type) {
+			case GPR_FUNCTION_FLOOR: {
+				gpr_source_printf(source, "%s", "  v = floor(v1);\n");
+				break;
+			}
+			case GPR_FUNCTION_ABS: {
+				gpr_source_printf(source, "%s", "  v = fabs(v1);\n");
+				break;
+			}
+			case GPR_FUNCTION_SINE: {
+				gpr_source_printf(source, "%s", "  v = (float)sin(v1);\n");
+				break;
+			}
+			case GPR_FUNCTION_ARCSINE: {
+				gpr_source_printf(source, "%s",
+								  "  v = (float)asin(v1);\n");
+				break;
+			}
+			case GPR_FUNCTION_COSINE: {
+				gpr_source_printf(source, "%s", "  v = (float)cos(v1);\n");
+				break;
+			}
+			case GPR_FUNCTION_ARCCOSINE: {
+				gpr_source_printf(source, "%s",
+								  "  v = (float)acos(v1);\n");
+				break;
+			}
+			}
+			gpr_jit_not_nan(source, "v");
+			break;
+		}
+		case GPR_FUNCTION_SQUARE_ROOT: {
+			gpr_jit_sum(source, "v1", r, sp);
+			gpr_source_printf(source, "%s", "  v = fabs(v1);\n");
+			gpr_jit_not_nan(source, "v");
+			gpr_source_printf(source, "%s", "  v = (float)sqrt(v);\n");
+			gpr_jit_not_nan(source, "v");
+			break;
+		}
+		case GPR_FUNCTION_GREATER_THAN:
+		case GPR_FUNCTION_LESS_THAN:
+		case GPR_FUNCTION_EQUALS:
+		case GPR_FUNCTION_AND:
+		case GPR_FUNCTION_OR:
+		case GPR_FUNCTION_XOR:
+		case GPR_FUNCTION_NOT: {
+			gpr_jit_sum(source, "v1", r, r + argc/2);
+			gpr_jit_sum(source, "v2", r + argc/2, sp);
+			gpr_source_printf(source, "%s", "  v = (");
+			switch(instr->function_type) {
+			case GPR_FUNCTION_GREATER_THAN: {
+				gpr_source_printf(source, "%s", "v1 > v2");
+				break;
+			}
+			case GPR_FUNCTION_LESS_THAN: {
+				gpr_source_printf(source, "%s", "v1 < v2");
+				break;
+			}
+			case GPR_FUNCTION_EQUALS: {
+				gpr_source_printf(source, "%s", "(int)v1 == (int)v2");
+				break;
+			}
+			case GPR_FUNCTION_AND: {
+				gpr_source_printf(source, "%s", "(v1>0) && (v2>0)");
+				break;
+			}
+			case GPR_FUNCTION_OR: {
+				gpr_source_printf(source, "%s", "(v1>0) || (v2>0)");
+				break;
+			}
+			case GPR_FUNCTION_XOR: {
+				gpr_source_printf(source, "%s", "(v1>0) != (v2>0)");
+				break;
+			}
+			case GPR_FUNCTION_NOT: {
+				gpr_source_printf(source, "%s", "(int)v1 != (int)v2");
+				break;
+			}
+			}
+			gpr_source_printf(source, ") ? %d : %d;\n",
+							  GPR_TRUE, GPR_FALSE);
+			break;
+		}
+		case GPR_FUNCTION_DATA_PUSH:
+		case GPR_FUNCTION_DATA_GET:
+		case GPR_FUNCTION_DATA_SET:
+		case GPR_FUNCTION_SET:
+		case GPR_FUNCTION_GET: {
+			gpr_source_printf(source,
+							  "  v = call[%d](s[%d], s[%d], st);\n",
+							  (instr->function_type ==
+							   GPR_FUNCTION_DATA_PUSH) ?
+							  GPR_JIT_CALL_PUSH :
+							  (instr->function_type ==
+							   GPR_FUNCTION_DATA_GET) ?
+							  GPR_JIT_CALL_DATA_GET :
+							  (instr->function_type ==
+							   GPR_FUNCTION_DATA_SET) ?
+							  GPR_JIT_CALL_DATA_SET :
+							  (instr->function_type ==
+							   GPR_FUNCTION_SET) ?
+							  GPR_JIT_CALL_STORE : GPR_JIT_CALL_FETCH,
+							  r, r+1);
+			break;
+		}
+		case GPR_FUNCTION_DATA_POP: {
+			gpr_source_printf(source, "  v = call[%d](s[%d], 0, st);\n",
+							  GPR_JIT_CALL_POP, r);
+			break;
+		}
+		case GPR_OP_ADF_ENTER: {
+			/* the arguments and call are skipped when too deep */
+			gpr_source_printf(source,
+							  "  if (depth >= %d) {\n"
+							  "    s[%d] = 0;\n"
+							  "  }\n"
+							  "  else {\n"
+							  "  depth++;\n",
+							  GPR_MAX_CALL_DEPTH-1, sp);
+			continue;
+		}
+		case GPR_OP_ADF_ARG: {
+			sp--;
+			gpr_source_printf(source,
+							  "  arg[depth*%d + %d] = s[%d];\n",
+							  GPR_MAX_ARGUMENTS, (int)instr->value, sp);
+			continue;
+		}
+		case GPR_OP_ADF_CALL: {
+			gpr_source_printf(source,
+							  "  s[%d] = adf%d(st, arg, depth, "
+							  "call, custom);\n"
+							  "  depth--;\n"
+							  "  }\n",
+							  sp, (int)instr->value);
+			sp++;
+			continue;
+		}
+		default: {
+			/* no operation */
+			gpr_source_printf(source, "%s", "  v = 0;\n");
+		}
+		}
+
+		/* replace the arguments with the result */
+		sp = r;
+		gpr_source_printf(source, "  s[%d] = v;\n", sp++);
+	}
+
+	if (sp > 0) {
+		gpr_source_printf(source, "  return s[%d];\n}\n\n", sp-1);
+	}
+	else {
+		gpr_source_printf(source, "%s", "  return 0;\n}\n\n");
+	}
+}
+
+/* Compiles a tree program into native code.
+   The native program gives the same results as gpr_run and
+   remains valid until gpr_jit_release is called, or until it is
+   unloaded to make room for other programs (see gpr_jit_load) */
+int gpr_jit(gpr_function * f, gpr_state * state, gpr_native * program)
+{
+	int i, retval;
+	char name[32];
+	void * function;
+	gpr_compiled compiled;
+	gpr_source source;
+
+	program->hash = 0;
+	program->run_tree = 0;
+	program->run_cartesian = 0;
+
+	gpr_compile(f, state, &compiled);
+
+	gpr_source_init(&source);
+	gpr_source_printf(&source, "%s",
+					  "#include <stdlib.h>\n"
+					  "#include <math.h>\n\n"
+					  "typedef float (*gpr_call)(float, float, void *);\n\n");
+	for (i = 0; i < GPR_MAX_ARGUMENTS; i++) {
+		gpr_source_printf(&source,
+						  "static float adf%d(void * st, float * arg, "
+						  "int depth,\n"
+						  "  gpr_call * call, "
+						  "float (*custom)(float,float,float));\n", i);
+	}
+	gpr_source_printf(&source, "%s", "\n");
+
+	for (i = 0; i < GPR_MAX_ARGUMENTS; i++) {
+		sprintf(name, "adf%d", i);
+		gpr_jit_segment(&source, &compiled, name,
+						compiled.ADF_start[i], compiled.ADF_end[i]);
+	}
+	gpr_jit_segment(&source, &compiled, "program",
+					compiled.start, compiled.end);
+
+	gpr_source_printf(&source, "%s",
+					  "float gpr_kernel(void * st, float * arg,\n"
+					  "  gpr_call * call, "
+					  "float (*custom)(float,float,float))\n"
+					  "{\n"
+					  "  return program(st, arg, 0, call, custom);\n"
+					  "}\n");
+
+	retval = gpr_jit_load(&source, "gpr_kernel", &function);
+	if (retval == GPR_JIT_OK) {
+		program->hash = gpr_source_hash(&source);
+		*(void **)(&program->run_tree) = function;
+	}
+
+	gpr_source_free(&source);
+	gpr_free_compiled(&compiled);
+	return retval;
+}
+
+/* runs a tree program which was compiled into native code.
+   This gives the same result as calling gpr_run */
+float gpr_run_native(gpr_native * program, gpr_state * state,
+					 float (*custom_function)(float,float,float))
+{
+	return (*program->run_tree)((void*)state, &state->temp_ADF_arg[0][0],
+								gpr_jit_calls, (*custom_function));
+}
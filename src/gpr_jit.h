@@ -0,0 +1,93 @@
+/*
+ libgpr - a library for genetic programming
+ Copyright (C) 2013  Bob Mottram <bob@robotics.uk.to>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef GPR_JIT_H
+#define GPR_JIT_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <float.h>
+#include <math.h>
+#include "globals.h"
+#include "gpr.h"
+#include "gpr_compiled.h"
+
+/* operations on the state which compiled tree programs call back into */
+enum {
+	GPR_JIT_CALL_STORE = 0,
+	GPR_JIT_CALL_FETCH,
+	GPR_JIT_CALL_PUSH,
+	GPR_JIT_CALL_POP,
+	GPR_JIT_CALL_DATA_GET,
+	GPR_JIT_CALL_DATA_SET,
+	GPR_JIT_CALLS
+};
+
+typedef float (*gpr_jit_call)(float, float, void *);
+
+/* generated source code */
+struct gpr_src {
+	/* the number of characters */
+	int length;
+	/* the number of allocated characters */
+	int max_length;
+	/* null terminated text */
+	char * text;
+};
+typedef struct gpr_src gpr_source;
+
+/* a program which has been compiled into native code */
+struct gpr_nat {
+	/* hash of the generated source */
+	unsigned int hash;
+	/* entry point for tree programs */
+	float (*run_tree)(void *, float *, gpr_jit_call *,
+					  float (*)(float,float,float));
+	/* entry point for Cartesian programs */
+	void (*run_cartesian)(float *);
+};
+typedef struct gpr_nat gpr_native;
+
+void gpr_source_init(gpr_source * source);
+void gpr_source_free(gpr_source * source);
+void gpr_source_printf(gpr_source * source, const char * format, ...);
+void gpr_source_float(gpr_source * source, float value);
+unsigned int gpr_source_hash(gpr_source * source);
+int gpr_jit_load(gpr_source * source, const char * entry_point,
+				 void ** function);
+int gpr_jit_cache_size();
+void gpr_jit_set_cache_limit(int limit);
+void gpr_jit_release();
+int gpr_jit(gpr_function * f, gpr_state * state, gpr_native * program);
+float gpr_run_native(gpr_native * program, gpr_state * state,
+					 float (*custom_function)(float,float,float));
+
+#endif
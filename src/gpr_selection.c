@@ -0,0 +1,392 @@
+/*
+ libgpr - a library for genetic programming
+ Copyright (C) 2013  Bob Mottram <bob@robotics.uk.to>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <omp.h>
+#include "gpr.h"
+
+/* initialise selection, which by default is truncation */
+void gpr_selection_init(gpr_selection * selection)
+{
+	memset((void*)selection,'\0',sizeof(gpr_selection));
+	selection->method = GPR_SELECTION_TRUNCATION;
+	selection->tournament_size = GPR_DEFAULT_TOURNAMENT_SIZE;
+}
+
+/* deallocate memory used for selection */
+void gpr_selection_free(gpr_selection * selection)
+{
+	int method = selection->method;
+	int tournament_size = selection->tournament_size;
+
+	if (selection->errors != 0) free(selection->errors);
+	if (selection->case_errors != 0) free(selection->case_errors);
+	if (selection->epsilon != 0) free(selection->epsilon);
+	if (selection->ordering != 0) free(selection->ordering);
+	if (selection->candidates != 0) free(selection->candidates);
+	gpr_selection_init(selection);
+	selection->method = method;
+	selection->tournament_size = tournament_size;
+}
+
+/* sets the selection method */
+void gpr_selection_set(gpr_selection * selection,
+					   int method, int tournament_size)
+{
+	selection->method = method;
+	if (tournament_size < 1) {
+		tournament_size = GPR_DEFAULT_TOURNAMENT_SIZE;
+	}
+	selection->tournament_size = tournament_size;
+}
+
+/* Sets the number of individuals and cases for which errors
+   are stored.  Returns non-zero if the errors were reallocated,
+   in which case all individuals need to be evaluated again */
+int gpr_selection_cases(gpr_selection * selection, int size, int cases)
+{
+	if ((selection->errors != 0) &&
+		(selection->size == size) && (selection->cases == cases)) {
+		return 0;
+	}
+	gpr_selection_free(selection);
+	selection->size = size;
+	selection->cases = cases;
+	selection->errors = (float*)malloc(size*cases*sizeof(float));
+	selection->case_errors = (float*)malloc(size*cases*sizeof(float));
+	selection->epsilon = (float*)malloc(cases*sizeof(float));
+	selection->ordering =
+		(int*)malloc(GPR_SELECTION_ORDERINGS*cases*sizeof(int));
+#ifdef DEBUG
+	assert(selection->errors!=0);
+	assert(selection->case_errors!=0);
+	assert(selection->epsilon!=0);
+	assert(selection->ordering!=0);
+#endif
+	memset((void*)selection->errors,'\0',size*cases*sizeof(float));
+	return 1;
+}
+
+/* returns the errors for the individual with the given index */
+float * gpr_selection_errors(gpr_selection * selection, int index)
+{
+	if (selection->errors == 0) return 0;
+	return &selection->errors[index*selection->cases];
+}
+
+/* Rearranges the errors in the same way as the individuals,
+   so that the row for index[i] becomes row i */
+void gpr_selection_permute(gpr_selection * selection, int * index)
+{
+	if (selection->errors == 0) return;
+	gpr_permute((void*)selection->errors,
+				selection->cases*sizeof(float),
+				index, selection->size);
+}
+
+/* copies the errors for an individual, for example when it migrates */
+void gpr_selection_copy(gpr_selection * source, int source_index,
+						gpr_selection * dest, int dest_index)
+{
+	if ((source->errors == 0) || (dest->errors == 0) ||
+		(source->cases != dest->cases)) {
+		return;
+	}
+	memcpy((void*)gpr_selection_errors(dest, dest_index),
+		   (void*)gpr_selection_errors(source, source_index),
+		   source->cases*sizeof(float));
+}
+
+/* Gives a child the errors which its parent had before selection.
+   This is used when the child behaves in the same way as its parent,
+   and is safe to call while breeding in parallel */
+void gpr_selection_inherit(gpr_selection * selection,
+						   int child_index, int parent_index)
+{
+	int c;
+	float * errors;
+
+	if (selection->errors == 0) return;
+
+	errors = gpr_selection_errors(selection, child_index);
+	for (c = 0; c < selection->cases; c++) {
+		errors[c] =
+			selection->case_errors[c*selection->size + parent_index];
+	}
+}
+
+/* returns the k'th smallest value, partially reordering the array */
+static float gpr_selection_kth(float * values, int size, int k)
+{
+	int lo = 0, hi = size-1, i, j;
+	float pivot, v;
+
+	while (lo < hi) {
+		pivot = values[lo + (hi-lo)/2];
+		i = lo;
+		j = hi;
+		while (i <= j) {
+			while (values[i] < pivot) i++;
+			while (values[j] > pivot) j--;
+			if (i <= j) {
+				v = values[i];
+				values[i] = values[j];
+				values[j] = v;
+				i++;
+				j--;
+			}
+		}
+		if (k <= j) {
+			hi = j;
+		}
+		else if (k >= i) {
+			lo = i;
+		}
+		else {
+			break;
+		}
+	}
+	return values[k];
+}
+
+/* Prepares for selecting parents.
+   For lexicase selection the errors are copied so that each case
+   is a row, the epsilon for each case is the median absolute
+   deviation of its errors, and a number of shuffled orderings of
+   the cases are created */
+void gpr_selection_prepare(gpr_selection * selection,
+						   unsigned int * random_seed)
+{
+	int i, c, o, j, v, size = selection->size;
+	int * ordering;
+	float * scratch;
+
+	if (selection->errors == 0) return;
+
+	/* copy the errors with one row per case */
+	for (i = 0; i < size; i++) {
+		float * errors = &selection->errors[i*selection->cases];
+		for (c = 0; c < selection->cases; c++) {
+			if (errors[c] == errors[c]) {
+				selection->case_errors[c*size + i] = errors[c];
+			}
+			else {
+				/* not a number */
+				selection->case_errors[c*size + i] =
+					GPR_SELECTION_MAX_ERROR;
+			}
+		}
+	}
+
+	if (selection->method != GPR_SELECTION_LEXICASE) return;
+
+	/* candidates for each thread */
+	if (selection->threads < omp_get_max_threads()) {
+		if (selection->candidates != 0) free(selection->candidates);
+		selection->threads = omp_get_max_threads();
+		selection->candidates =
+			(int*)malloc(selection->threads*size*sizeof(int));
+#ifdef DEBUG
+		assert(selection->candidates!=0);
+#endif
+	}
+
+	/* epsilon for each case */
+	scratch = (float*)malloc(size*sizeof(float));
+#ifdef DEBUG
+	assert(scratch!=0);
+#endif
+	for (c = 0; c < selection->cases; c++) {
+		float * errors = &selection->case_errors[c*size];
+		float median;
+
+		memcpy((void*)scratch, (void*)errors, size*sizeof(float));
+		median = gpr_selection_kth(scratch, size, size/2);
+		for (i = 0; i < size; i++) {
+			scratch[i] = fabs(errors[i] - median);
+		}
+		selection->epsilon[c] = gpr_selection_kth(scratch, size, size/2);
+	}
+	free(scratch);
+
+	/* shuffled orderings of the cases */
+	for (o = 0; o < GPR_SELECTION_ORDERINGS; o++) {
+		ordering = &selection->ordering[o*selection->cases];
+		for (c = 0; c < selection->cases; c++) {
+			ordering[c] = c;
+		}
+		for (c = selection->cases-1; c > 0; c--) {
+			j = rand_num(random_seed)%(c+1);
+			v = ordering[c];
+			ordering[c] = ordering[j];
+			ordering[j] = v;
+		}
+	}
+}
+
+/* returns the fittest of a random sample of individuals */
+static int gpr_select_tournament(gpr_selection * selection,
+								 float * fitness, int size,
+								 unsigned int * random_seed)
+{
+	int i, index, best = rand_num(random_seed)%size;
+
+	for (i = 1; i < selection->tournament_size; i++) {
+		index = rand_num(random_seed)%size;
+		if (fitness[index] > fitness[best]) best = index;
+	}
+	return best;
+}
+
+/* Epsilon-lexicase selection.  Cases are taken in a shuffled order,
+   and at each case only the candidates whose error is within epsilon
+   of the lowest error remain.  One of the remaining candidates is
+   returned once there is only one left or the cases run out */
+static int gpr_select_lexicase(gpr_selection * selection,
+							   int size,
+							   unsigned int * random_seed)
+{
+	int i, k, c, start, remaining = size;
+	int * candidates, * ordering;
+	float * errors, lowest, threshold;
+
+	candidates =
+		&selection->candidates[omp_get_thread_num()*selection->size];
+	for (i = 0; i < size; i++) {
+		candidates[i] = i;
+	}
+
+	ordering = &selection->ordering[(rand_num(random_seed)%
+									 GPR_SELECTION_ORDERINGS)*
+									selection->cases];
+	start = rand_num(random_seed)%selection->cases;
+
+	for (k = 0; (k < selection->cases) && (remaining > 1); k++) {
+		c = ordering[(start + k) % selection->cases];
+		errors = &selection->case_errors[c*selection->size];
+
+		lowest = errors[candidates[0]];
+		for (i = 1; i < remaining; i++) {
+			if (errors[candidates[i]] < lowest) {
+				lowest = errors[candidates[i]];
+			}
+		}
+
+		threshold = lowest + selection->epsilon[c];
+		for (i = 0; i < remaining; i++) {
+			if (errors[candidates[i]] > threshold) {
+				candidates[i--] = candidates[--remaining];
+			}
+		}
+	}
+	return candidates[rand_num(random_seed)%remaining];
+}
+
+/* Returns the index of a parent chosen from the first
+   size individuals */
+int gpr_select(gpr_selection * selection,
+			   float * fitness, int size,
+			   unsigned int * random_seed)
+{
+	switch(selection->method) {
+	case GPR_SELECTION_TOURNAMENT: {
+		return gpr_select_tournament(selection, fitness, size,
+									 random_seed);
+	}
+	case GPR_SELECTION_LEXICASE: {
+		/* without errors use tournaments instead */
+		if ((selection->errors == 0) || (selection->cases <= 0) ||
+			(size > selection->size)) {
+			return gpr_select_tournament(selection, fitness, size,
+										 random_seed);
+		}
+		return gpr_select_lexicase(selection, size, random_seed);
+	}
+	}
+	return rand_num(random_seed)%size;
+}
+
+/* Returns indexes such that the first survivors indexes are the
+   fittest individuals, without sorting the whole population.
+   The fittest individual comes first and the least fit last */
+void gpr_partition(float * fitness, int size, int survivors,
+				   int * index)
+{
+	int lo = 0, hi = size-1, i, j, v, k = survivors;
+	float pivot;
+
+	for (i = 0; i < size; i++) {
+		index[i] = i;
+	}
+	if (size < 2) return;
+
+	/* select in descending order of fitness */
+	while ((k > 0) && (k < size) && (lo < hi)) {
+		pivot = fitness[index[lo + (hi-lo)/2]];
+		i = lo;
+		j = hi;
+		while (i <= j) {
+			while (fitness[index[i]] > pivot) i++;
+			while (fitness[index[j]] < pivot) j--;
+			if (i <= j) {
+				v = index[i];
+				index[i] = index[j];
+				index[j] = v;
+				i++;
+				j--;
+			}
+		}
+		if (k <= j) {
+			hi = j;
+		}
+		else if (k >= i) {
+			lo = i;
+		}
+		else {
+			break;
+		}
+	}
+
+	/* fittest first */
+	j = 0;
+	for (i = 1; i < size; i++) {
+		if (fitness[index[i]] > fitness[index[j]]) j = i;
+	}
+	v = index[0];
+	index[0] = index[j];
+	index[j] = v;
+
+	/* least fit last */
+	j = size-1;
+	for (i = (survivors > 1 ? survivors : 1); i < size-1; i++) {
+		if (fitness[index[i]] < fitness[index[j]]) j = i;
+	}
+	v = index[size-1];
+	index[size-1] = index[j];
+	index[j] = v;
+}
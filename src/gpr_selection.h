@@ -0,0 +1,100 @@
+/*
+ libgpr - a library for genetic programming
+ Copyright (C) 2013  Bob Mottram <bob@robotics.uk.to>
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions
+ are met:
+ 1. Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+ 3. Neither the name of the University nor the names of its contributors
+    may be used to endorse or promote products derived from this software
+    without specific prior written permission.
+ .
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE HOLDERS OR
+ CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF 
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING 
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef GPR_SELECTION_H
+#define GPR_SELECTION_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "globals.h"
+
+/* the number of shuffled case orderings used by lexicase selection */
+#define GPR_SELECTION_ORDERINGS 16
+
+/* error given to every case for programs which couldn't be run */
+#define GPR_SELECTION_MAX_ERROR 1.0e30f
+
+/* the default number of individuals in each tournament */
+#define GPR_DEFAULT_TOURNAMENT_SIZE 4
+
+/* methods used to choose parents */
+enum {
+	/* parents are chosen uniformly from the fittest individuals */
+	GPR_SELECTION_TRUNCATION = 0,
+	/* the fittest of a random sample of individuals */
+	GPR_SELECTION_TOURNAMENT,
+	/* epsilon-lexicase selection using the error on each case */
+	GPR_SELECTION_LEXICASE
+};
+
+/* how parents are selected within a population */
+struct gpr_sel {
+	/* the selection method */
+	int method;
+	/* the number of individuals in each tournament */
+	int tournament_size;
+	/* the number of individuals and the number of cases */
+	int size, cases;
+	/* the error of each individual on each case,
+	   with one row per individual */
+	float * errors;
+	/* Copy of the errors made before selection, with one row
+	   per case, so that candidates for a case are contiguous */
+	float * case_errors;
+	/* the epsilon value for each case */
+	float * epsilon;
+	/* shuffled orderings of the cases */
+	int * ordering;
+	/* remaining candidates for each thread */
+	int * candidates;
+	int threads;
+};
+typedef struct gpr_sel gpr_selection;
+
+void gpr_selection_init(gpr_selection * selection);
+void gpr_selection_free(gpr_selection * selection);
+void gpr_selection_set(gpr_selection * selection,
+					   int method, int tournament_size);
+int gpr_selection_cases(gpr_selection * selection, int size, int cases);
+float * gpr_selection_errors(gpr_selection * selection, int index);
+void gpr_selection_permute(gpr_selection * selection, int * index);
+void gpr_selection_copy(gpr_selection * source, int source_index,
+						gpr_selection * dest, int dest_index);
+void gpr_selection_prepare(gpr_selection * selection,
+						   unsigned int * random_seed);
+void gpr_selection_inherit(gpr_selection * selection,
+						   int child_index, int parent_index);
+int gpr_select(gpr_selection * selection,
+			   float * fitness, int size,
+			   unsigned int * random_seed);
+void gpr_partition(float * fitness, int size, int survivors,
+				   int * index);
+
+#endif
@@ -28,6 +28,7 @@
 */
 
 #include "gprc.h"
+#include "gpr_jit.h"
 
 
 /* returns the value of an actuator */
@@ -72,10 +73,10 @@ int gprc_get_actuators(int ADF_module, int actuators)
 }
 
 /* returns the number of arguments that a function has */
-static int gprc_function_args(int function_type,
-							  float value,
-							  int connections_per_gene,
-							  int argc)
+int gprc_function_args(int function_type,
+					   float value,
+					   int connections_per_gene,
+					   int argc)
 {
 	/* no arguments */
 	if (function_type == GPR_FUNCTION_VALUE) {
@@ -264,13 +265,62 @@ static void gprc_clear_genome(gprc_function * f,
 	}
 }
 
-/* initialize an individual */
-void gprc_init(gprc_function * f,
-			   int rows, int columns, int sensors, int actuators,
-			   int connections_per_gene,
-			   int ADF_modules,
-			   int data_size, int data_fields,
-			   unsigned int * random_seed)
+/* Returns the number of bytes needed for the arrays of an individual
+   within a population slab.  This must match the arrays which are
+   carved out by gprc_init_slab */
+static size_t gprc_slab_stride(int rows, int columns,
+							   int sensors, int actuators,
+							   int connections_per_gene,
+							   int ADF_modules,
+							   int data_size, int data_fields)
+{
+	int m, sens, act;
+	size_t bytes = 0;
+
+	for (m = 0; m < ADF_modules+1; m++) {
+		sens = gprc_get_sensors(m, sensors);
+		act = gprc_get_actuators(m, actuators);
+		bytes += GPRC_SLAB_ROUND(((rows*columns*
+								   GPRC_GENE_SIZE(connections_per_gene)) +
+								  act)*sizeof(float));
+		bytes += GPRC_SLAB_ROUND(((rows*columns) + sens + act)*2*
+								 sizeof(float));
+		bytes += GPRC_SLAB_ROUND(((rows*columns) + sens + act)*
+								 sizeof(unsigned char));
+		bytes += GPRC_SLAB_ROUND(rows*columns*sizeof(int))*2;
+		bytes += GPRC_SLAB_ROUND(rows*columns*connections_per_gene*
+								 sizeof(int));
+	}
+	bytes += GPRC_SLAB_ROUND(GPRC_MAX_ADF_GENES*3*sizeof(int));
+	bytes += GPRC_SLAB_ROUND(gpr_data_length(data_size, data_fields)*
+							 sizeof(float));
+	return bytes;
+}
+
+/* Returns an array of the given number of bytes.  If there is a slab
+   then the array is taken from it, otherwise it is allocated */
+static void * gprc_slab_alloc(unsigned char ** slab, size_t bytes)
+{
+	void * array;
+
+	if (*slab == 0) return malloc(bytes);
+
+	array = (void*)*slab;
+	*slab += GPRC_SLAB_ROUND(bytes);
+	return array;
+}
+
+/* Initialise an individual.  If a slab is given then all arrays,
+   other than sensor sources and actuator destinations, are taken
+   from it rather than being separately allocated */
+static void gprc_init_slab(gprc_function * f,
+						   int rows, int columns,
+						   int sensors, int actuators,
+						   int connections_per_gene,
+						   int ADF_modules,
+						   int data_size, int data_fields,
+						   unsigned int * random_seed,
+						   unsigned char * slab)
 {
 	int m, sens, act;
 
@@ -280,15 +330,29 @@ void gprc_init(gprc_function * f,
 		sens = gprc_get_sensors(m, sensors);
 		act = gprc_get_actuators(m, actuators);
 		f->genome[m].gene =
-			(float*)malloc(((rows*columns*
-							 GPRC_GENE_SIZE(connections_per_gene)) +
-							act)*sizeof(float));
+			(float*)gprc_slab_alloc(&slab,
+									((rows*columns*
+									  GPRC_GENE_SIZE(connections_per_gene)) +
+									 act)*sizeof(float));
 		f->genome[m].state =
-			(float*)malloc(((rows*columns) + sens + act)*2*
-						   sizeof(float));
+			(float*)gprc_slab_alloc(&slab,
+									((rows*columns) + sens + act)*2*
+									sizeof(float));
 		f->genome[m].used =
-			(unsigned char*)malloc(((rows*columns) + sens + act)*
-								   sizeof(unsigned char));
+			(unsigned char*)gprc_slab_alloc(&slab,
+											((rows*columns) +
+											 sens + act)*
+											sizeof(unsigned char));
+		f->genome[m].active =
+			(int*)gprc_slab_alloc(&slab, rows*columns*sizeof(int));
+		f->genome[m].function_type =
+			(int*)gprc_slab_alloc(&slab, rows*columns*sizeof(int));
+		f->genome[m].connection =
+			(int*)gprc_slab_alloc(&slab,
+								  rows*columns*connections_per_gene*
+								  sizeof(int));
+		f->genome[m].no_of_active = 0;
+		f->genome[m].active_valid = 0;
 	}
 
 	/* clear the state */
@@ -314,12 +378,49 @@ void gprc_init(gprc_function * f,
 
 	f->age = 0;
 
-	f->temp_genes = (int*)malloc(GPRC_MAX_ADF_GENES*3*sizeof(int));
+	f->temp_genes =
+		(int*)gprc_slab_alloc(&slab, GPRC_MAX_ADF_GENES*3*sizeof(int));
+
+	if (slab != 0) {
+		gpr_data_init_block(&f->data,
+							(unsigned int)data_size,
+							(unsigned int)data_fields,
+							(float*)gprc_slab_alloc(&slab,
+													gpr_data_length(data_size,
+																	data_fields)*
+													sizeof(float)));
+	}
+	else {
+		gpr_data_init(&f->data,
+					  (unsigned int)data_size,
+					  (unsigned int)data_fields);
+	}
+}
+
+/* initialize an individual */
+void gprc_init(gprc_function * f,
+			   int rows, int columns, int sensors, int actuators,
+			   int connections_per_gene,
+			   int ADF_modules,
+			   int data_size, int data_fields,
+			   unsigned int * random_seed)
+{
+	gprc_init_slab(f, rows, columns, sensors, actuators,
+				   connections_per_gene, ADF_modules,
+				   data_size, data_fields, random_seed, 0);
+}
 
-	gpr_data_init(&f->data,
-				  (unsigned int)data_size,
-				  (unsigned int)data_fields);
+/* deallocate sensor sources and actuator destinations,
+   which are never held within a slab */
+static void gprc_free_sources(gprc_function * f)
+{
+	if (f->no_of_sensor_sources>0) {
+		free(f->sensor_source);
+	}
 
+	if (f->no_of_actuator_destinations>0) {
+		free(f->actuator_destination);
+	}
 }
 
 /* deallocate memory for an individual */
@@ -329,15 +430,12 @@ void gprc_free(gprc_function * f)
 		free(f->genome[m].gene);
 		free(f->genome[m].state);
 		free(f->genome[m].used);
+		free(f->genome[m].active);
+		free(f->genome[m].function_type);
+		free(f->genome[m].connection);
 	}
 
-	if (f->no_of_sensor_sources>0) {
-		free(f->sensor_source);
-	}
-
-	if (f->no_of_actuator_destinations>0) {
-		free(f->actuator_destination);
-	}
+	gprc_free_sources(f);
 	free(f->temp_genes);
 	gpr_data_free(&f->data);
 }
@@ -707,89 +805,172 @@ static int gprc_get_used_gene(gprc_function * f,
 	return -1;
 }
 
+/* decodes the function type and connections for the given gene */
+static void gprc_decode_gene(gprc_ADF_module * f, int index,
+							 int connections_per_gene)
+{
+	int c;
+	float * gp = &f->gene[index*GPRC_GENE_SIZE(connections_per_gene)];
+	int * con = &f->connection[index*connections_per_gene];
+
+	f->function_type[index] = (int)gp[GPRC_GENE_FUNCTION_TYPE];
+	for (c = 0; c < connections_per_gene; c++) {
+		con[c] = (int)gp[GPRC_INITIAL+c];
+	}
+}
+
+/* Updates the list of used genes in the order in which they run,
+   together with the decoded function types and connections,
+   so that programs can be run without visiting unused genes */
+static void gprc_update_active(gprc_ADF_module * f,
+							   int rows, int columns,
+							   int connections_per_gene,
+							   int sensors)
+{
+	int i;
+
+	f->no_of_active = 0;
+	for (i = 0; i < rows*columns; i++) {
+		gprc_decode_gene(f, i, connections_per_gene);
+		if (f->used[i+sensors] != 0) {
+			f->active[f->no_of_active++] = i;
+		}
+	}
+	f->active_valid = 1;
+}
+
+/* This should be called after the genome has been changed,
+   so that the list of used genes is updated before the
+   program is next run */
+void gprc_genome_changed(gprc_function * f)
+{
+	int m;
+
+	for (m = 0; m < f->ADF_modules+1; m++) {
+		f->genome[m].active_valid = 0;
+	}
+}
+
+/* returns the range of connections which are inputs to a gene */
+static void gprc_gene_inputs(float * gp, int connections_per_gene,
+							 int * min, int * max)
+{
+	int function_type = (int)gp[GPRC_GENE_FUNCTION_TYPE];
+
+	*min = 0;
+	*max =
+		gprc_function_args(function_type,
+						   gp[GPRC_GENE_CONSTANT],
+						   connections_per_gene,
+						   (int)gp[GPRC_INITIAL]);
+
+	if (function_type == GPR_FUNCTION_ADF) {
+		*min = 1;
+		(*max)++;
+	}
+}
+
+/* Marks the given index as used, adding it to the pending list if it
+   is a gene whose own connections have not yet been traced */
+static void gprc_mark_used(gprc_ADF_module * f, int connection_index,
+						   int * pending, int * no_of_pending,
+						   int no_of_genes, int sensors)
+{
+	if (f->used[connection_index] == 1) return;
+
+	f->used[connection_index] = 1;
+	if ((connection_index >= sensors) &&
+		(connection_index < sensors+no_of_genes)) {
+		pending[(*no_of_pending)++] = connection_index - sensors;
+	}
+}
+
+/* Traces backwards from the genes within the pending list, marking
+   every gene which they connect to as used.
+   Returns non-zero if a connection is out of range */
+static int gprc_trace_used(gprc_ADF_module * f,
+						   int * pending, int no_of_pending,
+						   int rows, int columns,
+						   int connections_per_gene,
+						   int sensors, int actuators)
+{
+	int index, c, min, max, connection_index;
+	int no_of_genes = rows*columns;
+	float * gp;
+
+	while (no_of_pending > 0) {
+		index = pending[--no_of_pending];
+		gp = &f->gene[index*GPRC_GENE_SIZE(connections_per_gene)];
+		gprc_gene_inputs(gp, connections_per_gene, &min, &max);
+
+		for (c = min; c < max; c++) {
+			/* get the prior connection */
+			connection_index = (int)gp[GPRC_INITIAL + c];
+			if (connection_index >=
+				sensors+actuators+no_of_genes) {
+				printf("Connection %d out of range %d/%d\n",
+					   c, connection_index,
+					   sensors+actuators+no_of_genes);
+				return -1;
+			}
+			if (connection_index < 0) {
+				printf("Connection %d out of range %d\n",
+					   c, connection_index);
+				return -1;
+			}
+			gprc_mark_used(f, connection_index,
+						   pending, &no_of_pending,
+						   no_of_genes, sensors);
+		}
+	}
+	return 0;
+}
+
 /* the purpose of this is to discover which functions within
    the grid are actually used as part of the input -> output
-   transformation. */
+   transformation. Genes are traced backwards from the actuators
+   using a worklist, so each used gene is only visited once */
 static void gprc_used_genes(gprc_ADF_module * f,
 							int rows, int columns,
 							int connections_per_gene,
 							int sensors, int actuators)
 {
-    int row,col,index=0,index2,c,connection_index,ctr,prev_ctr,n;
-	int min,max,function_type;
+	int index, n;
+	int no_of_genes = rows*columns;
 	int array_bytes =
-		(sensors+actuators+(rows*columns))*sizeof(unsigned char);
+		(sensors+actuators+no_of_genes)*sizeof(unsigned char);
+	/* genes which have been marked but not yet traced.
+	   The list of active genes is rebuilt afterwards, so its
+	   array can be used for this */
+	int * pending = f->active;
+	int no_of_pending = 0;
 
 	/* clear the array */
 	memset((void*)f->used,'\0',array_bytes);
+	f->active_valid = 0;
 
 	/* mark actuators as traced */
 	for (index=0; index < actuators; index++) {
-		f->used[sensors+(rows*columns)+index]=1;
+		f->used[sensors+no_of_genes+index]=1;
 	}
 
-	/* propagate backwards */
-	ctr = 0;
-	prev_ctr = -1;
-	while (ctr > prev_ctr) {
-		prev_ctr = ctr;
-		index = 0;
-		n = 0;
-		for (col = 0; col < columns; col++) {
-			for (row = 0; row < rows; row++, index++,
-					 n += GPRC_GENE_SIZE(connections_per_gene)) {
-				/* has been traced */
-				if (f->used[index + sensors] == 1) {
-
-					function_type = (int)f->gene[n];
-					min=0;
-					max =
-						gprc_function_args(function_type,
-										   f->gene[n+GPRC_GENE_CONSTANT],
-										   connections_per_gene,
-										   (int)f->gene[n+GPRC_INITIAL]);
-
-					if (function_type==GPR_FUNCTION_ADF) {
-						min=1;
-						max++;
-					}
+	/* mark the genes connected to the actuators */
+	n = no_of_genes*GPRC_GENE_SIZE(connections_per_gene);
+	for (index = 0; index < actuators; index++, n++) {
+		gprc_mark_used(f, (int)f->gene[n],
+					   pending, &no_of_pending,
+					   no_of_genes, sensors);
+	}
 
-					for (c = min; c < max; c++) {
-						/* get the prior connection */
-						connection_index =
-							(int)f->gene[n + GPRC_INITIAL + c];
-						if (connection_index >=
-							sensors+actuators+(rows*columns)) {
-							printf("Connection %d out of range %d/%d\n",
-								   c, connection_index,
-								   sensors+actuators+(rows*columns));
-							return;
-						}
-						if (connection_index < 0) {
-							printf("Connection %d out of range %d\n",
-								   c, connection_index);
-							return;
-						}
-						/* prior has not been traced */
-						if (f->used[connection_index] == 0) {
-							/* mark the prior as traced */
-							f->used[connection_index] = 1;
-							ctr++;
-						}
-					}
-				}
-			}
-		}
-		for (index2 = 0; index2 < actuators; index2++, n++) {
-			connection_index = (int)f->gene[n];
-			/* prior has not been traced */
-			if (f->used[connection_index] == 0) {
-				/* mark the prior as traced */
-				f->used[connection_index]=1;
-				ctr++;
-			}
-		}
+	/* propagate backwards */
+	if (gprc_trace_used(f, pending, no_of_pending,
+						rows, columns, connections_per_gene,
+						sensors, actuators) != 0) {
+		return;
 	}
+
+	/* update the list of genes to be run */
+	gprc_update_active(f, rows, columns, connections_per_gene, sensors);
 }
 
 /* the purpose of this is to discover which functions within
@@ -810,6 +991,209 @@ void gprc_used_functions(gprc_function * f,
 	}
 }							  
 
+/* discovers which functions are used within a single module,
+   leaving the number of arguments of each ADF unchanged */
+void gprc_used_functions_module(gprc_function * f, int ADF_module,
+								int rows, int columns,
+								int connections_per_gene,
+								int sensors, int actuators)
+{
+	gprc_used_genes(&f->genome[ADF_module],
+					rows, columns,
+					connections_per_gene,
+					gprc_get_sensors(ADF_module, sensors),
+					gprc_get_actuators(ADF_module, actuators));
+}
+
+/* Returns the connections which are inputs to a gene, or to an
+   actuator if the index is rows*columns or above */
+static float * gprc_changed_inputs(float * gp, int index, int no_of_genes,
+								   int connections_per_gene,
+								   int * min, int * max)
+{
+	if (index >= no_of_genes) {
+		*min = 0;
+		*max = 1;
+		return gp;
+	}
+	gprc_gene_inputs(gp, connections_per_gene, min, max);
+	return &gp[GPRC_INITIAL];
+}
+
+/* Unmarks the given index and anything which it leads to,
+   so that they become candidates for removal */
+static int gprc_unmark_used(gprc_ADF_module * f, int connection_index,
+							int * pending, int no_of_genes,
+							int connections_per_gene, int sensors)
+{
+	int c, min, max, no_of_pending = 0, unmarked = 0;
+	float * gp;
+
+	if ((connection_index < 0) ||
+		(connection_index >= sensors+no_of_genes) ||
+		(f->used[connection_index] != 1)) {
+		return 0;
+	}
+	f->used[connection_index] = 2;
+	unmarked++;
+	if (connection_index >= sensors) {
+		pending[no_of_pending++] = connection_index - sensors;
+	}
+	while (no_of_pending > 0) {
+		gp = &f->gene[pending[--no_of_pending]*
+					  GPRC_GENE_SIZE(connections_per_gene)];
+		gprc_gene_inputs(gp, connections_per_gene, &min, &max);
+		for (c = min; c < max; c++) {
+			connection_index = (int)gp[GPRC_INITIAL + c];
+			if ((connection_index < 0) ||
+				(connection_index >= sensors+no_of_genes) ||
+				(f->used[connection_index] != 1)) {
+				continue;
+			}
+			f->used[connection_index] = 2;
+			unmarked++;
+			if (connection_index >= sensors) {
+				pending[no_of_pending++] = connection_index - sensors;
+			}
+		}
+	}
+	return unmarked;
+}
+
+/* Updates the used genes after a single gene within the given
+   module has been changed.  Genes with index rows*columns or above
+   are the actuator connections.  previous contains the values of the
+   gene before it was changed.  This assumes that the used genes were
+   up to date before the change.
+   Changes to unused genes have no effect upon the program, so they
+   don't need to be traced.  Otherwise only the cone of genes which
+   the changed gene connects to, before or after the change, is
+   retraced: genes which the removed connections lead to are
+   unmarked, genes which the new connections lead to are marked,
+   and unmarked genes which some other used gene still connects to
+   are marked again.
+   Returns non-zero if the change may alter the program behavior */
+int gprc_used_genes_changed(gprc_function * f,
+							int ADF_module, int index,
+							float * previous,
+							int rows, int columns,
+							int connections_per_gene,
+							int sensors, int actuators)
+{
+	gprc_ADF_module * genome = &f->genome[ADF_module];
+	int sens = gprc_get_sensors(ADF_module, sensors);
+	int act = gprc_get_actuators(ADF_module, actuators);
+	int no_of_genes = rows*columns;
+	int gene_size = GPRC_GENE_SIZE(connections_per_gene);
+	int i, j, c, min, max, new_min, new_max, connection_index;
+	int * pending = genome->active;
+	int no_of_pending = 0, unmarked = 0, marked = 0;
+	float * changed, * old_inputs, * new_inputs, * gp;
+
+	if (index < no_of_genes) {
+		if (genome->used[sens+index] == 0) {
+			/* an unused gene: only its decoded form is updated */
+			if (genome->active_valid != 0) {
+				gprc_decode_gene(genome, index, connections_per_gene);
+			}
+			return 0;
+		}
+		changed = &genome->gene[index*gene_size];
+	}
+	else {
+		changed = &genome->gene[no_of_genes*gene_size +
+								index - no_of_genes];
+	}
+
+	old_inputs =
+		gprc_changed_inputs(previous, index, no_of_genes,
+							connections_per_gene, &min, &max);
+	new_inputs =
+		gprc_changed_inputs(changed, index, no_of_genes,
+							connections_per_gene, &new_min, &new_max);
+
+	/* anything which the removed connections lead to
+	   may no longer be used */
+	for (i = min; i < max; i++) {
+		connection_index = (int)old_inputs[i];
+		for (j = new_min; j < new_max; j++) {
+			if ((int)new_inputs[j] == connection_index) break;
+		}
+		if (j < new_max) continue;
+		unmarked +=
+			gprc_unmark_used(genome, connection_index, pending,
+							 no_of_genes, connections_per_gene, sens);
+	}
+
+	/* anything which the new connections lead to is used,
+	   unless the changed gene itself is no longer used */
+	if ((index >= no_of_genes) || (genome->used[sens+index] == 1)) {
+		for (j = new_min; j < new_max; j++) {
+			connection_index = (int)new_inputs[j];
+			if ((connection_index < 0) ||
+				(connection_index >= sens+act+no_of_genes) ||
+				(genome->used[connection_index] == 1)) {
+				continue;
+			}
+			gprc_mark_used(genome, connection_index,
+						   pending, &no_of_pending,
+						   no_of_genes, sens);
+			gprc_trace_used(genome, pending, no_of_pending,
+							rows, columns, connections_per_gene,
+							sens, act);
+			no_of_pending = 0;
+			marked++;
+		}
+	}
+
+	if (unmarked > 0) {
+		/* unmarked genes which other used genes or actuators
+		   connect to are still used */
+		for (i = 0; i <= no_of_genes; i++) {
+			if (i == no_of_genes) {
+				gp = &genome->gene[no_of_genes*gene_size];
+				min = 0;
+				max = act;
+			}
+			else {
+				if (genome->used[sens+i] != 1) continue;
+				gprc_gene_inputs(&genome->gene[i*gene_size],
+								 connections_per_gene, &min, &max);
+				gp = &genome->gene[i*gene_size + GPRC_INITIAL];
+			}
+			for (c = min; c < max; c++) {
+				connection_index = (int)gp[c];
+				if ((connection_index < 0) ||
+					(connection_index >= sens+no_of_genes) ||
+					(genome->used[connection_index] != 2)) {
+					continue;
+				}
+				gprc_mark_used(genome, connection_index,
+							   pending, &no_of_pending,
+							   no_of_genes, sens);
+				gprc_trace_used(genome, pending, no_of_pending,
+								rows, columns, connections_per_gene,
+								sens, act);
+				no_of_pending = 0;
+			}
+		}
+
+		/* anything remaining is no longer used */
+		for (i = 0; i < sens+no_of_genes; i++) {
+			if (genome->used[i] == 2) genome->used[i] = 0;
+		}
+	}
+
+	if ((unmarked > 0) || (marked > 0)) {
+		/* the list of active genes was used for tracing */
+		genome->active_valid = 0;
+	}
+	else if ((index < no_of_genes) && (genome->active_valid != 0)) {
+		gprc_decode_gene(genome, index, connections_per_gene);
+	}
+	return 1;
+}
+
 /* Tries to convert code within the given module into
    an automatically defined function */
 int gprc_compress_ADF(gprc_function * f,
@@ -826,6 +1210,8 @@ int gprc_compress_ADF(gprc_function * f,
 	int no_of_genes = 0;
 	int no_of_inputs = 0;
 
+	gprc_genome_changed(f);
+
 	if (f->ADF_modules == 0) return -1;
 
 	/* does an unused ADF exist? */
@@ -941,6 +1327,8 @@ void gprc_remove_ADFs(gprc_function * f,
 	int index,n,function_type,m;
 	float * gene;
 
+	gprc_genome_changed(f);
+
 	for (m = 0; m < f->ADF_modules+1; m++) {
 		gene = f->genome[m].gene;
 		n = 0;
@@ -954,16 +1342,22 @@ void gprc_remove_ADFs(gprc_function * f,
 	}
 }
 
-void gprc_valid_ADFs(gprc_function * f,
-					 int rows, int columns,
-					 int connections_per_gene,
-					 int sensors,
-					 float min_value, float max_value)
+/* ensures that ADF calls are valid.  If previous is not NULL then
+   the used genes are updated as each gene is changed, with previous
+   being used to store the gene before the change */
+static void gprc_check_ADFs(gprc_function * f,
+							int rows, int columns,
+							int connections_per_gene,
+							int sensors, int actuators,
+							float min_value, float max_value,
+							float * previous)
 {
 	int m, n, function_type, ADF_module_index;
 	int new_connection,row,col,previous_values;
 	float v;
 
+	gprc_genome_changed(f);
+
 	/*for (m = 0; m < f->ADF_modules+1; m++) {*/
 	for (m = 0; m < 1; m++) {
 		n=0;
@@ -980,6 +1374,12 @@ void gprc_valid_ADFs(gprc_function * f,
 				}
 				
 				if (function_type == GPR_FUNCTION_ADF) {
+					if (previous != NULL) {
+						memcpy((void*)previous,
+							   (void*)&f->genome[m].gene[n],
+							   GPRC_GENE_SIZE(connections_per_gene)*
+							   sizeof(float));
+					}
 					if ((m > 0) || (f->ADF_modules == 0)) {
 						f->genome[m].gene[n] = GPR_FUNCTION_VALUE;
 
@@ -1007,22 +1407,43 @@ void gprc_valid_ADFs(gprc_function * f,
 						}
 						*/
 					}
+					if (previous != NULL) {
+						gprc_used_genes_changed(f, m,
+												n/GPRC_GENE_SIZE(connections_per_gene),
+												previous,
+												rows, columns,
+												connections_per_gene,
+												sensors, actuators);
+					}
 				}
 			}
 		}
 	}
-}								 
+}
+
+void gprc_valid_ADFs(gprc_function * f,
+					 int rows, int columns,
+					 int connections_per_gene,
+					 int sensors,
+					 float min_value, float max_value)
+{
+	gprc_check_ADFs(f, rows, columns, connections_per_gene,
+					sensors, 0, min_value, max_value, NULL);
+}
 
 /* for functions which have two inputs make sure that the
    inputs are from different sources in some cases */
-static void gprc_ADF_valid_logical_operators(gprc_ADF_module * f,
+static void gprc_ADF_valid_logical_operators(gprc_function * program,
+											 int ADF_module,
 											 int rows, int columns,
 											 int connections_per_gene,
-											 int sensors,
-											 unsigned int * random_seed)
+											 int sensors, int actuators,
+											 unsigned int * random_seed,
+											 float * previous)
 {
 	int row,col,n=0,previous_values,function_type,index;
 	int attempts,max;
+	gprc_ADF_module * f = &program->genome[ADF_module];
 
 	for (col = 0; col < columns; col++) {
 		previous_values = (col*rows) + sensors;
@@ -1044,6 +1465,12 @@ static void gprc_ADF_valid_logical_operators(gprc_ADF_module * f,
 
 			/* look for connections which are the same */
 			index = gprc_same_connections(&f->gene[n],max);
+			if (index == -1) continue;
+			if (previous != NULL) {
+				memcpy((void*)previous, (void*)&f->gene[n],
+					   GPRC_GENE_SIZE(connections_per_gene)*
+					   sizeof(float));
+			}
 			attempts=0;
 			while ((index>-1) && (attempts<5)) {
 				/* change the connection */
@@ -1055,6 +1482,14 @@ static void gprc_ADF_valid_logical_operators(gprc_ADF_module * f,
 			if ((attempts==5) && (max>2)) {
 				f->gene[n+GPRC_GENE_CONSTANT] = 0;
 			}
+			if (previous != NULL) {
+				gprc_used_genes_changed(program, ADF_module,
+										n/GPRC_GENE_SIZE(connections_per_gene),
+										previous,
+										rows, columns,
+										connections_per_gene,
+										sensors, actuators);
+			}
 		}
 	}
 }
@@ -1070,20 +1505,22 @@ void gprc_valid_logical_operators(gprc_function * f,
 	int m;
 
 	for (m = 0; m < f->ADF_modules+1; m++) {
-		gprc_ADF_valid_logical_operators(&f->genome[m],
+		gprc_ADF_valid_logical_operators(f, m,
 										 rows, columns,
 										 connections_per_gene,
-										 gprc_get_sensors(m,sensors),
-										 random_seed);
+										 sensors, 0,
+										 random_seed, NULL);
 	}
 }
 
-/* ensures that the output sources are unique */
-void gprc_unique_outputs(gprc_function * f,
-						 int rows, int columns,
-						 int connections_per_gene,
-						 int sensors, int actuators,
-						 unsigned int * random_seed)
+/* ensures that the output sources are unique.  If previous is not
+   NULL then the used genes are updated as each output is changed */
+static void gprc_check_unique_outputs(gprc_function * f,
+									  int rows, int columns,
+									  int connections_per_gene,
+									  int sensors, int actuators,
+									  unsigned int * random_seed,
+									  float * previous)
 {
 	int i,j,changes,attempts,m,act,sens;
 	int n = rows*columns*GPRC_GENE_SIZE(connections_per_gene);
@@ -1104,9 +1541,18 @@ void gprc_unique_outputs(gprc_function * f,
 			for (i = 0; i < act; i++) {
 				for (j = i+1; j < act; j++) {
 					if ((int)gene[n+i] == (int)gene[n+j]) {
+						if (previous != NULL) previous[0] = gene[n+i];
 						gene[n+i] =
 							sens + (int)rand_num(random_seed)%
 							(rows*columns);
+						if (previous != NULL) {
+							gprc_used_genes_changed(f, m,
+													rows*columns + i,
+													previous,
+													rows, columns,
+													connections_per_gene,
+													sensors, actuators);
+						}
 						changes++;
 						break;
 					}
@@ -1117,6 +1563,19 @@ void gprc_unique_outputs(gprc_function * f,
 	}
 }
 
+/* ensures that the output sources are unique */
+void gprc_unique_outputs(gprc_function * f,
+						 int rows, int columns,
+						 int connections_per_gene,
+						 int sensors, int actuators,
+						 unsigned int * random_seed)
+{
+	gprc_check_unique_outputs(f, rows, columns,
+							  connections_per_gene,
+							  sensors, actuators,
+							  random_seed, NULL);
+}
+
 /* forces the given individual to be valid */
 void gprc_tidy(gprc_function * f,
 			   int rows, int columns,
@@ -1124,6 +1583,8 @@ void gprc_tidy(gprc_function * f,
 			   int connections_per_gene,
 			   float min_value, float max_value)
 {
+	gprc_genome_changed(f);
+
 	/* check that output connections are unique */
 	gprc_unique_outputs(f, rows, columns,
 						connections_per_gene,
@@ -1325,6 +1786,8 @@ void gprc_random(gprc_function * f,
 	int col,row,n,i,j,w,previous_values,m,act,function_type;
 	float * gene;
 
+	gprc_genome_changed(f);
+
 	/* for each ADF_module */
 	/*for (m = 0; m < f->ADF_modules+1; m++) {*/
 	for (m = 0; m < 1; m++) {
@@ -1828,12 +2291,14 @@ static void gprc_swap_chromosomes(gprc_function * f,
 	}
 }
 
-/* randomly permutes connections within genes */
+/* randomly permutes connections within genes, updating
+   the used genes as each gene is changed */
 static void	gprc_mutation_permute(gprc_function * f,
 								  int rows, int columns,
 								  int connections_per_gene,
+								  int sensors, int actuators,
 								  unsigned int * random_seed,
-								  float prob)
+								  float prob, float * previous)
 {
 	int no_of_mutations, i, index, con1, con2, col;
 	int previous_values, m, n, function_type, min, max;
@@ -1866,6 +2331,8 @@ static void	gprc_mutation_permute(gprc_function * f,
 			con2 = min + (rand_num(random_seed)%(max-min));
 			if (con1==con2) continue;
 
+			memcpy((void*)previous, (void*)&gene[n],
+				   GPRC_GENE_SIZE(connections_per_gene)*sizeof(float));
 
 			if ((gene[n+GPRC_INITIAL+con1] < 0) ||
 				(gene[n+GPRC_INITIAL+con1] >= previous_values)) {
@@ -1882,11 +2349,18 @@ static void	gprc_mutation_permute(gprc_function * f,
 			temp = gene[n+GPRC_INITIAL+con1];
 			gene[n+GPRC_INITIAL+con1] = gene[n+GPRC_INITIAL+con2];
 			gene[n+GPRC_INITIAL+con2] = temp;
+
+			gprc_used_genes_changed(f, m, index, previous,
+									rows, columns,
+									connections_per_gene,
+									sensors, actuators);
 		}
 	}
 }
 
-/* mutates an individual */
+/* mutates an individual.  The used genes are updated as each gene
+   is changed, so if they were up to date before the mutation then
+   they will also be up to date afterwards */
 void gprc_mutate(gprc_function * f,
 				 int rows, int columns,
 				 int sensors, int actuators,
@@ -1901,9 +2375,17 @@ void gprc_mutate(gprc_function * f,
 	int no_of_mutations,function_type,call_ADF_module;
 	int i,m,index,locn,col,new_connection;
 	int sens, act, gene_index, conn_index;
-	float * gene;
+	float * gene, * previous;
 	int step = GPRC_GENE_SIZE(connections_per_gene);
 
+	gprc_genome_changed(f);
+
+	/* the value of a gene before it was mutated */
+	previous = (float*)malloc(step*sizeof(float));
+#ifdef DEBUG
+	assert(previous!=0);
+#endif
+
 	/* mutate sensor sources */
 	if (f->no_of_sensor_sources > 0) {
 		for (i = 0; i < sensors; i++) {
@@ -1945,6 +2427,13 @@ void gprc_mutate(gprc_function * f,
 									  chromosomes,
 									  chromosomes,
 									  (rand_num(&f->random_seed)%5)-2);
+
+				/* many genes may have moved */
+				gprc_used_genes(&f->genome[m],
+								rows, columns,
+								connections_per_gene,
+								gprc_get_sensors(m,sensors),
+								gprc_get_actuators(m,actuators));
 			}
 		}
 
@@ -1958,15 +2447,23 @@ void gprc_mutate(gprc_function * f,
 				rand_num(&f->random_seed)%(rows*columns*step + act);
 			if (index < act) {
 				/* mutate actuators */
+				previous[0] = gene[rows*columns*step + index];
 				gprc_set_output_source(f, m, rows, columns,
 									   connections_per_gene,
 									   index,
 									   sens + rand_num(&f->random_seed)%
 									   (rows*columns));
+				gprc_used_genes_changed(f, m, rows*columns + index,
+										previous,
+										rows, columns,
+										connections_per_gene,
+										sensors, actuators);
 			}
 			else {
 				index -= act;
 				locn = index % step;
+				memcpy((void*)previous, (void*)&gene[index - locn],
+					   step*sizeof(float));
 				/* first value */
 				if (locn == GPRC_GENE_FUNCTION_TYPE) {
 					/* function type */
@@ -2099,28 +2596,39 @@ void gprc_mutate(gprc_function * f,
 						}
 					}
 				}
+				gprc_used_genes_changed(f, m, index / step, previous,
+										rows, columns,
+										connections_per_gene,
+										sensors, actuators);
 			}
 		}
 	}
 
 	/* connection permutations */
 	gprc_mutation_permute(f, rows, columns, connections_per_gene,
-						  &f->random_seed,prob*0.25f);
+						  sensors, actuators,
+						  &f->random_seed, prob*0.25f, previous);
 
 	/* make sure thet output sources are unique */
-	gprc_unique_outputs(f, rows, columns, connections_per_gene,
-						sensors, actuators, &f->random_seed);
+	gprc_check_unique_outputs(f, rows, columns, connections_per_gene,
+							  sensors, actuators, &f->random_seed,
+							  previous);
 
 	/* ensure that any logical operators have valid inputs */
-	gprc_valid_logical_operators(f, rows, columns,
-								 connections_per_gene,
-								 sensors, &f->random_seed);
+	for (m = 0; m < f->ADF_modules+1; m++) {
+		gprc_ADF_valid_logical_operators(f, m, rows, columns,
+										 connections_per_gene,
+										 sensors, actuators,
+										 &f->random_seed, previous);
+	}
 
 	/* ensure that ADF calls are valid */
-	gprc_valid_ADFs(f, rows, columns,
+	gprc_check_ADFs(f, rows, columns,
 					connections_per_gene,
-					sensors,
-					min_value, max_value);
+					sensors, actuators,
+					min_value, max_value, previous);
+
+	free(previous);
 }
 
 /* validate the genome */
@@ -2260,7 +2768,8 @@ int gprc_validate(gprc_function * f,
 	return GPR_VALIDATE_OK;
 }
 
-/* runs an ADF */
+/* runs an ADF.  A negative integers_only value runs the
+   real only version */
 static void gprc_c_run_ADF(gprc_function * f,
 						   int ADF_module, int i,
 						   float * gp,
@@ -2318,7 +2827,15 @@ static void gprc_c_run_ADF(gprc_function * f,
 
 	/* run the ADF_module */
 	for (itt = 0; itt < 2; itt++) {
-		if (integers_only < 1) {
+		if (integers_only < 0) {
+			gprc_run_real(f, call_ADF_module,
+						  rows, columns,
+						  connections_per_gene,
+						  sensors, actuators,
+						  dropout_prob, dynamic,
+						  (*custom_function));
+		}
+		else if (integers_only < 1) {
 			gprc_run_float(f, call_ADF_module,
 						   rows, columns,
 						   connections_per_gene,
@@ -2355,40 +2872,47 @@ void gprc_run_float(gprc_function * f,
 					int dynamic,
 					float (*custom_function)(float,float,float))
 {
-	int row,col,n=0,i=0,j,k,g,ctr,src,dest,no_of_args;
+	int n,i=0,j,k,g,ctr,src,dest,no_of_args,no_of_genes;
+	int * con;
 	float * gp, a, b, c, d, a2, b2;
 	int gene_size = GPRC_GENE_SIZE(connections_per_gene);
 	int block_from, block_to, act, no_of_states;
 	int dropout = (int)(dropout_prob*10000);
 	int sens = gprc_get_sensors(ADF_module,sensors);
 	float * gene = f->genome[ADF_module].gene;
-	unsigned char * used = f->genome[ADF_module].used;
+	gprc_ADF_module * module = &f->genome[ADF_module];
 	float * state = f->genome[ADF_module].state;
 
 	act = gprc_get_actuators(ADF_module,actuators);
 	no_of_states = (rows*columns) + sens + act;
 
-	for (col = 0; col < columns; col++) {
-		for (row = 0; row < rows; row++, i++,n+=gene_size) {
+	if (module->active_valid == 0) {
+		gprc_update_active(module, rows, columns,
+						   connections_per_gene, sens);
+	}
 
-			/* if this function is not on the path
-			   between sensors and actuators then skip it
-			   since it has no effect upon the program behavior */
-			if ((dynamic <= 0) && (used[i+sens] == 0)) {
-				continue;
-			}
+	/* Functions which are not on the path between sensors and
+	   actuators have no effect upon the program behavior,
+	   so unless the program is dynamic only the used genes
+	   are run */
+	no_of_genes = rows*columns;
+	if (dynamic <= 0) no_of_genes = module->no_of_active;
 
-			/* occasional dropout helps to avoid overfitting*/
-			if (rand_num(&f->random_seed)%10000<dropout) continue;
+	for (g = 0; g < no_of_genes; g++) {
+		i = g;
+		if (dynamic <= 0) i = module->active[g];
 
-			gp = &gene[n];
-			switch((int)gp[GPRC_GENE_FUNCTION_TYPE]) {
+		/* occasional dropout helps to avoid overfitting*/
+		if (rand_num(&f->random_seed)%10000 >= dropout) {
+			gp = &gene[i*gene_size];
+			con = &module->connection[i*connections_per_gene];
+			switch(module->function_type[i]) {
 			case GPR_FUNCTION_DATA_PUSH: {
 				if ((f->data.size > 0) && (f->data.fields > 0)) {
 					gpr_data_set_head(&f->data,
-									  ((unsigned int)state[(int)gp[GPRC_INITIAL]])%f->data.fields,
-									  state[(int)gp[GPRC_INITIAL+1]],
-									  state[(int)gp[GPRC_INITIAL+1]+no_of_states]);
+									  ((unsigned int)state[con[0]])%f->data.fields,
+									  state[con[1]],
+									  state[con[1]+no_of_states]);
 					gpr_data_push(&f->data);
 				}
 				break;
@@ -2396,7 +2920,7 @@ void gprc_run_float(gprc_function * f,
 			case GPR_FUNCTION_DATA_POP: {
 				if ((f->data.size > 0) && (f->data.fields > 0)) {
 					gpr_data_get_tail(&f->data,
-									  ((unsigned int)state[(int)gp[GPRC_INITIAL]])%f->data.fields,
+									  ((unsigned int)state[con[0]])%f->data.fields,
 									  &state[sens+i],
 									  &state[sens+i+no_of_states]);
 					gpr_data_pop(&f->data);
@@ -2406,8 +2930,8 @@ void gprc_run_float(gprc_function * f,
 			case GPR_FUNCTION_DATA_GET: {
 				if ((f->data.size > 0) && (f->data.fields > 0)) {
 					gpr_data_get_elem(&f->data,
-									  (unsigned int)state[(int)gp[GPRC_INITIAL]],
-									  ((unsigned int)state[(int)gp[GPRC_INITIAL+1]])%(f->data.fields),
+									  (unsigned int)state[con[0]],
+									  ((unsigned int)state[con[1]])%(f->data.fields),
 									  &state[sens+i],
 									  &state[sens+i+no_of_states]);
 				}
@@ -2416,16 +2940,16 @@ void gprc_run_float(gprc_function * f,
 			case GPR_FUNCTION_DATA_SET: {
 				if ((f->data.size > 0) && (f->data.fields > 0)) {
 					gpr_data_set_elem(&f->data,
-									  (unsigned int)state[(int)gp[GPRC_INITIAL]],
-									  ((unsigned int)state[(int)gp[GPRC_INITIAL+1]])%(f->data.fields),
+									  (unsigned int)state[con[0]],
+									  ((unsigned int)state[con[1]])%(f->data.fields),
 									  state[sens+i],
 									  state[sens+i+no_of_states]);
 				}
 				break;
 			}
 			case GPR_FUNCTION_GET: {				
-				j = abs((int)state[(int)gp[GPRC_INITIAL]] +
-						(int)state[(int)gp[1+GPRC_INITIAL]])
+				j = abs((int)state[con[0]] +
+						(int)state[con[1]])
 					%(rows*columns);
 				state[sens+i] = state[sens+j];
 				state[sens+i+no_of_states] =
@@ -2433,13 +2957,13 @@ void gprc_run_float(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_SET: {
-				j = abs((int)state[(int)gp[1+GPRC_INITIAL]])
+				j = abs((int)state[con[1]])
 					%(rows*columns);
 				state[sens+i] = gp[GPRC_GENE_CONSTANT]*
-					state[(int)gp[GPRC_INITIAL]];
+					state[con[0]];
 				state[sens+i+no_of_states] =
 					gp[GPRC_GENE_CONSTANT]*
-					state[(int)gp[GPRC_INITIAL]+no_of_states];
+					state[con[0]+no_of_states];
 				state[sens+j] = state[sens+i];
 				state[sens+j+no_of_states] =
 					state[sens+i+no_of_states];
@@ -2492,7 +3016,7 @@ void gprc_run_float(gprc_function * f,
 				state[sens+i] = 0;
 				for (j = 0; j < no_of_args; j++) {
 					state[sens+i] +=
-						state[(int)gp[GPRC_INITIAL+j]]*
+						state[con[j]]*
 						gp[GPRC_INITIAL+j+connections_per_gene];
 				}
 
@@ -2507,7 +3031,7 @@ void gprc_run_float(gprc_function * f,
 				/* a is the real part, b is the imaginary part */
 				a = 0; b = 0;
 				for (j = 0; j < no_of_args; j++) {
-					k = (int)gp[GPRC_INITIAL+j];
+					k = con[j];
 					c = state[k];
 					d = state[k + no_of_states];
 					a += c;
@@ -2524,7 +3048,7 @@ void gprc_run_float(gprc_function * f,
 				/* a is the real part, b is the imaginary part */
 				a = 0; b = 0;
 				for (j = 0; j < no_of_args; j++) {
-					k = (int)gp[GPRC_INITIAL+j];
+					k = con[j];
 					c = state[k];
 					d = state[k + no_of_states];
 					if (j > 0) {
@@ -2541,9 +3065,9 @@ void gprc_run_float(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_NEGATE: {
-				state[sens+i] = -state[(int)gp[GPRC_INITIAL]];
+				state[sens+i] = -state[con[0]];
 				state[sens+i+no_of_states] =
-					-state[(int)gp[GPRC_INITIAL]+no_of_states];
+					-state[con[0]+no_of_states];
 				break;
 			}
 			case GPR_FUNCTION_MULTIPLY: {
@@ -2553,7 +3077,7 @@ void gprc_run_float(gprc_function * f,
 				/* a is the real part, b is the imaginary part */
 				a = 0; b = 0;
 				for (j = 0; j < no_of_args; j++) {
-					k = (int)gp[GPRC_INITIAL+j];
+					k = con[j];
 					c = state[k];
 					d = state[k + no_of_states];
 					if (j > 0) {
@@ -2572,16 +3096,16 @@ void gprc_run_float(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_WEIGHT: {
-				state[sens+i] = state[(int)gp[GPRC_INITIAL]] *
+				state[sens+i] = state[con[0]] *
 					gp[GPRC_GENE_CONSTANT];
 				state[sens+i+no_of_states] =
-					state[(int)gp[GPRC_INITIAL]+no_of_states] *
+					state[con[0]+no_of_states] *
 					gp[GPRC_GENE_CONSTANT];
 				break;
 			}
 			case GPR_FUNCTION_DIVIDE: {
-				j = (int)gp[GPRC_INITIAL];
-				k = (int)gp[1+GPRC_INITIAL];
+				j = con[0];
+				k = con[1];
 				if((state[k] <= 1e-1) &&
 				   (state[k] >= -1e-1)) {
 					/* if the real denominator is close to zero
@@ -2608,21 +3132,21 @@ void gprc_run_float(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_MODULUS: {
-				if (fabs(state[(int)gp[1+GPRC_INITIAL]]) <= -1e-1) {
+				if (fabs(state[con[1]]) <= -1e-1) {
 					/* if the denominator is close to zero */
-					state[sens+i] = state[(int)gp[GPRC_INITIAL]];
+					state[sens+i] = state[con[0]];
 					state[sens+i+no_of_states] =
-						state[(int)gp[GPRC_INITIAL]+no_of_states];
+						state[con[0]+no_of_states];
 				}
 				else {
 					/* a is the real part of numerator,
 					   b is the imaginary part or numerator */
-					a = state[(int)gp[GPRC_INITIAL]];
-					b = state[(int)gp[GPRC_INITIAL]+no_of_states];
+					a = state[con[0]];
+					b = state[con[0]+no_of_states];
 					/* c is the real part of denominator,
 					   d is the imaginary part or denominator */
-					c = state[(int)gp[1+GPRC_INITIAL]];
-					d = state[(int)gp[1+GPRC_INITIAL]+no_of_states];
+					c = state[con[1]];
+					d = state[con[1]+no_of_states];
 					if (b+d == 0) {
 						/* if there are no imaginary components */
 						state[sens+i] =	fmod(a,c);
@@ -2641,54 +3165,54 @@ void gprc_run_float(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_FLOOR: {
-				state[sens+i] = floor(state[(int)gp[GPRC_INITIAL]]);
+				state[sens+i] = floor(state[con[0]]);
 				state[sens+i+no_of_states] =
-					floor(state[(int)gp[GPRC_INITIAL]+no_of_states]);
+					floor(state[con[0]+no_of_states]);
 				break;
 			}
 			case GPR_FUNCTION_AVERAGE: {
 				no_of_args =
 					1 + (abs((int)gp[GPRC_GENE_CONSTANT])%
 						 (connections_per_gene-1));
-				state[sens+i] = state[(int)gp[GPRC_INITIAL]];
+				state[sens+i] = state[con[0]];
 				state[sens+i+no_of_states] =
-					state[(int)gp[GPRC_INITIAL]+no_of_states];
+					state[con[0]+no_of_states];
 				for (j = 1; j < no_of_args; j++) {
-					state[sens+i] += state[(int)gp[GPRC_INITIAL+j]];
+					state[sens+i] += state[con[j]];
 					state[sens+i+no_of_states] +=
-						state[(int)gp[GPRC_INITIAL+j]+no_of_states];
+						state[con[j]+no_of_states];
 				}
 				state[sens+i] /= no_of_args;
 				state[sens+i+no_of_states] /= no_of_args;
 				break;
 			}
 			case GPR_FUNCTION_NOOP1: {
-				state[sens+i] = state[(int)gp[GPRC_INITIAL]];
+				state[sens+i] = state[con[0]];
 				state[sens+i+no_of_states] =
-					state[(int)gp[GPRC_INITIAL]+no_of_states];
+					state[con[0]+no_of_states];
 				break;
 			}
 			case GPR_FUNCTION_NOOP2: {
-				state[sens+i] = state[(int)gp[GPRC_INITIAL]];
+				state[sens+i] = state[con[0]];
 				state[sens+i+no_of_states] =
-					state[(int)gp[GPRC_INITIAL]+no_of_states];
+					state[con[0]+no_of_states];
 				break;
 			}
 			case GPR_FUNCTION_NOOP3: {
-				state[sens+i] = state[(int)gp[GPRC_INITIAL]];
+				state[sens+i] = state[con[0]];
 				state[sens+i+no_of_states] =
-					state[(int)gp[GPRC_INITIAL]+no_of_states];
+					state[con[0]+no_of_states];
 				break;
 			}
 			case GPR_FUNCTION_NOOP4: {
-				state[sens+i] = state[(int)gp[GPRC_INITIAL]];
+				state[sens+i] = state[con[0]];
 				state[sens+i+no_of_states] =
-					state[(int)gp[GPRC_INITIAL]+no_of_states];
+					state[con[0]+no_of_states];
 				break;
 			}
 			case GPR_FUNCTION_GREATER_THAN: {
-				if (state[(int)gp[GPRC_INITIAL]] >
-					state[(int)gp[1+GPRC_INITIAL]]) {
+				if (state[con[0]] >
+					state[con[1]]) {
 					state[sens+i] = gp[GPRC_GENE_CONSTANT];
 					state[sens+i+no_of_states] =
 						gp[GPRC_GENE_IMAGINARY];
@@ -2700,8 +3224,8 @@ void gprc_run_float(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_LESS_THAN: {
-				if (state[(int)gp[GPRC_INITIAL]] <
-					state[(int)gp[1+GPRC_INITIAL]]) {
+				if (state[con[0]] <
+					state[con[1]]) {
 					state[sens+i] = gp[GPRC_GENE_CONSTANT];
 					state[sens+i+no_of_states] =
 						gp[GPRC_GENE_IMAGINARY];
@@ -2713,10 +3237,10 @@ void gprc_run_float(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_EQUALS: {
-				if (((int)state[(int)gp[GPRC_INITIAL]] ==
-					(int)state[(int)gp[1+GPRC_INITIAL]]) &&
-					((int)state[(int)gp[GPRC_INITIAL]+no_of_states] ==
-					 (int)state[(int)gp[1+GPRC_INITIAL]+no_of_states])) {
+				if (((int)state[con[0]] ==
+					(int)state[con[1]]) &&
+					((int)state[con[0]+no_of_states] ==
+					 (int)state[con[1]+no_of_states])) {
 					state[sens+i] = gp[GPRC_GENE_CONSTANT];
 					state[sens+i+no_of_states] =
 						gp[GPRC_GENE_IMAGINARY];
@@ -2728,8 +3252,8 @@ void gprc_run_float(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_AND: {
-				if ((state[(int)gp[GPRC_INITIAL]]>0) &&
-					(state[(int)gp[1+GPRC_INITIAL]]>0)) {
+				if ((state[con[0]]>0) &&
+					(state[con[1]]>0)) {
 					state[sens+i] = gp[GPRC_GENE_CONSTANT];
 					state[sens+i+no_of_states] =
 						gp[GPRC_GENE_IMAGINARY];
@@ -2741,8 +3265,8 @@ void gprc_run_float(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_OR: {
-				if ((state[(int)gp[GPRC_INITIAL]]>0) ||
-					(state[(int)gp[1+GPRC_INITIAL]]>0)) {
+				if ((state[con[0]]>0) ||
+					(state[con[1]]>0)) {
 					state[sens+i] = gp[GPRC_GENE_CONSTANT];
 					state[sens+i+no_of_states] =
 						gp[GPRC_GENE_IMAGINARY];
@@ -2754,8 +3278,8 @@ void gprc_run_float(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_XOR: {
-				if ((state[(int)gp[GPRC_INITIAL]]>0) !=
-					(state[(int)gp[1+GPRC_INITIAL]]>0)) {
+				if ((state[con[0]]>0) !=
+					(state[con[1]]>0)) {
 					state[sens+i] = gp[GPRC_GENE_CONSTANT];
 					state[sens+i+no_of_states] =
 						gp[GPRC_GENE_IMAGINARY];
@@ -2767,8 +3291,8 @@ void gprc_run_float(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_NOT: {
-				if (((int)state[(int)gp[GPRC_INITIAL]]) !=
-					((int)state[(int)gp[1+GPRC_INITIAL]])) {
+				if (((int)state[con[0]]) !=
+					((int)state[con[1]])) {
 					state[sens+i] = gp[GPRC_GENE_CONSTANT];
 					state[sens+i+no_of_states] =
 						gp[GPRC_GENE_IMAGINARY];
@@ -2787,7 +3311,7 @@ void gprc_run_float(gprc_function * f,
 				state[sens+i] = 0;
 				for (j = 0; j < no_of_args; j++) {
 					state[sens+i] +=
-						state[(int)gp[GPRC_INITIAL+j]] *
+						state[con[j]] *
 						gp[GPRC_INITIAL+j+connections_per_gene];
 				}
 				/* adjust weights.  Here the imaginary
@@ -2795,7 +3319,7 @@ void gprc_run_float(gprc_function * f,
 				state[sens+i+no_of_states] = 0;
 				for (j = 0; j < no_of_args; j++) {
 					/* change in the weight value */
-					a =	state[sens+i] * state[(int)gp[GPRC_INITIAL+j]] *
+					a =	state[sens+i] * state[con[j]] *
 						GPR_HEBBIAN_LEARNING_RATE;
 					/* alter the weight */
 					gp[GPRC_INITIAL+j+connections_per_gene] += a;
@@ -2805,13 +3329,13 @@ void gprc_run_float(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_EXP: {
-				state[sens+i] = (float)exp(state[(int)gp[GPRC_INITIAL]]);
+				state[sens+i] = (float)exp(state[con[0]]);
 				state[sens+i+no_of_states] =
-					(float)exp(state[(int)gp[GPRC_INITIAL]+no_of_states]);
+					(float)exp(state[con[0]+no_of_states]);
 				break;
 			}
 			case GPR_FUNCTION_SQUARE_ROOT: {
-				k = (int)gp[GPRC_INITIAL];
+				k = con[0];
 				a = state[k];
 				b = state[k+no_of_states];
 				if (b == 0) {
@@ -2833,13 +3357,13 @@ void gprc_run_float(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_ABS: {
-				k = (int)gp[GPRC_INITIAL];
+				k = con[0];
 				a = state[k];
 				b = state[k+no_of_states];
 				if (b == 0) {
 					/* ordinary number */
 					state[sens+i] =
-						(float)fabs(state[(int)gp[GPRC_INITIAL]]);
+						(float)fabs(state[con[0]]);
 				}
 				else {
 					/* if this is a complex number */
@@ -2850,7 +3374,7 @@ void gprc_run_float(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_SINE: {
-				k = (int)gp[GPRC_INITIAL];
+				k = con[0];
 				a = state[k];
 				b = state[k+no_of_states];
 				if (b == 0) {
@@ -2868,11 +3392,11 @@ void gprc_run_float(gprc_function * f,
 			}
 			case GPR_FUNCTION_ARCSINE: {
 				state[sens+i] =
-					(float)asin(state[(int)gp[GPRC_INITIAL]]);
+					(float)asin(state[con[0]]);
 				break;
 			}
 			case GPR_FUNCTION_COSINE: {
-				k = (int)gp[GPRC_INITIAL];
+				k = con[0];
 				a = state[k];
 				b = state[k+no_of_states];
 				if (b == 0) {
@@ -2890,28 +3414,28 @@ void gprc_run_float(gprc_function * f,
 			}
 			case GPR_FUNCTION_ARCCOSINE: {
 				state[sens+i] =
-					(float)acos(state[(int)gp[GPRC_INITIAL]]);
+					(float)acos(state[con[0]]);
 				break;
 			}
 			case GPR_FUNCTION_POW: {
 				state[sens+i] =
-					(float)pow(state[(int)gp[GPRC_INITIAL]],
-							   state[(int)gp[1+GPRC_INITIAL]]);
+					(float)pow(state[con[0]],
+							   state[con[1]]);
 				state[sens+i+no_of_states] =
-					(float)pow(state[(int)gp[GPRC_INITIAL]+no_of_states],
-							   state[(int)gp[1+GPRC_INITIAL]+no_of_states]);
+					(float)pow(state[con[0]+no_of_states],
+							   state[con[1]+no_of_states]);
 				break;
 			}
 			case GPR_FUNCTION_MIN: {
 				no_of_args =
 					1 + (abs((int)gp[GPRC_GENE_CONSTANT])%
 						 (connections_per_gene-1));
-				state[sens+i] = state[(int)gp[GPRC_INITIAL]];
+				state[sens+i] = state[con[0]];
 				for (j = 1; j < no_of_args; j++) {
-					if (state[(int)gp[GPRC_INITIAL+j]] < state[sens+i]) {
-						state[sens+i] = state[(int)gp[GPRC_INITIAL+j]];
+					if (state[con[j]] < state[sens+i]) {
+						state[sens+i] = state[con[j]];
 						state[sens+i+no_of_states] =
-							state[(int)gp[GPRC_INITIAL+j]+no_of_states];
+							state[con[j]+no_of_states];
 					}
 				}
 				break;
@@ -2920,30 +3444,32 @@ void gprc_run_float(gprc_function * f,
 				no_of_args =
 					1 + (abs((int)gp[GPRC_GENE_CONSTANT])%
 						 (connections_per_gene-1));
-				state[sens+i] = state[(int)gp[GPRC_INITIAL]];
+				state[sens+i] = state[con[0]];
 				for (j = 1; j < no_of_args; j++) {
-					if (state[(int)gp[GPRC_INITIAL+j]] > state[sens+i]) {
-						state[sens+i] = state[(int)gp[GPRC_INITIAL+j]];
+					if (state[con[j]] > state[sens+i]) {
+						state[sens+i] = state[con[j]];
 						state[sens+i+no_of_states] =
-							state[(int)gp[GPRC_INITIAL+j]+no_of_states];
+							state[con[j]+no_of_states];
 					}
 				}
 				break;
 			}
 			case GPR_FUNCTION_COPY_FUNCTION: {
-				if (((int)gp[GPRC_INITIAL] > sens) &&
-					((int)gp[1+GPRC_INITIAL] > sens)) {
-					src = ((int)gp[GPRC_INITIAL]-sens) * gene_size;
-					dest = ((int)gp[1+GPRC_INITIAL]-sens) * gene_size;
+				if ((con[0] > sens) &&
+					(con[1] > sens)) {
+					src = (con[0]-sens) * gene_size;
+					dest = (con[1]-sens) * gene_size;
 					gene[dest] = gene[src];
+					gprc_decode_gene(module, dest/gene_size,
+									 connections_per_gene);
 				}
 				break;
 			}
 			case GPR_FUNCTION_COPY_CONSTANT: {
-				if (((int)gp[GPRC_INITIAL] > sens) &&
-					((int)gp[1+GPRC_INITIAL] > sens)) {
-					src = ((int)gp[GPRC_INITIAL]-sens) * gene_size;
-					dest = ((int)gp[1+GPRC_INITIAL]-sens) * gene_size;
+				if ((con[0] > sens) &&
+					(con[1] > sens)) {
+					src = (con[0]-sens) * gene_size;
+					dest = (con[1]-sens) * gene_size;
 					gene[dest+GPRC_GENE_CONSTANT] =
 						gene[src+GPRC_GENE_CONSTANT];
 					gene[dest+GPRC_GENE_IMAGINARY] =
@@ -2952,18 +3478,18 @@ void gprc_run_float(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_COPY_STATE: {
-				state[(int)gp[1+GPRC_INITIAL]] =
-					state[(int)gp[GPRC_INITIAL]];
-				state[(int)gp[1+GPRC_INITIAL]+no_of_states] =
-					state[(int)gp[GPRC_INITIAL]+no_of_states];
+				state[con[1]] =
+					state[con[0]];
+				state[con[1]+no_of_states] =
+					state[con[0]+no_of_states];
 				break;
 			}
 			case GPR_FUNCTION_COPY_BLOCK: {
-				block_from = (int)gp[GPRC_INITIAL];
-				block_to = (int)gp[1+GPRC_INITIAL];
+				block_from = con[0];
+				block_to = con[1];
 				if (block_from < block_to) {
-					block_from = (int)gp[1+GPRC_INITIAL];
-					block_to = (int)gp[GPRC_INITIAL];
+					block_from = con[1];
+					block_to = con[0];
 				}
 				k = block_to - GPR_BLOCK_WIDTH;
 				for (j = block_from - GPR_BLOCK_WIDTH;
@@ -2971,39 +3497,45 @@ void gprc_run_float(gprc_function * f,
 					if ((j>sens) &&
 						(k>sens) &&
 						(j<i) && (k<i)) {
-						for (g = 0; g < gene_size; g++) {
-							gene[(j-sens)*gene_size + g] =
-								gene[(k-sens)*gene_size + g];
+						for (ctr = 0; ctr < gene_size; ctr++) {
+							gene[(j-sens)*gene_size + ctr] =
+								gene[(k-sens)*gene_size + ctr];
 						}
+						gprc_decode_gene(module, j-sens,
+										 connections_per_gene);
 					}
 				}
 				break;
 			}
 			case GPR_FUNCTION_COPY_CONNECTION1: {
 				if (gp[GPRC_INITIAL] > sens) {
-					src = ((int)gp[GPRC_INITIAL] - sens) * gene_size;
+					src = (con[0] - sens) * gene_size;
 					gp[1+GPRC_INITIAL] = gene[src+GPRC_INITIAL];
+					gprc_decode_gene(module, i, connections_per_gene);
 				}
 				break;
 			}
 			case GPR_FUNCTION_COPY_CONNECTION2: {
 				if (gp[1+GPRC_INITIAL] > sens) {
-					src = ((int)gp[1+GPRC_INITIAL] - sens) * gene_size;
+					src = (con[1] - sens) * gene_size;
 					gp[GPRC_INITIAL] = gene[src+GPRC_INITIAL];
+					gprc_decode_gene(module, i, connections_per_gene);
 				}
 				break;
 			}
 			case GPR_FUNCTION_COPY_CONNECTION3: {
 				if (gp[1+GPRC_INITIAL] > sens) {
-					src = ((int)gp[1+GPRC_INITIAL] - sens) * gene_size;
+					src = (con[1] - sens) * gene_size;
 					gp[GPRC_INITIAL] = gene[src+1+GPRC_INITIAL];
+					gprc_decode_gene(module, i, connections_per_gene);
 				}
 				break;
 			}
 			case GPR_FUNCTION_COPY_CONNECTION4: {
 				if (gp[GPRC_INITIAL] > sens) {
-					src = ((int)gp[GPRC_INITIAL] - sens) * gene_size;
+					src = (con[0] - sens) * gene_size;
 					gp[1+GPRC_INITIAL] = gene[src+1+GPRC_INITIAL];
+					gprc_decode_gene(module, i, connections_per_gene);
 				}
 				break;
 			}
@@ -3033,7 +3565,8 @@ void gprc_run_float(gprc_function * f,
 	}
 
 	/* set the actuator values */
-	ctr = sens + i;
+	ctr = sens + (rows*columns);
+	n = rows*columns*gene_size;
 	for (i = 0; i < act; i++, ctr++, n++) {
 		/* real component */
 		state[ctr] = state[(int)gene[n]];
@@ -3042,49 +3575,493 @@ void gprc_run_float(gprc_function * f,
 	}
 }
 
-/* an integer version of the run function */
-void gprc_run_int(gprc_function * f,
-				  int ADF_module,
-				  int rows, int columns,
-				  int connections_per_gene,
-				  int sensors, int actuators,
+/* limits a real value to the range of constants, with NaN values
+   becoming zero.  Written as selects so that it compiles to
+   min/max rather than branches */
+static float gprc_clamp_real(float v)
+{
+	v = (v == v) ? v : 0.0f;
+	v = (v < GPR_MAX_CONSTANT) ? v : GPR_MAX_CONSTANT;
+	v = (v > -GPR_MAX_CONSTANT) ? v : -GPR_MAX_CONSTANT;
+	return v;
+}
+
+/* A version of the run function for programs which only use real
+   numbers.  Only the real part of the state is used, and any
+   imaginary parts are taken to be zero */
+void gprc_run_real(gprc_function * f,
+				   int ADF_module,
+				   int rows, int columns,
+				   int connections_per_gene,
+				   int sensors, int actuators,
+				   float dropout_prob,
+				   int dynamic,
+				   float (*custom_function)(float,float,float))
+{
+	int n,i=0,j,k,g,ctr,src,dest,no_of_args,no_of_genes;
+	int * con;
+	float * gp, a, c, imaginary;
+	int gene_size = GPRC_GENE_SIZE(connections_per_gene);
+	int block_from, block_to, act;
+	int dropout = (int)(dropout_prob*10000);
+	int sens = gprc_get_sensors(ADF_module,sensors);
+	float * gene = f->genome[ADF_module].gene;
+	gprc_ADF_module * module = &f->genome[ADF_module];
+	float * state = f->genome[ADF_module].state;
+
+	act = gprc_get_actuators(ADF_module,actuators);
+
+	if (module->active_valid == 0) {
+		gprc_update_active(module, rows, columns,
+						   connections_per_gene, sens);
+	}
+
+	/* unless the program is dynamic only the used genes are run */
+	no_of_genes = rows*columns;
+	if (dynamic <= 0) no_of_genes = module->no_of_active;
+
+	for (g = 0; g < no_of_genes; g++) {
+		i = g;
+		if (dynamic <= 0) i = module->active[g];
+
+		/* occasional dropout helps to avoid overfitting*/
+		if (rand_num(&f->random_seed)%10000<dropout) continue;
+
+		gp = &gene[i*gene_size];
+		con = &module->connection[i*connections_per_gene];
+		switch(module->function_type[i]) {
+		case GPR_FUNCTION_DATA_PUSH: {
+			if ((f->data.size > 0) && (f->data.fields > 0)) {
+				gpr_data_set_head(&f->data,
+								  ((unsigned int)state[con[0]])%f->data.fields,
+								  state[con[1]], 0);
+				gpr_data_push(&f->data);
+			}
+			break;
+		}
+		case GPR_FUNCTION_DATA_POP: {
+			if ((f->data.size > 0) && (f->data.fields > 0)) {
+				gpr_data_get_tail(&f->data,
+								  ((unsigned int)state[con[0]])%f->data.fields,
+								  &state[sens+i], &imaginary);
+				gpr_data_pop(&f->data);
+			}
+			break;
+		}
+		case GPR_FUNCTION_DATA_GET: {
+			if ((f->data.size > 0) && (f->data.fields > 0)) {
+				gpr_data_get_elem(&f->data,
+								  (unsigned int)state[con[0]],
+								  ((unsigned int)state[con[1]])%(f->data.fields),
+								  &state[sens+i], &imaginary);
+			}
+			break;
+		}
+		case GPR_FUNCTION_DATA_SET: {
+			if ((f->data.size > 0) && (f->data.fields > 0)) {
+				gpr_data_set_elem(&f->data,
+								  (unsigned int)state[con[0]],
+								  ((unsigned int)state[con[1]])%(f->data.fields),
+								  state[sens+i], 0);
+			}
+			break;
+		}
+		case GPR_FUNCTION_GET: {
+			j = abs((int)state[con[0]] +
+					(int)state[con[1]])
+				%(rows*columns);
+			state[sens+i] = state[sens+j];
+			break;
+		}
+		case GPR_FUNCTION_SET: {
+			j = abs((int)state[con[1]])
+				%(rows*columns);
+			state[sens+i] = gp[GPRC_GENE_CONSTANT]*state[con[0]];
+			state[sens+j] = gprc_clamp_real(state[sens+i]);
+			break;
+		}
+		case GPR_FUNCTION_ADF: {
+			gprc_c_run_ADF(f, ADF_module, i,
+						   gp, rows, columns,
+						   connections_per_gene,
+						   sensors, actuators,
+						   dropout_prob, dynamic,
+						   (*custom_function),-1);
+			break;
+		}
+		case GPR_FUNCTION_CUSTOM: {
+			if (*custom_function) {
+				state[sens+i] =
+					(*custom_function)(gp[GPRC_GENE_CONSTANT],
+									   gp[GPRC_INITIAL],
+									   gp[GPRC_GENE_CONSTANT]);
+			}
+			break;
+		}
+		case GPR_FUNCTION_VALUE: {
+			state[sens+i] = gp[GPRC_GENE_CONSTANT];
+			break;
+		}
+		case GPR_FUNCTION_SIGMOID: {
+			no_of_args =
+				1 + (abs((int)gp[GPRC_GENE_CONSTANT])%
+					 (connections_per_gene-1));
+			a = 0;
+			for (j = 0; j < no_of_args; j++) {
+				a += state[con[j]]*
+					gp[GPRC_INITIAL+j+connections_per_gene];
+			}
+			state[sens+i] = 1.0f / (1.0f + exp(-a));
+			break;
+		}
+		case GPR_FUNCTION_ADD: {
+			no_of_args =
+				1 + (abs((int)gp[GPRC_GENE_CONSTANT])%
+					 (connections_per_gene-1));
+			a = 0;
+			for (j = 0; j < no_of_args; j++) {
+				a += state[con[j]];
+			}
+			state[sens+i] = a;
+			break;
+		}
+		case GPR_FUNCTION_SUBTRACT: {
+			no_of_args =
+				1 + (abs((int)gp[GPRC_GENE_CONSTANT])%
+					 (connections_per_gene-1));
+			a = state[con[0]];
+			for (j = 1; j < no_of_args; j++) {
+				a -= state[con[j]];
+			}
+			state[sens+i] = a;
+			break;
+		}
+		case GPR_FUNCTION_NEGATE: {
+			state[sens+i] = -state[con[0]];
+			break;
+		}
+		case GPR_FUNCTION_MULTIPLY: {
+			no_of_args =
+				1 + (abs((int)gp[GPRC_GENE_CONSTANT])%
+					 (connections_per_gene-1));
+			a = state[con[0]];
+			for (j = 1; j < no_of_args; j++) {
+				a *= state[con[j]];
+			}
+			state[sens+i] = a;
+			break;
+		}
+		case GPR_FUNCTION_WEIGHT: {
+			state[sens+i] = state[con[0]] * gp[GPRC_GENE_CONSTANT];
+			break;
+		}
+		case GPR_FUNCTION_DIVIDE: {
+			c = state[con[1]];
+			if ((c <= 1e-1) && (c >= -1e-1)) {
+				/* if the denominator is close to zero
+				   then just pass through */
+				state[sens+i] = state[con[0]];
+			}
+			else {
+				state[sens+i] = state[con[0]] / c;
+			}
+			break;
+		}
+		case GPR_FUNCTION_MODULUS: {
+			state[sens+i] = fmod(state[con[0]], state[con[1]]);
+			break;
+		}
+		case GPR_FUNCTION_FLOOR: {
+			state[sens+i] = floor(state[con[0]]);
+			break;
+		}
+		case GPR_FUNCTION_AVERAGE: {
+			no_of_args =
+				1 + (abs((int)gp[GPRC_GENE_CONSTANT])%
+					 (connections_per_gene-1));
+			a = state[con[0]];
+			for (j = 1; j < no_of_args; j++) {
+				a += state[con[j]];
+			}
+			state[sens+i] = a / no_of_args;
+			break;
+		}
+		case GPR_FUNCTION_NOOP1:
+		case GPR_FUNCTION_NOOP2:
+		case GPR_FUNCTION_NOOP3:
+		case GPR_FUNCTION_NOOP4: {
+			state[sens+i] = state[con[0]];
+			break;
+		}
+		case GPR_FUNCTION_GREATER_THAN: {
+			state[sens+i] = 0;
+			if (state[con[0]] > state[con[1]]) {
+				state[sens+i] = gp[GPRC_GENE_CONSTANT];
+			}
+			break;
+		}
+		case GPR_FUNCTION_LESS_THAN: {
+			state[sens+i] = 0;
+			if (state[con[0]] < state[con[1]]) {
+				state[sens+i] = gp[GPRC_GENE_CONSTANT];
+			}
+			break;
+		}
+		case GPR_FUNCTION_EQUALS: {
+			state[sens+i] = 0;
+			if ((int)state[con[0]] == (int)state[con[1]]) {
+				state[sens+i] = gp[GPRC_GENE_CONSTANT];
+			}
+			break;
+		}
+		case GPR_FUNCTION_AND: {
+			state[sens+i] = 0;
+			if ((state[con[0]]>0) && (state[con[1]]>0)) {
+				state[sens+i] = gp[GPRC_GENE_CONSTANT];
+			}
+			break;
+		}
+		case GPR_FUNCTION_OR: {
+			state[sens+i] = 0;
+			if ((state[con[0]]>0) || (state[con[1]]>0)) {
+				state[sens+i] = gp[GPRC_GENE_CONSTANT];
+			}
+			break;
+		}
+		case GPR_FUNCTION_XOR: {
+			state[sens+i] = 0;
+			if ((state[con[0]]>0) != (state[con[1]]>0)) {
+				state[sens+i] = gp[GPRC_GENE_CONSTANT];
+			}
+			break;
+		}
+		case GPR_FUNCTION_NOT: {
+			state[sens+i] = 0;
+			if (((int)state[con[0]]) != ((int)state[con[1]])) {
+				state[sens+i] = gp[GPRC_GENE_CONSTANT];
+			}
+			break;
+		}
+		case GPR_FUNCTION_HEBBIAN: {
+			no_of_args =
+				1 + (abs((int)gp[GPRC_GENE_CONSTANT])%
+					 (connections_per_gene-1));
+			/* update the output */
+			a = 0;
+			for (j = 0; j < no_of_args; j++) {
+				a += state[con[j]] *
+					gp[GPRC_INITIAL+j+connections_per_gene];
+			}
+			state[sens+i] = a;
+			/* adjust weights */
+			for (j = 0; j < no_of_args; j++) {
+				gp[GPRC_INITIAL+j+connections_per_gene] +=
+					a * state[con[j]] * GPR_HEBBIAN_LEARNING_RATE;
+			}
+			break;
+		}
+		case GPR_FUNCTION_EXP: {
+			state[sens+i] = (float)exp(state[con[0]]);
+			break;
+		}
+		case GPR_FUNCTION_SQUARE_ROOT: {
+			state[sens+i] = (float)sqrt(fabs(state[con[0]]));
+			break;
+		}
+		case GPR_FUNCTION_ABS: {
+			state[sens+i] = (float)fabs(state[con[0]]);
+			break;
+		}
+		case GPR_FUNCTION_SINE: {
+			state[sens+i] = (float)sin(state[con[0]])*256;
+			break;
+		}
+		case GPR_FUNCTION_ARCSINE: {
+			state[sens+i] = (float)asin(state[con[0]]);
+			break;
+		}
+		case GPR_FUNCTION_COSINE: {
+			state[sens+i] = (float)cos(state[con[0]])*256;
+			break;
+		}
+		case GPR_FUNCTION_ARCCOSINE: {
+			state[sens+i] = (float)acos(state[con[0]]);
+			break;
+		}
+		case GPR_FUNCTION_POW: {
+			state[sens+i] =
+				(float)pow(state[con[0]], state[con[1]]);
+			break;
+		}
+		case GPR_FUNCTION_MIN: {
+			no_of_args =
+				1 + (abs((int)gp[GPRC_GENE_CONSTANT])%
+					 (connections_per_gene-1));
+			a = state[con[0]];
+			for (j = 1; j < no_of_args; j++) {
+				c = state[con[j]];
+				a = (c < a) ? c : a;
+			}
+			state[sens+i] = a;
+			break;
+		}
+		case GPR_FUNCTION_MAX: {
+			no_of_args =
+				1 + (abs((int)gp[GPRC_GENE_CONSTANT])%
+					 (connections_per_gene-1));
+			a = state[con[0]];
+			for (j = 1; j < no_of_args; j++) {
+				c = state[con[j]];
+				a = (c > a) ? c : a;
+			}
+			state[sens+i] = a;
+			break;
+		}
+		case GPR_FUNCTION_COPY_FUNCTION: {
+			if ((con[0] > sens) &&
+				(con[1] > sens)) {
+				src = (con[0]-sens) * gene_size;
+				dest = (con[1]-sens) * gene_size;
+				gene[dest] = gene[src];
+				gprc_decode_gene(module, dest/gene_size,
+								 connections_per_gene);
+			}
+			break;
+		}
+		case GPR_FUNCTION_COPY_CONSTANT: {
+			if ((con[0] > sens) &&
+				(con[1] > sens)) {
+				src = (con[0]-sens) * gene_size;
+				dest = (con[1]-sens) * gene_size;
+				gene[dest+GPRC_GENE_CONSTANT] =
+					gene[src+GPRC_GENE_CONSTANT];
+				gene[dest+GPRC_GENE_IMAGINARY] =
+					gene[src+GPRC_GENE_IMAGINARY];
+			}
+			break;
+		}
+		case GPR_FUNCTION_COPY_STATE: {
+			state[con[1]] = state[con[0]];
+			break;
+		}
+		case GPR_FUNCTION_COPY_BLOCK: {
+			block_from = con[0];
+			block_to = con[1];
+			if (block_from < block_to) {
+				block_from = con[1];
+				block_to = con[0];
+			}
+			k = block_to - GPR_BLOCK_WIDTH;
+			for (j = block_from - GPR_BLOCK_WIDTH;
+				 j <= block_from + GPR_BLOCK_WIDTH; j++,k++) {
+				if ((j>sens) &&
+					(k>sens) &&
+					(j<i) && (k<i)) {
+					for (ctr = 0; ctr < gene_size; ctr++) {
+						gene[(j-sens)*gene_size + ctr] =
+							gene[(k-sens)*gene_size + ctr];
+					}
+					gprc_decode_gene(module, j-sens,
+									 connections_per_gene);
+				}
+			}
+			break;
+		}
+		case GPR_FUNCTION_COPY_CONNECTION1: {
+			if (gp[GPRC_INITIAL] > sens) {
+				src = (con[0] - sens) * gene_size;
+				gp[1+GPRC_INITIAL] = gene[src+GPRC_INITIAL];
+				gprc_decode_gene(module, i, connections_per_gene);
+			}
+			break;
+		}
+		case GPR_FUNCTION_COPY_CONNECTION2: {
+			if (gp[1+GPRC_INITIAL] > sens) {
+				src = (con[1] - sens) * gene_size;
+				gp[GPRC_INITIAL] = gene[src+GPRC_INITIAL];
+				gprc_decode_gene(module, i, connections_per_gene);
+			}
+			break;
+		}
+		case GPR_FUNCTION_COPY_CONNECTION3: {
+			if (gp[1+GPRC_INITIAL] > sens) {
+				src = (con[1] - sens) * gene_size;
+				gp[GPRC_INITIAL] = gene[src+1+GPRC_INITIAL];
+				gprc_decode_gene(module, i, connections_per_gene);
+			}
+			break;
+		}
+		case GPR_FUNCTION_COPY_CONNECTION4: {
+			if (gp[GPRC_INITIAL] > sens) {
+				src = (con[0] - sens) * gene_size;
+				gp[1+GPRC_INITIAL] = gene[src+1+GPRC_INITIAL];
+				gprc_decode_gene(module, i, connections_per_gene);
+			}
+			break;
+		}
+		}
+		/* prevent values from going out of range */
+		state[sens+i] = gprc_clamp_real(state[sens+i]);
+	}
+
+	/* set the actuator values */
+	ctr = sens + (rows*columns);
+	n = rows*columns*gene_size;
+	for (i = 0; i < act; i++, ctr++, n++) {
+		state[ctr] = state[(int)gene[n]];
+	}
+}
+
+/* an integer version of the run function */
+void gprc_run_int(gprc_function * f,
+				  int ADF_module,
+				  int rows, int columns,
+				  int connections_per_gene,
+				  int sensors, int actuators,
 				  float dropout_prob, int dynamic,
 				  float (*custom_function)(float,float,float))
 {
-	int row,col,n=0,i=0,j,k,g,ctr,src,dest,no_of_args;
+	int n,i=0,j,k,g,ctr,src,dest,no_of_args,no_of_genes;
+	int * con;
 	float * gp, a, b, c, d, a2, b2;
 	int gene_size = GPRC_GENE_SIZE(connections_per_gene);
 	int block_from,block_to, no_of_states;
 	int dropout = (int)(dropout_prob*10000);
 	int sens = gprc_get_sensors(ADF_module,sensors);
 	float * gene = f->genome[ADF_module].gene;
-	unsigned char * used = f->genome[ADF_module].used;
+	gprc_ADF_module * module = &f->genome[ADF_module];
 	float * state = f->genome[ADF_module].state;
 
 	actuators = gprc_get_actuators(ADF_module,actuators);
 	no_of_states = (rows*columns) + sens + actuators;
 
-	for (col = 0; col < columns; col++) {
-		for (row = 0; row < rows; row++, i++,n+=gene_size) {
+	if (module->active_valid == 0) {
+		gprc_update_active(module, rows, columns,
+						   connections_per_gene, sens);
+	}
 
-			/* if this function is not on the path
-			   between sensors and actuators then skip it
-			   since it has no effect upon the program behavior */
-			if ((dynamic <= 0) && (used[i+sens] == 0)) {
-				continue;
-			}
+	/* Functions which are not on the path between sensors and
+	   actuators have no effect upon the program behavior,
+	   so unless the program is dynamic only the used genes
+	   are run */
+	no_of_genes = rows*columns;
+	if (dynamic <= 0) no_of_genes = module->no_of_active;
 
-			/* occasional dropout helps to avoid overfitting*/
-			if (rand_num(&f->random_seed)%10000<dropout) continue;
+	for (g = 0; g < no_of_genes; g++) {
+		i = g;
+		if (dynamic <= 0) i = module->active[g];
 
-			gp = &gene[n];
-			switch((int)gp[GPRC_GENE_FUNCTION_TYPE]) {
+		/* occasional dropout helps to avoid overfitting*/
+		if (rand_num(&f->random_seed)%10000 >= dropout) {
+			gp = &gene[i*gene_size];
+			con = &module->connection[i*connections_per_gene];
+			switch(module->function_type[i]) {
 			case GPR_FUNCTION_DATA_PUSH: {
 				if ((f->data.size > 0) && (f->data.fields > 0)) {
 					gpr_data_set_head(&f->data,
-									  ((unsigned int)state[(int)gp[GPRC_INITIAL]])%f->data.fields,
-									  (int)state[(int)gp[GPRC_INITIAL+1]],
-									  (int)state[(int)gp[GPRC_INITIAL+1]+no_of_states]);
+									  ((unsigned int)state[con[0]])%f->data.fields,
+									  (int)state[con[1]],
+									  (int)state[con[1]+no_of_states]);
 					gpr_data_push(&f->data);
 				}
 				break;
@@ -3092,7 +4069,7 @@ void gprc_run_int(gprc_function * f,
 			case GPR_FUNCTION_DATA_POP: {
 				if ((f->data.size > 0) && (f->data.fields > 0)) {
 					gpr_data_get_tail(&f->data,
-									  ((unsigned int)state[(int)gp[GPRC_INITIAL]])%f->data.fields,
+									  ((unsigned int)state[con[0]])%f->data.fields,
 									  &state[sens+i],
 									  &state[sens+i+no_of_states]);
 					state[sens+i] = (int)state[sens+i];
@@ -3104,8 +4081,8 @@ void gprc_run_int(gprc_function * f,
 			case GPR_FUNCTION_DATA_GET: {
 				if ((f->data.size > 0) && (f->data.fields > 0)) {
 					gpr_data_get_elem(&f->data,
-									  (unsigned int)state[(int)gp[GPRC_INITIAL]],
-									  ((unsigned int)state[(int)gp[GPRC_INITIAL+1]])%(f->data.fields),
+									  (unsigned int)state[con[0]],
+									  ((unsigned int)state[con[1]])%(f->data.fields),
 									  &state[sens+i],
 									  &state[sens+i+no_of_states]);
 					state[sens+i] = (int)state[sens+i];
@@ -3116,16 +4093,16 @@ void gprc_run_int(gprc_function * f,
 			case GPR_FUNCTION_DATA_SET: {
 				if ((f->data.size > 0) && (f->data.fields > 0)) {
 					gpr_data_set_elem(&f->data,
-									  (unsigned int)state[(int)gp[GPRC_INITIAL]],
-									  ((unsigned int)state[(int)gp[GPRC_INITIAL+1]])%(f->data.fields),
+									  (unsigned int)state[con[0]],
+									  ((unsigned int)state[con[1]])%(f->data.fields),
 									  (int)state[sens+i],
 									  (int)state[sens+i+no_of_states]);
 				}
 				break;
 			}
 			case GPR_FUNCTION_GET: {				
-				j = abs((int)state[(int)gp[GPRC_INITIAL]] +
-						(int)state[(int)gp[1+GPRC_INITIAL]])
+				j = abs((int)state[con[0]] +
+						(int)state[con[1]])
 					%(rows*columns);
 				state[sens+i] = (int)state[sens+j];
 				state[sens+i+no_of_states] =
@@ -3133,14 +4110,14 @@ void gprc_run_int(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_SET: {
-				j = abs((int)state[(int)gp[1+GPRC_INITIAL]])
+				j = abs((int)state[con[1]])
 					%(rows*columns);
 				state[sens+i] =
 					(int)gp[GPRC_GENE_CONSTANT]*
-					(int)state[(int)gp[GPRC_INITIAL]];
+					(int)state[con[0]];
 				state[sens+i+no_of_states] =
 					(int)gp[GPRC_GENE_CONSTANT]*
-					(int)state[(int)gp[GPRC_INITIAL]+
+					(int)state[con[0]+
 							   no_of_states];
 				state[sens+j] = (int)state[sens+i];
 				state[sens+j+no_of_states] =
@@ -3176,7 +4153,7 @@ void gprc_run_int(gprc_function * f,
 				if (*custom_function) {
 					state[sens+i] =
 						(*custom_function)((int)gp[GPRC_GENE_CONSTANT],
-										   (int)gp[GPRC_INITIAL],
+										   con[0],
 										   (int)gp[GPRC_GENE_CONSTANT]);
 				}
 				break;
@@ -3194,7 +4171,7 @@ void gprc_run_int(gprc_function * f,
 				state[sens+i] = 0;
 				for (j = 0; j < no_of_args; j++) {
 					state[sens+i] +=
-						state[(int)gp[GPRC_INITIAL+j]]*
+						state[con[j]]*
 						gp[GPRC_INITIAL+j+connections_per_gene];
 				}
 
@@ -3208,7 +4185,7 @@ void gprc_run_int(gprc_function * f,
 						 (connections_per_gene-1));
 				a = 0; b = 0;
 				for (j = 0; j < no_of_args; j++) {
-					k = (int)gp[GPRC_INITIAL+j];
+					k = con[j];
 					c = (int)state[k];
 					d = (int)state[k + no_of_states];
 					a += c;
@@ -3224,7 +4201,7 @@ void gprc_run_int(gprc_function * f,
 						 (connections_per_gene-1));
 				a = 0; b = 0;
 				for (j = 0; j < no_of_args; j++) {
-					k = (int)gp[GPRC_INITIAL+j];
+					k = con[j];
 					c = (int)state[k];
 					d = (int)state[k + no_of_states];
 					if (j > 0) {
@@ -3241,9 +4218,9 @@ void gprc_run_int(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_NEGATE: {
-				state[sens+i] = -(int)state[(int)gp[GPRC_INITIAL]];
+				state[sens+i] = -(int)state[con[0]];
 				state[sens+i+no_of_states] =
-					-(int)state[(int)gp[GPRC_INITIAL]+no_of_states];
+					-(int)state[con[0]+no_of_states];
 				break;
 			}
 			case GPR_FUNCTION_MULTIPLY: {
@@ -3252,7 +4229,7 @@ void gprc_run_int(gprc_function * f,
 						 (connections_per_gene-1));
 				a = 0; b = 0;
 				for (j = 0; j < no_of_args; j++) {
-					k = (int)gp[GPRC_INITIAL+j];
+					k = con[j];
 					c = (int)state[k];
 					d = (int)state[k + no_of_states];
 					if (j > 0) {
@@ -3271,16 +4248,16 @@ void gprc_run_int(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_WEIGHT: {
-				state[sens+i] = state[(int)gp[GPRC_INITIAL]] *
+				state[sens+i] = state[con[0]] *
 					(int)gp[GPRC_GENE_CONSTANT];
 				state[sens+i+no_of_states] =
-					state[(int)gp[GPRC_INITIAL]+no_of_states] *
+					state[con[0]+no_of_states] *
 					(int)gp[GPRC_GENE_CONSTANT];
 				break;
 			}
 			case GPR_FUNCTION_DIVIDE: {
-				j = (int)gp[GPRC_INITIAL];
-				k = (int)gp[1+GPRC_INITIAL];
+				j = con[0];
+				k = con[1];
 				if((state[k] <= 1e-1) &&
 				   (state[k] >= -1e-1)) {
 					state[sens+i] = state[j];
@@ -3299,20 +4276,20 @@ void gprc_run_int(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_MODULUS: {
-				if ((int)state[(int)gp[1+GPRC_INITIAL]] == 0) {
-					state[sens+i] = (int)state[(int)gp[GPRC_INITIAL]];
+				if ((int)state[con[1]] == 0) {
+					state[sens+i] = (int)state[con[0]];
 					state[sens+i+no_of_states] =
-						(int)state[(int)gp[GPRC_INITIAL]+no_of_states];
+						(int)state[con[0]+no_of_states];
 				}
 				else {
 					/* a is the real part of numerator,
 					   b is the imaginary part or numerator */					
-					a = (int)state[(int)gp[GPRC_INITIAL]];
-					b = (int)state[(int)gp[GPRC_INITIAL]+no_of_states];
+					a = (int)state[con[0]];
+					b = (int)state[con[0]+no_of_states];
 					/* c is the real part of denominator,
 					   d is the imaginary part or denominator */
-					c = (int)state[(int)gp[1+GPRC_INITIAL]];
-					d = (int)state[(int)gp[1+GPRC_INITIAL]+no_of_states];
+					c = (int)state[con[1]];
+					d = (int)state[con[1]+no_of_states];
 					if (b+d == 0) {
 						/* if there is no imaginary component */
 						state[sens+i] = (int)a % (int)c;
@@ -3331,54 +4308,54 @@ void gprc_run_int(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_FLOOR: {
-				state[sens+i] = (int)state[(int)gp[GPRC_INITIAL]];
+				state[sens+i] = (int)state[con[0]];
 				state[sens+i+no_of_states] =
-					(int)state[(int)gp[GPRC_INITIAL]+no_of_states];
+					(int)state[con[0]+no_of_states];
 				break;
 			}
 			case GPR_FUNCTION_AVERAGE: {
 				no_of_args =
 					1 + (abs((int)gp[GPRC_GENE_CONSTANT])%
 						 (connections_per_gene-1));
-				state[sens+i] = (int)state[(int)gp[GPRC_INITIAL]];
+				state[sens+i] = (int)state[con[0]];
 				state[sens+i+no_of_states] =
-					(int)state[(int)gp[GPRC_INITIAL]+no_of_states];
+					(int)state[con[0]+no_of_states];
 				for (j = 0; j < no_of_args; j++) {
-					state[sens+i] += (int)state[(int)gp[GPRC_INITIAL+j]];
+					state[sens+i] += (int)state[con[j]];
 					state[sens+i+no_of_states] +=
-						(int)state[(int)gp[GPRC_INITIAL+j]+no_of_states];
+						(int)state[con[j]+no_of_states];
 				}
 				state[sens+i] /= no_of_args;
 				state[sens+i+no_of_states] /= no_of_args;
 				break;
 			}
 			case GPR_FUNCTION_NOOP1: {
-				state[sens+i] = (int)state[(int)gp[GPRC_INITIAL]];
+				state[sens+i] = (int)state[con[0]];
 				state[sens+i+no_of_states] =
-					(int)state[(int)gp[GPRC_INITIAL]+no_of_states];
+					(int)state[con[0]+no_of_states];
 				break;
 			}
 			case GPR_FUNCTION_NOOP2: {
-				state[sens+i] = (int)state[(int)gp[GPRC_INITIAL]];
+				state[sens+i] = (int)state[con[0]];
 				state[sens+i+no_of_states] =
-					(int)state[(int)gp[GPRC_INITIAL]+no_of_states];
+					(int)state[con[0]+no_of_states];
 				break;
 			}
 			case GPR_FUNCTION_NOOP3: {
-				state[sens+i] = (int)state[(int)gp[GPRC_INITIAL]];
+				state[sens+i] = (int)state[con[0]];
 				state[sens+i+no_of_states] =
-					(int)state[(int)gp[GPRC_INITIAL]+no_of_states];
+					(int)state[con[0]+no_of_states];
 				break;
 			}
 			case GPR_FUNCTION_NOOP4: {
-				state[sensors+i] = (int)state[(int)gp[GPRC_INITIAL]];
+				state[sensors+i] = (int)state[con[0]];
 				state[sens+i+no_of_states] =
-					(int)state[(int)gp[GPRC_INITIAL]+no_of_states];
+					(int)state[con[0]+no_of_states];
 				break;
 			}
 			case GPR_FUNCTION_GREATER_THAN: {
-				if ((int)state[(int)gp[GPRC_INITIAL]] >
-					(int)state[(int)gp[1+GPRC_INITIAL]]) {
+				if ((int)state[con[0]] >
+					(int)state[con[1]]) {
 					state[sens+i] = (int)gp[GPRC_GENE_CONSTANT];
 					state[sens+i+no_of_states] =
 						(int)gp[GPRC_GENE_IMAGINARY];
@@ -3390,8 +4367,8 @@ void gprc_run_int(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_LESS_THAN: {
-				if ((int)state[(int)gp[GPRC_INITIAL]] <
-					(int)state[(int)gp[1+GPRC_INITIAL]]) {
+				if ((int)state[con[0]] <
+					(int)state[con[1]]) {
 					state[sens+i] = (int)gp[GPRC_GENE_CONSTANT];
 					state[sens+i+no_of_states] =
 						(int)gp[GPRC_GENE_IMAGINARY];
@@ -3403,10 +4380,10 @@ void gprc_run_int(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_EQUALS: {
-				if (((int)state[(int)gp[GPRC_INITIAL]] ==
-					(int)state[(int)gp[1+GPRC_INITIAL]]) &&
-					((int)state[(int)gp[GPRC_INITIAL]+no_of_states] ==
-					 (int)state[(int)gp[1+GPRC_INITIAL]+no_of_states])) {
+				if (((int)state[con[0]] ==
+					(int)state[con[1]]) &&
+					((int)state[con[0]+no_of_states] ==
+					 (int)state[con[1]+no_of_states])) {
 					state[sens+i] = (int)gp[GPRC_GENE_CONSTANT];
 					state[sens+i+no_of_states] =
 						(int)gp[GPRC_GENE_IMAGINARY];
@@ -3418,8 +4395,8 @@ void gprc_run_int(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_AND: {
-				if (((int)state[(int)gp[GPRC_INITIAL]]>0) &&
-					((int)state[(int)gp[1+GPRC_INITIAL]]>0)) {
+				if (((int)state[con[0]]>0) &&
+					((int)state[con[1]]>0)) {
 					state[sens+i] = (int)gp[GPRC_GENE_CONSTANT];
 					state[sens+i+no_of_states] =
 						(int)gp[GPRC_GENE_IMAGINARY];
@@ -3431,8 +4408,8 @@ void gprc_run_int(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_OR: {
-				if (((int)state[(int)gp[GPRC_INITIAL]]>0) ||
-					((int)state[(int)gp[1+GPRC_INITIAL]]>0)) {
+				if (((int)state[con[0]]>0) ||
+					((int)state[con[1]]>0)) {
 					state[sens+i] = (int)gp[GPRC_GENE_CONSTANT];
 					state[sens+i+no_of_states] =
 						(int)gp[GPRC_GENE_IMAGINARY];
@@ -3444,8 +4421,8 @@ void gprc_run_int(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_XOR: {
-				if (((int)state[(int)gp[GPRC_INITIAL]]>0) !=
-					((int)state[(int)gp[1+GPRC_INITIAL]]>0)) {
+				if (((int)state[con[0]]>0) !=
+					((int)state[con[1]]>0)) {
 					state[sens+i] = (int)gp[GPRC_GENE_CONSTANT];
 					state[sens+i+no_of_states] =
 						(int)gp[GPRC_GENE_IMAGINARY];
@@ -3457,8 +4434,8 @@ void gprc_run_int(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_NOT: {
-				if (((int)state[(int)gp[GPRC_INITIAL]]) !=
-					((int)state[(int)gp[1+GPRC_INITIAL]])) {
+				if (((int)state[con[0]]) !=
+					((int)state[con[1]])) {
 					state[sens+i] = (int)gp[GPRC_GENE_CONSTANT];
 					state[sens+i+no_of_states] =
 						(int)gp[GPRC_GENE_IMAGINARY];
@@ -3477,7 +4454,7 @@ void gprc_run_int(gprc_function * f,
 				state[sens+i] = 0;
 				for (j = 0; j < no_of_args; j++) {
 					state[sens+i] +=
-						state[(int)gp[GPRC_INITIAL+j]] *
+						state[con[j]] *
 						gp[GPRC_INITIAL+j+connections_per_gene];
 				}
 				/* adjust weights.  Here the imaginary
@@ -3485,7 +4462,7 @@ void gprc_run_int(gprc_function * f,
 				state[sens+i+no_of_states] = 0;
 				for (j = 0; j < no_of_args; j++) {
 					/* change in the weight value */
-					a =	state[sens+i] * state[(int)gp[GPRC_INITIAL+j]] *
+					a =	state[sens+i] * state[con[j]] *
 						GPR_HEBBIAN_LEARNING_RATE;
 					/* alter the weight */
 					gp[GPRC_INITIAL+j+connections_per_gene] += a;
@@ -3496,13 +4473,13 @@ void gprc_run_int(gprc_function * f,
 			}
 			case GPR_FUNCTION_EXP: {
 				state[sens+i] =
-					(int)exp((int)state[(int)gp[GPRC_INITIAL]]);
+					(int)exp((int)state[con[0]]);
 				state[sens+i+no_of_states] =
-					(int)exp((int)state[(int)gp[GPRC_INITIAL]+no_of_states]);
+					(int)exp((int)state[con[0]+no_of_states]);
 				break;
 			}
 			case GPR_FUNCTION_SQUARE_ROOT: {
-				k = (int)gp[GPRC_INITIAL];
+				k = con[0];
 				a = (int)state[k];
 				b = (int)state[k+no_of_states];
 				if (b == 0) {
@@ -3524,13 +4501,13 @@ void gprc_run_int(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_ABS: {
-				k = (int)gp[GPRC_INITIAL];
+				k = con[0];
 				a = (int)state[k];
 				b = (int)state[k+no_of_states];
 				if (b == 0) {
 					/* if this is an ordinary number */
 					state[sens+i] =
-						(int)abs((int)state[(int)gp[GPRC_INITIAL]]);
+						(int)abs((int)state[con[0]]);
 				}
 				else {
 					/* if this is a complex number */
@@ -3541,7 +4518,7 @@ void gprc_run_int(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_SINE: {
-				k = (int)gp[GPRC_INITIAL];
+				k = con[0];
 				a = state[k];
 				b = state[k+no_of_states];
 				if (b == 0) {
@@ -3559,11 +4536,11 @@ void gprc_run_int(gprc_function * f,
 			}
 			case GPR_FUNCTION_ARCSINE: {
 				state[sens+i] =
-					(int)asin((int)state[(int)gp[GPRC_INITIAL]]);
+					(int)asin((int)state[con[0]]);
 				break;
 			}
 			case GPR_FUNCTION_COSINE: {
-				k = (int)gp[GPRC_INITIAL];
+				k = con[0];
 				a = state[k];
 				b = state[k+no_of_states];
 				if (b == 0) {
@@ -3581,30 +4558,30 @@ void gprc_run_int(gprc_function * f,
 			}
 			case GPR_FUNCTION_ARCCOSINE: {
 				state[sens+i] =
-					(int)acos((int)state[(int)gp[GPRC_INITIAL]]);
+					(int)acos((int)state[con[0]]);
 				break;
 			}
 			case GPR_FUNCTION_POW: {
 				state[sens+i] =
-					(int)pow((int)state[(int)gp[GPRC_INITIAL]],
-							 (int)state[(int)gp[1+GPRC_INITIAL]]);
+					(int)pow((int)state[con[0]],
+							 (int)state[con[1]]);
 				state[sens+i+no_of_states] =
-					(int)pow((int)state[(int)gp[GPRC_INITIAL]+no_of_states],
-							 (int)state[(int)gp[1+GPRC_INITIAL]+no_of_states]);
+					(int)pow((int)state[con[0]+no_of_states],
+							 (int)state[con[1]+no_of_states]);
 				break;
 			}
 			case GPR_FUNCTION_MIN: {
 				no_of_args =
 					1 + (abs((int)gp[GPRC_GENE_CONSTANT])%
 						 (connections_per_gene-1));
-				state[sens+i] = (int)state[(int)gp[GPRC_INITIAL]];
+				state[sens+i] = (int)state[con[0]];
 				for (j = 1; j < no_of_args; j++) {
-					if ((int)state[(int)gp[GPRC_INITIAL+j]] <
+					if ((int)state[con[j]] <
 						state[sens+i]) {
 						state[sens+i] =
-							(int)state[(int)gp[GPRC_INITIAL+j]];
+							(int)state[con[j]];
 						state[sens+i+no_of_states] =
-							(int)state[(int)gp[GPRC_INITIAL+j]+no_of_states];
+							(int)state[con[j]+no_of_states];
 					}
 				}
 				break;
@@ -3613,32 +4590,34 @@ void gprc_run_int(gprc_function * f,
 				no_of_args =
 					1 + (abs((int)gp[GPRC_GENE_CONSTANT])%
 						 (connections_per_gene-1));
-				state[sens+i] = (int)state[(int)gp[GPRC_INITIAL]];
+				state[sens+i] = (int)state[con[0]];
 				for (j = 1; j < no_of_args; j++) {
-					if ((int)state[(int)gp[GPRC_INITIAL+j]] >
+					if ((int)state[con[j]] >
 						state[sens+i]) {
 						state[sens+i] =
-							(int)state[(int)gp[GPRC_INITIAL+j]];
+							(int)state[con[j]];
 						state[sens+i+no_of_states] =
-							(int)state[(int)gp[GPRC_INITIAL+j]+no_of_states];
+							(int)state[con[j]+no_of_states];
 					}
 				}
 				break;
 			}
 			case GPR_FUNCTION_COPY_FUNCTION: {
-				if (((int)gp[GPRC_INITIAL] > sens) &&
-					((int)gp[1+GPRC_INITIAL] > sens)) {
-					src = ((int)gp[GPRC_INITIAL]-sens) * gene_size;
-					dest = ((int)gp[1+GPRC_INITIAL]-sens) * gene_size;
+				if ((con[0] > sens) &&
+					(con[1] > sens)) {
+					src = (con[0]-sens) * gene_size;
+					dest = (con[1]-sens) * gene_size;
 					gene[dest] = gene[src];
+					gprc_decode_gene(module, dest/gene_size,
+									 connections_per_gene);
 				}
 				break;
 			}
 			case GPR_FUNCTION_COPY_CONSTANT: {
-				if (((int)gp[GPRC_INITIAL] > sens) &&
-					((int)gp[1+GPRC_INITIAL] > sens)) {
-					src = ((int)gp[GPRC_INITIAL]-sens) * gene_size;
-					dest = ((int)gp[1+GPRC_INITIAL]-sens) * gene_size;
+				if ((con[0] > sens) &&
+					(con[1] > sens)) {
+					src = (con[0]-sens) * gene_size;
+					dest = (con[1]-sens) * gene_size;
 					gene[dest+GPRC_GENE_CONSTANT] =
 						gene[src+GPRC_GENE_CONSTANT];
 					gene[dest+GPRC_GENE_IMAGINARY] =
@@ -3647,18 +4626,18 @@ void gprc_run_int(gprc_function * f,
 				break;
 			}
 			case GPR_FUNCTION_COPY_STATE: {
-				state[(int)gp[1+GPRC_INITIAL]] =
-					state[(int)gp[GPRC_INITIAL]];
-				state[(int)gp[1+GPRC_INITIAL]+no_of_states] =
-					state[(int)gp[GPRC_INITIAL]+no_of_states];
+				state[con[1]] =
+					state[con[0]];
+				state[con[1]+no_of_states] =
+					state[con[0]+no_of_states];
 				break;
 			}
 			case GPR_FUNCTION_COPY_BLOCK: {
-				block_from = (int)gp[GPRC_INITIAL];
-				block_to = (int)gp[1+GPRC_INITIAL];
+				block_from = con[0];
+				block_to = con[1];
 				if (block_from<block_to) {
-					block_from = (int)gp[1+GPRC_INITIAL];
-					block_to = (int)gp[GPRC_INITIAL];
+					block_from = con[1];
+					block_to = con[0];
 				}
 				k = block_to - GPR_BLOCK_WIDTH;
 				for (j = block_from - GPR_BLOCK_WIDTH;
@@ -3667,39 +4646,45 @@ void gprc_run_int(gprc_function * f,
 						(k>sens) &&
 						(j<i) && (k<i)) {
 
-						for (g = 0; g < gene_size; g++) {
-							gene[(j-sens)*gene_size + g] =
-								gene[(k-sens)*gene_size + g];
+						for (ctr = 0; ctr < gene_size; ctr++) {
+							gene[(j-sens)*gene_size + ctr] =
+								gene[(k-sens)*gene_size + ctr];
 						}
+						gprc_decode_gene(module, j-sens,
+										 connections_per_gene);
 					}
 				}
 				break;
 			}
 			case GPR_FUNCTION_COPY_CONNECTION1: {
 				if (gp[GPRC_INITIAL] > sens) {
-					src = ((int)gp[GPRC_INITIAL] - sens) * gene_size;
+					src = (con[0] - sens) * gene_size;
 					gp[1+GPRC_INITIAL] = gene[src+GPRC_INITIAL];
+					gprc_decode_gene(module, i, connections_per_gene);
 				}
 				break;
 			}
 			case GPR_FUNCTION_COPY_CONNECTION2: {
 				if (gp[1+GPRC_INITIAL] > sens) {
-					src = ((int)gp[1+GPRC_INITIAL] - sens) * gene_size;
+					src = (con[1] - sens) * gene_size;
 					gp[GPRC_INITIAL] = gene[src+GPRC_INITIAL];
+					gprc_decode_gene(module, i, connections_per_gene);
 				}
 				break;
 			}
 			case GPR_FUNCTION_COPY_CONNECTION3: {
 				if (gp[1+GPRC_INITIAL] > sens) {
-					src = ((int)gp[1+GPRC_INITIAL] - sens) * gene_size;
+					src = (con[1] - sens) * gene_size;
 					gp[GPRC_INITIAL] = gene[src+1+GPRC_INITIAL];
+					gprc_decode_gene(module, i, connections_per_gene);
 				}
 				break;
 			}
 			case GPR_FUNCTION_COPY_CONNECTION4: {
 				if (gp[GPRC_INITIAL] > sens) {
-					src = ((int)gp[GPRC_INITIAL] - sens) * gene_size;
+					src = (con[0] - sens) * gene_size;
 					gp[1+GPRC_INITIAL] = gene[src+1+GPRC_INITIAL];
+					gprc_decode_gene(module, i, connections_per_gene);
 				}
 				break;
 			}
@@ -3727,55 +4712,840 @@ void gprc_run_int(gprc_function * f,
 			}
 		}
 	}
-
-	/* set the actuator values */
-	ctr = sens + i;
-	for (i = 0; i < actuators; i++, ctr++, n++) {
-		/* real component */
-		state[ctr] = (int)state[(int)gene[n]];
-		/* imaginary component */
-		state[ctr+no_of_states] = state[(int)gene[n]+no_of_states];
+
+	/* set the actuator values */
+	ctr = sens + (rows*columns);
+	n = rows*columns*gene_size;
+	for (i = 0; i < actuators; i++, ctr++, n++) {
+		/* real component */
+		state[ctr] = (int)state[(int)gene[n]];
+		/* imaginary component */
+		state[ctr+no_of_states] = state[(int)gene[n]+no_of_states];
+	}
+}
+
+void gprc_run(gprc_function * f, gprc_population * population,
+			  float dropout_prob, int dynamic,
+			  float (*custom_function)(float,float,float))
+{
+	if ((population->integers_only<=0) &&
+		(population->real_only>0)) {
+		gprc_run_real(f, 0,
+					  population->rows, population->columns,
+					  population->connections_per_gene,
+					  population->sensors, population->actuators,
+					  dropout_prob, dynamic, (*custom_function));
+	}
+	else if (population->integers_only<=0) {
+		gprc_run_float(f, 0,
+					   population->rows, population->columns,
+					   population->connections_per_gene,
+					   population->sensors, population->actuators,
+					   dropout_prob, dynamic, (*custom_function));
+	}
+	else {
+		gprc_run_int(f, 0,
+					 population->rows, population->columns,
+					 population->connections_per_gene,
+					 population->sensors, population->actuators,
+					 dropout_prob, dynamic, (*custom_function));
+	}
+}
+
+void gprc_run_environment(gprc_function * f, gprc_environment * population,
+						  float dropout_prob, int dynamic,
+						  float (*custom_function)(float,float,float))
+{
+	if (population->integers_only<=0) {
+		gprc_run_float(f, 0,
+					   population->rows, population->columns,
+					   population->connections_per_gene,
+					   population->sensors, population->actuators,
+					   dropout_prob, dynamic, (*custom_function));
+	}
+	else {
+		gprc_run_int(f, 0,
+					 population->rows, population->columns,
+					 population->connections_per_gene,
+					 population->sensors, population->actuators,
+					 dropout_prob, dynamic, (*custom_function));
+	}
+}
+
+/* returns non-zero if the used genes of the main program can be
+   run over a batch of samples at once.  Each gene must only read
+   from sensors or from genes which run before it, and must not
+   change the genome, the data store or any other state */
+static int gprc_batchable(gprc_function * f,
+						  int rows, int columns,
+						  int connections_per_gene,
+						  int sensors, int actuators)
+{
+	int g, i, j, no_of_args;
+	int * con;
+	gprc_ADF_module * module = &f->genome[0];
+	int gene_size = GPRC_GENE_SIZE(connections_per_gene);
+	float * actuator_gene = &module->gene[rows*columns*gene_size];
+
+	for (g = 0; g < module->no_of_active; g++) {
+		i = module->active[g];
+		switch(module->function_type[i]) {
+		case GPR_FUNCTION_VALUE:
+		case GPR_FUNCTION_SIGMOID:
+		case GPR_FUNCTION_ADD:
+		case GPR_FUNCTION_SUBTRACT:
+		case GPR_FUNCTION_NEGATE:
+		case GPR_FUNCTION_MULTIPLY:
+		case GPR_FUNCTION_WEIGHT:
+		case GPR_FUNCTION_DIVIDE:
+		case GPR_FUNCTION_MODULUS:
+		case GPR_FUNCTION_FLOOR:
+		case GPR_FUNCTION_AVERAGE:
+		case GPR_FUNCTION_NOOP1:
+		case GPR_FUNCTION_NOOP2:
+		case GPR_FUNCTION_NOOP3:
+		case GPR_FUNCTION_NOOP4:
+		case GPR_FUNCTION_GREATER_THAN:
+		case GPR_FUNCTION_LESS_THAN:
+		case GPR_FUNCTION_EQUALS:
+		case GPR_FUNCTION_AND:
+		case GPR_FUNCTION_OR:
+		case GPR_FUNCTION_XOR:
+		case GPR_FUNCTION_NOT:
+		case GPR_FUNCTION_EXP:
+		case GPR_FUNCTION_SQUARE_ROOT:
+		case GPR_FUNCTION_ABS:
+		case GPR_FUNCTION_SINE:
+		case GPR_FUNCTION_ARCSINE:
+		case GPR_FUNCTION_COSINE:
+		case GPR_FUNCTION_ARCCOSINE:
+		case GPR_FUNCTION_POW:
+		case GPR_FUNCTION_MIN:
+		case GPR_FUNCTION_MAX: {
+			break;
+		}
+		default: {
+			/* self-modifying, stateful or external functions */
+			return 0;
+		}
+		}
+
+		/* connections to later genes or to actuators carry
+		   values over from the previous sample */
+		con = &module->connection[i*connections_per_gene];
+		no_of_args =
+			gprc_function_args(module->function_type[i],
+							   module->gene[i*gene_size +
+											GPRC_GENE_CONSTANT],
+							   connections_per_gene, con[0]);
+		for (j = 0; j < no_of_args; j++) {
+			if ((con[j] < 0) || (con[j] >= sensors+i)) return 0;
+		}
+	}
+
+	for (j = 0; j < actuators; j++) {
+		if (((int)actuator_gene[j] < 0) ||
+			((int)actuator_gene[j] >= sensors+(rows*columns))) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* runs the used genes of the main program over a block of samples.
+   Each state is a vector of lanes, so that every gene becomes a
+   loop over contiguous values.  This gives the same results as
+   gprc_run_real for each sample */
+static void gprc_run_lanes(gprc_function * f,
+						   int rows, int columns,
+						   int connections_per_gene,
+						   int sensors, int lanes,
+						   float * values)
+{
+	int g, i, j, lane, no_of_args;
+	int * con;
+	float * gp, * out, * in0, * in1, * in;
+	float value, weight;
+	int gene_size = GPRC_GENE_SIZE(connections_per_gene);
+	gprc_ADF_module * module = &f->genome[0];
+
+	for (g = 0; g < module->no_of_active; g++) {
+		i = module->active[g];
+		gp = &module->gene[i*gene_size];
+		con = &module->connection[i*connections_per_gene];
+		out = &values[(sensors+i)*GPR_BATCH_LANES];
+		in0 = &values[con[0]*GPR_BATCH_LANES];
+		in1 = in0;
+		no_of_args = 1;
+		if (connections_per_gene > 1) {
+			in1 = &values[con[1]*GPR_BATCH_LANES];
+			no_of_args =
+				1 + (abs((int)gp[GPRC_GENE_CONSTANT])%
+					 (connections_per_gene-1));
+		}
+		value = gp[GPRC_GENE_CONSTANT];
+
+		switch(module->function_type[i]) {
+		case GPR_FUNCTION_VALUE: {
+			for (lane = 0; lane < lanes; lane++) {
+				out[lane] = value;
+			}
+			break;
+		}
+		case GPR_FUNCTION_SIGMOID: {
+			for (lane = 0; lane < lanes; lane++) {
+				out[lane] = 0;
+			}
+			for (j = 0; j < no_of_args; j++) {
+				in = &values[con[j]*GPR_BATCH_LANES];
+				weight = gp[GPRC_INITIAL+j+connections_per_gene];
+				for (lane = 0; lane < lanes; lane++) {
+					out[lane] += in[lane]*weight;
+				}
+			}
+			for (lane = 0; lane < lanes; lane++) {
+				out[lane] = 1.0f / (1.0f + exp(-out[lane]));
+			}
+			break;
+		}
+		case GPR_FUNCTION_ADD: {
+			for (lane = 0; lane < lanes; lane++) {
+				out[lane] = 0;
+			}
+			for (j = 0; j < no_of_args; j++) {
+				in = &values[con[j]*GPR_BATCH_LANES];
+				for (lane = 0; lane < lanes; lane++) {
+					out[lane] += in[lane];
+				}
+			}
+			break;
+		}
+		case GPR_FUNCTION_SUBTRACT: {
+			memcpy((void*)out, (void*)in0, lanes*sizeof(float));
+			for (j = 1; j < no_of_args; j++) {
+				in = &values[con[j]*GPR_BATCH_LANES];
+				for (lane = 0; lane < lanes; lane++) {
+					out[lane] -= in[lane];
+				}
+			}
+			break;
+		}
+		case GPR_FUNCTION_NEGATE: {
+			for (lane = 0; lane < lanes; lane++) {
+				out[lane] = -in0[lane];
+			}
+			break;
+		}
+		case GPR_FUNCTION_MULTIPLY: {
+			memcpy((void*)out, (void*)in0, lanes*sizeof(float));
+			for (j = 1; j < no_of_args; j++) {
+				in = &values[con[j]*GPR_BATCH_LANES];
+				for (lane = 0; lane < lanes; lane++) {
+					out[lane] *= in[lane];
+				}
+			}
+			break;
+		}
+		case GPR_FUNCTION_WEIGHT: {
+			for (lane = 0; lane < lanes; lane++) {
+				out[lane] = in0[lane] * value;
+			}
+			break;
+		}
+		case GPR_FUNCTION_DIVIDE: {
+			/* if the denominator is close to zero
+			   then just pass through */
+			for (lane = 0; lane < lanes; lane++) {
+				out[lane] =
+					((in1[lane] <= 1e-1) && (in1[lane] >= -1e-1)) ?
+					in0[lane] : in0[lane] / in1[lane];
+			}
+			break;
+		}
+		case GPR_FUNCTION_MODULUS: {
+			for (lane = 0; lane < lanes; lane++) {
+				out[lane] = fmod(in0[lane], in1[lane]);
+			}
+			break;
+		}
+		case GPR_FUNCTION_FLOOR: {
+			for (lane = 0; lane < lanes; lane++) {
+				out[lane] = floor(in0[lane]);
+			}
+			break;
+		}
+		case GPR_FUNCTION_AVERAGE: {
+			memcpy((void*)out, (void*)in0, lanes*sizeof(float));
+			for (j = 1; j < no_of_args; j++) {
+				in = &values[con[j]*GPR_BATCH_LANES];
+				for (lane = 0; lane < lanes; lane++) {
+					out[lane] += in[lane];
+				}
+			}
+			for (lane = 0; lane < lanes; lane++) {
+				out[lane] = out[lane] / no_of_args;
+			}
+			break;
+		}
+		case GPR_FUNCTION_NOOP1:
+		case GPR_FUNCTION_NOOP2:
+		case GPR_FUNCTION_NOOP3:
+		case GPR_FUNCTION_NOOP4: {
+			memcpy((void*)out, (void*)in0, lanes*sizeof(float));
+			break;
+		}
+		case GPR_FUNCTION_GREATER_THAN: {
+			for (lane = 0; lane < lanes; lane++) {
+				out[lane] = (in0[lane] > in1[lane]) ? value : 0;
+			}
+			break;
+		}
+		case GPR_FUNCTION_LESS_THAN: {
+			for (lane = 0; lane < lanes; lane++) {
+				out[lane] = (in0[lane] < in1[lane]) ? value : 0;
+			}
+			break;
+		}
+		case GPR_FUNCTION_EQUALS: {
+			for (lane = 0; lane < lanes; lane++) {
+				out[lane] =
+					((int)in0[lane] == (int)in1[lane]) ? value : 0;
+			}
+			break;
+		}
+		case GPR_FUNCTION_AND: {
+			for (lane = 0; lane < lanes; lane++) {
+				out[lane] =
+					((in0[lane]>0) && (in1[lane]>0)) ? value : 0;
+			}
+			break;
+		}
+		case GPR_FUNCTION_OR: {
+			for (lane = 0; lane < lanes; lane++) {
+				out[lane] =
+					((in0[lane]>0) || (in1[lane]>0)) ? value : 0;
+			}
+			break;
+		}
+		case GPR_FUNCTION_XOR: {
+			for (lane = 0; lane < lanes; lane++) {
+				out[lane] =
+					((in0[lane]>0) != (in1[lane]>0)) ? value : 0;
+			}
+			break;
+		}
+		case GPR_FUNCTION_NOT: {
+			for (lane = 0; lane < lanes; lane++) {
+				out[lane] =
+					((int)in0[lane] != (int)in1[lane]) ? value : 0;
+			}
+			break;
+		}
+		case GPR_FUNCTION_EXP: {
+			for (lane = 0; lane < lanes; lane++) {
+				out[lane] = (float)exp(in0[lane]);
+			}
+			break;
+		}
+		case GPR_FUNCTION_SQUARE_ROOT: {
+			for (lane = 0; lane < lanes; lane++) {
+				out[lane] = (float)sqrt(fabs(in0[lane]));
+			}
+			break;
+		}
+		case GPR_FUNCTION_ABS: {
+			for (lane = 0; lane < lanes; lane++) {
+				out[lane] = (float)fabs(in0[lane]);
+			}
+			break;
+		}
+		case GPR_FUNCTION_SINE: {
+			for (lane = 0; lane < lanes; lane++) {
+				out[lane] = (float)sin(in0[lane])*256;
+			}
+			break;
+		}
+		case GPR_FUNCTION_ARCSINE: {
+			for (lane = 0; lane < lanes; lane++) {
+				out[lane] = (float)asin(in0[lane]);
+			}
+			break;
+		}
+		case GPR_FUNCTION_COSINE: {
+			for (lane = 0; lane < lanes; lane++) {
+				out[lane] = (float)cos(in0[lane])*256;
+			}
+			break;
+		}
+		case GPR_FUNCTION_ARCCOSINE: {
+			for (lane = 0; lane < lanes; lane++) {
+				out[lane] = (float)acos(in0[lane]);
+			}
+			break;
+		}
+		case GPR_FUNCTION_POW: {
+			for (lane = 0; lane < lanes; lane++) {
+				out[lane] = (float)pow(in0[lane], in1[lane]);
+			}
+			break;
+		}
+		case GPR_FUNCTION_MIN: {
+			memcpy((void*)out, (void*)in0, lanes*sizeof(float));
+			for (j = 1; j < no_of_args; j++) {
+				in = &values[con[j]*GPR_BATCH_LANES];
+				for (lane = 0; lane < lanes; lane++) {
+					out[lane] = (in[lane] < out[lane]) ?
+						in[lane] : out[lane];
+				}
+			}
+			break;
+		}
+		case GPR_FUNCTION_MAX: {
+			memcpy((void*)out, (void*)in0, lanes*sizeof(float));
+			for (j = 1; j < no_of_args; j++) {
+				in = &values[con[j]*GPR_BATCH_LANES];
+				for (lane = 0; lane < lanes; lane++) {
+					out[lane] = (in[lane] > out[lane]) ?
+						in[lane] : out[lane];
+				}
+			}
+			break;
+		}
+		}
+
+		/* prevent values from going out of range */
+		for (lane = 0; lane < lanes; lane++) {
+			out[lane] = gprc_clamp_real(out[lane]);
+		}
+	}
+}
+
+/* Runs the main program over a number of samples.
+   Sensor values are stored column-major, such that the value of
+   sensor s for sample i is sensor_values[s*no_of_samples + i],
+   and actuator values are returned using the same layout.
+   Programs which only use real numbers are run over blocks of
+   samples at once.  Anything else, such as dynamic or self-modifying
+   programs, is run one sample at a time.  Either way the results
+   are the same as running each sample in turn */
+void gprc_run_samples(gprc_function * f,
+					  int rows, int columns,
+					  int connections_per_gene,
+					  int sensors, int actuators,
+					  int integers_only, int real_only,
+					  float * sensor_values, int no_of_samples,
+					  float * actuator_values,
+					  float dropout_prob, int dynamic,
+					  float (*custom_function)(float,float,float))
+{
+	int i, j, lanes=0, slot;
+	float * values, * state = f->genome[0].state;
+	gprc_ADF_module * module = &f->genome[0];
+	int gene_size = GPRC_GENE_SIZE(connections_per_gene);
+	float * actuator_gene = &module->gene[rows*columns*gene_size];
+	int no_of_values = sensors + (rows*columns);
+
+	if (no_of_samples <= 0) return;
+
+	if (module->active_valid == 0) {
+		gprc_update_active(module, rows, columns,
+						   connections_per_gene, sensors);
+	}
+
+	if ((integers_only > 0) || (real_only <= 0) ||
+		(dynamic > 0) || (dropout_prob > 0) ||
+		(gprc_batchable(f, rows, columns, connections_per_gene,
+						sensors, actuators) == 0)) {
+		/* run one sample at a time */
+		for (i = 0; i < no_of_samples; i++) {
+			for (j = 0; j < sensors; j++) {
+				gprc_set_sensor(f, j, sensor_values[j*no_of_samples + i]);
+			}
+			if (integers_only > 0) {
+				gprc_run_int(f, 0, rows, columns, connections_per_gene,
+							 sensors, actuators, dropout_prob, dynamic,
+							 (*custom_function));
+			}
+			else if (real_only > 0) {
+				gprc_run_real(f, 0, rows, columns, connections_per_gene,
+							  sensors, actuators, dropout_prob, dynamic,
+							  (*custom_function));
+			}
+			else {
+				gprc_run_float(f, 0, rows, columns, connections_per_gene,
+							   sensors, actuators, dropout_prob, dynamic,
+							   (*custom_function));
+			}
+			for (j = 0; j < actuators; j++) {
+				actuator_values[j*no_of_samples + i] =
+					gprc_get_actuator(f, j, rows, columns, sensors);
+			}
+		}
+		return;
+	}
+
+	values = (float*)malloc(no_of_values*GPR_BATCH_LANES*sizeof(float));
+#ifdef DEBUG
+	assert(values!=0);
+#endif
+
+	for (i = 0; i < no_of_samples; i += GPR_BATCH_LANES) {
+		lanes = no_of_samples - i;
+		if (lanes > GPR_BATCH_LANES) lanes = GPR_BATCH_LANES;
+
+		for (j = 0; j < sensors; j++) {
+			memcpy((void*)&values[j*GPR_BATCH_LANES],
+				   (void*)&sensor_values[j*no_of_samples + i],
+				   lanes*sizeof(float));
+		}
+
+		gprc_run_lanes(f, rows, columns, connections_per_gene,
+					   sensors, lanes, values);
+
+		for (j = 0; j < actuators; j++) {
+			memcpy((void*)&actuator_values[j*no_of_samples + i],
+				   (void*)&values[(int)actuator_gene[j]*GPR_BATCH_LANES],
+				   lanes*sizeof(float));
+		}
+	}
+
+	/* the state is left as it would be after the final sample */
+	for (j = 0; j < sensors; j++) {
+		state[j] = values[j*GPR_BATCH_LANES + lanes-1];
+	}
+	for (j = 0; j < module->no_of_active; j++) {
+		slot = sensors + module->active[j];
+		state[slot] = values[slot*GPR_BATCH_LANES + lanes-1];
+	}
+	for (j = 0; j < actuators; j++) {
+		slot = (int)actuator_gene[j];
+		state[no_of_values+j] = values[slot*GPR_BATCH_LANES + lanes-1];
+	}
+
+	free(values);
+}
+
+/* runs the program over a number of samples,
+   see gprc_run_samples for the layout of values */
+void gprc_run_batch(gprc_function * f, gprc_population * population,
+					float * sensor_values, int no_of_samples,
+					float * actuator_values,
+					float dropout_prob, int dynamic,
+					float (*custom_function)(float,float,float))
+{
+	gprc_run_samples(f, population->rows, population->columns,
+					 population->connections_per_gene,
+					 population->sensors, population->actuators,
+					 population->integers_only, population->real_only,
+					 sensor_values, no_of_samples, actuator_values,
+					 dropout_prob, dynamic, (*custom_function));
+}
+
+/* appends code which runs a single gene, doing the same as
+   gprc_run_real */
+static void gprc_jit_gene(gpr_source * source, gprc_ADF_module * module,
+						  int i, int connections_per_gene, int sensors)
+{
+	int j, no_of_args = 1, out = sensors + i;
+	int gene_size = GPRC_GENE_SIZE(connections_per_gene);
+	float * gp = &module->gene[i*gene_size];
+	int * con = &module->connection[i*connections_per_gene];
+	int function_type = module->function_type[i];
+	const char * op = "";
+
+	if (connections_per_gene > 1) {
+		no_of_args =
+			1 + (abs((int)gp[GPRC_GENE_CONSTANT])%
+				 (connections_per_gene-1));
+	}
+
+	switch(function_type) {
+	case GPR_FUNCTION_VALUE: {
+		gpr_source_printf(source, "  state[%d] = ", out);
+		gpr_source_float(source, gp[GPRC_GENE_CONSTANT]);
+		gpr_source_printf(source, "%s", ";\n");
+		break;
+	}
+	case GPR_FUNCTION_SIGMOID: {
+		gpr_source_printf(source, "%s", "  a = 0;\n");
+		for (j = 0; j < no_of_args; j++) {
+			gpr_source_printf(source, "  a += state[%d]*", con[j]);
+			gpr_source_float(source,
+							 gp[GPRC_INITIAL+j+connections_per_gene]);
+			gpr_source_printf(source, "%s", ";\n");
+		}
+		gpr_source_printf(source,
+						  "  state[%d] = 1.0f / (1.0f + exp(-a));\n", out);
+		break;
+	}
+	case GPR_FUNCTION_ADD: {
+		gpr_source_printf(source, "%s", "  a = 0;\n");
+		for (j = 0; j < no_of_args; j++) {
+			gpr_source_printf(source, "  a += state[%d];\n", con[j]);
+		}
+		gpr_source_printf(source, "  state[%d] = a;\n", out);
+		break;
+	}
+	case GPR_FUNCTION_SUBTRACT:
+	case GPR_FUNCTION_MULTIPLY:
+	case GPR_FUNCTION_AVERAGE: {
+		op = (function_type == GPR_FUNCTION_SUBTRACT) ? "-=" :
+			((function_type == GPR_FUNCTION_MULTIPLY) ? "*=" : "+=");
+		gpr_source_printf(source, "  a = state[%d];\n", con[0]);
+		for (j = 1; j < no_of_args; j++) {
+			gpr_source_printf(source, "  a %s state[%d];\n", op, con[j]);
+		}
+		if (function_type == GPR_FUNCTION_AVERAGE) {
+			gpr_source_printf(source, "  state[%d] = a / %d;\n",
+							  out, no_of_args);
+		}
+		else {
+			gpr_source_printf(source, "  state[%d] = a;\n", out);
+		}
+		break;
+	}
+	case GPR_FUNCTION_MIN:
+	case GPR_FUNCTION_MAX: {
+		op = (function_type == GPR_FUNCTION_MIN) ? "<" : ">";
+		gpr_source_printf(source, "  a = state[%d];\n", con[0]);
+		for (j = 1; j < no_of_args; j++) {
+			gpr_source_printf(source, "  c = state[%d];\n", con[j]);
+			gpr_source_printf(source, "  a = (c %s a) ? c : a;\n", op);
+		}
+		gpr_source_printf(source, "  state[%d] = a;\n", out);
+		break;
+	}
+	case GPR_FUNCTION_NEGATE: {
+		gpr_source_printf(source, "  state[%d] = -state[%d];\n",
+						  out, con[0]);
+		break;
+	}
+	case GPR_FUNCTION_WEIGHT: {
+		gpr_source_printf(source, "  state[%d] = state[%d] * ",
+						  out, con[0]);
+		gpr_source_float(source, gp[GPRC_GENE_CONSTANT]);
+		gpr_source_printf(source, "%s", ";\n");
+		break;
+	}
+	case GPR_FUNCTION_DIVIDE: {
+		gpr_source_printf(source,
+						  "  c = state[%d];\n"
+						  "  if ((c <= 1e-1) && (c >= -1e-1)) "
+						  "state[%d] = state[%d];\n"
+						  "  else state[%d] = state[%d] / c;\n",
+						  con[1], out, con[0], out, con[0]);
+		break;
+	}
+	case GPR_FUNCTION_MODULUS:
+	case GPR_FUNCTION_POW: {
+		gpr_source_printf(source, "  state[%d] = (float)%s(state[%d], "
+						  "state[%d]);\n", out,
+						  (function_type == GPR_FUNCTION_POW) ?
+						  "pow" : "fmod", con[0], con[1]);
+		break;
+	}
+	case GPR_FUNCTION_NOOP1:
+	case GPR_FUNCTION_NOOP2:
+	case GPR_FUNCTION_NOOP3:
+	case GPR_FUNCTION_NOOP4: {
+		gpr_source_printf(source, "  state[%d] = state[%d];\n",
+						  out, con[0]);
+		break;
+	}
+	case GPR_FUNCTION_GREATER_THAN:
+	case GPR_FUNCTION_LESS_THAN:
+	case GPR_FUNCTION_EQUALS:
+	case GPR_FUNCTION_AND:
+	case GPR_FUNCTION_OR:
+	case GPR_FUNCTION_XOR:
+	case GPR_FUNCTION_NOT: {
+		switch(function_type) {
+		case GPR_FUNCTION_GREATER_THAN: {
+			op = "a > c";
+			break;
+		}
+		case GPR_FUNCTION_LESS_THAN: {
+			op = "a < c";
+			break;
+		}
+		case GPR_FUNCTION_EQUALS: {
+			op = "(int)a == (int)c";
+			break;
+		}
+		case GPR_FUNCTION_AND: {
+			op = "(a>0) && (c>0)";
+			break;
+		}
+		case GPR_FUNCTION_OR: {
+			op = "(a>0) || (c>0)";
+			break;
+		}
+		case GPR_FUNCTION_XOR: {
+			op = "(a>0) != (c>0)";
+			break;
+		}
+		case GPR_FUNCTION_NOT: {
+			op = "(int)a != (int)c";
+			break;
+		}
+		}
+		gpr_source_printf(source,
+						  "  a = state[%d];\n"
+						  "  c = state[%d];\n"
+						  "  state[%d] = 0;\n"
+						  "  if (%s) state[%d] = ",
+						  con[0], con[1], out, op, out);
+		gpr_source_float(source, gp[GPRC_GENE_CONSTANT]);
+		gpr_source_printf(source, "%s", ";\n");
+		break;
+	}
+	case GPR_FUNCTION_FLOOR:
+	case GPR_FUNCTION_EXP:
+	case GPR_FUNCTION_ABS:
+	case GPR_FUNCTION_ARCSINE:
+	case GPR_FUNCTION_ARCCOSINE: {
+		switch(function_type) {
+		case GPR_FUNCTION_FLOOR: {
+			op = "floor";
+			break;
+		}
+		case GPR_FUNCTION_EXP: {
+			op = "exp";
+			break;
+		}
+		case GPR_FUNCTION_ABS: {
+			op = "fabs";
+			break;
+		}
+		case GPR_FUNCTION_ARCSINE: {
+			op = "asin";
+			break;
+		}
+		case GPR_FUNCTION_ARCCOSINE: {
+			op = "acos";
+			break;
+		}
+		}
+		gpr_source_printf(source, "  state[%d] = (float)%s(state[%d]);\n",
+						  out, op, con[0]);
+		break;
+	}
+	case GPR_FUNCTION_SQUARE_ROOT: {
+		gpr_source_printf(source,
+						  "  state[%d] = (float)sqrt(fabs(state[%d]));\n",
+						  out, con[0]);
+		break;
+	}
+	case GPR_FUNCTION_SINE:
+	case GPR_FUNCTION_COSINE: {
+		gpr_source_printf(source, "  state[%d] = (float)%s(state[%d])*256;\n",
+						  out, (function_type == GPR_FUNCTION_SINE) ?
+						  "sin" : "cos", con[0]);
+		break;
 	}
+	}
+
+	/* prevent values from going out of range */
+	gpr_source_printf(source, "  state[%d] = clamp(state[%d]);\n",
+					  out, out);
 }
 
-void gprc_run(gprc_function * f, gprc_population * population,
-			  float dropout_prob, int dynamic,
-			  float (*custom_function)(float,float,float))
+/* Compiles the main program into native code.
+   This is only possible for real-only programs which can also be run
+   in batches, since anything else depends upon previous runs or
+   changes itself.  The native program gives the same results as
+   gprc_run and remains valid until gpr_jit_release is called, or
+   until it is unloaded to make room for other programs */
+int gprc_jit_base(gprc_function * f,
+				  int rows, int columns,
+				  int connections_per_gene,
+				  int sensors, int actuators,
+				  int integers_only, int real_only,
+				  gpr_native * program)
 {
-	if (population->integers_only<=0) {
-		gprc_run_float(f, 0,
-					   population->rows, population->columns,
-					   population->connections_per_gene,
-					   population->sensors, population->actuators,
-					   dropout_prob, dynamic, (*custom_function));
+	int g, i, retval;
+	void * function;
+	gpr_source source;
+	gprc_ADF_module * module = &f->genome[0];
+	int gene_size = GPRC_GENE_SIZE(connections_per_gene);
+	float * actuator_gene = &module->gene[rows*columns*gene_size];
+
+	program->hash = 0;
+	program->run_tree = 0;
+	program->run_cartesian = 0;
+
+	if ((integers_only > 0) || (real_only <= 0)) {
+		return GPR_JIT_NOT_SUPPORTED;
 	}
-	else {
-		gprc_run_int(f, 0,
-					 population->rows, population->columns,
-					 population->connections_per_gene,
-					 population->sensors, population->actuators,
-					 dropout_prob, dynamic, (*custom_function));
+
+	if (module->active_valid == 0) {
+		gprc_update_active(module, rows, columns,
+						   connections_per_gene, sensors);
+	}
+	if (gprc_batchable(f, rows, columns, connections_per_gene,
+					   sensors, actuators) == 0) {
+		return GPR_JIT_NOT_SUPPORTED;
 	}
-}
 
-void gprc_run_environment(gprc_function * f, gprc_environment * population,
-						  float dropout_prob, int dynamic,
-						  float (*custom_function)(float,float,float))
-{
-	if (population->integers_only<=0) {
-		gprc_run_float(f, 0,
-					   population->rows, population->columns,
-					   population->connections_per_gene,
-					   population->sensors, population->actuators,
-					   dropout_prob, dynamic, (*custom_function));
+	gpr_source_init(&source);
+	gpr_source_printf(&source, "%s", "#include <math.h>\n\n");
+	gpr_source_printf(&source,
+					  "static float clamp(float v)\n"
+					  "{\n"
+					  "  v = (v == v) ? v : 0.0f;\n"
+					  "  v = (v < %d) ? v : %d;\n"
+					  "  v = (v > -%d) ? v : -%d;\n"
+					  "  return v;\n"
+					  "}\n\n",
+					  GPR_MAX_CONSTANT, GPR_MAX_CONSTANT,
+					  GPR_MAX_CONSTANT, GPR_MAX_CONSTANT);
+	gpr_source_printf(&source, "%s",
+					  "void gprc_kernel(float * state)\n"
+					  "{\n"
+					  "  float a, c;\n\n");
+
+	for (g = 0; g < module->no_of_active; g++) {
+		gprc_jit_gene(&source, module, module->active[g],
+					  connections_per_gene, sensors);
 	}
-	else {
-		gprc_run_int(f, 0,
-					 population->rows, population->columns,
-					 population->connections_per_gene,
-					 population->sensors, population->actuators,
-					 dropout_prob, dynamic, (*custom_function));
+
+	/* set the actuator values */
+	for (i = 0; i < actuators; i++) {
+		gpr_source_printf(&source, "  state[%d] = state[%d];\n",
+						  sensors + (rows*columns) + i,
+						  (int)actuator_gene[i]);
+	}
+	gpr_source_printf(&source, "%s",
+					  "  (void)a;\n"
+					  "  (void)c;\n"
+					  "}\n");
+
+	retval = gpr_jit_load(&source, "gprc_kernel", &function);
+	if (retval == GPR_JIT_OK) {
+		program->hash = gpr_source_hash(&source);
+		*(void **)(&program->run_cartesian) = function;
 	}
+
+	gpr_source_free(&source);
+	return retval;
+}
+
+/* compiles the main program into native code */
+int gprc_jit(gprc_function * f, gprc_population * population,
+			 gpr_native * program)
+{
+	return gprc_jit_base(f, population->rows, population->columns,
+						 population->connections_per_gene,
+						 population->sensors, population->actuators,
+						 population->integers_only,
+						 population->real_only, program);
+}
+
+/* runs a program which was compiled into native code.
+   This gives the same result as calling gprc_run */
+void gprc_run_native(gpr_native * program, gprc_function * f)
+{
+	(*program->run_cartesian)(f->genome[0].state);
 }
 
 /* initialize the population */
@@ -3794,8 +5564,29 @@ void gprc_init_population(gprc_population * population,
 {
 	int i;
 
+	/* the current and next individuals are allocated together */
 	population->individual =
-		(gprc_function*)malloc(size*sizeof(gprc_function));
+		(gprc_function*)malloc(size*2*sizeof(gprc_function));
+#ifdef DEBUG
+	assert(population->individual!=0);
+#endif
+	population->next_individual = &population->individual[size];
+
+	/* allocate the slab, aligning its start */
+	population->slab_stride =
+		gprc_slab_stride(rows, columns, sensors, actuators,
+						 connections_per_gene, ADF_modules,
+						 data_size, data_fields);
+	population->slab_memory =
+		malloc(population->slab_stride*size*2 + GPRC_SLAB_ALIGNMENT);
+#ifdef DEBUG
+	assert(population->slab_memory!=0);
+#endif
+	population->slab = (unsigned char*)population->slab_memory;
+	population->slab +=
+		(GPRC_SLAB_ALIGNMENT -
+		 ((size_t)population->slab % GPRC_SLAB_ALIGNMENT)) %
+		GPRC_SLAB_ALIGNMENT;
 	population->size = size;
 	population->rows = rows;
 	population->columns = columns;
@@ -3814,14 +5605,28 @@ void gprc_init_population(gprc_population * population,
 	population->history.index = 0;
 	population->history.interval = 1;
 	population->history.tick = 0;
+	population->skipped_evaluations = 0;
+	population->real_only = 0;
+	gpr_selection_init(&population->selection);
 
 	for (i = 0; i < size; i++) {
 		/* initialise the individual */
-		gprc_init(&population->individual[i],
-				  rows, columns, sensors, actuators,
-				  connections_per_gene, ADF_modules,
-				  data_size, data_fields,
-				  random_seed);
+		gprc_init_slab(&population->individual[i],
+					   rows, columns, sensors, actuators,
+					   connections_per_gene, ADF_modules,
+					   data_size, data_fields,
+					   random_seed,
+					   &population->slab[i*population->slab_stride]);
+
+		/* the next individual in this position is only
+		   filled in when breeding */
+		gprc_init_slab(&population->next_individual[i],
+					   rows, columns, sensors, actuators,
+					   connections_per_gene, ADF_modules,
+					   data_size, data_fields,
+					   random_seed,
+					   &population->slab[(size+i)*
+										 population->slab_stride]);
 
 		/* initialise individuals randomly */
 		gprc_random(&population->individual[i],
@@ -3990,10 +5795,20 @@ void gprc_free_system(gprc_system * system)
 void gprc_free_population(gprc_population * population)
 {
 	for (int i = 0; i < population->size; i++) {
-		gprc_free(&population->individual[i]);
+		/* other arrays are within the slab */
+		gprc_free_sources(&population->individual[i]);
+		gprc_free_sources(&population->next_individual[i]);
 	}
-	free(population->individual);
+	/* the current and next individuals may have been swapped */
+	if (population->next_individual < population->individual) {
+		free(population->next_individual);
+	}
+	else {
+		free(population->individual);
+	}
+	free(population->slab_memory);
 	free(population->fitness);
+	gpr_selection_free(&population->selection);
 }
 
 /* deallocates memory for the given environment */
@@ -4053,6 +5868,65 @@ void gprc_evaluate(gprc_population * population,
 	}
 }
 
+/* Evaluates the fitness of all individuals in the population,
+   also storing the error of each individual on each of the
+   given number of cases for use by lexicase selection */
+void gprc_evaluate_cases(gprc_population * population,
+						 int time_steps, int reevaluate, int cases,
+						 float (*evaluate_program)
+						 (int,gprc_population*,int,int,float*))
+{
+	int i;
+	gpr_selection * selection = &population->selection;
+
+	/* if the errors are new then every individual needs them */
+	if (gpr_selection_cases(selection, population->size, cases) != 0) {
+		reevaluate = 1;
+	}
+
+#pragma omp parallel for
+	for (i = 0; i < population->size; i++) {
+		if ((population->fitness[i]==0) ||
+			(reevaluate>0)) {
+			int s;
+			gprc_function * f = &population->individual[i];
+			unsigned char * used = f->genome[0].used;
+			float * errors = gpr_selection_errors(selection, i);
+
+			/* clear the retained state */
+			gprc_clear_state(f,
+							 population->rows, population->columns,
+							 population->sensors,
+							 population->actuators);
+
+			/* is there a path which links sensors to actuators? */
+			for (s = 0; s < population->sensors; s++) {
+				if (used[s] != 0) break;
+			}
+
+			if (s < population->sensors) {
+				/* run the evaluation function */
+				population->fitness[i] =
+					(*evaluate_program)(time_steps,population,i,0,
+										errors);
+			}
+			else {
+				/* don't evaluate, since there is no path between
+				   sensors and actuators */
+				population->fitness[i] = 0;
+				for (s = 0; s < cases; s++) {
+					errors[s] = GPR_SELECTION_MAX_ERROR;
+				}
+			}
+		}
+		/* if individual gets too old */
+		(&population->individual[i])->age++;
+		if ((&population->individual[i])->age>GPR_MAX_AGE) {
+			population->fitness[i] = 0;
+		}
+	}
+}
+
 /* evaluates a system containing multiple sub-populations */
 void gprc_evaluate_system(gprc_system * system,
 						  int time_steps, int reevaluate,
@@ -4216,61 +6090,68 @@ int gprc_get_actuator_destination(gprc_function * f, int index)
 /* sorts individuals in order of fitness */
 void gprc_sort(gprc_population * population)
 {
-	int i, j, best;
-	float max, temp_fitness;
-	gprc_function temp_individual;
+	int * index;
 
-	for (i = 0; i < population->size-1; i++) {
-		max = population->fitness[i];
-		best = i;
-		for (j = i+1; j < population->size; j++) {
-			if (population->fitness[j] > max) {
-				max = population->fitness[j];
-				best = j;
-			}
-		}
-		if (best != i) {
-			/* swap fitness */
-			temp_fitness = population->fitness[i];
-			population->fitness[i] = population->fitness[best];
-			population->fitness[best] = temp_fitness;
+	if (population->size < 2) return;
 
-			/* swap individual */
-			temp_individual = population->individual[i];
-			population->individual[i] = population->individual[best];
-			population->individual[best] = temp_individual;
-		}
-	}
+	index = (int*)malloc(population->size*sizeof(int));
+#ifdef DEBUG
+	assert(index!=0);
+#endif
+
+	gpr_rank(population->fitness, population->size, index);
+	gpr_permute((void*)population->fitness, sizeof(float),
+				index, population->size);
+	gpr_permute((void*)population->individual, sizeof(gprc_function),
+				index, population->size);
+	gpr_selection_permute(&population->selection, index);
+
+	free(index);
+}
+
+/* Moves the given number of fittest individuals to the start of the
+   population, with the fittest first and the least fit last */
+static void gprc_partition(gprc_population * population, int survivors)
+{
+	int * index;
+
+	if (population->size < 2) return;
+
+	index = (int*)malloc(population->size*sizeof(int));
+#ifdef DEBUG
+	assert(index!=0);
+#endif
+
+	gpr_partition(population->fitness, population->size,
+				  survivors, index);
+	gpr_permute((void*)population->fitness, sizeof(float),
+				index, population->size);
+	gpr_permute((void*)population->individual, sizeof(gprc_function),
+				index, population->size);
+	gpr_selection_permute(&population->selection, index);
+
+	free(index);
 }
 
 /* sorts populations in order of average fitness */
 void gprc_sort_system(gprc_system * system)
 {
-	int i, j, best;
-	float max, temp_fitness;
-	gprc_population temp_island;
+	int * index;
 
-	for (i = 0; i < system->size-1; i++) {
-		max = system->fitness[i];
-		best = i;
-		for (j = i+1; j < system->size; j++) {
-			if (system->fitness[j] > max) {
-				max = system->fitness[j];
-				best = j;
-			}
-		}
-		if (best != i) {
-			/* swap fitness */
-			temp_fitness = system->fitness[i];
-			system->fitness[i] = system->fitness[best];
-			system->fitness[best] = temp_fitness;
+	if (system->size < 2) return;
 
-			/* swap island */
-			temp_island = system->island[i];
-			system->island[i] = system->island[best];
-			system->island[best] = temp_island;
-		}
-	}
+	index = (int*)malloc(system->size*sizeof(int));
+#ifdef DEBUG
+	assert(index!=0);
+#endif
+
+	gpr_rank(system->fitness, system->size, index);
+	gpr_permute((void*)system->fitness, sizeof(float),
+				index, system->size);
+	gpr_permute((void*)system->island, sizeof(gprc_population),
+				index, system->size);
+
+	free(index);
 }
 
 /* copy a ADF_module from one individual to another */
@@ -4283,6 +6164,8 @@ void gprc_copy_ADF_module(gprc_function * source, gprc_function * dest,
 	float * source_gene, * dest_gene;
 	unsigned char * source_used, * dest_used;
 
+	gprc_genome_changed(dest);
+
 	if (dest == source) return;
 
 	source_gene = source->genome[ADF_module].gene;
@@ -4310,6 +6193,8 @@ void gprc_copy(gprc_function * source, gprc_function * dest,
 {
 	int m, min_ADF_modules = source->ADF_modules;
 
+	gprc_genome_changed(dest);
+
 	if (dest->ADF_modules < min_ADF_modules) {
 		min_ADF_modules = dest->ADF_modules;
 	}
@@ -4362,7 +6247,7 @@ static void gprc_copy_chromosome(gprc_function * parent,
 								 int ADF_module,
 								 int chromosome_index, int chromosomes)
 {
-	int col,row,n,i,j;
+	int col,n,i;
 	int start_row = chromosome_index * rows / chromosomes;
 	int end_row = (chromosome_index+1) * rows / chromosomes;
 	float * parent_gene = parent->genome[ADF_module].gene;
@@ -4370,20 +6255,21 @@ static void gprc_copy_chromosome(gprc_function * parent,
 	float * parent_state = parent->genome[ADF_module].state;
 	float * child_state = child->genome[ADF_module].state;
 
+	if (end_row <= start_row) return;
+
+	/* rows within each column are contiguous */
 	for (col = 0; col < columns; col++) {
 		i = (col*rows) + start_row;
 		n = i * GPRC_GENE_SIZE(connections_per_gene);
-		for (row = start_row; row < end_row; row++, i++,
-				 n += GPRC_GENE_SIZE(connections_per_gene)) {
-			/* copy the genome */
-			for (j = 0;
-				 j < GPRC_GENE_SIZE(connections_per_gene); j++) {
-				child_gene[n+j] = parent_gene[n+j];
-			}
-		
-			/* copy the state */
-			child_state[i] = parent_state[i];
-		}
+
+		/* copy the genome */
+		memcpy((void*)&child_gene[n], (void*)&parent_gene[n],
+			   (end_row - start_row)*
+			   GPRC_GENE_SIZE(connections_per_gene)*sizeof(float));
+
+		/* copy the state */
+		memcpy((void*)&child_state[i], (void*)&parent_state[i],
+			   (end_row - start_row)*sizeof(float));
 	}
 }
 
@@ -4415,13 +6301,14 @@ void gprc_crossover(gprc_function *parent1, gprc_function *parent2,
 				  parent1->data.size, parent1->data.fields,
 				  &parent1->random_seed);
 	}
+	gprc_genome_changed(child);
 
 	for (m = 0; m < min_ADF_modules+1; m++) {
 
 		if (m == 0) {
 			/* copy chromosomes from the parents */
 			for (c = 0; c < chromosomes; c++) {
-				if (rand_num(&parent1->random_seed)%10000 > 5000) {
+				if (rand_num(&child->random_seed)%10000 > 5000) {
 					/* copy chromosome from the first parent */
 					gprc_copy_chromosome(parent1, child, sensors,
 										 rows, columns,
@@ -4468,7 +6355,7 @@ void gprc_crossover(gprc_function *parent1, gprc_function *parent2,
 						parent = parent1;
 					}
 					else {
-						if (rand_num(&parent1->random_seed)%10000 >
+						if (rand_num(&child->random_seed)%10000 >
 							5000) {
 							parent = parent2;
 						}
@@ -4492,7 +6379,7 @@ void gprc_crossover(gprc_function *parent1, gprc_function *parent2,
 	/* actuators */
 	n = rows*columns*GPRC_GENE_SIZE(connections_per_gene);
 	for (i = 0; i < actuators; i++, n++) {
-		if (rand_num(&parent1->random_seed)%10000>5000) {
+		if (rand_num(&child->random_seed)%10000>5000) {
 			child_gene[n] = parent1_gene[n];
 		}
 		else {
@@ -4504,7 +6391,7 @@ void gprc_crossover(gprc_function *parent1, gprc_function *parent2,
 	if ((parent1->no_of_sensor_sources > 0) &&
 		(parent2->no_of_sensor_sources > 0) &&
 		(child->no_of_sensor_sources > 0)) {
-		crossover_point = rand_num(&parent1->random_seed)%sensors;
+		crossover_point = rand_num(&child->random_seed)%sensors;
 		for (i = 0; i < sensors; i++) {
 			if (i < sensors/2) {
 				child->sensor_source[crossover_point] =
@@ -4525,7 +6412,7 @@ void gprc_crossover(gprc_function *parent1, gprc_function *parent2,
 	if ((parent1->no_of_actuator_destinations > 0) &&
 		(parent2->no_of_actuator_destinations > 0) &&
 		(child->no_of_actuator_destinations > 0)) {
-		crossover_point = rand_num(&parent2->random_seed)%actuators;
+		crossover_point = rand_num(&child->random_seed)%actuators;
 		for (i = 0; i < actuators; i++) {
 			if (i < actuators/2) {
 				child->actuator_destination[crossover_point] =
@@ -4626,8 +6513,314 @@ int gprc_mate_environment(gprc_environment * population,
 	/* increment the size of the population */
 	population->population_size++;
 
-	/* return the array index of the child */
-	return population->population_size-1;
+	/* return the array index of the child */
+	return population->population_size-1;
+}
+
+/* Initialises steady state evolution of the given environment.
+   The number of individuals in the environment shouldn't change
+   while evolution is running */
+void gprc_steady_init(gprc_steady * engine,
+					  gprc_environment * population,
+					  int threads, int tournament_size,
+					  int time_steps,
+					  float mutation_prob, int use_crossover,
+					  unsigned int random_seed,
+					  int * instruction_set, int no_of_instructions,
+					  float (*evaluate_program)
+					  (int,gprc_environment*,int,int))
+{
+	int i, size = population->max_population_size;
+
+	engine->population = population;
+	engine->fitness = (float*)malloc(size*sizeof(float));
+	engine->evaluated = (unsigned char*)malloc(size);
+	engine->slot_lock =
+		(pthread_mutex_t*)malloc(size*sizeof(pthread_mutex_t));
+#ifdef DEBUG
+	assert(engine->fitness!=0);
+	assert(engine->evaluated!=0);
+	assert(engine->slot_lock!=0);
+#endif
+	for (i = 0; i < size; i++) {
+		engine->fitness[i] = 0;
+		engine->evaluated[i] = 0;
+		pthread_mutex_init(&engine->slot_lock[i], NULL);
+	}
+	pthread_mutex_init(&engine->lock, NULL);
+
+	/* a tournament needs two parents and a victim */
+	if (tournament_size < 3) {
+		tournament_size = GPRC_STEADY_TOURNAMENT_SIZE;
+	}
+	if (tournament_size > population->population_size) {
+		tournament_size = population->population_size;
+	}
+
+	/* leave enough slots for every thread to hold a tournament */
+	if (threads*tournament_size > population->population_size) {
+		threads = population->population_size / tournament_size;
+	}
+	if (threads < 1) threads = 1;
+
+	engine->threads = threads;
+	engine->tournament_size = tournament_size;
+	engine->time_steps = time_steps;
+	engine->mutation_prob = mutation_prob;
+	engine->use_crossover = use_crossover;
+	engine->instruction_set = instruction_set;
+	engine->no_of_instructions = no_of_instructions;
+	engine->evaluate_program = evaluate_program;
+	engine->random_seed = random_seed;
+	engine->evaluations = 0;
+	engine->max_evaluations = 0;
+	engine->replacements = 0;
+	engine->collisions = 0;
+}
+
+/* deallocates memory for steady state evolution */
+void gprc_steady_free(gprc_steady * engine)
+{
+	int i;
+
+	for (i = 0; i < engine->population->max_population_size; i++) {
+		pthread_mutex_destroy(&engine->slot_lock[i]);
+	}
+	pthread_mutex_destroy(&engine->lock);
+	free(engine->slot_lock);
+	free(engine->evaluated);
+	free(engine->fitness);
+}
+
+/* reserves one evaluation from the current run,
+   returning zero if there are none left */
+static int gprc_steady_reserve(gprc_steady * engine)
+{
+	int reserved = 0;
+
+	pthread_mutex_lock(&engine->lock);
+	if (engine->evaluations < engine->max_evaluations) {
+		engine->evaluations++;
+		reserved = 1;
+	}
+	pthread_mutex_unlock(&engine->lock);
+	return reserved;
+}
+
+/* evaluates the individual within the given slot.
+   The slot should already be claimed */
+static void gprc_steady_evaluate(gprc_steady * engine, int index)
+{
+	int s;
+	gprc_environment * population = engine->population;
+	gprc_function * f = &population->individual[index];
+	unsigned char * used = f->genome[0].used;
+
+	/* clear the retained state */
+	gprc_clear_state(f,
+					 population->rows, population->columns,
+					 population->sensors, population->actuators);
+
+	/* is there a path which links sensors to actuators? */
+	for (s = 0; s < population->sensors; s++) {
+		if (used[s] != 0) break;
+	}
+
+	engine->fitness[index] = 0;
+	if (s < population->sensors) {
+		engine->fitness[index] =
+			(*engine->evaluate_program)(engine->time_steps,
+										population, index, 0);
+	}
+	engine->evaluated[index] = 1;
+}
+
+/* Claims random slots for a tournament, returning the number of
+   slots claimed.  Slots which are already claimed, either by
+   another thread or by this tournament, are skipped */
+static int gprc_steady_claim(gprc_steady * engine, int * slot,
+							 unsigned int * random_seed)
+{
+	int index, claimed = 0, attempts = 0, collisions = 0;
+	int size = engine->population->population_size;
+
+	while ((claimed < engine->tournament_size) &&
+		   (attempts < size*4)) {
+		index = rand_num(random_seed)%size;
+		attempts++;
+		if (pthread_mutex_trylock(&engine->slot_lock[index]) != 0) {
+			collisions++;
+			continue;
+		}
+		slot[claimed++] = index;
+	}
+
+	if (collisions > 0) {
+		pthread_mutex_lock(&engine->lock);
+		engine->collisions += collisions;
+		pthread_mutex_unlock(&engine->lock);
+	}
+	return claimed;
+}
+
+/* the random number stream for each worker thread */
+struct gprc_stdy_worker {
+	gprc_steady * engine;
+	unsigned int random_seed;
+};
+
+/* Runs replacement tournaments until the evaluations for the
+   current run have all been used */
+static void * gprc_steady_worker(void * arg)
+{
+	struct gprc_stdy_worker * worker = (struct gprc_stdy_worker*)arg;
+	gprc_steady * engine = worker->engine;
+	gprc_environment * population = engine->population;
+	gprc_function * victim;
+	int i, j, index, claimed, running = 1;
+	int * slot;
+
+	slot = (int*)malloc(engine->tournament_size*sizeof(int));
+#ifdef DEBUG
+	assert(slot!=0);
+#endif
+
+	while (running != 0) {
+		claimed = gprc_steady_claim(engine, slot, &worker->random_seed);
+
+		/* evaluate any individuals which are new */
+		for (i = 0; i < claimed; i++) {
+			if (engine->evaluated[slot[i]] != 0) continue;
+			if (gprc_steady_reserve(engine) == 0) {
+				running = 0;
+				break;
+			}
+			gprc_steady_evaluate(engine, slot[i]);
+		}
+
+		if ((running != 0) && (claimed >= 3)) {
+			/* order the tournament from most to least fit */
+			for (i = 1; i < claimed; i++) {
+				index = slot[i];
+				for (j = i; j > 0; j--) {
+					if (engine->fitness[slot[j-1]] >=
+						engine->fitness[index]) break;
+					slot[j] = slot[j-1];
+				}
+				slot[j] = index;
+			}
+
+			/* the two fittest produce a child which
+			   replaces the least fit */
+			victim = &population->individual[slot[claimed-1]];
+			victim->random_seed = rand_num(&worker->random_seed);
+			gprc_mate(&population->individual[slot[0]],
+					  &population->individual[slot[1]],
+					  population->rows, population->columns,
+					  population->sensors, population->actuators,
+					  population->connections_per_gene,
+					  population->min_value, population->max_value,
+					  population->integers_only,
+					  engine->mutation_prob, engine->use_crossover,
+					  population->chromosomes,
+					  engine->instruction_set,
+					  engine->no_of_instructions,
+					  0, victim);
+			victim->age = 0;
+			engine->evaluated[slot[claimed-1]] = 0;
+
+			pthread_mutex_lock(&engine->lock);
+			engine->replacements++;
+			pthread_mutex_unlock(&engine->lock);
+
+			/* evaluate the child while its slot is still claimed */
+			if (gprc_steady_reserve(engine) != 0) {
+				gprc_steady_evaluate(engine, slot[claimed-1]);
+			}
+			else {
+				running = 0;
+			}
+		}
+
+		/* release the slots */
+		for (i = 0; i < claimed; i++) {
+			pthread_mutex_unlock(&engine->slot_lock[slot[i]]);
+		}
+	}
+
+	free(slot);
+	return NULL;
+}
+
+/* Evolves the environment for the given number of evaluations.
+   With a single thread the result only depends upon the
+   random seed given when initialising */
+void gprc_steady_run(gprc_steady * engine, long evaluations)
+{
+	int t, started;
+	unsigned int run_seed;
+	struct gprc_stdy_worker * worker;
+	pthread_t * thread;
+
+	/* there needs to be room for a tournament */
+	if (engine->population->population_size < 3) return;
+
+	engine->max_evaluations = engine->evaluations + evaluations;
+	run_seed = rand_num(&engine->random_seed);
+
+	worker = (struct gprc_stdy_worker*)
+		malloc(engine->threads*sizeof(struct gprc_stdy_worker));
+#ifdef DEBUG
+	assert(worker!=0);
+#endif
+	for (t = 0; t < engine->threads; t++) {
+		worker[t].engine = engine;
+		worker[t].random_seed = rand_stream_seed(run_seed, t);
+	}
+
+	if (engine->threads == 1) {
+		gprc_steady_worker(&worker[0]);
+		free(worker);
+		return;
+	}
+
+	thread = (pthread_t*)malloc(engine->threads*sizeof(pthread_t));
+#ifdef DEBUG
+	assert(thread!=0);
+#endif
+	for (started = 0; started < engine->threads; started++) {
+		if (pthread_create(&thread[started], NULL,
+						   gprc_steady_worker,
+						   (void*)&worker[started]) != 0) {
+			break;
+		}
+	}
+	/* if no threads could be created then evolve on this one */
+	if (started == 0) {
+		gprc_steady_worker(&worker[0]);
+	}
+	for (t = 0; t < started; t++) {
+		pthread_join(thread[t], NULL);
+	}
+
+	free(thread);
+	free(worker);
+}
+
+/* returns the slot containing the fittest evaluated individual,
+   or -1 if none have been evaluated */
+int gprc_steady_best(gprc_steady * engine)
+{
+	int i, best = -1;
+
+	for (i = 0; i < engine->population->population_size; i++) {
+		if (engine->evaluated[i] == 0) continue;
+		if ((best == -1) ||
+			(engine->fitness[i] > engine->fitness[best])) {
+			best = i;
+		}
+	}
+	return best;
 }
 
 /* two parents mate and produce a child */
@@ -4671,7 +6864,7 @@ void gprc_mate(gprc_function *parent1, gprc_function *parent2,
 
 		/* clone one parent or the other */
 		parent = parent1;
-		if (rand_num(&parent1->random_seed)%10000 > 5000) {
+		if (rand_num(&child->random_seed)%10000 > 5000) {
 			parent = parent2;
 		}
 
@@ -4682,6 +6875,19 @@ void gprc_mate(gprc_function *parent1, gprc_function *parent2,
 				  sensors, actuators);
 	}
 
+	/* Mutation keeps the used genes up to date, but they need to be
+	   up to date beforehand.  The genes of a cloned parent only
+	   change after its used genes were found if it contains
+	   dynamic functions */
+	if ((use_crossover > 0) ||
+		(gprc_no_of_dynamic_functions(child, rows, columns,
+									  sensors, actuators,
+									  connections_per_gene) > 0)) {
+		gprc_used_functions(child, rows, columns,
+							connections_per_gene,
+							sensors, actuators);
+	}
+
 	/* add mutations */
 	gprc_mutate(child, rows, columns,
 				sensors, actuators,
@@ -4692,10 +6898,7 @@ void gprc_mate(gprc_function *parent1, gprc_function *parent2,
 				integers_only,
 				instruction_set, no_of_instructions);
 
-	/* which functions are used */
-	gprc_used_functions(child, rows, columns,
-						connections_per_gene,
-						sensors, actuators);
+	if (child->ADF_modules == 0) return;
 
 	/* compress */
 	gprc_compress_ADF(child, 0, -1,
@@ -4704,10 +6907,100 @@ void gprc_mate(gprc_function *parent1, gprc_function *parent2,
 					  sensors, actuators,
 					  min_value, max_value, max_depth, 1);
 
+	/* which functions are used after compression */
+	gprc_used_functions(child, rows, columns,
+						connections_per_gene,
+						sensors, actuators);
+
 	/* update all ADF connections */
 	gprc_update_ADF_modules(child, rows, columns,
 							connections_per_gene,
 							sensors);
+
+	/* the number of arguments of ADF calls may have changed */
+	gprc_used_functions_module(child, 0, rows, columns,
+							   connections_per_gene,
+							   sensors, actuators);
+}
+
+/* Returns non-zero if the two individuals have the same used genes,
+   and so will behave in the same way when run.
+   Dynamic programs run every gene and can change their genes while
+   running, and hebbian genes change their weights while running,
+   so in those cases the genes don't describe the behavior */
+int gprc_same_phenotype(gprc_function * f1, gprc_function * f2,
+						int rows, int columns,
+						int connections_per_gene,
+						int sensors, int actuators)
+{
+	int m, i, sens, act;
+	int gene_size = GPRC_GENE_SIZE(connections_per_gene);
+	float * gene1, * gene2;
+	unsigned char * used1, * used2;
+
+	if (f1->ADF_modules != f2->ADF_modules) return 0;
+
+	if ((gprc_no_of_dynamic_functions(f1, rows, columns,
+									  sensors, actuators,
+									  connections_per_gene) > 0) ||
+		(gprc_no_of_dynamic_functions(f2, rows, columns,
+									  sensors, actuators,
+									  connections_per_gene) > 0)) {
+		return 0;
+	}
+
+	/* sensor sources and actuator destinations */
+	if ((f1->no_of_sensor_sources != f2->no_of_sensor_sources) ||
+		(f1->no_of_actuator_destinations !=
+		 f2->no_of_actuator_destinations)) {
+		return 0;
+	}
+	if ((f1->no_of_sensor_sources > 0) &&
+		(memcmp((void*)f1->sensor_source, (void*)f2->sensor_source,
+				sensors*sizeof(int)) != 0)) {
+		return 0;
+	}
+	if ((f1->no_of_actuator_destinations > 0) &&
+		(memcmp((void*)f1->actuator_destination,
+				(void*)f2->actuator_destination,
+				actuators*sizeof(int)) != 0)) {
+		return 0;
+	}
+
+	for (m = 0; m < f1->ADF_modules+1; m++) {
+		sens = gprc_get_sensors(m, sensors);
+		act = gprc_get_actuators(m, actuators);
+		gene1 = f1->genome[m].gene;
+		gene2 = f2->genome[m].gene;
+		used1 = &f1->genome[m].used[sens];
+		used2 = &f2->genome[m].used[sens];
+
+		if (memcmp((void*)used1, (void*)used2, rows*columns) != 0) {
+			return 0;
+		}
+
+		/* compare the used genes */
+		for (i = 0; i < rows*columns; i++) {
+			if (used1[i] == 0) continue;
+			if ((int)gene1[i*gene_size + GPRC_GENE_FUNCTION_TYPE] ==
+				GPR_FUNCTION_HEBBIAN) {
+				return 0;
+			}
+			if (memcmp((void*)&gene1[i*gene_size],
+					   (void*)&gene2[i*gene_size],
+					   gene_size*sizeof(float)) != 0) {
+				return 0;
+			}
+		}
+
+		/* compare the actuator connections */
+		if (memcmp((void*)&gene1[rows*columns*gene_size],
+				   (void*)&gene2[rows*columns*gene_size],
+				   act*sizeof(float)) != 0) {
+			return 0;
+		}
+	}
+	return 1;
 }
 
 /* Returns a fitness histogram for the given population */
@@ -4836,6 +7129,31 @@ static float gprc_diversity(gprc_population * population)
 	return occupied_fraction * (1.0f/(1.0f+variance));
 }
 
+/* Ensures that a child has arrays for sensor sources and
+   actuator destinations if its parent has them */
+static void gprc_inherit_sources(gprc_function * parent,
+								 gprc_function * child,
+								 int sensors, int actuators)
+{
+	if ((parent->no_of_sensor_sources > 0) &&
+		(child->sensor_source == 0)) {
+		child->no_of_sensor_sources = parent->no_of_sensor_sources;
+		child->sensor_source = (int*)malloc(sensors*sizeof(int));
+		memcpy((void*)child->sensor_source,
+			   (void*)parent->sensor_source, sensors*sizeof(int));
+	}
+	if ((parent->no_of_actuator_destinations > 0) &&
+		(child->actuator_destination == 0)) {
+		child->no_of_actuator_destinations =
+			parent->no_of_actuator_destinations;
+		child->actuator_destination =
+			(int*)malloc(actuators*sizeof(int));
+		memcpy((void*)child->actuator_destination,
+			   (void*)parent->actuator_destination,
+			   actuators*sizeof(int));
+	}
+}
+
 /* Produce the next generation.
    This assumes that fitness has already been evaluated */
 void gprc_generation(gprc_population * population,
@@ -4844,12 +7162,36 @@ void gprc_generation(gprc_population * population,
 					 int use_crossover, unsigned int * random_seed,
 					 int * instruction_set, int no_of_instructions)
 {
-	int i, threshold;
+	int i, threshold, parents, skipped = 0;
+	unsigned int generation_seed;
 	float diversity,mutation_prob_range;
-	gprc_function * parent1, * parent2, * child;
+	float * child_fitness;
+	gprc_function survivor, * next_individual;
+	gpr_selection * selection = &population->selection;
+
+	/* range checking */
+	if ((elitism < 0.1f) || (elitism > 0.9f)) {
+		elitism = 0.3f;
+	}
+
+	/* index setting the threshold for the fittest individuals */
+	threshold = (int)((1.0f - elitism)*(population->size-1));
 
-	/* sort the population in order of fitness */
-	gprc_sort(population);
+	if (selection->method == GPR_SELECTION_TRUNCATION) {
+		/* sort the population in order of fitness */
+		gprc_sort(population);
+
+		/* parents are chosen from the fittest individuals */
+		parents = threshold;
+	}
+	else {
+		/* only the survivors need to be found */
+		gprc_partition(population, threshold);
+
+		/* Children are bred into the next individuals, so parents
+		   can be chosen from the whole population */
+		parents = population->size;
+	}
 
 	diversity = gprc_diversity(population);
 	mutation_prob_range = (1.0f-mutation_prob)/2;
@@ -4883,25 +7225,47 @@ void gprc_generation(gprc_population * population,
 		}
 	}
 
-	/* range checking */
-	if ((elitism < 0.1f) || (elitism > 0.9f)) {
-		elitism = 0.3f;
-	}
+	/* Each child gets its own random number stream derived from
+	   this seed, so the result doesn't depend upon the
+	   number of threads */
+	generation_seed = rand_num(random_seed);
+	gpr_selection_prepare(selection, random_seed);
 
-	/* index setting the threshold for the fittest individuals */
-	threshold = (int)((1.0f - elitism)*(population->size-1));
+	/* the fitness of each parent is needed until all children
+	   have been bred */
+	child_fitness =
+		(float*)malloc((population->size - threshold)*sizeof(float));
+#ifdef DEBUG
+	assert(child_fitness!=0);
+#endif
 
-#pragma omp parallel for
+	/* Children are bred into the next individuals, so parents
+	   are only ever read while breeding */
+#pragma omp parallel for reduction(+:skipped)
 	for (i = 0; i < population->size - threshold; i++) {
-		/* randomly choose parents from the fittest
-		   section of the population */
-		parent1 =
-			&population->individual[rand_num(random_seed)%threshold];
-		parent2 =
-			&population->individual[rand_num(random_seed)%threshold];
+		gprc_function * parent1, * parent2;
+		gprc_function * child =
+			&population->next_individual[threshold + i];
+		int index1, index2;
+
+		child->random_seed =
+			rand_stream_seed(generation_seed, threshold + i);
+
+		/* choose the parents */
+		index1 = gpr_select(selection, population->fitness,
+							parents, &child->random_seed);
+		index2 = gpr_select(selection, population->fitness,
+							parents, &child->random_seed);
+		parent1 = &population->individual[index1];
+		parent2 = &population->individual[index2];
+
+		/* the child needs somewhere to store sensor sources
+		   and actuator destinations */
+		gprc_inherit_sources(parent1, child,
+							 population->sensors,
+							 population->actuators);
 
 		/* produce a new child */
-		child = &population->individual[threshold + i];
 		gprc_mate(parent1, parent2,
 				  population->rows, population->columns,
 				  population->sensors, population->actuators,
@@ -4915,12 +7279,53 @@ void gprc_generation(gprc_population * population,
 				  0, child);
 
 		/* fitness not yet evaluated */
-		population->fitness[threshold + i] = 0;
+		child_fitness[i] = 0;
+
+		/* If the changes were only to unused genes then the child
+		   behaves in the same way as a parent, so its fitness
+		   doesn't need to be evaluated again */
+		if (gprc_same_phenotype(child, parent1,
+								population->rows, population->columns,
+								population->connections_per_gene,
+								population->sensors,
+								population->actuators) != 0) {
+			child_fitness[i] = population->fitness[index1];
+			gpr_selection_inherit(selection, threshold + i, index1);
+			skipped++;
+		}
+		else if (gprc_same_phenotype(child, parent2,
+									 population->rows,
+									 population->columns,
+									 population->connections_per_gene,
+									 population->sensors,
+									 population->actuators) != 0) {
+			child_fitness[i] = population->fitness[index2];
+			gpr_selection_inherit(selection, threshold + i, index2);
+			skipped++;
+		}
 
 		/* reset the age of the child */
 		child->age = 0;
 	}
 
+	memcpy((void*)&population->fitness[threshold],
+		   (void*)child_fitness,
+		   (population->size - threshold)*sizeof(float));
+	free(child_fitness);
+
+	/* the fittest individuals survive into the next generation */
+	for (i = 0; i < threshold; i++) {
+		survivor = population->individual[i];
+		population->individual[i] = population->next_individual[i];
+		population->next_individual[i] = survivor;
+	}
+
+	/* swap the buffers */
+	next_individual = population->next_individual;
+	population->next_individual = population->individual;
+	population->individual = next_individual;
+
+	population->skipped_evaluations += skipped;
 }
 
 /* Produce the next generation for a system containing multiple
@@ -4938,13 +7343,17 @@ void gprc_generation_system(gprc_system * system,
 	int i, migrant_index;
 	gprc_population *population1, *population2;
 	int island1_index, island2_index;
+	unsigned int system_seed = rand_num(random_seed);
 
 #pragma omp parallel for
 	for (i = 0; i < system->size; i++) {
+		/* each island has its own random number stream */
+		unsigned int island_seed = rand_stream_seed(system_seed, i);
+
 		gprc_generation(&system->island[i],
 						elitism,
 						mutation_prob,
-						use_crossover, random_seed,
+						use_crossover, &island_seed,
 						instruction_set, no_of_instructions);
 	}
 
@@ -4977,6 +7386,9 @@ void gprc_generation_system(gprc_system * system,
 			/* copy the fitness value */
 			population2->fitness[population2->size-1] =
 				population1->fitness[migrant_index];
+			gpr_selection_copy(&population1->selection, migrant_index,
+							   &population2->selection,
+							   population2->size-1);
 
 			/* create a new random individual */
 			population1->fitness[migrant_index] = 0;
@@ -5056,8 +7468,7 @@ int gprc_save(gprc_function * f,
 	retval = fwrite(&f->random_seed, sizeof(unsigned int), 1, fp);
 
 	if (data_size > 0) {
-		retval = fwrite(&f->data.block, sizeof(float),
-						data_size*data_fields*2, fp);
+		retval = gpr_data_save(&f->data, fp);
 	}
 	return retval;
 }
@@ -5168,8 +7579,7 @@ int gprc_load(gprc_function * f,
 
 	/* read the data */
 	if (data_size > 0) {
-		retval = fread(f->data.block, sizeof(float),
-					   data_size*data_fields*2, fp);
+		retval = gpr_data_load(&f->data, fp);
 	}
 
 	/* calculate the function usage array */
@@ -5525,6 +7935,453 @@ void gprc_load_system(gprc_system * system,
 	}
 }
 
+/* appends an individual to a buffer which will be saved
+   as part of a binary file */
+void gprc_save_binary(gprc_function * f,
+					  int rows, int columns,
+					  int connections_per_gene,
+					  int sensors, int actuators,
+					  int data_size, int data_fields,
+					  gpr_binary_buffer * buffer)
+{
+	int m, act;
+
+	gpr_binary_put_int(buffer, f->ADF_modules);
+	for (m = 0; m < f->ADF_modules+1; m++) {
+		act = gprc_get_actuators(m,actuators);
+		gpr_binary_put(buffer, f->genome[m].gene,
+					   ((rows*columns*
+						 GPRC_GENE_SIZE(connections_per_gene)) +
+						act)*sizeof(float));
+	}
+
+	gpr_binary_put_int(buffer, f->no_of_sensor_sources);
+	if (f->no_of_sensor_sources > 0) {
+		gpr_binary_put(buffer, f->sensor_source, sensors*sizeof(int));
+	}
+	gpr_binary_put_int(buffer, f->no_of_actuator_destinations);
+	if (f->no_of_actuator_destinations > 0) {
+		gpr_binary_put(buffer, f->actuator_destination,
+					   actuators*sizeof(int));
+	}
+
+	gpr_binary_put(buffer, &f->random_seed, sizeof(unsigned int));
+	gpr_binary_put_int(buffer, f->age);
+
+	if (data_size > 0) {
+		gpr_binary_put_int(buffer, f->data.head);
+		gpr_binary_put_int(buffer, f->data.tail);
+		gpr_binary_put(buffer, f->data.block,
+					   gpr_data_length(data_size, data_fields)*
+					   sizeof(float));
+	}
+}
+
+/* loads an individual from the current section of a binary file */
+int gprc_load_binary(gprc_function * f,
+					 int rows, int columns,
+					 int connections_per_gene,
+					 int sensors, int actuators,
+					 int data_size, int data_fields,
+					 gpr_binary_reader * reader)
+{
+	int m, i, act, states, ADF_modules;
+	float * actuator_source;
+
+	/* the number of modules can't exceed those allocated */
+	ADF_modules = gpr_binary_get_int(reader);
+	if ((ADF_modules < 0) || (ADF_modules > f->ADF_modules)) {
+		return GPR_LOAD_BINARY_SECTION;
+	}
+	f->ADF_modules = ADF_modules;
+
+	/* read the genome */
+	for (m = 0; m < f->ADF_modules+1; m++) {
+		act = gprc_get_actuators(m,actuators);
+		gpr_binary_get_array(reader, f->genome[m].gene,
+							 ((rows*columns*
+							   GPRC_GENE_SIZE(connections_per_gene)) +
+							  act)*sizeof(float));
+
+		/* actuator sources index the used genes array */
+		states = gprc_get_sensors(m,sensors) + (rows*columns) + act;
+		actuator_source =
+			&f->genome[m].gene[rows*columns*
+							   GPRC_GENE_SIZE(connections_per_gene)];
+		for (i = 0; i < act; i++) {
+			if (gpr_binary_in_range((int)actuator_source[i],
+									0, states-1) == 0) {
+				return GPR_LOAD_BINARY_SECTION;
+			}
+		}
+	}
+
+	/* read the sensor sources and actuator destinations */
+	f->no_of_sensor_sources = gpr_binary_get_int(reader);
+	if (f->no_of_sensor_sources > 0) {
+		if (f->sensor_source == 0) {
+			f->sensor_source = (int*)malloc(sensors*sizeof(int));
+		}
+		gpr_binary_get_array(reader, f->sensor_source,
+							 sensors*sizeof(int));
+	}
+	f->no_of_actuator_destinations = gpr_binary_get_int(reader);
+	if (f->no_of_actuator_destinations > 0) {
+		if (f->actuator_destination == 0) {
+			f->actuator_destination =
+				(int*)malloc(actuators*sizeof(int));
+		}
+		gpr_binary_get_array(reader, f->actuator_destination,
+							 actuators*sizeof(int));
+	}
+
+	gpr_binary_get_array(reader, &f->random_seed, sizeof(unsigned int));
+	f->age = gpr_binary_get_int(reader);
+
+	/* read the data */
+	if (data_size > 0) {
+		f->data.head = gpr_binary_get_int(reader) & f->data.mask;
+		f->data.tail = gpr_binary_get_int(reader) & f->data.mask;
+		gpr_binary_get_array(reader, f->data.block,
+							 gpr_data_length(data_size, data_fields)*
+							 sizeof(float));
+	}
+	if (reader->overrun != 0) return GPR_LOAD_BINARY_SECTION;
+
+	/* calculate the function usage array */
+	gprc_used_functions(f,rows,columns,
+						connections_per_gene,
+						sensors, actuators);
+	return GPR_LOAD_OK;
+}
+
+/* Returns non-zero if the population parameters read from
+   a binary file are within sensible limits */
+int gprc_valid_binary_parameters(int size,
+								 int rows, int columns,
+								 int sensors, int actuators,
+								 int connections_per_gene,
+								 int chromosomes, int ADF_modules,
+								 int data_size, int data_fields)
+{
+	const int max = GPR_BINARY_MAX_DIMENSION;
+
+	if ((gpr_binary_in_range(size, 1, max) == 0) ||
+		(gpr_binary_in_range(rows, 1, max) == 0) ||
+		(gpr_binary_in_range(columns, 1, max) == 0) ||
+		(gpr_binary_in_range(sensors, 1, max) == 0) ||
+		(gpr_binary_in_range(actuators, 1, max) == 0) ||
+		(gpr_binary_in_range(connections_per_gene, 1, max) == 0) ||
+		(gpr_binary_in_range(chromosomes, 1, rows) == 0) ||
+		(gpr_binary_in_range(ADF_modules, 0,
+							 GPRC_MAX_ADF_MODULES) == 0) ||
+		(gpr_binary_in_range(data_size, 0, max) == 0) ||
+		(gpr_binary_in_range(data_fields, 0, max) == 0)) {
+		return 0;
+	}
+	if ((long long)rows*columns > GPR_BINARY_MAX_GENES) return 0;
+	if ((data_size > 0) && (data_fields == 0)) return 0;
+	return 1;
+}
+
+/* writes the sections describing a population */
+static int gprc_save_population_sections(gprc_population * population,
+										 FILE * fp, int compress)
+{
+	int i, retval = 0;
+	gpr_binary_buffer buffer;
+
+	gpr_binary_init(&buffer);
+
+	/* population parameters */
+	gpr_binary_put_int(&buffer, population->size);
+	gpr_binary_put_int(&buffer, population->rows);
+	gpr_binary_put_int(&buffer, population->columns);
+	gpr_binary_put_int(&buffer, population->sensors);
+	gpr_binary_put_int(&buffer, population->actuators);
+	gpr_binary_put_int(&buffer, population->connections_per_gene);
+	gpr_binary_put_float(&buffer, population->min_value);
+	gpr_binary_put_float(&buffer, population->max_value);
+	gpr_binary_put_int(&buffer, population->integers_only);
+	gpr_binary_put_int(&buffer, population->real_only);
+	gpr_binary_put_int(&buffer, population->chromosomes);
+	gpr_binary_put_int(&buffer, population->ADF_modules);
+	gpr_binary_put_int(&buffer, population->data_size);
+	gpr_binary_put_int(&buffer, population->data_fields);
+	if (gpr_binary_write_section(fp, GPR_BINARY_SECTION_PARAMETERS,
+								 &buffer, compress) != 0) retval = -1;
+
+	/* fitness history */
+	gpr_binary_clear(&buffer);
+	gpr_binary_put(&buffer, &population->history, sizeof(gpr_history));
+	if (gpr_binary_write_section(fp, GPR_BINARY_SECTION_HISTORY,
+								 &buffer, compress) != 0) retval = -1;
+
+	/* individuals */
+	gpr_binary_clear(&buffer);
+	for (i = 0; i < population->size; i++) {
+		gpr_binary_put_float(&buffer, population->fitness[i]);
+		gprc_save_binary(&population->individual[i],
+						 population->rows, population->columns,
+						 population->connections_per_gene,
+						 population->sensors, population->actuators,
+						 population->data_size,
+						 population->data_fields,
+						 &buffer);
+	}
+	if (gpr_binary_write_section(fp, GPR_BINARY_SECTION_INDIVIDUALS,
+								 &buffer, compress) != 0) retval = -1;
+
+	gpr_binary_free(&buffer);
+	return retval;
+}
+
+/* Reads the sections describing a population.
+   If this fails then the population is left unallocated */
+static int gprc_load_population_sections(gprc_population * population,
+										 gpr_binary_reader * reader,
+										 int * instruction_set,
+										 int no_of_instructions)
+{
+	int i, retval;
+	int size, rows, columns, sensors, actuators;
+	int connections_per_gene, integers_only, real_only;
+	int chromosomes, ADF_modules, data_size, data_fields;
+	float min_value, max_value;
+	unsigned int random_seed = 1234;
+
+	/* population parameters */
+	retval = gpr_binary_next_section(reader,
+									 GPR_BINARY_SECTION_PARAMETERS);
+	if (retval != GPR_LOAD_OK) return retval;
+	size = gpr_binary_get_int(reader);
+	rows = gpr_binary_get_int(reader);
+	columns = gpr_binary_get_int(reader);
+	sensors = gpr_binary_get_int(reader);
+	actuators = gpr_binary_get_int(reader);
+	connections_per_gene = gpr_binary_get_int(reader);
+	min_value = gpr_binary_get_float(reader);
+	max_value = gpr_binary_get_float(reader);
+	integers_only = gpr_binary_get_int(reader);
+	real_only = gpr_binary_get_int(reader);
+	chromosomes = gpr_binary_get_int(reader);
+	ADF_modules = gpr_binary_get_int(reader);
+	data_size = gpr_binary_get_int(reader);
+	data_fields = gpr_binary_get_int(reader);
+	if ((reader->overrun != 0) ||
+		(gprc_valid_binary_parameters(size, rows, columns,
+									  sensors, actuators,
+									  connections_per_gene,
+									  chromosomes, ADF_modules,
+									  data_size, data_fields) == 0)) {
+		return GPR_LOAD_BINARY_SECTION;
+	}
+
+	gprc_init_population(population,
+						 size,
+						 rows, columns,
+						 sensors, actuators,
+						 connections_per_gene,
+						 ADF_modules,
+						 chromosomes,
+						 min_value, max_value,
+						 integers_only,
+						 data_size, data_fields,
+						 &random_seed,
+						 instruction_set, no_of_instructions);
+	population->real_only = real_only;
+
+	/* fitness history */
+	retval = gpr_binary_next_section(reader, GPR_BINARY_SECTION_HISTORY);
+	if (retval == GPR_LOAD_OK) {
+		gpr_binary_get_array(reader, &population->history,
+							 sizeof(gpr_history));
+
+		/* individuals */
+		retval = gpr_binary_next_section(reader,
+										 GPR_BINARY_SECTION_INDIVIDUALS);
+	}
+	for (i = 0; (i < size) && (retval == GPR_LOAD_OK); i++) {
+		population->fitness[i] = gpr_binary_get_float(reader);
+		retval = gprc_load_binary(&population->individual[i],
+								  rows, columns,
+								  connections_per_gene,
+								  sensors, actuators,
+								  data_size, data_fields,
+								  reader);
+	}
+	if (retval != GPR_LOAD_OK) {
+		gprc_free_population(population);
+	}
+	return retval;
+}
+
+/* Saves a population to a binary file.
+   Sections are compressed if compress is non-zero.
+   Returns zero on success */
+int gprc_save_population_binary(gprc_population * population,
+								FILE * fp, int compress)
+{
+	if (gpr_binary_write_header(fp, GPR_BINARY_GPRC_POPULATION) != 0) {
+		return -1;
+	}
+	if (gprc_save_population_sections(population, fp, compress) != 0) {
+		return -1;
+	}
+	return gpr_binary_write_end(fp);
+}
+
+/* Loads a population from a binary file.
+   If this fails then the population is left unallocated */
+int gprc_load_population_binary(gprc_population * population,
+								FILE * fp,
+								int * instruction_set,
+								int no_of_instructions)
+{
+	gpr_binary_reader reader;
+	int retval;
+
+	retval = gpr_binary_open(&reader, fp, GPR_BINARY_GPRC_POPULATION);
+	if (retval == GPR_LOAD_OK) {
+		retval = gprc_load_population_sections(population, &reader,
+											   instruction_set,
+											   no_of_instructions);
+		if (retval == GPR_LOAD_OK) {
+			retval = gpr_binary_next_section(&reader,
+											 GPR_BINARY_SECTION_END);
+			if (retval != GPR_LOAD_OK) {
+				gprc_free_population(population);
+			}
+		}
+	}
+	gpr_binary_close(&reader);
+	return retval;
+}
+
+/* Saves a system to a binary file.
+   Returns zero on success */
+int gprc_save_system_binary(gprc_system * system, FILE * fp,
+							int compress)
+{
+	int i, retval = 0;
+	gpr_binary_buffer buffer;
+
+	if (gpr_binary_write_header(fp, GPR_BINARY_GPRC_SYSTEM) != 0) {
+		return -1;
+	}
+
+	gpr_binary_init(&buffer);
+	gpr_binary_put_int(&buffer, system->size);
+	gpr_binary_put_int(&buffer, system->migration_tick);
+	gpr_binary_put(&buffer, &system->history, sizeof(gpr_history));
+	gpr_binary_put(&buffer, system->fitness, system->size*sizeof(float));
+	retval = gpr_binary_write_section(fp, GPR_BINARY_SECTION_SYSTEM,
+									  &buffer, compress);
+	gpr_binary_free(&buffer);
+
+	for (i = 0; i < system->size; i++) {
+		if (retval != 0) return retval;
+		retval = gprc_save_population_sections(&system->island[i],
+											   fp, compress);
+	}
+	if (retval != 0) return retval;
+	return gpr_binary_write_end(fp);
+}
+
+/* Loads a system from a binary file.
+   If this fails then the system is left unallocated */
+int gprc_load_system_binary(gprc_system * system, FILE * fp,
+							int * instruction_set, int no_of_instructions)
+{
+	gpr_binary_reader reader;
+	int i, j, islands, migration_tick, retval;
+	int population_per_island=10;
+	int rows=5, columns=5;
+	int sensors=1, actuators=1;
+	int connections_per_gene=2;
+	int chromosomes=1, ADF_modules=1;
+	float min_value=-10, max_value=10;
+	int integers_only=0;
+	unsigned int random_seed = 1234;
+	int data_size = 1, data_fields = 1;
+
+	retval = gpr_binary_open(&reader, fp, GPR_BINARY_GPRC_SYSTEM);
+	if (retval == GPR_LOAD_OK) {
+		retval = gpr_binary_next_section(&reader,
+										 GPR_BINARY_SECTION_SYSTEM);
+	}
+	if (retval != GPR_LOAD_OK) {
+		gpr_binary_close(&reader);
+		return retval;
+	}
+
+	islands = gpr_binary_get_int(&reader);
+	migration_tick = gpr_binary_get_int(&reader);
+	if ((reader.overrun != 0) ||
+		(gpr_binary_in_range(islands, 1,
+							 GPR_BINARY_MAX_DIMENSION) == 0)) {
+		gpr_binary_close(&reader);
+		return GPR_LOAD_BINARY_SECTION;
+	}
+
+	/* create a system.
+	   It doesn't matter what the parameters are here, because
+	   they will be overwritten later */
+	gprc_init_system(system,
+					 islands,
+					 population_per_island,
+					 rows, columns,
+					 sensors, actuators,
+					 connections_per_gene,
+					 ADF_modules, chromosomes,
+					 min_value, max_value,
+					 integers_only,
+					 data_size, data_fields,
+					 &random_seed,
+					 instruction_set, no_of_instructions);
+	system->migration_tick = migration_tick;
+	gpr_binary_get_array(&reader, &system->history, sizeof(gpr_history));
+	gpr_binary_get_array(&reader, system->fitness,
+						 islands*sizeof(float));
+
+	/* load each population */
+	for (i = 0; i < islands; i++) {
+		gprc_free_population(&system->island[i]);
+		retval = gprc_load_population_sections(&system->island[i],
+											   &reader,
+											   instruction_set,
+											   no_of_instructions);
+		if (retval != GPR_LOAD_OK) break;
+	}
+	if (retval == GPR_LOAD_OK) {
+		retval = gpr_binary_next_section(&reader,
+										 GPR_BINARY_SECTION_END);
+	}
+	if (retval != GPR_LOAD_OK) {
+		/* an island which failed to load has already been freed */
+		for (j = i+1; j < islands; j++) {
+			gprc_free_population(&system->island[j]);
+		}
+		system->size = i;
+		gprc_free_system(system);
+	}
+	gpr_binary_close(&reader);
+	return retval;
+}
+
+/* writes a binary checkpoint of a system in the background */
+int gprc_checkpoint_system(gprc_system * system,
+						   gpr_checkpoint * checkpoint,
+						   char * filename, int compress)
+{
+	FILE * fp = gpr_checkpoint_begin(checkpoint);
+
+	if (fp == 0) return -1;
+	return gpr_checkpoint_end(checkpoint,
+							  gprc_save_system_binary(system, fp, 0),
+							  filename, compress);
+}
+
 /* arduino setup */
 static void gprc_arduino_setup(FILE * fp,
 							   int no_of_digital_inputs,
@@ -6593,14 +9450,16 @@ static void gprc_c_run(FILE * fp,
 	fprintf(fp,"%s","      }\n");
 	fprintf(fp,"%s","      /* prevent values from going ");
 	fprintf(fp,"%s","out of range */\n");
-	fprintf(fp,"%s","      if ((isnan(state[ADF_module][sens+i])) ");
-	fprintf(fp,"%s","|| (isinf(state[ADF_module][sens+i]))) {\n");
-	fprintf(fp,"%s","        state[ADF_module][sens+i] = 0;\n");
-	fprintf(fp,"%s","      }\n");
-	fprintf(fp,"%s","      if ((isnan(state[ADF_module][sens+i+no_of_states])) ");
-	fprintf(fp,"%s","|| (isinf(state[ADF_module][sens+i+no_of_states]))) {\n");
-	fprintf(fp,"%s","        state[ADF_module][sens+i+no_of_states] = 0;\n");
-	fprintf(fp,"%s","      }\n");
+	if (integers_only <= 0) {
+		fprintf(fp,"%s","      if ((isnan(state[ADF_module][sens+i])) ");
+		fprintf(fp,"%s","|| (isinf(state[ADF_module][sens+i]))) {\n");
+		fprintf(fp,"%s","        state[ADF_module][sens+i] = 0;\n");
+		fprintf(fp,"%s","      }\n");
+		fprintf(fp,"%s","      if ((isnan(state[ADF_module][sens+i+no_of_states])) ");
+		fprintf(fp,"%s","|| (isinf(state[ADF_module][sens+i+no_of_states]))) {\n");
+		fprintf(fp,"%s","        state[ADF_module][sens+i+no_of_states] = 0;\n");
+		fprintf(fp,"%s","      }\n");
+	}
 	fprintf(fp,     "      if (state[ADF_module][sens+i] > %d) {\n",
 			GPR_MAX_CONSTANT);
 	fprintf(fp,     "        state[ADF_module][sens+i] = %d;\n",
@@ -39,6 +39,7 @@
 #include <assert.h>
 #include "globals.h"
 #include "gpr.h"
+#include "gpr_jit.h"
 
 enum {
 	GPRC_GENE_FUNCTION_TYPE = 0,
@@ -58,6 +59,12 @@ enum {
  with the first value being the connection location itself */
 #define GPRC_WEIGHTS_PER_CONNECTION 2
 
+/* alignment of each array within a population slab */
+#define GPRC_SLAB_ALIGNMENT 64
+#define GPRC_SLAB_ROUND(bytes) \
+	((((bytes) + GPRC_SLAB_ALIGNMENT - 1) / GPRC_SLAB_ALIGNMENT) * \
+	 GPRC_SLAB_ALIGNMENT)
+
 /* the size of each gene within the cartesian grid */
 #define GPRC_GENE_SIZE(connections) ((GPRC_INITIAL) + \
 									 (connections* \
@@ -72,6 +79,15 @@ struct gprc_mod {
 	/* whether each gene is currently being used
 	   as part of the inputs -> outputs transform */
 	unsigned char * used;
+	/* indexes of the used genes in the order in which they run */
+	int * active;
+	int no_of_active;
+	/* function type and connections for each gene,
+	   decoded from the genome */
+	int * function_type;
+	int * connection;
+	/* whether the above reflect the current genome */
+	unsigned char active_valid;
 };
 typedef struct gprc_mod gprc_ADF_module;
 
@@ -128,13 +144,32 @@ struct gprc_pop {
 	int chromosomes;
 	/* whether to only use integer maths */
 	int integers_only;
+	/* whether to only use real numbers, ignoring
+	   any imaginary components */
+	int real_only;
 	/* size of the data store for each individual */
 	int data_size, data_fields;
 	/* array containing individual programs */
 	struct gprc_func * individual;
+	/* Individuals into which the next generation is bred.
+	   These are swapped with the current individuals after each
+	   generation, so that parents are never overwritten while
+	   children are being produced */
+	struct gprc_func * next_individual;
+	/* The arrays for both the current and next individuals are
+	   carved from a single slab, with a fixed number of bytes
+	   for each individual */
+	void * slab_memory;
+	unsigned char * slab;
+	size_t slab_stride;
 	float * fitness;
 	/* the fitness history for the population */
 	struct gpr_hist history;
+	/* how parents are selected */
+	gpr_selection selection;
+	/* the number of children which inherited their parent's
+	   fitness rather than being evaluated */
+	int skipped_evaluations;
 };
 typedef struct gprc_pop gprc_population;
 
@@ -184,6 +219,48 @@ struct gprc_env {
 };
 typedef struct gprc_env gprc_environment;
 
+/* the default number of individuals in each replacement tournament */
+#define GPRC_STEADY_TOURNAMENT_SIZE 4
+
+/* Steady state evolution of an environment.
+   Worker threads each repeatedly claim a few random slots,
+   evaluate any which have not been evaluated and replace the
+   least fit with a child of the two fittest.  Slots are claimed
+   individually, so there is no barrier between generations */
+struct gprc_stdy {
+	/* the environment being evolved */
+	gprc_environment * population;
+	/* fitness of each slot within the environment */
+	float * fitness;
+	/* whether each slot has been evaluated */
+	unsigned char * evaluated;
+	/* one lock per slot, held while the slot is in a tournament */
+	pthread_mutex_t * slot_lock;
+	/* protects the counters below */
+	pthread_mutex_t lock;
+	/* number of worker threads. With a single thread
+	   evolution runs on the calling thread and is repeatable */
+	int threads;
+	/* the number of slots in each replacement tournament */
+	int tournament_size;
+	/* parameters passed on to mating and evaluation */
+	int time_steps;
+	float mutation_prob;
+	int use_crossover;
+	int * instruction_set;
+	int no_of_instructions;
+	float (*evaluate_program)(int,gprc_environment*,int,int);
+	/* seed from which each run is derived */
+	unsigned int random_seed;
+	/* evaluations started and the limit for the current run */
+	long evaluations, max_evaluations;
+	/* the number of children which replaced an individual */
+	long replacements;
+	/* the number of times a slot was already claimed */
+	long collisions;
+};
+typedef struct gprc_stdy gprc_steady;
+
 int get_ADF_args(gprc_function * f, int ADF_module);
 void gprc_tidy(gprc_function * f,
 			   int rows, int columns,
@@ -219,10 +296,29 @@ int gprc_contains_ADFs(gprc_function * f,
 					   int rows, int columns,
 					   int connections_per_gene,
 					   int sensors);
+int gprc_function_args(int function_type,
+					   float value,
+					   int connections_per_gene,
+					   int argc);
+void gprc_genome_changed(gprc_function * f);
+int gprc_same_phenotype(gprc_function * f1, gprc_function * f2,
+						int rows, int columns,
+						int connections_per_gene,
+						int sensors, int actuators);
+int gprc_used_genes_changed(gprc_function * f,
+							int ADF_module, int index,
+							float * previous,
+							int rows, int columns,
+							int connections_per_gene,
+							int sensors, int actuators);
 void gprc_used_functions(gprc_function * f,
 						 int rows, int columns,
 						 int connections_per_gene,
 						 int sensors, int actuators);
+void gprc_used_functions_module(gprc_function * f, int ADF_module,
+								int rows, int columns,
+								int connections_per_gene,
+								int sensors, int actuators);
 void gprc_valid_ADFs(gprc_function * f,
 					 int rows, int columns,
 					 int connections_per_gene,
@@ -278,6 +374,14 @@ void gprc_run_float(gprc_function * f,
 					float dropout_prob,
 					int dynamic,
 					float (*custom_function)(float,float,float));
+void gprc_run_real(gprc_function * f,
+				   int ADF_module,
+				   int rows, int columns,
+				   int connections_per_gene,
+				   int sensors, int actuators,
+				   float dropout_prob,
+				   int dynamic,
+				   float (*custom_function)(float,float,float));
 void gprc_run_int(gprc_function * f,
 				  int ADF_module,
 				  int rows, int columns,
@@ -293,6 +397,29 @@ void gprc_run_environment(gprc_function * f,
 						  gprc_environment * population,
 						  float dropout_prob, int dynamic,
 						  float (*custom_function)(float,float,float));
+void gprc_run_samples(gprc_function * f,
+					  int rows, int columns,
+					  int connections_per_gene,
+					  int sensors, int actuators,
+					  int integers_only, int real_only,
+					  float * sensor_values, int no_of_samples,
+					  float * actuator_values,
+					  float dropout_prob, int dynamic,
+					  float (*custom_function)(float,float,float));
+void gprc_run_batch(gprc_function * f, gprc_population * population,
+					float * sensor_values, int no_of_samples,
+					float * actuator_values,
+					float dropout_prob, int dynamic,
+					float (*custom_function)(float,float,float));
+int gprc_jit_base(gprc_function * f,
+				  int rows, int columns,
+				  int connections_per_gene,
+				  int sensors, int actuators,
+				  int integers_only, int real_only,
+				  gpr_native * program);
+int gprc_jit(gprc_function * f, gprc_population * population,
+			 gpr_native * program);
+void gprc_run_native(gpr_native * program, gprc_function * f);
 void gprc_init_population(gprc_population * population,
 						  int size,
 						  int rows, int columns,
@@ -335,6 +462,10 @@ void gprc_evaluate(gprc_population * population,
 				   int time_steps, int reevaluate,
 				   float (*evaluate_program)
 				   (int,gprc_population*,int,int));
+void gprc_evaluate_cases(gprc_population * population,
+						 int time_steps, int reevaluate, int cases,
+						 float (*evaluate_program)
+						 (int,gprc_population*,int,int,float*));
 float gprc_best_fitness(gprc_population * population);
 float gprc_worst_fitness(gprc_population * population);
 float gprc_average_fitness(gprc_population * population);
@@ -483,6 +614,37 @@ void gprc_load_system(gprc_system * system,
 					  FILE * fp,
 					  int * instruction_set, int no_of_instructions);
 void gprc_save_system(gprc_system *system, FILE * fp);
+void gprc_save_binary(gprc_function * f,
+					  int rows, int columns,
+					  int connections_per_gene,
+					  int sensors, int actuators,
+					  int data_size, int data_fields,
+					  gpr_binary_buffer * buffer);
+int gprc_load_binary(gprc_function * f,
+					 int rows, int columns,
+					 int connections_per_gene,
+					 int sensors, int actuators,
+					 int data_size, int data_fields,
+					 gpr_binary_reader * reader);
+int gprc_valid_binary_parameters(int size,
+								 int rows, int columns,
+								 int sensors, int actuators,
+								 int connections_per_gene,
+								 int chromosomes, int ADF_modules,
+								 int data_size, int data_fields);
+int gprc_save_population_binary(gprc_population * population,
+								FILE * fp, int compress);
+int gprc_load_population_binary(gprc_population * population,
+								FILE * fp,
+								int * instruction_set,
+								int no_of_instructions);
+int gprc_save_system_binary(gprc_system * system, FILE * fp,
+							int compress);
+int gprc_load_system_binary(gprc_system * system, FILE * fp,
+							int * instruction_set, int no_of_instructions);
+int gprc_checkpoint_system(gprc_system * system,
+						   gpr_checkpoint * checkpoint,
+						   char * filename, int compress);
 int gprc_default_instruction_set(int * instruction_set);
 int gprc_equation_instruction_set(int * instruction_set);
 int gprc_equation_dynamic_instruction_set(int * instruction_set);
@@ -538,6 +700,18 @@ int gprc_mate_environment(gprc_environment * population,
 						  int * instruction_set, int no_of_instructions);
 void gprc_death(gprc_environment * population,
 				int victim_index);
+void gprc_steady_init(gprc_steady * engine,
+					  gprc_environment * population,
+					  int threads, int tournament_size,
+					  int time_steps,
+					  float mutation_prob, int use_crossover,
+					  unsigned int random_seed,
+					  int * instruction_set, int no_of_instructions,
+					  float (*evaluate_program)
+					  (int,gprc_environment*,int,int));
+void gprc_steady_free(gprc_steady * engine);
+void gprc_steady_run(gprc_steady * engine, long evaluations);
+int gprc_steady_best(gprc_steady * engine);
 int gprc_functions_are_equal(gprc_function * f1,
 							 gprc_function * f2,
 							 int rows, int columns,
@@ -42,26 +42,163 @@
 
 #include "gprcm.h"
 
-/* use the morphology generator to specify the functions
-   and constants within the main program */
-static void gprcm_morphology(gprcm_function * f,
-							 int rows, int columns,
-							 int sensors, int actuators,
-							 int connections_per_gene,
-							 int ADF_modules,
-							 int integers_only,
-							 float min_value, float max_value,
-							 int * instruction_set,
-							 int no_of_instructions)
+/* mixes a value into a hash */
+static unsigned long long gprcm_hash_mix(unsigned long long hash,
+										 unsigned int value)
+{
+	hash ^= value;
+	hash *= 1099511628211ULL;
+	hash ^= hash >> 29;
+	return hash;
+}
+
+/* Returns a hash of the active genes of the morphology generator,
+   which together with the size of the program determine its outputs.
+   Zero is returned if the generator can alter its own genome while
+   running, or if it uses its data store, which isn't cleared between
+   runs.  In either case its outputs can't be reused */
+static unsigned long long gprcm_morphology_hash(gprcm_function * f,
+												int rows, int columns,
+												int integers_only)
+{
+	int i, j;
+	int gene_size = GPRC_GENE_SIZE(GPRCM_MORPHOLOGY_CONNECTIONS_PER_GENE);
+	int genes = GPRCM_MORPHOLOGY_ROWS*GPRCM_MORPHOLOGY_COLUMNS;
+	gprc_function * morphology = &f->morphology;
+	unsigned char * used = morphology->genome[0].used;
+	float * gene = morphology->genome[0].gene;
+	unsigned long long hash = 14695981039346656037ULL;
+	union {
+		float value;
+		unsigned int bits;
+	} v;
+
+	if (gprc_no_of_dynamic_functions(morphology,
+									 GPRCM_MORPHOLOGY_ROWS,
+									 GPRCM_MORPHOLOGY_COLUMNS,
+									 GPRCM_MORPHOLOGY_SENSORS,
+									 GPRCM_MORPHOLOGY_ACTUATORS,
+									 GPRCM_MORPHOLOGY_CONNECTIONS_PER_GENE)
+		> 0) {
+		return 0;
+	}
+
+	/* the sensor values depend upon the size of the program */
+	hash = gprcm_hash_mix(hash, (unsigned int)rows);
+	hash = gprcm_hash_mix(hash, (unsigned int)columns);
+	hash = gprcm_hash_mix(hash, (unsigned int)(integers_only > 0));
+
+	/* genes on the path between sensors and actuators */
+	for (i = 0; i < genes; i++) {
+		if (used[i + GPRCM_MORPHOLOGY_SENSORS] == 0) continue;
+		switch((int)gene[i*gene_size + GPRC_GENE_FUNCTION_TYPE]) {
+		case GPR_FUNCTION_DATA_PUSH:
+		case GPR_FUNCTION_DATA_POP:
+		case GPR_FUNCTION_DATA_GET:
+		case GPR_FUNCTION_DATA_SET: {
+			return 0;
+		}
+		}
+		hash = gprcm_hash_mix(hash, (unsigned int)i);
+		for (j = 0; j < gene_size; j++) {
+			v.value = gene[i*gene_size + j];
+			hash = gprcm_hash_mix(hash, v.bits);
+		}
+	}
+
+	/* the actuator connections */
+	for (j = 0; j < GPRCM_MORPHOLOGY_ACTUATORS; j++) {
+		v.value = gene[genes*gene_size + j];
+		hash = gprcm_hash_mix(hash, v.bits);
+	}
+
+	if (hash == 0) hash = 1;
+	return hash;
+}
+
+/* runs the morphology generator for every location within
+   the grid of the main program, storing its outputs */
+static void gprcm_morphology_run(gprcm_function * f,
+								 int rows, int columns,
+								 int integers_only)
 {
-	int row, col, m, index, n;
+	int row, col, a, m = 0, dynamic = 0;
 	gprc_function * morphology = &f->morphology;
-	gprc_function * program = &f->program;
-	float constant_value, imaginary_value, dropout_prob = 0, v;
-	int function_type, con, max_con, previous_values, dynamic = 0;
+	float dropout_prob = 0;
+	float * output = f->morphology_output;
 	int row_centre = rows / 2;
 	int col_centre = columns / 2;
-	float * gene;
+
+	gprc_clear_state(morphology,
+					 GPRCM_MORPHOLOGY_ROWS,
+					 GPRCM_MORPHOLOGY_COLUMNS,
+					 GPRCM_MORPHOLOGY_SENSORS,
+					 GPRCM_MORPHOLOGY_ACTUATORS);
+
+	/* for every column within the Cartesian grid */
+	for (col = 0; col < columns; col++) {
+		/* for every row within the Cartesian grid */
+		for (row = 0; row < rows;
+			 row++, output += GPRCM_MORPHOLOGY_ACTUATORS) {
+			/* set the sensors */
+			gprc_set_sensor(morphology, 0, row - row_centre);
+			gprc_set_sensor(morphology, 1, col - col_centre);
+			gprc_set_sensor(morphology, 2, m);
+
+			/* run the morphology generator */
+			if (integers_only <= 0) {
+				gprc_run_float(morphology, 0,
+							   GPRCM_MORPHOLOGY_ROWS,
+							   GPRCM_MORPHOLOGY_COLUMNS,
+							   GPRCM_MORPHOLOGY_CONNECTIONS_PER_GENE,
+							   GPRCM_MORPHOLOGY_SENSORS,
+							   GPRCM_MORPHOLOGY_ACTUATORS,
+							   dropout_prob, dynamic, 0);
+			}
+			else {
+				gprc_run_int(morphology, 0,
+							 GPRCM_MORPHOLOGY_ROWS,
+							 GPRCM_MORPHOLOGY_COLUMNS,
+							 GPRCM_MORPHOLOGY_CONNECTIONS_PER_GENE,
+							 GPRCM_MORPHOLOGY_SENSORS,
+							 GPRCM_MORPHOLOGY_ACTUATORS,
+							 dropout_prob, dynamic, 0);
+			}
+
+			for (a = 0; a < GPRCM_MORPHOLOGY_ACTUATORS; a++) {
+				output[a] =
+					gprc_get_actuator(morphology, a,
+									  GPRCM_MORPHOLOGY_ROWS,
+									  GPRCM_MORPHOLOGY_COLUMNS,
+									  GPRCM_MORPHOLOGY_SENSORS);
+			}
+		}
+	}
+}
+
+/* Use the morphology generator to specify the functions
+   and constants within the main program.
+   If either parent is given and its morphology generator has the
+   same active genes then its outputs are reused rather than running
+   the generator again.  Returns non-zero if outputs were reused */
+static int gprcm_morphology(gprcm_function * f,
+							gprcm_function * parent1,
+							gprcm_function * parent2,
+							int rows, int columns,
+							int sensors, int actuators,
+							int connections_per_gene,
+							int ADF_modules,
+							int integers_only,
+							float min_value, float max_value,
+							int * instruction_set,
+							int no_of_instructions)
+{
+	int row, col, m, index, n;
+	gprc_function * program = &f->program;
+	gprcm_function * source;
+	float constant_value, imaginary_value, v;
+	int function_type, con, max_con, previous_values;
+	float * gene, * output;
 
 	/* the number of connections which can be specified by the
 	   morphology generator */
@@ -70,16 +207,34 @@ static void gprcm_morphology(gprcm_function * f,
 		max_con = connections_per_gene;
 	}
 
-	gprc_clear_state(morphology,
-					 GPRCM_MORPHOLOGY_ROWS,
-					 GPRCM_MORPHOLOGY_COLUMNS,
-					 GPRCM_MORPHOLOGY_SENSORS,
-					 GPRCM_MORPHOLOGY_ACTUATORS);
+	/* reuse the outputs if the generator hasn't changed */
+	f->morphology_hash =
+		gprcm_morphology_hash(f, rows, columns, integers_only);
+	source = 0;
+	if (f->morphology_hash != 0) {
+		if ((parent1 != 0) &&
+			(parent1->morphology_hash == f->morphology_hash)) {
+			source = parent1;
+		}
+		else if ((parent2 != 0) &&
+				 (parent2->morphology_hash == f->morphology_hash)) {
+			source = parent2;
+		}
+	}
+	if (source != 0) {
+		memcpy((void*)f->morphology_output,
+			   (void*)source->morphology_output,
+			   rows*columns*GPRCM_MORPHOLOGY_ACTUATORS*sizeof(float));
+	}
+	else {
+		gprcm_morphology_run(f, rows, columns, integers_only);
+	}
 
 	/* for the main program and each ADF */
 	/*for (m = 0; m < program->ADF_modules+1; m++) {*/
 	for (m = 0; m < 1; m++) {
 		gene = program->genome[m].gene;
+		output = f->morphology_output;
 		n = 0;
 		/* for every column within the Cartesian grid */
 		for (col = 0; col < columns; col++) {
@@ -87,39 +242,11 @@ static void gprcm_morphology(gprcm_function * f,
 				(col*rows) + gprc_get_sensors(m, sensors);
 			/* for every row within the Cartesian grid */
 			for (row = 0; row < rows;
-				 row++, n += GPRC_GENE_SIZE(connections_per_gene)) {
-				/* set the sensors */
-				gprc_set_sensor(morphology, 0, row - row_centre);
-				gprc_set_sensor(morphology, 1, col - col_centre);
-				gprc_set_sensor(morphology, 2, m);
-
-				/* run the morphology generator */
-				if (integers_only <= 0) {
-					gprc_run_float(morphology, 0,
-								   GPRCM_MORPHOLOGY_ROWS,
-								   GPRCM_MORPHOLOGY_COLUMNS,
-								   GPRCM_MORPHOLOGY_CONNECTIONS_PER_GENE,
-								   GPRCM_MORPHOLOGY_SENSORS,
-								   GPRCM_MORPHOLOGY_ACTUATORS,
-								   dropout_prob, dynamic, 0);
-				}
-				else {
-					gprc_run_int(morphology, 0,
-								 GPRCM_MORPHOLOGY_ROWS,
-								 GPRCM_MORPHOLOGY_COLUMNS,
-								 GPRCM_MORPHOLOGY_CONNECTIONS_PER_GENE,
-								 GPRCM_MORPHOLOGY_SENSORS,
-								 GPRCM_MORPHOLOGY_ACTUATORS,
-								 dropout_prob, dynamic, 0);
-				}
-
+				 row++, n += GPRC_GENE_SIZE(connections_per_gene),
+					 output += GPRCM_MORPHOLOGY_ACTUATORS) {
 				/* get the function type from the
 				   morphology generator */
-				v =
-					gprc_get_actuator(morphology, 0,
-									  GPRCM_MORPHOLOGY_ROWS,
-									  GPRCM_MORPHOLOGY_COLUMNS,
-									  GPRCM_MORPHOLOGY_SENSORS);
+				v = output[0];
 				index =	(abs((int)v)%(no_of_instructions+1))-1;
 
 				if ((index < 0) ||
@@ -140,11 +267,7 @@ static void gprcm_morphology(gprcm_function * f,
 
 				/* get the constant value type from the
 				   morphology generator */
-				v =
-					gprc_get_actuator(morphology, 1,
-									  GPRCM_MORPHOLOGY_ROWS,
-									  GPRCM_MORPHOLOGY_COLUMNS,
-									  GPRCM_MORPHOLOGY_SENSORS);
+				v = output[1];
 				constant_value = min_value +
 					fmod(fabs(v), (max_value - min_value));
 
@@ -161,11 +284,7 @@ static void gprcm_morphology(gprcm_function * f,
 
 				/* get the imaginary value type from the
 				   morphology generator */
-				v =
-					gprc_get_actuator(morphology, 2,
-									  GPRCM_MORPHOLOGY_ROWS,
-									  GPRCM_MORPHOLOGY_COLUMNS,
-									  GPRCM_MORPHOLOGY_SENSORS);
+				v = output[2];
 				imaginary_value = min_value +
 					fmod(fabs(v), (max_value - min_value));
 
@@ -182,11 +301,7 @@ static void gprcm_morphology(gprcm_function * f,
 
 				/* get the connection */
 				for (con = 0; con < max_con; con++) {
-					index =
-						(int)gprc_get_actuator(morphology, 2+con,
-											   GPRCM_MORPHOLOGY_ROWS,
-											   GPRCM_MORPHOLOGY_COLUMNS,
-											   GPRCM_MORPHOLOGY_SENSORS);
+					index = (int)output[2+con];
 
 					if (index >= 0) {						
 						gene[n+GPRC_INITIAL+con] =
@@ -215,6 +330,15 @@ static void gprcm_morphology(gprcm_function * f,
 	gprc_valid_ADFs(program, rows, columns,
 					connections_per_gene,
 					sensors, min_value, max_value);	
+
+	/* which functions are used within the changed program.
+	   Only the main program is overwritten, and retracing the ADF
+	   modules could change their number of arguments */
+	gprc_used_functions_module(program, 0, rows, columns,
+							   connections_per_gene,
+							   sensors, actuators);
+
+	return (source != 0);
 }
 
 /* returns an instruction set used by the morphology generator */
@@ -251,6 +375,16 @@ void gprcm_init(gprcm_function * f,
 			  connections_per_gene, ADF_modules,
 			  data_size, data_fields,
 			  random_seed);
+
+	/* outputs of the morphology generator for each gene
+	   within the program, not yet generated */
+	f->morphology_hash = 0;
+	f->morphology_output =
+		(float*)malloc(rows*columns*GPRCM_MORPHOLOGY_ACTUATORS*
+					   sizeof(float));
+#ifdef DEBUG
+	assert(f->morphology_output!=0);
+#endif
 }
 
 /* free memory */
@@ -258,6 +392,7 @@ void gprcm_free(gprcm_function * f)
 {
 	gprc_free(&f->program);
 	gprc_free(&f->morphology);
+	free(f->morphology_output);
 }
 
 /* initialise sensor sources for the given system */
@@ -365,7 +500,7 @@ void gprcm_random(gprcm_function * f,
 				instruction_set, no_of_instructions);
 
 	/* overlay morphology onto the main program */
-	gprcm_morphology(f, rows, columns,
+	gprcm_morphology(f, 0, 0, rows, columns,
 					 sensors, actuators,
 					 connections_per_gene,
 					 f->program.ADF_modules, integers_only,
@@ -411,7 +546,15 @@ void gprcm_run(gprcm_function * f, gprcm_population * population,
 			   float dropout_prob, int dynamic,
 			   float (*custom_function)(float,float,float))
 {
-	if (population->integers_only<=0) {
+	if ((population->integers_only<=0) &&
+		(population->real_only>0)) {
+		gprc_run_real(&f->program, 0,
+					  population->rows, population->columns,
+					  population->connections_per_gene,
+					  population->sensors, population->actuators,
+					  dropout_prob, dynamic, (*custom_function));
+	}
+	else if (population->integers_only<=0) {
 		gprc_run_float(&f->program, 0,
 					   population->rows, population->columns,
 					   population->connections_per_gene,
@@ -427,6 +570,40 @@ void gprcm_run(gprcm_function * f, gprcm_population * population,
 	}
 }
 
+/* runs the program over a number of samples,
+   see gprc_run_samples for the layout of values */
+void gprcm_run_batch(gprcm_function * f, gprcm_population * population,
+					 float * sensor_values, int no_of_samples,
+					 float * actuator_values,
+					 float dropout_prob, int dynamic,
+					 float (*custom_function)(float,float,float))
+{
+	gprc_run_samples(&f->program, population->rows, population->columns,
+					 population->connections_per_gene,
+					 population->sensors, population->actuators,
+					 population->integers_only, population->real_only,
+					 sensor_values, no_of_samples, actuator_values,
+					 dropout_prob, dynamic, (*custom_function));
+}
+
+/* compiles the program into native code */
+int gprcm_jit(gprcm_function * f, gprcm_population * population,
+			  gpr_native * program)
+{
+	return gprc_jit_base(&f->program, population->rows, population->columns,
+						 population->connections_per_gene,
+						 population->sensors, population->actuators,
+						 population->integers_only,
+						 population->real_only, program);
+}
+
+/* runs a program which was compiled into native code.
+   This gives the same result as calling gprcm_run */
+void gprcm_run_native(gpr_native * program, gprcm_function * f)
+{
+	gprc_run_native(program, &f->program);
+}
+
 void gprcm_run_environment(gprcm_function * f,
 						   gprcm_environment * population,
 						   float dropout_prob, int dynamic,
@@ -483,6 +660,9 @@ void gprcm_init_population(gprcm_population * population,
 	population->history.index = 0;
 	population->history.interval = 1;
 	population->history.tick = 0;
+	population->real_only = 0;
+	gpr_selection_init(&population->selection);
+	population->morphology_hits = 0;
 
 	population->data_size = data_size;
 	population->data_fields = data_fields;
@@ -563,6 +743,7 @@ void gprcm_init_environment(gprcm_environment * population,
 	population->mating =
 		(int*)malloc(max_population_size*3*sizeof(int));
 	population->matings = 0;
+	population->morphology_hits = 0;
 	population->data_size = data_size;
 	population->data_fields = data_fields;
 
@@ -610,6 +791,7 @@ void gprcm_free_population(gprcm_population * population)
 	}
 	free(population->individual);
 	free(population->fitness);
+	gpr_selection_free(&population->selection);
 }
 
 /* free memory for the given environment population */
@@ -637,6 +819,13 @@ void gprcm_copy(gprcm_function * source, gprcm_function * dest,
 	gprc_copy(&source->program, &dest->program,
 			  rows, columns, connections_per_gene,
 			  sensors, actuators);
+
+	dest->morphology_hash = source->morphology_hash;
+	if (source->morphology_hash != 0) {
+		memcpy((void*)dest->morphology_output,
+			   (void*)source->morphology_output,
+			   rows*columns*GPRCM_MORPHOLOGY_ACTUATORS*sizeof(float));
+	}
 }
 
 /* Evaluates the fitness of all individuals in the population.
@@ -686,6 +875,64 @@ void gprcm_evaluate(gprcm_population * population,
 	}
 }
 
+/* Evaluates the fitness of all individuals in the population,
+   storing the error on each case for lexicase selection */
+void gprcm_evaluate_cases(gprcm_population * population,
+						  int time_steps, int reevaluate, int cases,
+						  float (*evaluate_program)
+						  (int,gprcm_population*,int,int,float*))
+{
+	int i;
+	gpr_selection * selection = &population->selection;
+
+	/* if the errors are new then every individual needs them */
+	if (gpr_selection_cases(selection, population->size, cases) != 0) {
+		reevaluate = 1;
+	}
+
+#pragma omp parallel for
+	for (i = 0; i < population->size; i++) {
+		if ((population->fitness[i]==0) ||
+			(reevaluate>0)) {
+			int s;
+			gprc_function * f = &(&population->individual[i])->program;
+			unsigned char * used = f->genome[0].used;
+			float * errors = gpr_selection_errors(selection, i);
+
+			/* clear the retained state */
+			gprc_clear_state(f,
+							 population->rows, population->columns,
+							 population->sensors,
+							 population->actuators);
+
+			/* is there a path which links sensors to actuators? */
+			for (s = 0; s < population->sensors; s++) {
+				if (used[s] != 0) break;
+			}
+
+			if (s < population->sensors) {
+				/* run the evaluation function */
+				population->fitness[i] =
+					(*evaluate_program)(time_steps,population,i,0,
+										errors);
+			}
+			else {
+				/* don't evaluate, since there is no path between
+				   sensors and actuators */
+				population->fitness[i] = 0;
+				for (s = 0; s < cases; s++) {
+					errors[s] = GPR_SELECTION_MAX_ERROR;
+				}
+			}
+		}
+		/* if individual gets too old */
+		(&(&population->individual[i])->program)->age++;
+		if ((&(&population->individual[i])->program)->age > GPR_MAX_AGE) {
+			population->fitness[i] = 0;
+		}
+	}
+}
+
 /* returns the highest fitness value */
 float gprcm_best_fitness(gprcm_population * population)
 {
@@ -801,35 +1048,53 @@ int gprcm_get_actuator_destination(gprcm_function * f, int index)
 /* sorts individuals in order of fitness */
 void gprcm_sort(gprcm_population * population)
 {
-	int i, j, best;
-	float max, temp_fitness;
-	gprcm_function temp_individual;
-
-	for (i = 0; i < population->size-1; i++) {
-		max = population->fitness[i];
-		best = i;
-		for (j = i+1; j < population->size; j++) {
-			if (population->fitness[j] > max) {
-				max = population->fitness[j];
-				best = j;
-			}
-		}
-		if (best != i) {
-			/* swap fitness */
-			temp_fitness = population->fitness[i];
-			population->fitness[i] = population->fitness[best];
-			population->fitness[best] = temp_fitness;
-
-			/* swap individual */
-			temp_individual = population->individual[i];
-			population->individual[i] =	population->individual[best];
-			population->individual[best] = temp_individual;
-		}
-	}
+	int * index;
+
+	if (population->size < 2) return;
+
+	index = (int*)malloc(population->size*sizeof(int));
+#ifdef DEBUG
+	assert(index!=0);
+#endif
+
+	gpr_rank(population->fitness, population->size, index);
+	gpr_permute((void*)population->fitness, sizeof(float),
+				index, population->size);
+	gpr_permute((void*)population->individual, sizeof(gprcm_function),
+				index, population->size);
+	gpr_selection_permute(&population->selection, index);
+
+	free(index);
 }
 
-/* two parents mate and produce a child */
-void gprcm_mate(gprcm_function *parent1, gprcm_function *parent2,
+/* Moves the given number of fittest individuals to the start of the
+   population, with the fittest first and the least fit last */
+static void gprcm_partition(gprcm_population * population, int survivors)
+{
+	int * index;
+
+	if (population->size < 2) return;
+
+	index = (int*)malloc(population->size*sizeof(int));
+#ifdef DEBUG
+	assert(index!=0);
+#endif
+
+	gpr_partition(population->fitness, population->size,
+				  survivors, index);
+	gpr_permute((void*)population->fitness, sizeof(float),
+				index, population->size);
+	gpr_permute((void*)population->individual, sizeof(gprcm_function),
+				index, population->size);
+	gpr_selection_permute(&population->selection, index);
+
+	free(index);
+}
+
+/* Two parents mate and produce a child.
+   Returns non-zero if the child's morphology generator was
+   unchanged from a parent, such that its outputs were reused */
+int gprcm_mate(gprcm_function *parent1, gprcm_function *parent2,
 				int rows, int columns,
 				int sensors, int actuators,
 				int connections_per_gene,
@@ -870,12 +1135,23 @@ void gprcm_mate(gprcm_function *parent1, gprcm_function *parent2,
 			  allocate_memory,
 			  &child->program);
 
-	gprcm_morphology(child, rows, columns,
-					 sensors, actuators,
-					 connections_per_gene,
-					 parent1->program.ADF_modules, integers_only,
-					 min_value, max_value,
-					 instruction_set, no_of_instructions);
+	if (allocate_memory > 0) {
+		child->morphology_hash = 0;
+		child->morphology_output =
+			(float*)malloc(rows*columns*GPRCM_MORPHOLOGY_ACTUATORS*
+						   sizeof(float));
+#ifdef DEBUG
+		assert(child->morphology_output!=0);
+#endif
+	}
+
+	return gprcm_morphology(child, parent1, parent2,
+							rows, columns,
+							sensors, actuators,
+							connections_per_gene,
+							parent1->program.ADF_modules, integers_only,
+							min_value, max_value,
+							instruction_set, no_of_instructions);
 }
 
 /* Returns a fitness histogram for the given population */
@@ -966,12 +1242,27 @@ void gprcm_generation(gprcm_population * population,
 					  int use_crossover, unsigned int * random_seed,
 					  int * instruction_set, int no_of_instructions)
 {
-	int i, threshold;
+	int i, threshold, hits = 0;
+	unsigned int generation_seed;
 	float diversity,mutation_prob_range;
-	gprcm_function * parent1, * parent2, * child;
+	gpr_selection * selection = &population->selection;
 
-	/* sort the population in order of fitness */
-	gprcm_sort(population);
+	/* range checking */
+	if ((elitism < 0.1f) || (elitism > 0.9f)) {
+		elitism = 0.3f;
+	}
+
+	/* index setting the threshold for the fittest individuals */
+	threshold = (int)((1.0f - elitism)*(population->size-1));
+
+	if (selection->method == GPR_SELECTION_TRUNCATION) {
+		/* sort the population in order of fitness */
+		gprcm_sort(population);
+	}
+	else {
+		/* only the survivors need to be found */
+		gprcm_partition(population, threshold);
+	}
 
 	diversity = gprcm_diversity(population);
 	mutation_prob_range = (1.0f - mutation_prob) / 2;
@@ -1005,35 +1296,46 @@ void gprcm_generation(gprcm_population * population,
 		}
 	}
 
-	/* range checking */
-	if ((elitism < 0.1f) || (elitism > 0.9f)) {
-		elitism = 0.3f;
-	}
-
-	/* index setting the threshold for the fittest individuals */
-	threshold = (int)((1.0f - elitism)*(population->size-1));
+	/* Each child gets its own random number streams derived from
+	   this seed, so the result doesn't depend upon the
+	   number of threads */
+	generation_seed = rand_num(random_seed);
+	gpr_selection_prepare(selection, random_seed);
 
-#pragma omp parallel for
+#pragma omp parallel for reduction(+:hits)
 	for (i = 0; i < population->size - threshold; i++) {
-		/* randomly choose parents from the fittest
-		   section of the population */
+		gprcm_function * parent1, * parent2;
+		gprcm_function * child = &population->individual[threshold + i];
+		unsigned int * child_seed = &(&child->program)->random_seed;
+
+		(&child->morphology)->random_seed =
+			rand_stream_seed(generation_seed, (threshold + i)*2);
+		*child_seed =
+			rand_stream_seed(generation_seed, (threshold + i)*2 + 1);
+
+		/* choose parents from the fittest section of the
+		   population, which isn't overwritten by children */
 		parent1 =
-			&population->individual[rand_num(random_seed)%threshold];
+			&population->individual[gpr_select(selection,
+											   population->fitness,
+											   threshold, child_seed)];
 		parent2 =
-			&population->individual[rand_num(random_seed)%threshold];
+			&population->individual[gpr_select(selection,
+											   population->fitness,
+											   threshold, child_seed)];
 
 		/* produce a new child */
-		child = &population->individual[threshold + i];
-		gprcm_mate(parent1, parent2,
-				   population->rows, population->columns,
-				   population->sensors, population->actuators,
-				   population->connections_per_gene,
-				   population->min_value, population->max_value,
-				   population->integers_only,
-				   mutation_prob, use_crossover,
-				   population->chromosomes,
-				   instruction_set, no_of_instructions,
-				   0, population->ADF_modules, child);
+		hits +=
+			gprcm_mate(parent1, parent2,
+					   population->rows, population->columns,
+					   population->sensors, population->actuators,
+					   population->connections_per_gene,
+					   population->min_value, population->max_value,
+					   population->integers_only,
+					   mutation_prob, use_crossover,
+					   population->chromosomes,
+					   instruction_set, no_of_instructions,
+					   0, population->ADF_modules, child);
 
 		/* fitness not yet evaluated */
 		population->fitness[threshold + i] = 0;
@@ -1041,6 +1343,8 @@ void gprcm_generation(gprcm_population * population,
 		/* reset the age of the child */
 		(&child->program)->age = 0;
 	}
+
+	population->morphology_hits += hits;
 }
 
 /* save the given individual to file */
@@ -1087,6 +1391,9 @@ int gprcm_load(gprcm_function * f,
 			  GPRCM_MORPHOLOGY_DATA_FIELDS,
 			  fp);
 
+	/* the morphology outputs aren't saved */
+	f->morphology_hash = 0;
+
 	return gprc_load(&f->program,
 					 rows, columns,
 					 connections_per_gene,
@@ -1560,13 +1867,17 @@ void gprcm_generation_system(gprcm_system * system,
 	int i, migrant_index;
 	gprcm_population *population1, *population2;
 	int island1_index, island2_index;
+	unsigned int system_seed = rand_num(random_seed);
 
 #pragma omp parallel for
 	for (i = 0; i < system->size; i++) {
+		/* each island has its own random number stream */
+		unsigned int island_seed = rand_stream_seed(system_seed, i);
+
 		gprcm_generation(&system->island[i],
 						 elitism,
 						 mutation_prob,
-						 use_crossover, random_seed,
+						 use_crossover, &island_seed,
 						 instruction_set, no_of_instructions);
 	}
 
@@ -1599,6 +1910,9 @@ void gprcm_generation_system(gprcm_system * system,
 			/* copy the fitness value */
 			population2->fitness[population2->size-1] =
 				population1->fitness[migrant_index];
+			gpr_selection_copy(&population1->selection, migrant_index,
+							   &population2->selection,
+							   population2->size-1);
 
 			/* create a new random individual */
 			population1->fitness[migrant_index] = 0;
@@ -1637,31 +1951,22 @@ void gprcm_generation_system(gprcm_system * system,
 /* sorts populations in order of average fitness */
 void gprcm_sort_system(gprcm_system * system)
 {
-	int i, j, best;
-	float max, temp_fitness;
-	gprcm_population temp_island;
-
-	for (i = 0; i < system->size-1; i++) {
-		max = system->fitness[i];
-		best = i;
-		for (j = i+1; j < system->size; j++) {
-			if (system->fitness[j] > max) {
-				max = system->fitness[j];
-				best = j;
-			}
-		}
-		if (best != i) {
-			/* swap fitness */
-			temp_fitness = system->fitness[i];
-			system->fitness[i] = system->fitness[best];
-			system->fitness[best] = temp_fitness;
-
-			/* swap island */
-			temp_island = system->island[i];
-			system->island[i] = system->island[best];
-			system->island[best] = temp_island;
-		}
-	}
+	int * index;
+
+	if (system->size < 2) return;
+
+	index = (int*)malloc(system->size*sizeof(int));
+#ifdef DEBUG
+	assert(index!=0);
+#endif
+
+	gpr_rank(system->fitness, system->size, index);
+	gpr_permute((void*)system->fitness, sizeof(float),
+				index, system->size);
+	gpr_permute((void*)system->island, sizeof(gprcm_population),
+				index, system->size);
+
+	free(index);
 }
 
 /* returns the highest fitness value for the given system */
@@ -1743,6 +2048,363 @@ void gprcm_load_system(gprcm_system * system,
 	}
 }
 
+/* appends an individual to a buffer which will be saved
+   as part of a binary file */
+void gprcm_save_binary(gprcm_function * f,
+					   int rows, int columns,
+					   int connections_per_gene,
+					   int sensors, int actuators,
+					   int data_size, int data_fields,
+					   gpr_binary_buffer * buffer)
+{
+	gprc_save_binary(&f->morphology,
+					 GPRCM_MORPHOLOGY_ROWS,
+					 GPRCM_MORPHOLOGY_COLUMNS,
+					 GPRCM_MORPHOLOGY_CONNECTIONS_PER_GENE,
+					 GPRCM_MORPHOLOGY_SENSORS,
+					 GPRCM_MORPHOLOGY_ACTUATORS,
+					 GPRCM_MORPHOLOGY_DATA_SIZE,
+					 GPRCM_MORPHOLOGY_DATA_FIELDS,
+					 buffer);
+
+	gprc_save_binary(&f->program,
+					 rows, columns,
+					 connections_per_gene,
+					 sensors, actuators,
+					 data_size, data_fields,
+					 buffer);
+}
+
+/* loads an individual from the current section of a binary file */
+int gprcm_load_binary(gprcm_function * f,
+					  int rows, int columns,
+					  int connections_per_gene,
+					  int sensors, int actuators,
+					  int data_size, int data_fields,
+					  gpr_binary_reader * reader)
+{
+	int retval;
+
+	retval = gprc_load_binary(&f->morphology,
+							  GPRCM_MORPHOLOGY_ROWS,
+							  GPRCM_MORPHOLOGY_COLUMNS,
+							  GPRCM_MORPHOLOGY_CONNECTIONS_PER_GENE,
+							  GPRCM_MORPHOLOGY_SENSORS,
+							  GPRCM_MORPHOLOGY_ACTUATORS,
+							  GPRCM_MORPHOLOGY_DATA_SIZE,
+							  GPRCM_MORPHOLOGY_DATA_FIELDS,
+							  reader);
+	if (retval != GPR_LOAD_OK) return retval;
+
+	/* the morphology outputs aren't saved */
+	f->morphology_hash = 0;
+
+	return gprc_load_binary(&f->program,
+							rows, columns,
+							connections_per_gene,
+							sensors, actuators,
+							data_size, data_fields,
+							reader);
+}
+
+/* writes the sections describing a population */
+static int gprcm_save_population_sections(gprcm_population * population,
+										  FILE * fp, int compress)
+{
+	int i, retval = 0;
+	gpr_binary_buffer buffer;
+
+	gpr_binary_init(&buffer);
+
+	/* population parameters */
+	gpr_binary_put_int(&buffer, population->size);
+	gpr_binary_put_int(&buffer, population->rows);
+	gpr_binary_put_int(&buffer, population->columns);
+	gpr_binary_put_int(&buffer, population->sensors);
+	gpr_binary_put_int(&buffer, population->actuators);
+	gpr_binary_put_int(&buffer, population->connections_per_gene);
+	gpr_binary_put_float(&buffer, population->min_value);
+	gpr_binary_put_float(&buffer, population->max_value);
+	gpr_binary_put_int(&buffer, population->integers_only);
+	gpr_binary_put_int(&buffer, population->real_only);
+	gpr_binary_put_int(&buffer, population->chromosomes);
+	gpr_binary_put_int(&buffer, population->ADF_modules);
+	gpr_binary_put_int(&buffer, population->data_size);
+	gpr_binary_put_int(&buffer, population->data_fields);
+	if (gpr_binary_write_section(fp, GPR_BINARY_SECTION_PARAMETERS,
+								 &buffer, compress) != 0) retval = -1;
+
+	/* fitness history */
+	gpr_binary_clear(&buffer);
+	gpr_binary_put(&buffer, &population->history, sizeof(gpr_history));
+	if (gpr_binary_write_section(fp, GPR_BINARY_SECTION_HISTORY,
+								 &buffer, compress) != 0) retval = -1;
+
+	/* individuals */
+	gpr_binary_clear(&buffer);
+	for (i = 0; i < population->size; i++) {
+		gpr_binary_put_float(&buffer, population->fitness[i]);
+		gprcm_save_binary(&population->individual[i],
+						  population->rows, population->columns,
+						  population->connections_per_gene,
+						  population->sensors, population->actuators,
+						  population->data_size,
+						  population->data_fields,
+						  &buffer);
+	}
+	if (gpr_binary_write_section(fp, GPR_BINARY_SECTION_INDIVIDUALS,
+								 &buffer, compress) != 0) retval = -1;
+
+	gpr_binary_free(&buffer);
+	return retval;
+}
+
+/* Reads the sections describing a population.
+   If this fails then the population is left unallocated */
+static int gprcm_load_population_sections(gprcm_population * population,
+										  gpr_binary_reader * reader,
+										  int * instruction_set,
+										  int no_of_instructions)
+{
+	int i, retval;
+	int size, rows, columns, sensors, actuators;
+	int connections_per_gene, integers_only, real_only;
+	int chromosomes, ADF_modules, data_size, data_fields;
+	float min_value, max_value;
+	unsigned int random_seed = 1234;
+
+	/* population parameters */
+	retval = gpr_binary_next_section(reader,
+									 GPR_BINARY_SECTION_PARAMETERS);
+	if (retval != GPR_LOAD_OK) return retval;
+	size = gpr_binary_get_int(reader);
+	rows = gpr_binary_get_int(reader);
+	columns = gpr_binary_get_int(reader);
+	sensors = gpr_binary_get_int(reader);
+	actuators = gpr_binary_get_int(reader);
+	connections_per_gene = gpr_binary_get_int(reader);
+	min_value = gpr_binary_get_float(reader);
+	max_value = gpr_binary_get_float(reader);
+	integers_only = gpr_binary_get_int(reader);
+	real_only = gpr_binary_get_int(reader);
+	chromosomes = gpr_binary_get_int(reader);
+	ADF_modules = gpr_binary_get_int(reader);
+	data_size = gpr_binary_get_int(reader);
+	data_fields = gpr_binary_get_int(reader);
+	if ((reader->overrun != 0) ||
+		(gprc_valid_binary_parameters(size, rows, columns,
+									  sensors, actuators,
+									  connections_per_gene,
+									  chromosomes, ADF_modules,
+									  data_size, data_fields) == 0)) {
+		return GPR_LOAD_BINARY_SECTION;
+	}
+
+	gprcm_init_population(population,
+						  size,
+						  rows, columns,
+						  sensors, actuators,
+						  connections_per_gene,
+						  ADF_modules,
+						  chromosomes,
+						  min_value, max_value,
+						  integers_only,
+						  data_size, data_fields,
+						  &random_seed,
+						  instruction_set, no_of_instructions);
+	population->real_only = real_only;
+
+	/* fitness history */
+	retval = gpr_binary_next_section(reader, GPR_BINARY_SECTION_HISTORY);
+	if (retval == GPR_LOAD_OK) {
+		gpr_binary_get_array(reader, &population->history,
+							 sizeof(gpr_history));
+
+		/* individuals */
+		retval = gpr_binary_next_section(reader,
+										 GPR_BINARY_SECTION_INDIVIDUALS);
+	}
+	for (i = 0; (i < size) && (retval == GPR_LOAD_OK); i++) {
+		population->fitness[i] = gpr_binary_get_float(reader);
+		retval = gprcm_load_binary(&population->individual[i],
+								   rows, columns,
+								   connections_per_gene,
+								   sensors, actuators,
+								   data_size, data_fields,
+								   reader);
+	}
+	if (retval != GPR_LOAD_OK) {
+		gprcm_free_population(population);
+	}
+	return retval;
+}
+
+/* Saves a population to a binary file.
+   Sections are compressed if compress is non-zero.
+   Returns zero on success */
+int gprcm_save_population_binary(gprcm_population * population,
+								 FILE * fp, int compress)
+{
+	if (gpr_binary_write_header(fp, GPR_BINARY_GPRCM_POPULATION) != 0) {
+		return -1;
+	}
+	if (gprcm_save_population_sections(population, fp, compress) != 0) {
+		return -1;
+	}
+	return gpr_binary_write_end(fp);
+}
+
+/* Loads a population from a binary file.
+   If this fails then the population is left unallocated */
+int gprcm_load_population_binary(gprcm_population * population,
+								 FILE * fp,
+								 int * instruction_set,
+								 int no_of_instructions)
+{
+	gpr_binary_reader reader;
+	int retval;
+
+	retval = gpr_binary_open(&reader, fp, GPR_BINARY_GPRCM_POPULATION);
+	if (retval == GPR_LOAD_OK) {
+		retval = gprcm_load_population_sections(population, &reader,
+												instruction_set,
+												no_of_instructions);
+		if (retval == GPR_LOAD_OK) {
+			retval = gpr_binary_next_section(&reader,
+											 GPR_BINARY_SECTION_END);
+			if (retval != GPR_LOAD_OK) {
+				gprcm_free_population(population);
+			}
+		}
+	}
+	gpr_binary_close(&reader);
+	return retval;
+}
+
+/* Saves a system to a binary file.
+   Returns zero on success */
+int gprcm_save_system_binary(gprcm_system * system, FILE * fp,
+							 int compress)
+{
+	int i, retval = 0;
+	gpr_binary_buffer buffer;
+
+	if (gpr_binary_write_header(fp, GPR_BINARY_GPRCM_SYSTEM) != 0) {
+		return -1;
+	}
+
+	gpr_binary_init(&buffer);
+	gpr_binary_put_int(&buffer, system->size);
+	gpr_binary_put_int(&buffer, system->migration_tick);
+	gpr_binary_put(&buffer, &system->history, sizeof(gpr_history));
+	gpr_binary_put(&buffer, system->fitness, system->size*sizeof(float));
+	retval = gpr_binary_write_section(fp, GPR_BINARY_SECTION_SYSTEM,
+									  &buffer, compress);
+	gpr_binary_free(&buffer);
+
+	for (i = 0; i < system->size; i++) {
+		if (retval != 0) return retval;
+		retval = gprcm_save_population_sections(&system->island[i],
+												fp, compress);
+	}
+	if (retval != 0) return retval;
+	return gpr_binary_write_end(fp);
+}
+
+/* Loads a system from a binary file.
+   If this fails then the system is left unallocated */
+int gprcm_load_system_binary(gprcm_system * system, FILE * fp,
+							 int * instruction_set, int no_of_instructions)
+{
+	gpr_binary_reader reader;
+	int i, j, islands, migration_tick, retval;
+	int population_per_island=10;
+	int rows=5, columns=5;
+	int sensors=1, actuators=1;
+	int connections_per_gene=2;
+	int chromosomes=1, ADF_modules=1;
+	float min_value=-10, max_value=10;
+	int integers_only=0;
+	unsigned int random_seed = 1234;
+	int data_size = 1, data_fields = 1;
+
+	retval = gpr_binary_open(&reader, fp, GPR_BINARY_GPRCM_SYSTEM);
+	if (retval == GPR_LOAD_OK) {
+		retval = gpr_binary_next_section(&reader,
+										 GPR_BINARY_SECTION_SYSTEM);
+	}
+	if (retval != GPR_LOAD_OK) {
+		gpr_binary_close(&reader);
+		return retval;
+	}
+
+	islands = gpr_binary_get_int(&reader);
+	migration_tick = gpr_binary_get_int(&reader);
+	if ((reader.overrun != 0) ||
+		(gpr_binary_in_range(islands, 1,
+							 GPR_BINARY_MAX_DIMENSION) == 0)) {
+		gpr_binary_close(&reader);
+		return GPR_LOAD_BINARY_SECTION;
+	}
+
+	/* create a system.
+	   It doesn't matter what the parameters are here, because
+	   they will be overwritten later */
+	gprcm_init_system(system,
+					  islands,
+					  population_per_island,
+					  rows, columns,
+					  sensors, actuators,
+					  connections_per_gene,
+					  ADF_modules, chromosomes,
+					  min_value, max_value,
+					  integers_only,
+					  data_size, data_fields,
+					  &random_seed,
+					  instruction_set, no_of_instructions);
+	system->migration_tick = migration_tick;
+	gpr_binary_get_array(&reader, &system->history, sizeof(gpr_history));
+	gpr_binary_get_array(&reader, system->fitness,
+						 islands*sizeof(float));
+
+	/* load each population */
+	for (i = 0; i < islands; i++) {
+		gprcm_free_population(&system->island[i]);
+		retval = gprcm_load_population_sections(&system->island[i],
+												&reader,
+												instruction_set,
+												no_of_instructions);
+		if (retval != GPR_LOAD_OK) break;
+	}
+	if (retval == GPR_LOAD_OK) {
+		retval = gpr_binary_next_section(&reader,
+										 GPR_BINARY_SECTION_END);
+	}
+	if (retval != GPR_LOAD_OK) {
+		/* an island which failed to load has already been freed */
+		for (j = i+1; j < islands; j++) {
+			gprcm_free_population(&system->island[j]);
+		}
+		system->size = i;
+		gprcm_free_system(system);
+	}
+	gpr_binary_close(&reader);
+	return retval;
+}
+
+/* writes a binary checkpoint of a system in the background */
+int gprcm_checkpoint_system(gprcm_system * system,
+							gpr_checkpoint * checkpoint,
+							char * filename, int compress)
+{
+	FILE * fp = gpr_checkpoint_begin(checkpoint);
+
+	if (fp == 0) return -1;
+	return gpr_checkpoint_end(checkpoint,
+							  gprcm_save_system_binary(system, fp, 0),
+							  filename, compress);
+}
+
 /* save the system to file */
 void gprcm_save_system(gprcm_system *system, FILE * fp)
 {
@@ -2371,20 +3033,21 @@ int gprcm_mate_environment(gprcm_environment * population,
 		&population->individual[parent2_index];
 
 	/* two parents mate */
-	gprcm_mate(parent1, parent2,
-			   population->rows,
-			   population->columns,
-			   population->sensors,
-			   population->actuators,
-			   population->connections_per_gene,
-			   population->min_value,
-			   population->max_value,
-			   population->integers_only,
-			   mutation_prob, use_crossover,
-			   population->chromosomes,
-			   instruction_set, no_of_instructions, 0,
-			   population->ADF_modules,
-			   &population->individual[population->population_size]);
+	population->morphology_hits +=
+		gprcm_mate(parent1, parent2,
+				   population->rows,
+				   population->columns,
+				   population->sensors,
+				   population->actuators,
+				   population->connections_per_gene,
+				   population->min_value,
+				   population->max_value,
+				   population->integers_only,
+				   mutation_prob, use_crossover,
+				   population->chromosomes,
+				   instruction_set, no_of_instructions, 0,
+				   population->ADF_modules,
+				   &population->individual[population->population_size]);
 
 	/* age of the child is zero */
 	(&(&population->individual[population->population_size])->program)->age=0;
@@ -56,6 +56,13 @@ struct gprcm_func {
 
 	/* morphology generator */
 	gprc_function morphology;
+	/* hash of the active genes of the morphology generator
+	   from which the outputs below were produced, or zero
+	   if there are no outputs which can be reused */
+	unsigned long long morphology_hash;
+	/* outputs of the morphology generator for each gene
+	   within the main program */
+	float * morphology_output;
 
 	/* the main program */
 	gprc_function program;
@@ -80,6 +87,9 @@ struct gprcm_pop {
 	int chromosomes;
 	/* whether to only use integer maths */
 	int integers_only;
+	/* whether to only use real numbers, ignoring
+	   any imaginary components */
+	int real_only;
 	/* size of the data store for each individual */
 	int data_size, data_fields;
 	/* array containing individual programs */
@@ -87,6 +97,11 @@ struct gprcm_pop {
 	float * fitness;
 	/* the fitness history for the population */
 	struct gpr_hist history;
+	/* how parents are selected */
+	gpr_selection selection;
+	/* the number of children whose morphology generator was
+	   unchanged, such that its outputs were reused */
+	int morphology_hits;
 };
 typedef struct gprcm_pop gprcm_population;
 
@@ -133,6 +148,9 @@ struct gprcm_env {
 	int matings;
 	/* index numbers of mating parents */
 	int * mating;
+	/* the number of children whose morphology generator was
+	   unchanged, such that its outputs were reused */
+	int morphology_hits;
 };
 typedef struct gprcm_env gprcm_environment;
 
@@ -173,6 +191,14 @@ void gprcm_run_environment(gprcm_function * f,
 						   gprcm_environment * population,
 						   float dropout_prob, int dynamic,
 						   float (*custom_function)(float,float,float));
+int gprcm_jit(gprcm_function * f, gprcm_population * population,
+			  gpr_native * program);
+void gprcm_run_native(gpr_native * program, gprcm_function * f);
+void gprcm_run_batch(gprcm_function * f, gprcm_population * population,
+					 float * sensor_values, int no_of_samples,
+					 float * actuator_values,
+					 float dropout_prob, int dynamic,
+					 float (*custom_function)(float,float,float));
 void gprcm_init_population(gprcm_population * population,
 						   int size,
 						   int rows, int columns,
@@ -209,6 +235,10 @@ void gprcm_evaluate(gprcm_population * population,
 					int time_steps, int reevaluate,
 					float (*evaluate_program)
 					(int,gprcm_population*,int,int));
+void gprcm_evaluate_cases(gprcm_population * population,
+						  int time_steps, int reevaluate, int cases,
+						  float (*evaluate_program)
+						  (int,gprcm_population*,int,int,float*));
 float gprcm_best_fitness(gprcm_population * population);
 float gprcm_worst_fitness(gprcm_population * population);
 float gprcm_average_fitness(gprcm_population * population);
@@ -238,7 +268,7 @@ void gprcm_get_actuator_colour(gprcm_function * f, int index,
 							   unsigned char * B);
 int gprcm_get_actuator_destination(gprcm_function * f, int index);
 void gprcm_sort(gprcm_population * population);
-void gprcm_mate(gprcm_function *parent1, gprcm_function *parent2,
+int gprcm_mate(gprcm_function *parent1, gprcm_function *parent2,
 				int rows, int columns,
 				int sensors, int actuators,
 				int connections_per_gene,
@@ -335,6 +365,31 @@ void gprcm_load_system(gprcm_system * system,
 					   FILE * fp,
 					   int * instruction_set, int no_of_instructions);
 void gprcm_save_system(gprcm_system *system, FILE * fp);
+void gprcm_save_binary(gprcm_function * f,
+					   int rows, int columns,
+					   int connections_per_gene,
+					   int sensors, int actuators,
+					   int data_size, int data_fields,
+					   gpr_binary_buffer * buffer);
+int gprcm_load_binary(gprcm_function * f,
+					  int rows, int columns,
+					  int connections_per_gene,
+					  int sensors, int actuators,
+					  int data_size, int data_fields,
+					  gpr_binary_reader * reader);
+int gprcm_save_population_binary(gprcm_population * population,
+								 FILE * fp, int compress);
+int gprcm_load_population_binary(gprcm_population * population,
+								 FILE * fp,
+								 int * instruction_set,
+								 int no_of_instructions);
+int gprcm_save_system_binary(gprcm_system * system, FILE * fp,
+							 int compress);
+int gprcm_load_system_binary(gprcm_system * system, FILE * fp,
+							 int * instruction_set, int no_of_instructions);
+int gprcm_checkpoint_system(gprcm_system * system,
+							gpr_checkpoint * checkpoint,
+							char * filename, int compress);
 int gprcm_default_instruction_set(int * instruction_set);
 int gprcm_equation_instruction_set(int * instruction_set);
 int gprcm_equation_dynamic_instruction_set(int * instruction_set);
@@ -29,41 +29,191 @@
 
 #include "som.h"
 
-/* initialises a SOM structure */
+/* Initialises a SOM structure.
+   The weights of all cells are stored within a single matrix,
+   together with masks for missing values */
 void gpr_som_init(int dimension,
 				  int no_of_sensors,
 				  gpr_som * som)
 {
-	int i;
-	gpr_som_element * elem;
+	int i, cells = dimension*dimension;
+	int stride = GPR_SOM_STRIDE(no_of_sensors);
+	float * block;
 
 	som->dimension = dimension;
 	som->no_of_sensors = no_of_sensors;
-	som->weight = (gpr_som_element**)malloc(dimension*dimension*
-											sizeof(gpr_som_element*));
+	som->stride = stride;
+
+	/* weights, weight masks, sensor scales, sample and sample mask */
+	som->memory =
+		malloc(((cells*2) + 3)*stride*sizeof(float) + GPR_SOM_ALIGNMENT);
+	assert(som->memory);
+	memset(som->memory, '\0',
+		   ((cells*2) + 3)*stride*sizeof(float) + GPR_SOM_ALIGNMENT);
+	block = (float*)(((size_t)som->memory + GPR_SOM_ALIGNMENT - 1) &
+					 ~((size_t)GPR_SOM_ALIGNMENT - 1));
+	som->weights = block;
+	som->weight_mask = &block[cells*stride];
+	som->sensor_scale = &block[cells*2*stride];
+	som->sample = &block[(cells*2 + 1)*stride];
+	som->sample_mask = &block[(cells*2 + 2)*stride];
+
+	som->weight = (gpr_som_element*)malloc(cells*sizeof(gpr_som_element));
 	assert(som->weight);
-	for (i = 0; i < dimension*dimension; i++) {
-		elem = (gpr_som_element *)&som->weight[i];
-		
-		elem->vect = (float*)malloc(no_of_sensors*sizeof(float));
+	for (i = 0; i < cells; i++) {
+		som->weight[i].vect = &som->weights[i*stride];
+		/* padding beyond the last sensor always stays zero */
+		for (int s = 0; s < no_of_sensors; s++) {
+			som->weight_mask[i*stride + s] = 1;
+		}
+	}
+	for (i = 0; i < no_of_sensors; i++) {
+		som->sensor_scale[i] = 1;
 	}
-	som->state = (float*)malloc(dimension*dimension*sizeof(float));
-	som->sensor_scale = (float*)malloc(no_of_sensors*sizeof(float));
+	som->state = (float*)malloc(cells*sizeof(float));
 }
 
 /* frees a SOM structure */
 void gpr_som_free(gpr_som * som)
+{
+	free(som->weight);
+	free(som->memory);
+	free(som->state);
+}
+
+/* updates the mask for the weights of the given cell,
+   which is zero wherever a weight is missing */
+static void gpr_som_mask_cell(gpr_som * som, int cell)
+{
+	float * w = &som->weights[cell*som->stride];
+	float * m = &som->weight_mask[cell*som->stride];
+
+	for (int s = 0; s < som->no_of_sensors; s++) {
+		m[s] = (w[s] != GPR_MISSING_VALUE) ? 1 : 0;
+	}
+}
+
+/* Updates the masks for the weights of every cell.
+   This should be called after any weights are changed directly
+   through som->weight, before gpr_som_update, gpr_som_run or
+   gpr_som_learn are used.  Functions which process whole data sets
+   call this themselves */
+void gpr_som_mask_weights(gpr_som * som)
 {
 	int i;
-	gpr_som_element * elem;
 
+#pragma omp parallel for
 	for (i = 0; i < som->dimension*som->dimension; i++) {
-		elem = (gpr_som_element *)&som->weight[i];
-		free(elem->vect);
+		gpr_som_mask_cell(som, i);
 	}
-	free(som->weight);
-	free(som->state);
-	free(som->sensor_scale);
+}
+
+/* Copies sensor values into the sample, with a mask for
+   any which are missing, so that comparisons with the weights
+   don't need to check for missing values */
+static void gpr_som_set_sample(gpr_som * som, float * sensors,
+							   float * sample, float * sample_mask)
+{
+	for (int s = 0; s < som->no_of_sensors; s++) {
+		if (sensors[s] != GPR_MISSING_VALUE) {
+			sample[s] = sensors[s];
+			sample_mask[s] = 1;
+		}
+		else {
+			sample[s] = 0;
+			sample_mask[s] = 0;
+		}
+	}
+	for (int s = som->no_of_sensors; s < som->stride; s++) {
+		sample[s] = 0;
+		sample_mask[s] = 0;
+	}
+}
+
+/* Returns the scaled squared distance between a sample and the
+   weights of a cell.  The sensor_scale value is used to avoid
+   bias towards any particular sensor */
+static float gpr_som_distance(gpr_som * som, int cell,
+							  float * sample, float * sample_mask)
+{
+	float dist = 0, d;
+	float * w = &som->weights[cell*som->stride];
+	float * m = &som->weight_mask[cell*som->stride];
+	float * scale = som->sensor_scale;
+
+#pragma omp simd private(d) reduction(+:dist)
+	for (int s = 0; s < som->stride; s++) {
+		d = sample[s] - w[s];
+		dist += d*d*scale[s]*m[s]*sample_mask[s];
+	}
+	return dist;
+}
+
+/* Finds the cell closest to the given sample, optionally storing
+   the distance for every cell within state.  Each thread finds the
+   closest cell within its share of the map, and these are then
+   combined.  Ties go to the lowest cell index */
+static int gpr_som_search(gpr_som * som,
+						  float * sample, float * sample_mask,
+						  float * state,
+						  float * min_distance, float * max_distance)
+{
+	int winner = -1;
+	float min = 0, max = 0;
+
+#pragma omp parallel
+	{
+		int i, local_winner = -1;
+		float dist, local_min = 0, local_max = 0;
+
+#pragma omp for nowait
+		for (i = 0; i < som->dimension*som->dimension; i++) {
+			dist = gpr_som_distance(som, i, sample, sample_mask);
+			if (state != 0) state[i] = dist;
+			if ((local_winner == -1) || (dist < local_min)) {
+				local_min = dist;
+				local_winner = i;
+			}
+			if (dist > local_max) local_max = dist;
+		}
+
+#pragma omp critical
+		{
+			if (local_winner > -1) {
+				if ((winner == -1) || (local_min < min) ||
+					((local_min == min) && (local_winner < winner))) {
+					min = local_min;
+					winner = local_winner;
+				}
+				if (local_max > max) max = local_max;
+			}
+		}
+	}
+
+	if (min_distance != 0) *min_distance = min;
+	if (max_distance != 0) *max_distance = max;
+	return winner;
+}
+
+/* Returns the cell closest to the given sample, searching on the
+   calling thread only.  Used where samples are already being
+   processed in parallel */
+static int gpr_som_closest(gpr_som * som,
+						   float * sample, float * sample_mask,
+						   float * min_distance)
+{
+	int i, winner = 0;
+	float dist, min = 0;
+
+	for (i = 0; i < som->dimension*som->dimension; i++) {
+		dist = gpr_som_distance(som, i, sample, sample_mask);
+		if ((i == 0) || (dist < min)) {
+			min = dist;
+			winner = i;
+		}
+	}
+	if (min_distance != 0) *min_distance = min;
+	return winner;
 }
 
 /* randomly initialise a sensor */
@@ -85,6 +235,7 @@ int gpr_som_init_sensor(gpr_som * som,
 			min_value +
 			((max_value - min_value)*
 			 (rand_num(random_seed)%10000)/10000.0f);
+		som->weight_mask[i*som->stride + sensor_index] = 1;
 	}
 	return 0;
 }
@@ -132,8 +283,9 @@ void gpr_som_learn(gpr_som * som,
 {
 	int i,s,x=0,y=0,xx,yy,dx,dy,r;
 	int inhibit_radius2;
-	float max=0,diff;
-	gpr_som_element * elem;
+	float max=0,rate;
+	float * w, * m;
+	float * sample = som->sample, * sample_mask = som->sample_mask;
 
 	/* location of the best response */
 	for (i = 0; i < som->dimension*som->dimension; i++) {
@@ -147,6 +299,8 @@ void gpr_som_learn(gpr_som * som,
 	excite_radius *= excite_radius;
 	inhibit_radius2 = inhibit_radius*inhibit_radius;
 
+	gpr_som_set_sample(som, sensors, sample, sample_mask);
+
 	/* alter weights */
 	for (xx = x - inhibit_radius; xx <= x + inhibit_radius; xx++) {
 		if ((xx < 0) || (xx >= som->dimension)) continue;
@@ -154,31 +308,24 @@ void gpr_som_learn(gpr_som * som,
 		for (yy = y - inhibit_radius; yy <= y + inhibit_radius; yy++) {
 			if ((yy < 0) || (yy >= som->dimension)) continue;
 			dy = yy - y;
-			elem =
-				(gpr_som_element *)&som->weight[(yy*som->dimension) +
-												xx];
 			r = (dx*dx) + (dy*dy);
 			if (r <= excite_radius) {
 				/* excite */
-				for (s = 0; s < som->no_of_sensors; s++) {
-					if ((elem->vect[s] != GPR_MISSING_VALUE) &&
-						(sensors[s] != GPR_MISSING_VALUE)) {
-						diff = sensors[s] - elem->vect[s];
-						elem->vect[s] += diff*learning_rate;
-					}
-				}
+				rate = learning_rate;
+			}
+			else if (r <= inhibit_radius2) {
+				/* inhibit */
+				rate = -learning_rate;
 			}
 			else {
-				if (r <= inhibit_radius2) {
-					/* inhibit */
-					for (s = 0; s < som->no_of_sensors; s++) {
-						if ((elem->vect[s] != GPR_MISSING_VALUE) &&
-							(sensors[s] != GPR_MISSING_VALUE)) {
-							diff = sensors[s] - elem->vect[s];
-							elem->vect[s] -= diff*learning_rate;
-						}
-					}
-				}
+				continue;
+			}
+			/* missing weights and sensor values are masked out */
+			w = &som->weights[((yy*som->dimension) + xx)*som->stride];
+			m = &som->weight_mask[((yy*som->dimension) + xx)*som->stride];
+#pragma omp simd
+			for (s = 0; s < som->stride; s++) {
+				w[s] += (sample[s] - w[s])*rate*m[s]*sample_mask[s];
 			}
 		}
 	}	
@@ -189,42 +336,13 @@ int gpr_som_update(float * sensors,
 				   gpr_som * som,
 				   float * x, float * y)
 {
-	int i,winner=-1;
-	float diff,min=0,max=0;
-	gpr_som_element * elem;
-
-	/* clear the state */
-	memset((void*)som->state,'\0',
-		   som->dimension*som->dimension*sizeof(float));
-
-	/* compare sensor values against weights.
-	   The sensor_scale value is used to avoid bias
-	   towards any particular sensor */
-#pragma omp parallel for
-	for (i = 0; i < som->dimension*som->dimension; i++) {
-		elem = (gpr_som_element *)&som->weight[i];
-		for (int s = 0; s < som->no_of_sensors; s++) {
-			if ((elem->vect[s] != GPR_MISSING_VALUE) &&
-				(sensors[s] != GPR_MISSING_VALUE)) {
-				som->state[i] +=
-					(sensors[s] - elem->vect[s])*
-					(sensors[s] - elem->vect[s])*
-					som->sensor_scale[s];
-			}
-		}
-	}
+	int i,winner;
+	float min=0,max=0;
 
-	/* find the winner */
-	for (i = 0; i < som->dimension*som->dimension; i++) {
-		diff = som->state[i];
-		if ((i == 0) || (diff < min)) {
-			min = diff;
-			winner = i;
-		}
-		if ((i == 0) || (diff > max)) {
-			max = diff;			
-		}
-	}
+	/* compare sensor values against weights */
+	gpr_som_set_sample(som, sensors, som->sample, som->sample_mask);
+	winner = gpr_som_search(som, som->sample, som->sample_mask,
+							som->state, &min, &max);
 	if (winner > -1) {
 		/* return the peak location in the range 0.0 - 1.0 */
 		*y = (int)(winner/som->dimension) / (float)som->dimension;
@@ -250,33 +368,132 @@ void gpr_som_run(float * sensors,
 				 gpr_som * som,
 				 float * x, float * y)
 {
-	int s,i,winner=0;
-	float diff,min=0,ds;
-	gpr_som_element * elem;
+	int winner;
+	float * sample;
 
 	*x=0;
 	*y=0;
 
-	/* compare sensor values against weights.
-	   The sensor_scale value is used to avoid bias
-	   towards any particular sensor */
+	/* the sample and its mask */
+	sample = (float*)malloc(som->stride*2*sizeof(float));
+	assert(sample);
+	gpr_som_set_sample(som, sensors, sample, &sample[som->stride]);
+
+	winner = gpr_som_search(som, sample, &sample[som->stride], 0, 0, 0);
+	if (winner > -1) {
+		*y = (int)(winner/som->dimension) / (float)som->dimension;
+		*x = (int)(winner%som->dimension) / (float)som->dimension;
+	}
+	free(sample);
+}
+
+/* Finds the given number of cells closest to the sample, in
+   order of increasing distance.  Entries beyond the number of
+   cells are given an index of -1 */
+static void gpr_som_closest_k(gpr_som * som,
+							  float * sample, float * sample_mask,
+							  int k, int * index, float * distance)
+{
+	int i, j, found = 0;
+	float dist;
+
 	for (i = 0; i < som->dimension*som->dimension; i++) {
-		elem = (gpr_som_element *)&som->weight[i];
-		diff=0;
-		for (s = 0; s < som->no_of_sensors; s++) {
-			if ((elem->vect[s] != GPR_MISSING_VALUE) &&
-				(sensors[s] != GPR_MISSING_VALUE)) {
-				ds = sensors[s] - elem->vect[s];
-				diff += ds * ds * som->sensor_scale[s];
-			}
+		dist = gpr_som_distance(som, i, sample, sample_mask);
+		if ((found == k) && (dist >= distance[k-1])) continue;
+		/* insert after any cells at the same distance */
+		j = (found < k) ? found++ : k-1;
+		while ((j > 0) && (distance[j-1] > dist)) {
+			index[j] = index[j-1];
+			distance[j] = distance[j-1];
+			j--;
 		}
-		if ((i==0) || (diff < min)) {
-			min = diff;
-			winner=i;
+		index[j] = i;
+		distance[j] = dist;
+	}
+	for (i = found; i < k; i++) {
+		index[i] = -1;
+		distance[i] = 0;
+	}
+}
+
+/* Finds the closest cell for each sample within the given data,
+   without altering the SOM, so that this may be called from several
+   threads at once.  Samples are processed in parallel.
+   Any of the following may be null:
+     winner receives the index of the closest cell for each sample.
+     result receives the x,y position of the closest cell for each
+       sample, in the range 0.0 - 1.0
+     top_index and top_distance receive the indexes and distances
+       of the top_k closest cells for each sample */
+void gpr_som_run_batch(gpr_som * som,
+					   int * data_field_index,
+					   float * data,
+					   int fields_per_sample,
+					   int no_of_samples,
+					   int * winner,
+					   float * result,
+					   int top_k,
+					   int * top_index,
+					   float * top_distance)
+{
+	if ((top_index == 0) || (top_distance == 0)) top_k = 0;
+
+	gpr_som_mask_weights(som);
+
+#pragma omp parallel
+	{
+		int i, s, closest, k = top_k;
+		float * sample, * sample_mask, * distance;
+		int * index;
+
+		if (k < 1) k = 1;
+		sample = (float*)malloc((som->stride*2 + k)*sizeof(float));
+		index = (int*)malloc(k*sizeof(int));
+		assert(sample);
+		assert(index);
+		sample_mask = &sample[som->stride];
+		distance = &sample[som->stride*2];
+
+#pragma omp for schedule(static)
+		for (i = 0; i < no_of_samples; i++) {
+			float * row = &data[i*fields_per_sample];
+			float value;
+
+			for (s = 0; s < som->no_of_sensors; s++) {
+				value = row[data_field_index[s]];
+				sample_mask[s] = (value != GPR_MISSING_VALUE) ? 1 : 0;
+				sample[s] = (value != GPR_MISSING_VALUE) ? value : 0;
+			}
+			for (s = som->no_of_sensors; s < som->stride; s++) {
+				sample[s] = 0;
+				sample_mask[s] = 0;
+			}
+
+			if (top_k > 0) {
+				gpr_som_closest_k(som, sample, sample_mask,
+								  top_k, index, distance);
+				memcpy((void*)&top_index[i*top_k], (void*)index,
+					   top_k*sizeof(int));
+				memcpy((void*)&top_distance[i*top_k], (void*)distance,
+					   top_k*sizeof(float));
+				closest = index[0];
+			}
+			else {
+				closest = gpr_som_closest(som, sample, sample_mask, 0);
+			}
+
+			if (winner != 0) winner[i] = closest;
+			if (result != 0) {
+				result[i*2] =
+					(int)(closest%som->dimension) / (float)som->dimension;
+				result[i*2 + 1] =
+					(int)(closest/som->dimension) / (float)som->dimension;
+			}
 		}
+
+		free(index);
+		free(sample);
 	}
-	*y = (int)(winner/som->dimension) / (float)som->dimension;
-	*x = (int)(winner%som->dimension) / (float)som->dimension;
 }
 
 /* Updates an array containing outputs for the given
@@ -288,23 +505,9 @@ void gpr_som_outputs_from_data(gpr_som * som,
 							   int no_of_samples,
 							   float * result)
 {
-	int i,s;
-	float x=0,y=0;
-	float * sensors;
-
-	sensors = (float*)malloc(som->no_of_sensors*sizeof(float));
-
-	for (i = 0; i < no_of_samples; i++) {
-		for (s = 0; s < som->no_of_sensors; s++) {
-			sensors[s] = data[i*fields_per_sample +
-							  data_field_index[s]];
-		}
-		gpr_som_run(sensors, som, &x, &y);
-		result[i*2] = x;
-		result[i*2 + 1] = y;
-	}
-
-	free(sensors);
+	gpr_som_run_batch(som, data_field_index, data,
+					  fields_per_sample, no_of_samples,
+					  0, result, 0, 0, 0);
 }
 
 /* learn from training data */
@@ -325,6 +528,8 @@ void gpr_som_learn_from_data(gpr_som * som,
 
 	sensors = (float*)malloc(som->no_of_sensors*sizeof(float));
 
+	gpr_som_mask_weights(som);
+
 	for (i = 0; i < learning_itterations; i++) {
 		for (j = 0; j < no_of_samples; j++) {
 			/* pick a training sample */
@@ -347,6 +552,195 @@ void gpr_som_learn_from_data(gpr_som * som,
 	free(sensors);
 }
 
+/* returns a value decaying from start to end over the given
+   number of epochs */
+static float gpr_som_schedule(float start, float end,
+							  int epoch, int epochs)
+{
+	float fraction;
+
+	if (epochs < 2) return end;
+	fraction = epoch / (float)(epochs - 1);
+	if ((start > 0) && (end > 0)) {
+		/* exponential decay */
+		return start * (float)pow(end / start, fraction);
+	}
+	return start + ((end - start)*fraction);
+}
+
+/* Batch learning from training data.
+   During each epoch every sample is assigned to its closest cell,
+   with each thread summing the samples for each cell separately.
+   The sums are then combined and smoothed over a neighbourhood
+   whose radius decays from start_radius to end_radius, and the
+   weights move towards the smoothed means by a learning rate which
+   decays from start_learning_rate to end_learning_rate.
+   A learning rate of one gives classic batch SOM updates */
+void gpr_som_learn_batch_from_data(gpr_som * som,
+								   int * data_field_index,
+								   float * training_data,
+								   int fields_per_sample,
+								   int no_of_samples,
+								   int epochs,
+								   float start_radius,
+								   float end_radius,
+								   float start_learning_rate,
+								   float end_learning_rate,
+								   int show_progress)
+{
+	int epoch, t, threads = omp_get_max_threads();
+	int dimension = som->dimension, stride = som->stride;
+	int cells = dimension*dimension;
+	int window;
+	size_t accumulator_length = (size_t)cells*stride*2;
+	float radius, learning_rate;
+	float * accumulator, * neighbour, * sample;
+
+	if ((no_of_samples < 1) || (epochs < 1)) return;
+
+	gpr_som_mask_weights(som);
+
+	/* sums and counts for every cell, for each thread */
+	accumulator = (float*)malloc(accumulator_length*threads*sizeof(float));
+	/* sample and mask for each thread */
+	sample = (float*)malloc(stride*2*threads*sizeof(float));
+	/* neighbourhood weights, large enough for the starting radius */
+	window = (int)ceil(start_radius > end_radius ?
+					   start_radius : end_radius);
+	if (window >= dimension) window = dimension - 1;
+	if (window < 0) window = 0;
+	neighbour = (float*)malloc((window*2+1)*(window*2+1)*sizeof(float));
+	assert(accumulator);
+	assert(sample);
+	assert(neighbour);
+
+	for (epoch = 0; epoch < epochs; epoch++) {
+		int w;
+
+		radius = gpr_som_schedule(start_radius, end_radius,
+								  epoch, epochs);
+		learning_rate =
+			gpr_som_schedule(start_learning_rate, end_learning_rate,
+							 epoch, epochs);
+
+		/* gaussian neighbourhood, falling to exp(-2) at the radius */
+		w = (int)ceil(radius);
+		if (w > window) w = window;
+		if (w < 0) w = 0;
+		for (int dy = -w; dy <= w; dy++) {
+			for (int dx = -w; dx <= w; dx++) {
+				float r2 = (float)((dx*dx) + (dy*dy));
+				float * h = &neighbour[(dy+w)*(w*2+1) + dx + w];
+				if (radius <= 0) {
+					*h = ((dx == 0) && (dy == 0)) ? 1 : 0;
+				}
+				else if (r2 > radius*radius) {
+					*h = 0;
+				}
+				else {
+					*h = (float)exp(-2*r2/(radius*radius));
+				}
+			}
+		}
+
+		memset((void*)accumulator, '\0',
+			   accumulator_length*threads*sizeof(float));
+
+		/* assign every sample to its closest cell */
+#pragma omp parallel
+		{
+			int i, s, winner, thread = omp_get_thread_num();
+			float * sum = &accumulator[accumulator_length*thread];
+			float * count = &sum[cells*stride];
+			float * sensors = &sample[stride*2*thread];
+			float * sensors_mask = &sensors[stride];
+
+#pragma omp for schedule(static)
+			for (i = 0; i < no_of_samples; i++) {
+				float * row = &training_data[i*fields_per_sample];
+				float value;
+				for (s = 0; s < som->no_of_sensors; s++) {
+					value = row[data_field_index[s]];
+					sensors_mask[s] = (value != GPR_MISSING_VALUE) ? 1 : 0;
+					sensors[s] = (value != GPR_MISSING_VALUE) ? value : 0;
+				}
+				for (s = som->no_of_sensors; s < stride; s++) {
+					sensors[s] = 0;
+					sensors_mask[s] = 0;
+				}
+				winner = gpr_som_closest(som, sensors, sensors_mask, 0);
+#pragma omp simd
+				for (s = 0; s < stride; s++) {
+					sum[winner*stride + s] += sensors[s];
+					count[winner*stride + s] += sensors_mask[s];
+				}
+			}
+		}
+
+		/* combine the sums from each thread */
+		for (t = 1; t < threads; t++) {
+			float * src = &accumulator[accumulator_length*t];
+#pragma omp parallel for
+			for (int i = 0; i < cells; i++) {
+				for (int s = 0; s < stride; s++) {
+					accumulator[i*stride + s] += src[i*stride + s];
+					accumulator[(cells+i)*stride + s] +=
+						src[(cells+i)*stride + s];
+				}
+			}
+		}
+
+		/* move each cell towards the mean of its neighbourhood */
+#pragma omp parallel
+		{
+			float * numerator = &sample[stride*2*omp_get_thread_num()];
+			float * denominator = &numerator[stride];
+
+#pragma omp for
+			for (int i = 0; i < cells; i++) {
+				int x = i % dimension, y = i / dimension, s;
+				float * weight = &som->weights[i*stride];
+				float * mask = &som->weight_mask[i*stride];
+
+				memset((void*)numerator, '\0', stride*2*sizeof(float));
+				for (int yy = y - w; yy <= y + w; yy++) {
+					if ((yy < 0) || (yy >= dimension)) continue;
+					for (int xx = x - w; xx <= x + w; xx++) {
+						int n = (yy*dimension) + xx;
+						float h;
+						if ((xx < 0) || (xx >= dimension)) continue;
+						h = neighbour[(yy-y+w)*(w*2+1) + xx-x+w];
+						if (h <= 0) continue;
+#pragma omp simd
+						for (s = 0; s < stride; s++) {
+							numerator[s] += h*accumulator[n*stride + s];
+							denominator[s] +=
+								h*accumulator[(cells+n)*stride + s];
+						}
+					}
+				}
+				/* missing weights and cells without any nearby
+				   samples are left unchanged */
+				for (s = 0; s < som->no_of_sensors; s++) {
+					if ((denominator[s] > 0) && (mask[s] != 0)) {
+						weight[s] += learning_rate *
+							((numerator[s]/denominator[s]) - weight[s]);
+					}
+				}
+			}
+		}
+
+		if (show_progress > 0) {
+			printf(".");
+			fflush(stdout);
+		}
+	}
+
+	free(neighbour);
+	free(sample);
+	free(accumulator);
+}
+
 void gpr_som_save(gpr_som * som,
 				  FILE * fp)
 {
@@ -404,5 +798,6 @@ void gpr_som_load(gpr_som * som,
 				}
 			}	
 		}
+		gpr_som_mask_cell(som, i);
 	}
 }
@@ -40,6 +40,15 @@
 #include "globals.h"
 #include "gpr.h"
 
+/* The weights for each cell are padded to a multiple of this
+   many bytes, so that every row of the weights is aligned */
+#define GPR_SOM_ALIGNMENT 64
+
+/* the number of floats between the weights of successive cells */
+#define GPR_SOM_STRIDE(sensors) \
+	((((sensors)*(int)sizeof(float) + GPR_SOM_ALIGNMENT - 1) / \
+	  GPR_SOM_ALIGNMENT) * (GPR_SOM_ALIGNMENT / (int)sizeof(float)))
+
 struct gpr_som_elem {
     float * vect;
 };
@@ -49,14 +58,28 @@ typedef struct gpr_som_elem gpr_som_element;
 struct gpr_som_struct {
 	int dimension;
 	int no_of_sensors;
-    struct gpr_som_elem ** weight;
+	/* the number of floats between the weights of successive cells */
+	int stride;
+	/* the weights of all cells, with one aligned row per cell */
+	float * weights;
+	/* one where a weight is present, zero where it is missing.
+	   See gpr_som_mask_weights */
+	float * weight_mask;
+	/* the row of weights for each cell */
+	struct gpr_som_elem * weight;
     float * state;
 	float * sensor_scale;
+	/* the current sensor values, with zero where a value is missing,
+	   and one where a sensor value is present */
+	float * sample, * sample_mask;
+	/* memory containing all of the above arrays of floats */
+	void * memory;
 };
 typedef struct gpr_som_struct gpr_som;
 
 void gpr_som_init(int dimension, int no_of_sensors, gpr_som * som);
 void gpr_som_free(gpr_som * som);
+void gpr_som_mask_weights(gpr_som * som);
 int gpr_som_init_sensor(gpr_som * som,
 						int sensor_index,
 						float min_value, float max_value,
@@ -78,12 +101,33 @@ void gpr_som_learn_from_data(gpr_som * som,
 							 float learning_rate,
 							 unsigned int * random_seed,
 							 int show_progress);
+void gpr_som_learn_batch_from_data(gpr_som * som,
+								   int * data_field_index,
+								   float * training_data,
+								   int fields_per_sample,
+								   int no_of_samples,
+								   int epochs,
+								   float start_radius,
+								   float end_radius,
+								   float start_learning_rate,
+								   float end_learning_rate,
+								   int show_progress);
 void gpr_som_outputs_from_data(gpr_som * som,
 							   int * data_field_index,
 							   float * data,
 							   int fields_per_sample,
 							   int no_of_samples,
 							   float * result);
+void gpr_som_run_batch(gpr_som * som,
+					   int * data_field_index,
+					   float * data,
+					   int fields_per_sample,
+					   int no_of_samples,
+					   int * winner,
+					   float * result,
+					   int top_k,
+					   int * top_index,
+					   float * top_distance);
 void gpr_som_learn(gpr_som * som,
 				   float * sensors,
 				   int inhibit_radius,
@@ -500,6 +500,69 @@ static void test_gpr_mutate()
 	printf("Ok\n");
 }
 
+static void test_gpr_index()
+{
+	gpr_function f;
+	gpr_index index, subtree_index;
+	int i, j, t, nodes, max_depth2, depth;
+	int min_depth=2, max_depth=10;
+	float branching_prob=0.8f;
+	float min_value = 100;
+	float max_value = 200;
+	unsigned int random_seed = 7265;
+	int integers_only = 0;
+	int instruction_set[64], no_of_instructions=0;
+
+	printf("test_gpr_index...");
+
+	no_of_instructions =
+		gpr_default_instruction_set((int*)instruction_set);
+	assert(no_of_instructions>0);
+
+	gpr_init_index(&index);
+	gpr_init_index(&subtree_index);
+
+	for (t = 0; t < GPR_MAX_TESTS; t++) {
+		depth=0;
+		gpr_random(&f,depth,min_depth,max_depth,branching_prob,
+				   min_value, max_value, integers_only, &random_seed,
+				   (int*)instruction_set, no_of_instructions);
+		gpr_build_index(&f, &index);
+
+		/* the index should agree with the tree statistics */
+		nodes=0;
+		gpr_nodes(&f,&nodes);
+		assert(index.size == nodes);
+		assert(index.node[0] == &f);
+		assert(index.depth[0] == 0);
+		assert(index.subtree_size[0] == nodes);
+		max_depth2=0;
+		gpr_max_depth(&f, 0, &max_depth2);
+		assert(index.height[0] == max_depth2);
+
+		/* each subtree should occupy a contiguous range */
+		for (i = 0; i < index.size; i++) {
+			gpr_build_index(index.node[i], &subtree_index);
+			assert(subtree_index.size == index.subtree_size[i]);
+			assert(subtree_index.height[0] == index.height[i]);
+			for (j = 0; j < subtree_index.size; j++) {
+				assert(subtree_index.node[j] == index.node[i+j]);
+				assert(subtree_index.depth[j] + index.depth[i] ==
+					   index.depth[i+j]);
+			}
+		}
+
+		gpr_free(&f);
+	}
+
+	gpr_free_index(&index);
+	gpr_free_index(&subtree_index);
+	assert(index.size == 0);
+	assert(index.node == 0);
+
+	printf("Ok\n");
+}
+
 static void test_gpr_crossover()
 {
 	gpr_function parent1,parent2,child;
@@ -815,6 +878,450 @@ static void test_gpr_run()
 	printf("Ok\n");
 }
 
+/* checks that compiled programs give the same results as
+   the original trees */
+static void test_gpr_compile()
+{
+	int i, j, t, ADFs, population_size = 200;
+	int max_depth=6, registers = 4;
+	gpr_population population;
+	gpr_state state;
+	gpr_compiled program;
+	float min_value = -5;
+	float max_value = 5;
+	float result1, result2;
+	unsigned int random_seed = 123;
+	int integers_only = 0;
+	int instruction_set[64], no_of_instructions=0;
+	int data_size = 8, data_fields = 2;
+
+	printf("test_gpr_compile...");
+
+	/* create an instruction set */
+	no_of_instructions =
+		gpr_default_instruction_set((int*)instruction_set);
+	assert(no_of_instructions>0);
+
+	for (ADFs = 0; ADFs <= 1; ADFs++) {
+		/* create a population */
+		gpr_init_population(&population, population_size,
+							registers, 1, 1,
+							max_depth, min_value, max_value,
+							integers_only, ADFs,
+							data_size, data_fields,
+							&random_seed,
+							(int*)instruction_set,no_of_instructions);
+
+		for (i = 0; i < population.size; i++) {
+			gpr_compile(&population.individual[i],
+						&population.state[i], &program);
+			assert(program.length > 0);
+			assert(gpr_compiled_changed(&program,
+										&population.individual[i]) == 0);
+
+			/* a separate state for the compiled program */
+			gpr_init_state(&state, registers, 1, 1,
+						   data_size, data_fields,
+						   &random_seed);
+
+			for (t = 0; t < 10; t++) {
+				gpr_set_sensor(&population.state[i], 0, t+1);
+				gpr_set_sensor(&state, 0, t+1);
+
+				result1 = gpr_run(&population.individual[i],
+								  &population.state[i], 0);
+				result2 = gpr_run_compiled(&program, &state, 0);
+
+				/* results should be identical */
+				if (is_nan(result1)==0) {
+					assert(result1 == result2);
+				}
+				else {
+					assert(is_nan(result2)!=0);
+				}
+				assert(gpr_get_actuator(&population.state[i],0) ==
+					   gpr_get_actuator(&state,0));
+				for (j = 0; j < registers; j++) {
+					assert(population.state[i].registers[j] ==
+						   state.registers[j]);
+				}
+			}
+
+			/* changing the tree is detected */
+			population.individual[i].value += 1;
+			assert(gpr_compiled_changed(&program,
+										&population.individual[i]) != 0);
+			population.individual[i].value -= 1;
+
+			gpr_free_state(&state);
+			gpr_free_compiled(&program);
+		}
+
+		gpr_free_population(&population);
+	}
+
+	printf("Ok\n");
+}
+
+/* checks that batch evaluation gives the same results as
+   running the program once for each sample */
+static void test_gpr_run_batch()
+{
+	int i, j, k, t, ADFs, population_size = 100;
+	int max_depth=6, registers = 4, sensors = 3, samples = 150;
+	gpr_population population;
+	gpr_state state;
+	gpr_compiled program;
+	float min_value = -5;
+	float max_value = 5;
+	float result, * block, * outputs, * actuators;
+	unsigned int random_seed = 123;
+	int integers_only = 0;
+	int instruction_set[64], no_of_instructions=0;
+	int data_size = 8, data_fields = 2;
+
+	printf("test_gpr_run_batch...");
+
+	block = (float*)malloc(sensors*samples*sizeof(float));
+	outputs = (float*)malloc(samples*sizeof(float));
+	actuators = (float*)malloc(samples*sizeof(float));
+	for (i = 0; i < sensors*samples; i++) {
+		block[i] = gpr_random_value(-10, 10, &random_seed);
+	}
+
+	for (t = 0; t < 2; t++) {
+		/* create an instruction set */
+		no_of_instructions =
+			gpr_default_instruction_set((int*)instruction_set);
+		if (t == 1) {
+			/* no instructions which change the state */
+			for (i = no_of_instructions-1; i >= 0; i--) {
+				if ((instruction_set[i] == GPR_FUNCTION_SET) ||
+					(instruction_set[i] == GPR_FUNCTION_DATA_PUSH) ||
+					(instruction_set[i] == GPR_FUNCTION_DATA_POP) ||
+					(instruction_set[i] == GPR_FUNCTION_DATA_GET) ||
+					(instruction_set[i] == GPR_FUNCTION_DATA_SET)) {
+					instruction_set[i] =
+						instruction_set[--no_of_instructions];
+				}
+			}
+		}
+		assert(no_of_instructions>0);
+
+		for (ADFs = 0; ADFs <= 1; ADFs++) {
+			gpr_init_population(&population, population_size,
+								registers, sensors, 1,
+								max_depth, min_value, max_value,
+								integers_only, ADFs,
+								data_size, data_fields,
+								&random_seed,
+								(int*)instruction_set,
+								no_of_instructions);
+
+			for (i = 0; i < population.size; i++) {
+				gpr_compile(&population.individual[i],
+							&population.state[i], &program);
+
+				gpr_init_state(&state, registers, sensors, 1,
+							   data_size, data_fields,
+							   &random_seed);
+				gpr_run_batch(&program, &state, block, samples,
+							  outputs, actuators, 0);
+
+				/* compare against one sample at a time */
+				for (j = 0; j < samples; j++) {
+					for (k = 0; k < sensors; k++) {
+						gpr_set_sensor(&population.state[i], k,
+									   block[k*samples + j]);
+					}
+					result = gpr_run(&population.individual[i],
+									 &population.state[i], 0);
+					if (is_nan(result)==0) {
+						assert(result == outputs[j]);
+					}
+					else {
+						assert(is_nan(outputs[j])!=0);
+					}
+					assert(gpr_get_actuator(&population.state[i],0) ==
+						   actuators[j]);
+				}
+
+				gpr_free_state(&state);
+				gpr_free_compiled(&program);
+			}
+
+			gpr_free_population(&population);
+		}
+	}
+
+	free(block);
+	free(outputs);
+	free(actuators);
+
+	printf("Ok\n");
+}
+
+/* checks that programs compiled into native code give the
+   same results as gpr_run */
+static void test_gpr_jit()
+{
+	int i, j, t, ADFs, population_size = 10;
+	int max_depth=6, registers = 4, cache_size, failures;
+	gpr_population population;
+	gpr_state state;
+	gpr_native program, program2;
+	float min_value = -5;
+	float max_value = 5;
+	float result1, result2;
+	unsigned int random_seed = 3621;
+	int integers_only = 0;
+	int instruction_set[64], no_of_instructions=0;
+	int data_size = 8, data_fields = 2;
+
+	printf("test_gpr_jit...");
+
+	no_of_instructions =
+		gpr_default_instruction_set((int*)instruction_set);
+	assert(no_of_instructions>0);
+
+	for (ADFs = 0; ADFs <= 1; ADFs++) {
+		gpr_init_population(&population, population_size,
+							registers, 1, 1,
+							max_depth, min_value, max_value,
+							integers_only, ADFs,
+							data_size, data_fields,
+							&random_seed,
+							(int*)instruction_set,no_of_instructions);
+
+		/* threads compiling the same programs at the same time
+		   only compile each of them once */
+		cache_size = gpr_jit_cache_size();
+		failures = 0;
+#pragma omp parallel for reduction(+:failures)
+		for (i = 0; i < population.size*4; i++) {
+			gpr_native native;
+			if (gpr_jit(&population.individual[i % population.size],
+						&population.state[i % population.size],
+						&native) != GPR_JIT_OK) {
+				failures++;
+			}
+		}
+		assert(failures == 0);
+		assert(gpr_jit_cache_size() - cache_size <= population.size);
+
+		for (i = 0; i < population.size; i++) {
+			assert(gpr_jit(&population.individual[i],
+						   &population.state[i],
+						   &program) == GPR_JIT_OK);
+			assert(program.run_tree != 0);
+
+			/* the same program should come from the cache */
+			cache_size = gpr_jit_cache_size();
+			assert(gpr_jit(&population.individual[i],
+						   &population.state[i],
+						   &program2) == GPR_JIT_OK);
+			assert(gpr_jit_cache_size() == cache_size);
+			assert(program2.hash == program.hash);
+			assert(program2.run_tree == program.run_tree);
+
+			/* a separate state for the native program */
+			gpr_init_state(&state, registers, 1, 1,
+						   data_size, data_fields,
+						   &random_seed);
+
+			for (t = 0; t < 10; t++) {
+				gpr_set_sensor(&population.state[i], 0, t+1);
+				gpr_set_sensor(&state, 0, t+1);
+
+				result1 = gpr_run(&population.individual[i],
+								  &population.state[i], 0);
+				result2 = gpr_run_native(&program, &state, 0);
+
+				/* results should be identical */
+				if (is_nan(result1)==0) {
+					assert(result1 == result2);
+				}
+				else {
+					assert(is_nan(result2)!=0);
+				}
+				assert(gpr_get_actuator(&population.state[i],0) ==
+					   gpr_get_actuator(&state,0));
+				for (j = 0; j < registers; j++) {
+					assert(population.state[i].registers[j] ==
+						   state.registers[j]);
+				}
+			}
+
+			gpr_free_state(&state);
+		}
+
+		/* once the cache is full the least recently
+		   loaded programs are unloaded */
+		gpr_jit_release();
+		gpr_jit_set_cache_limit(2);
+		for (i = 0; i < population.size; i++) {
+			assert(gpr_jit(&population.individual[i],
+						   &population.state[i],
+						   &program) == GPR_JIT_OK);
+			assert(program.run_tree != 0);
+			assert(gpr_jit_cache_size() <= 2);
+		}
+		gpr_jit_set_cache_limit(GPR_JIT_CACHE_LIMIT);
+
+		gpr_free_population(&population);
+	}
+
+	gpr_jit_release();
+	assert(gpr_jit_cache_size() == 0);
+
+	printf("Ok\n");
+}
+
+static void test_gpr_simplify()
+{
+	int i, j, k, t, ADFs, simple, population_size = 20;
+	int max_depth=6, registers = 4;
+	int nodes_before=0, nodes_after=0;
+	gpr_population population, simplified;
+	gpr_function * f1, * f2;
+	float min_value = -5;
+	float max_value = 5;
+	float result1, result2;
+	unsigned int random_seed = 2178, random_seed2;
+	int integers_only = 0;
+	int instruction_set[64], no_of_instructions=0;
+	int data_size = 8, data_fields = 2;
+
+	printf("test_gpr_simplify...");
+
+	for (i = 0; i < 4; i++) {
+		ADFs = i%2;
+		simple = i/2;
+		if (simple == 0) {
+			no_of_instructions =
+				gpr_default_instruction_set((int*)instruction_set);
+		}
+		else {
+			no_of_instructions =
+				gpr_simple_instruction_set((int*)instruction_set);
+		}
+		assert(no_of_instructions>0);
+
+		/* two identical populations */
+		random_seed2 = random_seed;
+		gpr_init_population(&population, population_size,
+							registers, 1, 1,
+							max_depth, min_value, max_value,
+							integers_only, ADFs,
+							data_size, data_fields,
+							&random_seed,
+							(int*)instruction_set,no_of_instructions);
+		gpr_init_population(&simplified, population_size,
+							registers, 1, 1,
+							max_depth, min_value, max_value,
+							integers_only, ADFs,
+							data_size, data_fields,
+							&random_seed2,
+							(int*)instruction_set,no_of_instructions);
+
+		for (j = 0; j < population.size; j++) {
+			gpr_nodes(&simplified.individual[j], &nodes_before);
+			gpr_simplify(&simplified.individual[j]);
+			gpr_nodes(&simplified.individual[j], &nodes_after);
+
+			for (t = 0; t < 10; t++) {
+				gpr_set_sensor(&population.state[j], 0, t+1);
+				gpr_set_sensor(&simplified.state[j], 0, t+1);
+
+				result1 = gpr_run(&population.individual[j],
+								  &population.state[j], 0);
+				result2 = gpr_run(&simplified.individual[j],
+								  &simplified.state[j], 0);
+
+				/* the behavior of the program should not change */
+				if (is_nan(result1)==0) {
+					assert(result1 == result2);
+				}
+				else {
+					assert(is_nan(result2)!=0);
+				}
+				assert(gpr_get_actuator(&population.state[j],0) ==
+					   gpr_get_actuator(&simplified.state[j],0));
+				for (k = 0; k < registers; k++) {
+					assert(population.state[j].registers[k] ==
+						   simplified.state[j].registers[k]);
+				}
+
+				/* the top level only runs its arguments,
+				   so also compare the value of each argument */
+				if (ADFs == 0) {
+					for (k = 0;
+						 k < population.individual[j].argc; k++) {
+						f1 = population.individual[j].argv[k];
+						f2 = simplified.individual[j].argv[k];
+						if (f1 == 0) continue;
+						result1 = gpr_run(f1, &population.state[j], 0);
+						result2 = gpr_run(f2, &simplified.state[j], 0);
+						if (is_nan(result1)==0) {
+							assert(result1 == result2);
+						}
+						else {
+							assert(is_nan(result2)!=0);
+						}
+					}
+				}
+			}
+		}
+
+		gpr_free_population(&population);
+		gpr_free_population(&simplified);
+	}
+
+	/* programs should have become smaller */
+	assert(nodes_after < nodes_before);
+
+	printf("Ok\n");
+}
+
+/* checks that ranking is ordered and stable */
+static void test_gpr_rank()
+{
+	int i, size = 1000;
+	int index[1000], value[1000];
+	float fitness[1000];
+	unsigned int random_seed = 5732;
+
+	printf("test_gpr_rank...");
+
+	/* fitness values containing many ties */
+	for (i = 0; i < size; i++) {
+		fitness[i] = (float)(rand_num(&random_seed)%20);
+		value[i] = i;
+	}
+
+	gpr_rank(fitness, size, index);
+
+	for (i = 1; i < size; i++) {
+		assert(fitness[index[i-1]] >= fitness[index[i]]);
+		if (fitness[index[i-1]] == fitness[index[i]]) {
+			/* equal fitness retains the original order */
+			assert(index[i-1] < index[i]);
+		}
+	}
+
+	gpr_permute((void*)fitness, sizeof(float), index, size);
+	gpr_permute((void*)value, sizeof(int), index, size);
+
+	for (i = 0; i < size; i++) {
+		assert(value[i] == index[i]);
+		if (i > 0) {
+			assert(fitness[i-1] >= fitness[i]);
+		}
+	}
+
+	printf("Ok\n");
+}
+
 static void test_gpr_sort()
 {
 	int population_size = 1000;
@@ -872,6 +1379,102 @@ static void test_gpr_sort()
 	printf("Ok\n");
 }
 
+static void test_gpr_selection()
+{
+	int size = 200, cases = 50, survivors = 60;
+	int i, c, index, hits[200];
+	int * order;
+	float * fitness, * errors, lowest;
+	gpr_selection selection;
+	unsigned int random_seed = 123;
+
+	printf("test_gpr_selection...");
+
+	fitness = (float*)malloc(size*sizeof(float));
+	order = (int*)malloc(size*sizeof(int));
+	assert(fitness!=0);
+	assert(order!=0);
+
+	for (i = 0; i < size; i++) {
+		fitness[i] = rand_num(&random_seed)%1000;
+	}
+
+	/* the fittest individuals should come first */
+	gpr_partition(fitness, size, survivors, order);
+	lowest = fitness[order[0]];
+	for (i = 1; i < survivors; i++) {
+		assert(fitness[order[i]] <= fitness[order[0]]);
+		if (fitness[order[i]] < lowest) lowest = fitness[order[i]];
+	}
+	for (i = survivors; i < size; i++) {
+		assert(fitness[order[i]] <= lowest);
+		assert(fitness[order[i]] >= fitness[order[size-1]]);
+	}
+	/* every index should appear once */
+	memset((void*)hits,'\0',size*sizeof(int));
+	for (i = 0; i < size; i++) {
+		hits[order[i]]++;
+	}
+	for (i = 0; i < size; i++) {
+		assert(hits[i] == 1);
+	}
+
+	/* a tournament containing everyone is won by the fittest */
+	gpr_selection_init(&selection);
+	gpr_selection_set(&selection, GPR_SELECTION_TOURNAMENT, size*20);
+	for (i = 0; i < 10; i++) {
+		index = gpr_select(&selection, fitness, size, &random_seed);
+		assert(fitness[index] == fitness[order[0]]);
+	}
+
+	/* each individual is a specialist on one case,
+	   except for the first individual which is mediocre */
+	gpr_selection_set(&selection, GPR_SELECTION_LEXICASE, 0);
+	assert(gpr_selection_cases(&selection, size, cases) != 0);
+	assert(gpr_selection_cases(&selection, size, cases) == 0);
+	for (i = 0; i < size; i++) {
+		errors = gpr_selection_errors(&selection, i);
+		for (c = 0; c < cases; c++) {
+			if (i == 0) {
+				errors[c] = 50;
+			}
+			else if ((i % cases) == c) {
+				errors[c] = 0;
+			}
+			else {
+				errors[c] = 100 + (rand_num(&random_seed)%100);
+			}
+		}
+	}
+	gpr_selection_prepare(&selection, &random_seed);
+
+	memset((void*)hits,'\0',size*sizeof(int));
+	for (i = 0; i < 2000; i++) {
+		index = gpr_select(&selection, fitness, size, &random_seed);
+		assert((index >= 0) && (index < size));
+		hits[index]++;
+	}
+	/* the mediocre individual is never the best on any case */
+	assert(hits[0] == 0);
+	/* specialists are selected for many different cases */
+	for (c = 0, i = 1; i < size; i++) {
+		if (hits[i] > 0) c++;
+	}
+	assert(c > cases/2);
+
+	/* selecting from only the first few individuals */
+	for (i = 0; i < 100; i++) {
+		index = gpr_select(&selection, fitness, 10, &random_seed);
+		assert((index >= 0) && (index < 10));
+	}
+
+	gpr_selection_free(&selection);
+	free(fitness);
+	free(order);
+
+	printf("Ok\n");
+}
+
 static void test_gpr_sort_system()
 {
 	int population_per_island = 256;
@@ -1154,6 +1757,129 @@ static void test_gpr_generation()
 	printf("Ok\n");
 }
 
+/* the number of times that the counting evaluation function was called */
+static int test_evaluations = 0;
+
+/* an evaluation function which counts the number of evaluations */
+static float test_counted_evaluate_program(int time_steps,
+										   gpr_function * f,
+										   gpr_state * state,
+										   int custom_command)
+{
+#pragma omp atomic
+	test_evaluations++;
+
+	return test_evaluate_program(time_steps, f, state, custom_command);
+}
+
+static void test_gpr_fitness_cache()
+{
+	int i, ADFs, population_size = 64;
+	int max_depth = 5, time_steps = 10;
+	gpr_population population;
+	gpr_fitness_cache cache;
+	gpr_function f;
+	float min_value = -5;
+	float max_value = 5;
+	float fitness[64];
+	unsigned int random_seed = 8124;
+	int integers_only = 0;
+	int instruction_set[64], no_of_instructions=0;
+	int data_size = 8, data_fields = 2;
+
+	printf("test_gpr_fitness_cache...");
+
+	no_of_instructions =
+		gpr_default_instruction_set((int*)instruction_set);
+	assert(no_of_instructions>0);
+
+	for (ADFs = 0; ADFs <= 1; ADFs++) {
+		gpr_init_population(&population, population_size, 4, 1, 1,
+							max_depth, min_value, max_value,
+							integers_only, ADFs,
+							data_size, data_fields,
+							&random_seed,
+							(int*)instruction_set,no_of_instructions);
+
+		/* copies have the same hash */
+		gpr_copy(&population.individual[0], &f);
+		assert(gpr_hash(&f) == gpr_hash(&population.individual[0]));
+		assert(gpr_hash(&f) != 0);
+
+		/* changing a value changes the hash */
+		f.argv[0]->value += 1;
+		assert(gpr_hash(&f) != gpr_hash(&population.individual[0]));
+		gpr_free(&f);
+
+		/* without a cache every program is evaluated */
+		test_evaluations = 0;
+		gpr_evaluate(&population, time_steps, 0,
+					 test_counted_evaluate_program);
+		assert(test_evaluations == population_size);
+		for (i = 0; i < population_size; i++) {
+			fitness[i] = population.fitness[i];
+			population.fitness[i] = 0;
+		}
+
+		/* the first time around everything is evaluated.
+		   The cache is large enough that no two programs
+		   share an entry */
+		gpr_init_fitness_cache(&cache, 65536);
+		population.fitness_cache = &cache;
+		test_evaluations = 0;
+		gpr_evaluate(&population, time_steps, 0,
+					 test_counted_evaluate_program);
+		assert(cache.hits + cache.misses == population_size);
+		assert(test_evaluations == (int)cache.misses);
+		for (i = 0; i < population_size; i++) {
+			assert(population.fitness[i] == fitness[i]);
+			population.fitness[i] = 0;
+		}
+
+		/* the second time fitness values come from the cache */
+		test_evaluations = 0;
+		gpr_evaluate(&population, time_steps, 0,
+					 test_counted_evaluate_program);
+		assert(test_evaluations == 0);
+		assert(cache.hits + cache.misses == population_size*2);
+		assert(gpr_fitness_cache_hit_rate(&cache) >= 50);
+		for (i = 0; i < population_size; i++) {
+			assert(population.fitness[i] == fitness[i]);
+		}
+
+		/* the same program with different sensor sources
+		   isn't given a cached fitness */
+		gpr_free(&population.individual[1]);
+		gpr_copy(&population.individual[0], &population.individual[1]);
+		for (i = 0; i < 2; i++) {
+			population.state[i].no_of_sensor_sources = 2;
+			population.state[i].sensor_source =
+				(int*)malloc(population.state[i].no_of_sensors*
+							 sizeof(int));
+			memset((void*)population.state[i].sensor_source, '\0',
+				   population.state[i].no_of_sensors*sizeof(int));
+			population.fitness[i] = 0;
+		}
+		population.state[1].sensor_source[0] = 1;
+		test_evaluations = 0;
+		gpr_evaluate(&population, time_steps, 0,
+					 test_counted_evaluate_program);
+		assert(test_evaluations == 2);
+
+		/* the cache isn't used when reevaluating */
+		test_evaluations = 0;
+		gpr_evaluate(&population, time_steps, 1,
+					 test_counted_evaluate_program);
+		assert(test_evaluations == population_size);
+		assert(cache.hits + cache.misses == population_size*2 + 2);
+
+		gpr_free_fitness_cache(&cache);
+		gpr_free_population(&population);
+	}
+
+	printf("Ok\n");
+}
+
 static void test_gpr_environment()
 {
 	int result, i, n, max_population_size = 64;
@@ -1287,6 +2013,79 @@ static void test_gpr_environment()
 	printf("Ok\n");
 }
 
+/* returns non-zero if the two program trees are identical */
+static int programs_identical(gpr_function * f1, gpr_function * f2)
+{
+	int i;
+
+	if ((f1 == 0) || (f2 == 0)) return (f1 == f2);
+	if ((f1->function_type != f2->function_type) ||
+		(f1->value != f2->value) ||
+		(f1->argc != f2->argc)) {
+		return 0;
+	}
+	for (i = 0; i < f1->argc; i++) {
+		if (programs_identical(f1->argv[i], f2->argv[i]) == 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* checks that breeding gives the same result for any
+   number of threads */
+static void test_gpr_generation_threads()
+{
+	int i, t, gen, population_size = 200;
+	int max_depth=8, registers = 4;
+	gpr_population population[2];
+	float min_value = -5;
+	float max_value = 5;
+	unsigned int random_seed, fitness_seed;
+	int instruction_set[64], no_of_instructions=0;
+	int threads[] = { 1, 4 };
+	int max_threads = omp_get_max_threads();
+
+	printf("test_gpr_generation_threads...");
+
+	no_of_instructions =
+		gpr_default_instruction_set((int*)instruction_set);
+
+	for (t = 0; t < 2; t++) {
+		omp_set_num_threads(threads[t]);
+		random_seed = 7321;
+		fitness_seed = 2468;
+		gpr_init_population(&population[t], population_size,
+							registers, 3, 2,
+							max_depth, min_value, max_value,
+							0, 0, 0, 0,
+							&random_seed,
+							(int*)instruction_set,no_of_instructions);
+
+		for (gen = 0; gen < 5; gen++) {
+			for (i = 0; i < population_size; i++) {
+				population[t].fitness[i] =
+					(float)(rand_num(&fitness_seed)%1000);
+			}
+			gpr_generation(&population[t], 0.3f,
+						   max_depth, min_value, max_value,
+						   0.2f, 0.1f, 0, 0,
+						   (int*)instruction_set, no_of_instructions);
+		}
+	}
+	omp_set_num_threads(max_threads);
+
+	for (i = 0; i < population_size; i++) {
+		assert(programs_identical(&population[0].individual[i],
+								  &population[1].individual[i]));
+	}
+
+	gpr_free_population(&population[0]);
+	gpr_free_population(&population[1]);
+
+	printf("Ok\n");
+}
+
 static void test_gpr_generation_system()
 {
 	int population_per_island = 256;
@@ -1858,6 +2657,132 @@ static void test_gpr_save_load_system()
 	printf("Ok\n");
 }
 
+static void test_gpr_save_load_system_binary()
+{
+	int islands = 4;
+	int population_per_island = 64;
+	int i, j, k, retval, compress, max_depth=5;
+	gpr_system system1,system2;
+	gpr_population *population1,*population2;
+	gpr_state * state1, * state2;
+	float min_value = -5;
+	float max_value = 5;
+	char filename[128], str[256];
+	FILE * fp;
+	unsigned int random_seed = 123;
+	int integers_only = 0;
+	int ADFs = 1;
+	int sensors=10, actuators=5, registers=4;
+	int no_of_sensor_sources=160;
+	int no_of_actuator_destinations=72;
+	int instruction_set[64], no_of_instructions=0;
+	int data_size = 8, data_fields = 2;
+
+	printf("test_gpr_save_load_system_binary...");
+
+	/* create an instruction set */
+	no_of_instructions =
+		gpr_default_instruction_set((int*)instruction_set);
+	assert(no_of_instructions>0);
+
+	/* create a population */
+	gpr_init_system(&system1, islands, population_per_island,
+					registers, sensors, actuators,
+					max_depth, min_value, max_value,
+					integers_only, ADFs,
+					data_size, data_fields,
+					&random_seed,
+					(int*)instruction_set,no_of_instructions);
+
+	gpr_init_sensor_sources(&system1,
+							sensors,
+							no_of_sensor_sources,
+							&random_seed);
+
+	gpr_init_actuator_destinations(&system1,
+								   actuators,
+								   no_of_actuator_destinations,
+								   &random_seed);
+
+	system1.migration_tick=2;
+	for (j = 0; j < system1.size; j++) {
+		system1.fitness[j] = j*10;
+		for (i = 0; i < population_per_island; i++) {
+			system1.island[j].fitness[i] = i + (j*0.5f);
+		}
+	}
+
+	sprintf(filename,"%stestsystem.bin",GPR_TEMP_DIRECTORY);
+
+	for (compress = 0; compress <= 1; compress++) {
+		/* save to file */
+		fp = fopen(filename,"wb");
+		assert(fp!=0);
+		assert(gpr_save_system_binary(&system1,fp,compress)==0);
+		fclose(fp);
+
+		/* the wrong type of content should not load */
+		fp = fopen(filename,"rb");
+		assert(fp!=0);
+		assert(gpr_load_population_binary(&system1.island[0],fp) ==
+			   GPR_LOAD_BINARY_FORMAT);
+		fclose(fp);
+
+		/* load from file */
+		fp = fopen(filename,"rb");
+		assert(fp!=0);
+		retval = gpr_load_system_binary(&system2,fp,instruction_set,
+										no_of_instructions);
+		assert(retval==GPR_LOAD_OK);
+		fclose(fp);
+
+		assert(system1.size==system2.size);
+		assert(system1.migration_tick==system2.migration_tick);
+
+		/* check that the functions are the same */
+		for (j = 0; j < system1.size; j++) {
+			assert(system1.fitness[j]==system2.fitness[j]);
+			population1 = &system1.island[j];
+			population2 = &system2.island[j];
+			assert(population1->size==population2->size);
+			for (i = 0; i < population1->size; i++) {
+				assert(population1->fitness[i]==population2->fitness[i]);
+				retval = 0;
+				/* check the functions */
+				gpr_functions_are_equal(&population1->individual[i],
+										&population2->individual[i],
+										&retval);
+				assert (retval==0);
+				/* check the state */
+				state1 = &population1->state[i];
+				state2 = &population2->state[i];
+				assert(state2->ADF[0]!=0);
+				assert(state2->no_of_sensor_sources==no_of_sensor_sources);
+				assert(state2->no_of_actuator_destinations==
+					   no_of_actuator_destinations);
+				for (k = 0; k < sensors; k++) {
+					assert(state1->sensor_source[k]==
+						   state2->sensor_source[k]);
+				}
+				for (k = 0; k < actuators; k++) {
+					assert(state1->actuator_destination[k]==
+						   state2->actuator_destination[k]);
+				}
+			}
+		}
+		gpr_free_system(&system2);
+	}
+
+	/* free memory */
+	gpr_free_system(&system1);
+
+	/* delete the test file */
+	sprintf(str,"rm %s",filename);
+	retval = system(str);
+
+	printf("Ok\n");
+}
+
 void test_gpr_S_expression()
 {
 	gpr_function f;
@@ -1907,6 +2832,101 @@ void test_gpr_S_expression()
 	printf("Ok\n");
 }
 
+/* returns non-zero if any terminal within the tree has children */
+static int terminal_has_children(gpr_function * f)
+{
+	int i;
+
+	for (i = 0; i < GPR_MAX_ARGUMENTS; i++) {
+		if (f->argv[i] != 0) {
+			if ((f->function_type == GPR_FUNCTION_VALUE) ||
+				(f->function_type == GPR_FUNCTION_NONE)) {
+				return 1;
+			}
+			if (terminal_has_children(f->argv[i]) != 0) {
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+/* checks that program nodes are reused from the pool */
+static void test_gpr_pool()
+{
+	int i, itt, population_size = 50;
+	int max_depth=8, registers = 4;
+	int pool_size = 0;
+	gpr_population population;
+	gpr_function copies[50];
+	float min_value = -5;
+	float max_value = 5;
+	unsigned int random_seed = 623;
+	int integers_only = 0;
+	int instruction_set[64], no_of_instructions=0;
+
+	printf("test_gpr_pool...");
+
+	no_of_instructions =
+		gpr_default_instruction_set((int*)instruction_set);
+
+	for (itt = 0; itt < 2; itt++) {
+		gpr_init_population(&population, population_size,
+							registers, 1, 1,
+							max_depth, min_value, max_value,
+							integers_only, 0, 0, 0,
+							&random_seed,
+							(int*)instruction_set,no_of_instructions);
+
+		for (i = 0; i < population.size; i++) {
+			assert(terminal_has_children(&population.individual[i])==0);
+		}
+		assert(gpr_pool_size() > 0);
+		if (itt == 0) {
+			pool_size = gpr_pool_size();
+		}
+		else {
+			/* the same number of nodes should fit within
+			   the existing pool */
+			assert(gpr_pool_size() <= pool_size + GPR_POOL_SLAB_SIZE);
+		}
+
+		gpr_free_population(&population);
+	}
+
+	/* nodes freed on other threads are returned to the thread
+	   which allocated them, so the pool doesn't keep growing */
+	gpr_pool_release();
+	gpr_init_population(&population, population_size,
+						registers, 1, 1,
+						max_depth, min_value, max_value,
+						integers_only, 0, 0, 0,
+						&random_seed,
+						(int*)instruction_set,no_of_instructions);
+	for (itt = 0; itt < 5; itt++) {
+		for (i = 0; i < population.size; i++) {
+			gpr_copy(&population.individual[i], &copies[i]);
+		}
+		if (itt == 0) {
+			pool_size = gpr_pool_size();
+		}
+		else {
+			assert(gpr_pool_size() <= pool_size + GPR_POOL_SLAB_SIZE);
+		}
+
+#pragma omp parallel for num_threads(4)
+		for (i = 0; i < population.size; i++) {
+			gpr_free(&copies[i]);
+		}
+	}
+	gpr_free_population(&population);
+
+	gpr_pool_release();
+	assert(gpr_pool_size() == 0);
+
+	printf("Ok\n");
+}
+
 void test_gpr_data()
 {
 	gpr_data data;
@@ -1915,46 +2935,91 @@ void test_gpr_data()
 	unsigned int field = 1;
 	unsigned int i;
 	float real=0, imaginary=0;
+	float block[64];
 
 	printf("test_gpr_data...");
 
 	gpr_data_init(&data, size, fields);
 
+	/* the ring has a power of two capacity */
+	assert(data.capacity == 16);
+	assert(data.mask == 15);
+	assert(data.imaginary == &data.block[16*fields]);
+	assert(gpr_data_length(size, fields) == 16*fields*2);
+	assert(gpr_data_length(0, fields) == 0);
+
 	/* test pushes */
 	for (i = 0; i < size*2; i++) {
+		assert(data.head == (i & data.mask));
 		if (i < size) {
 			assert(data.tail==0);
-			assert(data.head==(unsigned short)i);
+			assert(gpr_data_entries(&data) == i);
 		}
 		else {
-			assert(data.head == (unsigned short)(i - size));
-			if (i < (size*2)-1) {
-				if (data.tail != (unsigned short)(i - size + 1)) {
-					printf("\nhead %d  tail %d\n",
-						   data.head, data.tail);
-				}
-				assert(data.tail == (unsigned short)(i - size + 1));
-			}
-			else {
-				assert(data.tail == (unsigned short)0);
+			/* holds at most size-1 entries */
+			assert(gpr_data_entries(&data) == size-1);
+			if (data.tail != ((i - size + 1) & data.mask)) {
+				printf("\nhead %d  tail %d\n",
+					   data.head, data.tail);
 			}
+			assert(data.tail == ((i - size + 1) & data.mask));
 		}
-		gpr_data_set_head(&data, field, (float)i, (float)i);
+		gpr_data_set_head(&data, field, (float)i, -(float)i);
 		gpr_data_push(&data);
 	}
 
 	for (i = 1; i < size-1; i++) {
 		gpr_data_get_elem(&data, i, field, &real, &imaginary);
 		assert((int)real == size+i+1);
+		assert((int)imaginary == -(int)(size+i+1));
 	}
 
-	for (i = 1; i < size; i++) {
+	/* index zero refers to the start of the block */
+	data.block[0] = 123;
+	gpr_data_get_elem(&data, 0, field, &real, &imaginary);
+	assert((int)real == 123);
+	data.block[0] = 0;
+
+	/* indexes beyond the number of entries wrap around */
+	gpr_data_get_elem(&data, size-1+2, field, &real, &imaginary);
+	assert((int)real == size+3);
+	gpr_data_set_elem(&data, size-1+2, field, 1000, 2000);
+	gpr_data_get_elem(&data, 2, field, &real, &imaginary);
+	assert((int)real == 1000);
+	assert((int)imaginary == 2000);
+	gpr_data_set_elem(&data, 2, field, size+3, -(float)(size+3));
+
+	/* also when the number of entries is a power of two */
+	gpr_data_pop(&data);
+	assert(gpr_data_entries(&data) == 8);
+	gpr_data_get_elem(&data, 8+2, field, &real, &imaginary);
+	assert((int)real == size+4);
+	gpr_data_get_elem(&data, 2, field, &real, &imaginary);
+	assert((int)real == size+4);
+
+	for (i = 2; i < size; i++) {
 		gpr_data_get_tail(&data, field, &real, &imaginary);
 		gpr_data_pop(&data);
 		assert((int)real == size+i);
 	}
+	/* the last entry remains */
+	assert(gpr_data_entries(&data) == 1);
 
     gpr_data_free(&data);
+	assert(data.block == 0);
+
+	/* using a block which belongs to the caller */
+	assert(gpr_data_length(8, 4) <= 64);
+	gpr_data_init_block(&data, 8, 4, block);
+	assert(data.capacity == 8);
+	assert(data.block == block);
+	assert(data.imaginary == &block[32]);
+	gpr_data_push(&data);
+	gpr_data_set_head(&data, 3, 5, 6);
+	assert(block[GPR_FIELD_POS(1,3,4)] == 5);
+	assert(block[32 + GPR_FIELD_POS(1,3,4)] == 6);
+	gpr_data_free(&data);
+	assert(data.block == block);
 
 	printf("Ok\n");
 }
@@ -1972,21 +3037,32 @@ int run_tests()
 	test_gpr_prune();
 	test_gpr_copy();
 	test_gpr_mutate();
+	test_gpr_index();
 	test_gpr_crossover();
 	test_gpr_mate();
 	test_gpr_run();
+	test_gpr_compile();
+	test_gpr_run_batch();
+	test_gpr_jit();
+	test_gpr_simplify();
+	test_gpr_rank();
 	test_gpr_sort();
+	test_gpr_selection();
 	test_gpr_sort_system();
 	test_gpr_init_state();
 	test_gpr_generation();
+	test_gpr_fitness_cache();
 	test_gpr_generation_system();
+	test_gpr_generation_threads();
 	test_gpr_dot();
 	test_gpr_save_load();
 	test_gpr_save_load_population();
 	test_gpr_save_load_system();
+	test_gpr_save_load_system_binary();
 	test_gpr_S_expression();
 	test_gpr_ADF_population();
 	test_gpr_environment();
+	test_gpr_pool();
 
 	printf("All tests completed\n");
 	return 1;
@@ -38,6 +38,8 @@
 #include <math.h>
 #include "globals.h"
 #include "gpr.h"
+#include "gpr_compiled.h"
+#include "gpr_jit.h"
 
 int run_tests();
 
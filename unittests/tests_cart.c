@@ -200,6 +200,382 @@ static void test_gprc_random()
 	printf("Ok\n");
 }
 
+/* reference implementation which repeatedly sweeps the grid
+   until no more used genes are found */
+static void reference_used_genes(gprc_ADF_module * f,
+								 int rows, int columns,
+								 int connections_per_gene,
+								 int sensors, int actuators,
+								 unsigned char * used)
+{
+	int index, c, connection_index, ctr, prev_ctr, n;
+	int min, max, function_type;
+	int gene_size = GPRC_GENE_SIZE(connections_per_gene);
+
+	memset((void*)used, '\0', sensors+actuators+(rows*columns));
+	for (index = 0; index < actuators; index++) {
+		used[sensors+(rows*columns)+index] = 1;
+	}
+
+	ctr = 0;
+	prev_ctr = -1;
+	while (ctr > prev_ctr) {
+		prev_ctr = ctr;
+		n = 0;
+		for (index = 0; index < rows*columns; index++, n += gene_size) {
+			if (used[index + sensors] == 0) continue;
+			function_type = (int)f->gene[n];
+			max = gprc_function_args(function_type,
+									 f->gene[n+GPRC_GENE_CONSTANT],
+									 connections_per_gene,
+									 (int)f->gene[n+GPRC_INITIAL]);
+			min = 0;
+			if (function_type == GPR_FUNCTION_ADF) {
+				min = 1;
+				max++;
+			}
+			for (c = min; c < max; c++) {
+				connection_index = (int)f->gene[n + GPRC_INITIAL + c];
+				if (used[connection_index] == 0) {
+					used[connection_index] = 1;
+					ctr++;
+				}
+			}
+		}
+		for (index = 0; index < actuators; index++, n++) {
+			connection_index = (int)f->gene[n];
+			if (used[connection_index] == 0) {
+				used[connection_index] = 1;
+				ctr++;
+			}
+		}
+	}
+}
+
+/* checks that tracing of used genes, and incremental updates
+   after a change, give the same result as a full sweep */
+static void test_gprc_used_genes()
+{
+	int population_size = 64;
+	int rows = 8, columns = 12, sensors = 4, actuators = 3;
+	int connections_per_gene = GPRC_MAX_ADF_MODULE_SENSORS+1;
+	int chromosomes = 2, modules = 0;
+	int gene_size = GPRC_GENE_SIZE(connections_per_gene);
+	float min_value = -5, max_value = 5;
+	gprc_population population;
+	gprc_function * f;
+	unsigned char used[256];
+	float previous[GPRC_GENE_SIZE((GPRC_MAX_ADF_MODULE_SENSORS+1))];
+	int i, j, index, changed, col, itt, c;
+	unsigned int random_seed = 8217;
+	int instruction_set[64], no_of_instructions=0;
+	int data_size = 8, data_fields = 2;
+	int no_of_states = sensors + actuators + (rows*columns);
+
+	printf("test_gprc_used_genes...");
+
+	no_of_instructions =
+		gprc_default_instruction_set((int*)instruction_set);
+
+	gprc_init_population(&population,
+						 population_size,
+						 rows, columns,
+						 sensors, actuators,
+						 connections_per_gene,
+						 modules, chromosomes,
+						 min_value, max_value,
+						 0, data_size, data_fields,
+						 &random_seed,
+						 instruction_set, no_of_instructions);
+
+	for (i = 0; i < population_size; i++) {
+		f = &population.individual[i];
+
+		reference_used_genes(&f->genome[0], rows, columns,
+							 connections_per_gene,
+							 sensors, actuators, used);
+		assert(memcmp((void*)used, (void*)f->genome[0].used,
+					  no_of_states)==0);
+
+		for (itt = 0; itt < 20; itt++) {
+			index = rand_num(&random_seed)%(rows*columns + actuators);
+			if (index >= rows*columns) {
+				/* change the source of an actuator */
+				j = rows*columns*gene_size + index - (rows*columns);
+				previous[0] = f->genome[0].gene[j];
+				f->genome[0].gene[j] =
+					sensors + rand_num(&random_seed)%(rows*columns);
+			}
+			else {
+				memcpy((void*)previous,
+					   (void*)&f->genome[0].gene[index*gene_size],
+					   gene_size*sizeof(float));
+				if (itt%3 == 0) {
+					/* change the function type of a random gene */
+					f->genome[0].gene[index*gene_size +
+									  GPRC_GENE_FUNCTION_TYPE] =
+						instruction_set[rand_num(&random_seed)%
+										no_of_instructions];
+				}
+				else {
+					/* change a connection of a random gene */
+					col = index / rows;
+					c = rand_num(&random_seed)%connections_per_gene;
+					f->genome[0].gene[index*gene_size +
+									  GPRC_INITIAL + c] =
+						rand_num(&random_seed)%(sensors + (col*rows));
+				}
+			}
+
+			changed =
+				gprc_used_genes_changed(f, 0, index, previous,
+										rows, columns,
+										connections_per_gene,
+										sensors, actuators);
+			if (changed == 0) {
+				/* the gene was unused, so it should remain so */
+				assert(f->genome[0].used[sensors+index] == 0);
+			}
+
+			reference_used_genes(&f->genome[0], rows, columns,
+								 connections_per_gene,
+								 sensors, actuators, used);
+			for (j = 0; j < no_of_states; j++) {
+				assert(used[j] == f->genome[0].used[j]);
+			}
+		}
+	}
+
+	/* mutation keeps the used genes up to date */
+	for (itt = 0; itt < 10; itt++) {
+		for (i = 0; i < population_size; i++) {
+			gprc_mate(&population.individual[i],
+					  &population.individual[(i+1)%population_size],
+					  rows, columns,
+					  sensors, actuators,
+					  connections_per_gene,
+					  min_value, max_value,
+					  0, 0.3f, itt%2, chromosomes,
+					  instruction_set, no_of_instructions, 0,
+					  &population.individual[(i+2)%population_size]);
+			f = &population.individual[(i+2)%population_size];
+			reference_used_genes(&f->genome[0], rows, columns,
+								 connections_per_gene,
+								 sensors, actuators, used);
+			for (j = 0; j < no_of_states; j++) {
+				assert(used[j] == f->genome[0].used[j]);
+			}
+		}
+	}
+
+	gprc_free_population(&population);
+
+	printf("Ok\n");
+}
+
+/* checks that changes to unused genes are detected as neutral */
+static void test_gprc_same_phenotype()
+{
+	int population_size = 64;
+	int rows = 8, columns = 12, sensors = 4, actuators = 3;
+	int connections_per_gene = GPRC_MAX_ADF_MODULE_SENSORS+1;
+	int chromosomes = 2, modules = 0;
+	int gene_size = GPRC_GENE_SIZE(connections_per_gene);
+	float min_value = -5, max_value = 5;
+	gprc_population population;
+	gprc_function * f1, * f2;
+	float previous[GPRC_GENE_SIZE((GPRC_MAX_ADF_MODULE_SENSORS+1))];
+	int i, gen, index, neutral = 0, non_neutral = 0;
+	unsigned int random_seed = 5213;
+	int instruction_set[64], no_of_instructions=0;
+	int data_size = 8, data_fields = 2;
+
+	printf("test_gprc_same_phenotype...");
+
+	no_of_instructions =
+		gprc_default_instruction_set((int*)instruction_set);
+
+	gprc_init_population(&population,
+						 population_size,
+						 rows, columns,
+						 sensors, actuators,
+						 connections_per_gene,
+						 modules, chromosomes,
+						 min_value, max_value,
+						 0, data_size, data_fields,
+						 &random_seed,
+						 instruction_set, no_of_instructions);
+
+	for (i = 0; i < population_size/2; i++) {
+		f1 = &population.individual[i];
+		f2 = &population.individual[population_size - 1 - i];
+		gprc_copy(f1, f2, rows, columns, connections_per_gene,
+				  sensors, actuators);
+		assert(gprc_same_phenotype(f1, f2, rows, columns,
+								   connections_per_gene,
+								   sensors, actuators) != 0);
+
+		/* change the constant of a random gene */
+		index = rand_num(&random_seed)%(rows*columns);
+		memcpy((void*)previous,
+			   (void*)&f2->genome[0].gene[index*gene_size],
+			   gene_size*sizeof(float));
+		f2->genome[0].gene[index*gene_size + GPRC_GENE_CONSTANT] += 1;
+		gprc_used_genes_changed(f2, 0, index, previous, rows, columns,
+								connections_per_gene,
+								sensors, actuators);
+		if (f1->genome[0].used[sensors + index] == 0) {
+			assert(gprc_same_phenotype(f1, f2, rows, columns,
+									   connections_per_gene,
+									   sensors, actuators) != 0);
+			neutral++;
+		}
+		else {
+			assert(gprc_same_phenotype(f1, f2, rows, columns,
+									   connections_per_gene,
+									   sensors, actuators) == 0);
+			non_neutral++;
+		}
+	}
+	assert(neutral > 0);
+	assert(non_neutral > 0);
+
+	/* neutral children inherit fitness during breeding */
+	for (gen = 0; gen < 5; gen++) {
+		for (i = 0; i < population_size; i++) {
+			population.fitness[i] = 1 + (float)(rand_num(&random_seed)%100);
+		}
+		gprc_generation(&population, 0.3f, 0.1f, 0,
+						&random_seed,
+						instruction_set, no_of_instructions);
+	}
+	assert(population.skipped_evaluations > 0);
+
+	/* sensor sources differ beyond the number of possible sources */
+	f1 = &population.individual[0];
+	f2 = &population.individual[1];
+	gprc_copy(f1, f2, rows, columns, connections_per_gene,
+			  sensors, actuators);
+	f1->no_of_sensor_sources = 2;
+	f2->no_of_sensor_sources = 2;
+	f1->sensor_source = (int*)malloc(sensors*sizeof(int));
+	f2->sensor_source = (int*)malloc(sensors*sizeof(int));
+	for (i = 0; i < sensors; i++) {
+		f1->sensor_source[i] = i%2;
+		f2->sensor_source[i] = i%2;
+	}
+	assert(gprc_same_phenotype(f1, f2, rows, columns,
+							   connections_per_gene,
+							   sensors, actuators) != 0);
+	f2->sensor_source[sensors-1] = 1 - f2->sensor_source[sensors-1];
+	assert(gprc_same_phenotype(f1, f2, rows, columns,
+							   connections_per_gene,
+							   sensors, actuators) == 0);
+
+	/* dynamic functions can change other genes while running,
+	   even when they are in an unused position */
+	gprc_copy(f1, f2, rows, columns, connections_per_gene,
+			  sensors, actuators);
+	for (index = 0; index < rows*columns; index++) {
+		if (f1->genome[0].used[sensors + index] == 0) break;
+	}
+	assert(index < rows*columns);
+	f1->genome[0].gene[index*gene_size + GPRC_GENE_FUNCTION_TYPE] =
+		GPR_FUNCTION_COPY_FUNCTION;
+	f2->genome[0].gene[index*gene_size + GPRC_GENE_FUNCTION_TYPE] =
+		GPR_FUNCTION_COPY_FUNCTION;
+	assert(gprc_same_phenotype(f1, f2, rows, columns,
+							   connections_per_gene,
+							   sensors, actuators) == 0);
+
+	/* hebbian genes change their weights while running */
+	gprc_copy(f1, f2, rows, columns, connections_per_gene,
+			  sensors, actuators);
+	f1->genome[0].gene[index*gene_size + GPRC_GENE_FUNCTION_TYPE] =
+		GPR_FUNCTION_VALUE;
+	f2->genome[0].gene[index*gene_size + GPRC_GENE_FUNCTION_TYPE] =
+		GPR_FUNCTION_VALUE;
+	assert(gprc_same_phenotype(f1, f2, rows, columns,
+							   connections_per_gene,
+							   sensors, actuators) != 0);
+	for (index = 0; index < rows*columns; index++) {
+		if (f1->genome[0].used[sensors + index] != 0) break;
+	}
+	assert(index < rows*columns);
+	f1->genome[0].gene[index*gene_size + GPRC_GENE_FUNCTION_TYPE] =
+		GPR_FUNCTION_HEBBIAN;
+	f2->genome[0].gene[index*gene_size + GPRC_GENE_FUNCTION_TYPE] =
+		GPR_FUNCTION_HEBBIAN;
+	assert(gprc_same_phenotype(f1, f2, rows, columns,
+							   connections_per_gene,
+							   sensors, actuators) == 0);
+
+	gprc_free_population(&population);
+
+	printf("Ok\n");
+}
+
+/* checks that the list of active genes matches the used genes */
+static void test_gprc_active_genes()
+{
+	int population_size = 64;
+	int rows = 8, columns = 12, sensors = 4, actuators = 3;
+	int connections_per_gene = GPRC_MAX_ADF_MODULE_SENSORS+1;
+	int chromosomes = 2, modules = 0;
+	float min_value = -5, max_value = 5;
+	gprc_population population;
+	gprc_ADF_module * genome;
+	int i, j, ctr;
+	unsigned int random_seed = 3421;
+	int instruction_set[64], no_of_instructions=0;
+	int data_size = 8, data_fields = 2;
+
+	printf("test_gprc_active_genes...");
+
+	no_of_instructions =
+		gprc_default_instruction_set((int*)instruction_set);
+
+	gprc_init_population(&population,
+						 population_size,
+						 rows, columns,
+						 sensors, actuators,
+						 connections_per_gene,
+						 modules, chromosomes,
+						 min_value, max_value,
+						 0, data_size, data_fields,
+						 &random_seed,
+						 instruction_set, no_of_instructions);
+
+	for (i = 0; i < population_size; i++) {
+		genome = &population.individual[i].genome[0];
+		assert(genome->active_valid != 0);
+
+		/* active genes are the used genes in grid order */
+		ctr = 0;
+		for (j = 0; j < rows*columns; j++) {
+			if (genome->used[sensors + j] != 0) {
+				assert(ctr < genome->no_of_active);
+				assert(genome->active[ctr] == j);
+				ctr++;
+			}
+			assert(genome->function_type[j] ==
+				   (int)genome->gene[j*GPRC_GENE_SIZE(connections_per_gene)]);
+		}
+		assert(ctr == genome->no_of_active);
+
+		/* the list is rebuilt when next run */
+		gprc_genome_changed(&population.individual[i]);
+		assert(genome->active_valid == 0);
+		gprc_run(&population.individual[i], &population, 0, 0, 0);
+		assert(genome->active_valid != 0);
+		assert(ctr == genome->no_of_active);
+	}
+
+	gprc_free_population(&population);
+
+	printf("Ok\n");
+}
+
 static void test_gprc_run()
 {
 	gprc_function f;
@@ -317,6 +693,250 @@ static void test_gprc_run()
 	printf("Ok\n");
 }
 
+/* checks that the real only version of the run function gives the
+   same result as the complex version when there are no imaginary
+   components */
+static void test_gprc_run_real()
+{
+	int population_size = 32;
+	int rows = 6, columns = 10, sensors = 4, actuators = 3;
+	int connections_per_gene = 4;
+	int chromosomes = 1, modules = 0;
+	int gene_size = GPRC_GENE_SIZE(connections_per_gene);
+	float min_value = -10, max_value = 10;
+	gprc_population population;
+	gprc_function * f;
+	float result[8];
+	int i, j, trial;
+	unsigned int random_seed = 6324;
+	int instruction_set[] = {
+		GPR_FUNCTION_VALUE, GPR_FUNCTION_ADD, GPR_FUNCTION_SUBTRACT,
+		GPR_FUNCTION_NEGATE, GPR_FUNCTION_MULTIPLY, GPR_FUNCTION_WEIGHT,
+		GPR_FUNCTION_MIN, GPR_FUNCTION_MAX, GPR_FUNCTION_AVERAGE,
+		GPR_FUNCTION_GREATER_THAN, GPR_FUNCTION_LESS_THAN,
+		GPR_FUNCTION_AND, GPR_FUNCTION_OR, GPR_FUNCTION_XOR,
+		GPR_FUNCTION_NOOP1
+	};
+	int no_of_instructions = 15;
+	int data_size = 0, data_fields = 0;
+
+	printf("test_gprc_run_real...");
+
+	gprc_init_population(&population,
+						 population_size,
+						 rows, columns,
+						 sensors, actuators,
+						 connections_per_gene,
+						 modules, chromosomes,
+						 min_value, max_value,
+						 0, data_size, data_fields,
+						 &random_seed,
+						 instruction_set, no_of_instructions);
+
+	for (i = 0; i < population_size; i++) {
+		f = &population.individual[i];
+
+		/* remove any imaginary constants */
+		for (j = 0; j < rows*columns; j++) {
+			f->genome[0].gene[j*gene_size + GPRC_GENE_IMAGINARY] = 0;
+		}
+
+		for (trial = 0; trial < 10; trial++) {
+			/* complex version */
+			population.real_only = 0;
+			gprc_clear_state(f, rows, columns, sensors, actuators);
+			for (j = 0; j < sensors; j++) {
+				gprc_set_sensor(f, j, (float)((j+1)*(trial+1)%17) - 8);
+			}
+			gprc_run(f, &population, 0, 0, 0);
+			for (j = 0; j < actuators; j++) {
+				result[j] = gprc_get_actuator(f, j, rows, columns,
+											  sensors);
+			}
+
+			/* real only version */
+			population.real_only = 1;
+			gprc_clear_state(f, rows, columns, sensors, actuators);
+			for (j = 0; j < sensors; j++) {
+				gprc_set_sensor(f, j, (float)((j+1)*(trial+1)%17) - 8);
+			}
+			gprc_run(f, &population, 0, 0, 0);
+			for (j = 0; j < actuators; j++) {
+				assert(result[j] ==
+					   gprc_get_actuator(f, j, rows, columns, sensors));
+			}
+		}
+	}
+
+	gprc_free_population(&population);
+
+	printf("Ok\n");
+}
+
+static void test_gprc_run_batch()
+{
+	int population_size = 32;
+	int rows = 6, columns = 10, sensors = 4, actuators = 3;
+	int connections_per_gene = 4;
+	int chromosomes = 1, modules = 0;
+	int gene_size = GPRC_GENE_SIZE(connections_per_gene);
+	float min_value = -10, max_value = 10;
+	gprc_population population;
+	gprc_function * f;
+	int no_of_samples = 150;
+	float sensor_values[4*150], actuator_values[3*150];
+	int i, j, s, real_only;
+	unsigned int random_seed = 8251;
+	int instruction_set[] = {
+		GPR_FUNCTION_VALUE, GPR_FUNCTION_ADD, GPR_FUNCTION_SUBTRACT,
+		GPR_FUNCTION_NEGATE, GPR_FUNCTION_MULTIPLY, GPR_FUNCTION_WEIGHT,
+		GPR_FUNCTION_MIN, GPR_FUNCTION_MAX, GPR_FUNCTION_AVERAGE,
+		GPR_FUNCTION_GREATER_THAN, GPR_FUNCTION_LESS_THAN,
+		GPR_FUNCTION_AND, GPR_FUNCTION_OR, GPR_FUNCTION_XOR,
+		GPR_FUNCTION_DIVIDE, GPR_FUNCTION_SIGMOID, GPR_FUNCTION_FLOOR,
+		GPR_FUNCTION_COPY_STATE
+	};
+	int no_of_instructions = 18;
+	int data_size = 0, data_fields = 0;
+
+	printf("test_gprc_run_batch...");
+
+	gprc_init_population(&population,
+						 population_size,
+						 rows, columns,
+						 sensors, actuators,
+						 connections_per_gene,
+						 modules, chromosomes,
+						 min_value, max_value,
+						 0, data_size, data_fields,
+						 &random_seed,
+						 instruction_set, no_of_instructions);
+
+	for (s = 0; s < no_of_samples; s++) {
+		for (j = 0; j < sensors; j++) {
+			sensor_values[j*no_of_samples + s] =
+				(float)((j+3)*(s+1)%23) - 11;
+		}
+	}
+
+	/* vector and scalar versions should give the same results */
+	for (real_only = 1; real_only >= 0; real_only--) {
+		population.real_only = real_only;
+		for (i = 0; i < population_size; i++) {
+			f = &population.individual[i];
+			for (j = 0; j < rows*columns; j++) {
+				f->genome[0].gene[j*gene_size + GPRC_GENE_IMAGINARY] = 0;
+			}
+
+			gprc_clear_state(f, rows, columns, sensors, actuators);
+			gprc_run_batch(f, &population, sensor_values, no_of_samples,
+						   actuator_values, 0, 0, 0);
+
+			/* the state should be left as it was after the last sample */
+			for (j = 0; j < actuators; j++) {
+				assert(actuator_values[j*no_of_samples + no_of_samples-1] ==
+					   gprc_get_actuator(f, j, rows, columns, sensors));
+			}
+
+			gprc_clear_state(f, rows, columns, sensors, actuators);
+			for (s = 0; s < no_of_samples; s++) {
+				for (j = 0; j < sensors; j++) {
+					gprc_set_sensor(f, j,
+									sensor_values[j*no_of_samples + s]);
+				}
+				gprc_run(f, &population, 0, 0, 0);
+				for (j = 0; j < actuators; j++) {
+					assert(actuator_values[j*no_of_samples + s] ==
+						   gprc_get_actuator(f, j, rows, columns,
+											 sensors));
+				}
+			}
+		}
+	}
+
+	gprc_free_population(&population);
+
+	printf("Ok\n");
+}
+
+static void test_gprc_jit()
+{
+	int population_size = 8;
+	int rows = 6, columns = 10, sensors = 4, actuators = 3;
+	int connections_per_gene = 4;
+	int chromosomes = 1, modules = 0;
+	float min_value = -10, max_value = 10;
+	gprc_population population;
+	gprc_function * f;
+	gpr_native program;
+	float result[3];
+	int i, j, trial, compiled = 0;
+	unsigned int random_seed = 1592;
+	int instruction_set[] = {
+		GPR_FUNCTION_VALUE, GPR_FUNCTION_ADD, GPR_FUNCTION_SUBTRACT,
+		GPR_FUNCTION_NEGATE, GPR_FUNCTION_MULTIPLY, GPR_FUNCTION_WEIGHT,
+		GPR_FUNCTION_MIN, GPR_FUNCTION_MAX, GPR_FUNCTION_AVERAGE,
+		GPR_FUNCTION_GREATER_THAN, GPR_FUNCTION_LESS_THAN,
+		GPR_FUNCTION_AND, GPR_FUNCTION_OR, GPR_FUNCTION_XOR,
+		GPR_FUNCTION_DIVIDE, GPR_FUNCTION_SIGMOID, GPR_FUNCTION_FLOOR,
+		GPR_FUNCTION_SINE, GPR_FUNCTION_SQUARE_ROOT, GPR_FUNCTION_POW
+	};
+	int no_of_instructions = 20;
+	int data_size = 0, data_fields = 0;
+
+	printf("test_gprc_jit...");
+
+	gprc_init_population(&population,
+						 population_size,
+						 rows, columns,
+						 sensors, actuators,
+						 connections_per_gene,
+						 modules, chromosomes,
+						 min_value, max_value,
+						 0, data_size, data_fields,
+						 &random_seed,
+						 instruction_set, no_of_instructions);
+
+	/* only real-only programs can be compiled */
+	assert(gprc_jit(&population.individual[0], &population,
+					&program) == GPR_JIT_NOT_SUPPORTED);
+	population.real_only = 1;
+
+	for (i = 0; i < population_size; i++) {
+		f = &population.individual[i];
+		if (gprc_jit(f, &population, &program) != GPR_JIT_OK) continue;
+		compiled++;
+
+		for (trial = 0; trial < 10; trial++) {
+			gprc_clear_state(f, rows, columns, sensors, actuators);
+			for (j = 0; j < sensors; j++) {
+				gprc_set_sensor(f, j, (float)((j+2)*(trial+1)%19) - 9);
+			}
+			gprc_run(f, &population, 0, 0, 0);
+			for (j = 0; j < actuators; j++) {
+				result[j] = gprc_get_actuator(f, j, rows, columns,
+											  sensors);
+			}
+
+			gprc_clear_state(f, rows, columns, sensors, actuators);
+			for (j = 0; j < sensors; j++) {
+				gprc_set_sensor(f, j, (float)((j+2)*(trial+1)%19) - 9);
+			}
+			gprc_run_native(&program, f);
+			for (j = 0; j < actuators; j++) {
+				assert(result[j] ==
+					   gprc_get_actuator(f, j, rows, columns, sensors));
+			}
+		}
+	}
+	assert(compiled > 0);
+
+	gprc_free_population(&population);
+	gpr_jit_release();
+
+	printf("Ok\n");
+}
+
 static void test_gprc_environment()
 {
 	int result, i, n, population_size = 32;
@@ -439,9 +1059,150 @@ static void test_gprc_environment()
 	printf("Ok\n");
 }
 
-static void test_gprc_run_dynamic()
+/* A test evaluation function for an environment.
+   This tests how close the output is to the equation y = 3x^2 + 2x - 5 */
+static float test_evaluate_environment(int time_steps,
+									   gprc_environment * population,
+									   int individual_index,
+									   int custom_command)
 {
-	gprc_function f,f2;
+	int t,x,i;
+	float result,fitness=0, reference;
+	gprc_function * f = &population->individual[individual_index];
+
+	for (t = 0; t < time_steps; t++) {
+		x = t+1;
+		for (i = 0; i < population->sensors; i++) {
+			gprc_set_sensor(f,i,x);
+		}
+		gprc_run_environment(f, population, 0, 0, 0);
+		result = gprc_get_actuator(f,0,
+								   population->rows,
+								   population->columns,
+								   population->sensors);
+		reference = (3*x*x) + (2*x) - 5;
+		if (fabs(result - reference)<100) {
+			fitness += 100 - fabs(result - reference);
+		}
+	}
+	return fitness / (float)time_steps;
+}
+
+static void test_gprc_steady_state()
+{
+	int i, retval, population_size = 64;
+	int rows=5, columns=10, sensors=1, actuators=1;
+	int connections_per_gene=GPRC_MAX_ADF_MODULE_SENSORS+1;
+	int chromosomes=2;
+	int modules=0;
+	float min_value=-5, max_value=5;
+	int integers_only=0;
+	unsigned int random_seed;
+	int instruction_set[64], no_of_instructions=0;
+	gprc_environment population, population2;
+	gprc_steady engine, engine2;
+	int data_size = 8, data_fields = 2;
+
+	printf("test_gprc_steady_state...");
+
+	no_of_instructions =
+		gprc_default_instruction_set((int*)instruction_set);
+
+	/* two identical environments */
+	random_seed = 123;
+	gprc_init_environment(&population,
+						  population_size, population_size,
+						  rows, columns, sensors, actuators,
+						  connections_per_gene, modules, chromosomes,
+						  min_value, max_value, integers_only,
+						  data_size, data_fields,
+						  &random_seed,
+						  instruction_set, no_of_instructions);
+	random_seed = 123;
+	gprc_init_environment(&population2,
+						  population_size, population_size,
+						  rows, columns, sensors, actuators,
+						  connections_per_gene, modules, chromosomes,
+						  min_value, max_value, integers_only,
+						  data_size, data_fields,
+						  &random_seed,
+						  instruction_set, no_of_instructions);
+
+	/* with a single thread the result should be repeatable */
+	gprc_steady_init(&engine, &population, 1, 4, 10, 0.3f, 1, 5678,
+					 instruction_set, no_of_instructions,
+					 test_evaluate_environment);
+	gprc_steady_init(&engine2, &population2, 1, 4, 10, 0.3f, 1, 5678,
+					 instruction_set, no_of_instructions,
+					 test_evaluate_environment);
+	assert(engine.threads == 1);
+	assert(engine.tournament_size == 4);
+	assert(gprc_steady_best(&engine) == -1);
+
+	gprc_steady_run(&engine, 500);
+	gprc_steady_run(&engine, 500);
+	gprc_steady_run(&engine2, 500);
+	gprc_steady_run(&engine2, 500);
+	assert(engine.evaluations == 1000);
+	assert(engine.replacements > 0);
+	assert(engine.replacements == engine2.replacements);
+	assert(gprc_steady_best(&engine) >= 0);
+	assert(gprc_steady_best(&engine) == gprc_steady_best(&engine2));
+
+	for (i = 0; i < population_size; i++) {
+		assert(engine.evaluated[i] == engine2.evaluated[i]);
+		assert(engine.fitness[i] == engine2.fitness[i]);
+		assert(gprc_functions_are_equal(&population.individual[i],
+										&population2.individual[i],
+										rows, columns,
+										connections_per_gene,
+										modules, sensors) == 0);
+	}
+	gprc_steady_free(&engine2);
+	gprc_free_environment(&population2);
+
+	/* continue with several threads */
+	gprc_steady_free(&engine);
+	gprc_steady_init(&engine, &population, 4, 4, 10, 0.3f, 1, 5678,
+					 instruction_set, no_of_instructions,
+					 test_evaluate_environment);
+	assert(engine.threads == 4);
+	gprc_steady_run(&engine, 2000);
+	assert(engine.evaluations == 2000);
+	assert(engine.replacements > 0);
+	assert(gprc_steady_best(&engine) >= 0);
+	assert(population.population_size == population_size);
+
+	for (i = 0; i < population_size; i++) {
+		retval = gprc_validate(&population.individual[i],
+							   rows, columns,
+							   sensors, actuators,
+							   connections_per_gene,
+							   integers_only,
+							   instruction_set,
+							   no_of_instructions);
+		assert(retval == GPR_VALIDATE_OK);
+		assert(pthread_mutex_trylock(&engine.slot_lock[i]) == 0);
+		pthread_mutex_unlock(&engine.slot_lock[i]);
+	}
+
+	/* too many threads for the number of slots */
+	gprc_steady_free(&engine);
+	gprc_steady_init(&engine, &population, 100, 1, 10, 0.3f, 1, 5678,
+					 instruction_set, no_of_instructions,
+					 test_evaluate_environment);
+	assert(engine.tournament_size == GPRC_STEADY_TOURNAMENT_SIZE);
+	assert(engine.threads == population_size/engine.tournament_size);
+
+	gprc_steady_free(&engine);
+	gprc_free_environment(&population);
+
+	printf("Ok\n");
+}
+
+static void test_gprc_run_dynamic()
+{
+	gprc_function f,f2;
 	int rows=20, columns=20, sensors=8, actuators=8;
 	int connections_per_gene=2, tick, i, j, ctr, trial;
 	int chromosomes=2;
@@ -1102,6 +1863,50 @@ static float test_evaluate_program(int time_steps,
 	return fitness;
 }
 
+/* returns a fitness value for the given errors */
+static float test_fitness_from_errors(float * errors, int cases)
+{
+	int t;
+	float fitness = 0;
+
+	for (t = 0; t < cases; t++) {
+		if (errors[t] < 100) {
+			fitness += 100 - errors[t];
+		}
+	}
+	return fitness / (float)cases;
+}
+
+/* A test evaluation function which also records the error
+   at each time step, so that each time step is a test case.
+   This tests how close the output is to the equation y = 3x^2 + 2x - 5 */
+static float test_evaluate_program_cases(int time_steps,
+										 gprc_population * population,
+										 int individual_index,
+										 int custom_command,
+										 float * errors)
+{
+	int t,x,i;
+	float result, reference;
+	gprc_function * f = &population->individual[individual_index];
+
+	/* for each time step */
+	for (t = 0; t < time_steps; t++) {
+		x = t+1;
+		for (i = 0; i < population->sensors; i++) {
+			gprc_set_sensor(f,i,x);
+		}
+		gprc_run(f, population, 0, 0, 0);
+		result = gprc_get_actuator(f,0,
+								   population->rows,
+								   population->columns,
+								   population->sensors);
+		reference = (3*x*x) + (2*x) - 5;
+		errors[t] = fabs(result - reference);
+	}
+	return test_fitness_from_errors(errors, time_steps);
+}
+
 static void test_gprc_mate()
 {
 	gprc_function parent1, parent2, child;
@@ -1174,72 +1979,373 @@ static void test_gprc_mate()
 	show_validation_message(retval);
 	assert(retval==GPR_VALIDATE_OK);
 
-	/* produce child */
-	gprc_mate(&parent1, &parent2,
-			  rows, columns,
-			  sensors, actuators,
-			  connections_per_gene,
-			  min_value, max_value,
-			  integers_only,
-			  mutation_prob, 1,
-			  chromosomes,
-			  instruction_set, no_of_instructions,
-			  1, &child);
+	/* produce child */
+	gprc_mate(&parent1, &parent2,
+			  rows, columns,
+			  sensors, actuators,
+			  connections_per_gene,
+			  min_value, max_value,
+			  integers_only,
+			  mutation_prob, 1,
+			  chromosomes,
+			  instruction_set, no_of_instructions,
+			  1, &child);
+
+	/* validate the child */
+	retval = gprc_validate(&child, rows, columns,
+						   sensors, actuators,
+						   connections_per_gene,
+						   integers_only,
+						   instruction_set,
+						   no_of_instructions);
+	show_validation_message(retval);
+	assert(retval==GPR_VALIDATE_OK);
+
+	/* free memory */
+	gprc_free(&parent1);
+	gprc_free(&parent2);
+	gprc_free(&child);
+
+	printf("Ok\n");
+}
+
+static void test_gprc_generation()
+{
+	int population_size = 512;
+	int rows = 6, columns = 10, sensors = 5, actuators = 3;
+	int connections_per_gene = GPRC_MAX_ADF_MODULE_SENSORS+1;
+	int chromosomes = 2;
+	int modules=1;
+	float min_value = -5, max_value = 5;
+	gprc_population population;
+	float elitism = 0.3f;
+	float mutation_prob = 0.5f;
+	int retval, i, gen, time_steps = 10;
+	int integers_only;
+	int use_crossover = 1;
+	unsigned int random_seed = 123;
+	char dot_filename[128];
+	FILE * fp;
+	int instruction_set[64], no_of_instructions=0;
+	char * sensor_names[] = {
+		"Sensor 0", "Sensor 1", "Sensor 2", "Sensor 3", "Sensor 4"
+	};
+	char * actuator_names[] = {
+		"Actuator 0", "Actuator 1", "Actuator 2"
+	};
+	char command_str[256];
+	int data_size = 8, data_fields = 2;
+
+	printf("test_gprc_generation...");
+
+	/* create an instruction set */
+	no_of_instructions =
+		gprc_default_instruction_set((int*)instruction_set);
+	assert(no_of_instructions>0);
+
+	for (integers_only = 0; integers_only < 2; integers_only++) {
+		/* create a population */
+		gprc_init_population(&population,
+							 population_size,
+							 rows, columns,
+							 sensors, actuators,
+							 connections_per_gene,
+							 modules,
+							 chromosomes,
+							 min_value, max_value,
+							 integers_only,
+							 data_size, data_fields,
+							 &random_seed,
+							 instruction_set, no_of_instructions);
+
+		/* validate the individuals */
+		for (i = 0; i < population_size; i++) {
+			retval =
+				gprc_validate(&population.individual[i],
+							  rows, columns,
+							  sensors, actuators,
+							  connections_per_gene,
+							  integers_only,
+							  instruction_set,
+							  no_of_instructions);
+			show_validation_message(retval);
+			assert(retval==GPR_VALIDATE_OK);
+		}
+
+		for (gen = 0; gen < 20; gen++) {
+
+			/* evaluate each individual */
+			gprc_evaluate(&population,
+						  time_steps,0,
+						  (*test_evaluate_program));
+
+			/* produce the next generation */
+			gprc_generation(&population,
+							elitism,
+							mutation_prob,
+							use_crossover,
+							&random_seed,
+							instruction_set, no_of_instructions);
+
+			/* validate the individuals */
+			for (i = 0; i < population_size; i++) {
+				retval = gprc_validate(&population.individual[i],
+									   rows, columns,
+									   sensors, actuators,
+									   connections_per_gene,
+									   integers_only,
+									   instruction_set,
+									   no_of_instructions);
+				show_validation_message(retval);
+				assert(retval==GPR_VALIDATE_OK);
+
+			}
+
+		}
+
+		assert(population.history.index == gen);
+
+		/* validate the best individual */
+		retval = gprc_validate(gprc_best_individual(&population),
+							   rows, columns,
+							   sensors, actuators,
+							   connections_per_gene,
+							   integers_only,
+							   instruction_set,
+							   no_of_instructions);
+		show_validation_message(retval);
+		assert(retval==GPR_VALIDATE_OK);
+
+		/* save a dot file for the best individual */
+		sprintf(dot_filename,"%slibgpr_fittest.dot",GPR_TEMP_DIRECTORY);
+		fp = fopen(dot_filename,"w");
+		assert(fp);
+		gprc_dot(gprc_best_individual(&population), &population,
+				 sensor_names, actuator_names,
+				 fp);
+		fclose(fp);
+		sprintf(command_str,"rm %s",dot_filename);
+		assert(system(command_str)==0);
+
+		/* free memory */
+		gprc_free_population(&population);
+
+	}
+
+	printf("Ok\n");
+}
+
+/* checks that breeding gives the same result for any
+   number of threads */
+static void test_gprc_generation_threads()
+{
+	int population_size = 256;
+	int rows = 6, columns = 10, sensors = 5, actuators = 3;
+	int connections_per_gene = GPRC_MAX_ADF_MODULE_SENSORS+1;
+	int chromosomes = 2;
+	int modules = 0;
+	float min_value = -5, max_value = 5;
+	gprc_population population[2];
+	int i, t, gen, genes;
+	unsigned int random_seed, fitness_seed;
+	int instruction_set[64], no_of_instructions=0;
+	int data_size = 8, data_fields = 2;
+	int threads[] = { 1, 4 };
+	int max_threads = omp_get_max_threads();
+
+	printf("test_gprc_generation_threads...");
+
+	no_of_instructions =
+		gprc_default_instruction_set((int*)instruction_set);
+
+	for (t = 0; t < 2; t++) {
+		omp_set_num_threads(threads[t]);
+		random_seed = 4123;
+		fitness_seed = 9876;
+		gprc_init_population(&population[t],
+							 population_size,
+							 rows, columns,
+							 sensors, actuators,
+							 connections_per_gene,
+							 modules,
+							 chromosomes,
+							 min_value, max_value,
+							 0,
+							 data_size, data_fields,
+							 &random_seed,
+							 instruction_set, no_of_instructions);
+
+		for (gen = 0; gen < 5; gen++) {
+			for (i = 0; i < population_size; i++) {
+				population[t].fitness[i] =
+					(float)(rand_num(&fitness_seed)%1000);
+			}
+			gprc_generation(&population[t], 0.3f, 0.2f, 1,
+							&random_seed,
+							instruction_set, no_of_instructions);
+		}
+	}
+	omp_set_num_threads(max_threads);
+
+	genes = rows*columns*GPRC_GENE_SIZE(connections_per_gene) + actuators;
+	for (i = 0; i < population_size; i++) {
+		assert(memcmp((void*)population[0].individual[i].genome[0].gene,
+					  (void*)population[1].individual[i].genome[0].gene,
+					  genes*sizeof(float))==0);
+	}
+
+	gprc_free_population(&population[0]);
+	gprc_free_population(&population[1]);
+
+	printf("Ok\n");
+}
+
+static void test_gprc_generation_double_buffer()
+{
+	int population_size = 64;
+	int rows = 6, columns = 10, sensors = 5, actuators = 3;
+	int connections_per_gene = GPRC_MAX_ADF_MODULE_SENSORS+1;
+	int chromosomes = 2;
+	int m, modules = 1;
+	float min_value = -5, max_value = 5;
+	float elitism = 0.3f;
+	gprc_system system;
+	gprc_population * population;
+	gprc_function * f;
+	float * survivor, * arena_start, * arena_end;
+	int i, j, gen, threshold, genome_length;
+	int no_of_sensor_sources = 20;
+	unsigned int random_seed = 123;
+	int instruction_set[64], no_of_instructions=0;
+	int data_size = 8, data_fields = 2;
+
+	printf("test_gprc_generation_double_buffer...");
+
+	no_of_instructions =
+		gprc_default_instruction_set((int*)instruction_set);
+
+	gprc_init_system(&system, 1,
+					 population_size,
+					 rows, columns,
+					 sensors, actuators,
+					 connections_per_gene,
+					 modules,
+					 chromosomes,
+					 min_value, max_value,
+					 0,
+					 data_size, data_fields,
+					 &random_seed,
+					 instruction_set, no_of_instructions);
+	gprc_init_sensor_sources(&system,
+							 no_of_sensor_sources,
+							 &random_seed);
+	population = &system.island[0];
+
+	genome_length = 0;
+	for (m = 0; m < modules+1; m++) {
+		genome_length +=
+			(rows*columns*GPRC_GENE_SIZE(connections_per_gene)) +
+			gprc_get_actuators(m,actuators);
+	}
+	arena_start = (float*)population->slab;
+	arena_end = (float*)&population->slab[population_size*2*
+										  population->slab_stride];
+
+	threshold = (int)((1.0f - elitism)*(population_size-1));
+	survivor = (float*)malloc(threshold*genome_length*sizeof(float));
+	assert(survivor!=0);
+
+	for (gen = 0; gen < 4; gen++) {
+		/* give every individual a different fitness */
+		for (i = 0; i < population_size; i++) {
+			population->fitness[i] = 1 + i;
+		}
+
+		/* store the genomes of the fittest individuals */
+		gprc_sort(population);
+		for (i = 0; i < threshold; i++) {
+			f = &population->individual[i];
+			memcpy((void*)&survivor[i*genome_length],
+				   (void*)f->genome[0].gene,
+				   ((rows*columns*GPRC_GENE_SIZE(connections_per_gene))+
+					actuators)*sizeof(float));
+		}
+
+		gprc_generation(population, elitism, 0.5f, 1,
+						&random_seed,
+						instruction_set, no_of_instructions);
+
+		/* the fittest individuals should survive unchanged */
+		for (i = 0; i < threshold; i++) {
+			f = &population->individual[i];
+			for (j = 0;
+				 j < (rows*columns*GPRC_GENE_SIZE(connections_per_gene))+
+					 actuators; j++) {
+				assert(f->genome[0].gene[j] ==
+					   survivor[i*genome_length + j]);
+			}
+		}
 
-	/* validate the child */
-	retval = gprc_validate(&child, rows, columns,
-						   sensors, actuators,
-						   connections_per_gene,
-						   integers_only,
-						   instruction_set,
-						   no_of_instructions);
-	show_validation_message(retval);
-	assert(retval==GPR_VALIDATE_OK);
+		for (i = 0; i < population_size; i++) {
+			f = &population->individual[i];
+			/* arrays should be aligned within the slab */
+			for (m = 0; m < modules+1; m++) {
+				assert(f->genome[m].gene >= arena_start);
+				assert(f->genome[m].gene < arena_end);
+				assert((size_t)f->genome[m].gene %
+					   GPRC_SLAB_ALIGNMENT == 0);
+				assert(f->genome[m].state >= arena_start);
+				assert(f->genome[m].state < arena_end);
+				assert((size_t)f->genome[m].state %
+					   GPRC_SLAB_ALIGNMENT == 0);
+				assert((float*)f->genome[m].used >= arena_start);
+				assert((float*)f->genome[m].used < arena_end);
+			}
+			assert(f->data.block >= arena_start);
+			assert(f->data.block < arena_end);
+			/* children should have sensor sources */
+			assert(f->no_of_sensor_sources == no_of_sensor_sources);
+			assert(f->sensor_source != 0);
+			for (j = 0; j < sensors; j++) {
+				assert(f->sensor_source[j] >= 0);
+				assert(f->sensor_source[j] < no_of_sensor_sources);
+			}
+			/* no individual should share its genes with another */
+			for (j = i+1; j < population_size; j++) {
+				assert(f->genome[0].gene !=
+					   population->individual[j].genome[0].gene);
+			}
+		}
+	}
 
-	/* free memory */
-	gprc_free(&parent1);
-	gprc_free(&parent2);
-	gprc_free(&child);
+	free(survivor);
+	gprc_free_system(&system);
 
 	printf("Ok\n");
 }
 
-static void test_gprc_generation()
+static void test_gprc_generation_lexicase()
 {
-	int population_size = 512;
-	int rows = 6, columns = 10, sensors = 5, actuators = 3;
+	int population_size = 64;
+	int rows = 5, columns = 10, sensors = 1, actuators = 1;
 	int connections_per_gene = GPRC_MAX_ADF_MODULE_SENSORS+1;
 	int chromosomes = 2;
-	int modules=1;
+	int modules = 0;
 	float min_value = -5, max_value = 5;
-	gprc_population population;
 	float elitism = 0.3f;
-	float mutation_prob = 0.5f;
-	int retval, i, gen, time_steps = 10;
-	int integers_only;
-	int use_crossover = 1;
+	gprc_population population;
+	int i, gen, method, retval, time_steps = 10;
 	unsigned int random_seed = 123;
-	char dot_filename[128];
-	FILE * fp;
 	int instruction_set[64], no_of_instructions=0;
-	char * sensor_names[] = {
-		"Sensor 0", "Sensor 1", "Sensor 2", "Sensor 3", "Sensor 4"
-	};
-	char * actuator_names[] = {
-		"Actuator 0", "Actuator 1", "Actuator 2"
-	};
-	char command_str[256];
 	int data_size = 8, data_fields = 2;
 
-	printf("test_gprc_generation...");
+	printf("test_gprc_generation_lexicase...");
 
-	/* create an instruction set */
 	no_of_instructions =
 		gprc_default_instruction_set((int*)instruction_set);
-	assert(no_of_instructions>0);
 
-	for (integers_only = 0; integers_only < 2; integers_only++) {
-		/* create a population */
+	for (method = GPR_SELECTION_TOURNAMENT;
+		 method <= GPR_SELECTION_LEXICASE; method++) {
 		gprc_init_population(&population,
 							 population_size,
 							 rows, columns,
@@ -1248,83 +2354,55 @@ static void test_gprc_generation()
 							 modules,
 							 chromosomes,
 							 min_value, max_value,
-							 integers_only,
+							 0,
 							 data_size, data_fields,
 							 &random_seed,
 							 instruction_set, no_of_instructions);
+		gpr_selection_set(&population.selection, method, 0);
+		assert(population.selection.method == method);
+		assert(population.selection.tournament_size ==
+			   GPR_DEFAULT_TOURNAMENT_SIZE);
 
-		/* validate the individuals */
-		for (i = 0; i < population_size; i++) {
-			retval =
-				gprc_validate(&population.individual[i],
-							  rows, columns,
-							  sensors, actuators,
-							  connections_per_gene,
-							  integers_only,
-							  instruction_set,
-							  no_of_instructions);
-			show_validation_message(retval);
-			assert(retval==GPR_VALIDATE_OK);
-		}
-
-		for (gen = 0; gen < 20; gen++) {
+		for (gen = 0; gen < 8; gen++) {
+			gprc_evaluate_cases(&population, time_steps, 0, time_steps,
+								test_evaluate_program_cases);
 
-			/* evaluate each individual */
-			gprc_evaluate(&population,
-						  time_steps,0,
-						  (*test_evaluate_program));
+			/* the errors should belong to the same individual
+			   as the fitness */
+			for (i = 0; i < population_size; i++) {
+				if (population.fitness[i] == 0) continue;
+				assert(population.fitness[i] ==
+					   test_fitness_from_errors(
+						   gpr_selection_errors(&population.selection,i),
+						   time_steps));
+			}
 
-			/* produce the next generation */
-			gprc_generation(&population,
-							elitism,
-							mutation_prob,
-							use_crossover,
+			gprc_generation(&population, elitism, 0.5f, 1,
 							&random_seed,
 							instruction_set, no_of_instructions);
 
-			/* validate the individuals */
+			/* the fittest individual should be first */
+			for (i = 1; i < population_size; i++) {
+				assert(population.fitness[0] >= population.fitness[i]);
+			}
+
 			for (i = 0; i < population_size; i++) {
 				retval = gprc_validate(&population.individual[i],
 									   rows, columns,
 									   sensors, actuators,
 									   connections_per_gene,
-									   integers_only,
+									   0,
 									   instruction_set,
 									   no_of_instructions);
-				show_validation_message(retval);
-				assert(retval==GPR_VALIDATE_OK);
-
+				assert(retval == GPR_VALIDATE_OK);
+				if (population.fitness[i] == 0) continue;
+				assert(population.fitness[i] ==
+					   test_fitness_from_errors(
+						   gpr_selection_errors(&population.selection,i),
+						   time_steps));
 			}
-
 		}
-
-		assert(population.history.index == gen);
-
-		/* validate the best individual */
-		retval = gprc_validate(gprc_best_individual(&population),
-							   rows, columns,
-							   sensors, actuators,
-							   connections_per_gene,
-							   integers_only,
-							   instruction_set,
-							   no_of_instructions);
-		show_validation_message(retval);
-		assert(retval==GPR_VALIDATE_OK);
-
-		/* save a dot file for the best individual */
-		sprintf(dot_filename,"%slibgpr_fittest.dot",GPR_TEMP_DIRECTORY);
-		fp = fopen(dot_filename,"w");
-		assert(fp);
-		gprc_dot(gprc_best_individual(&population), &population,
-				 sensor_names, actuator_names,
-				 fp);
-		fclose(fp);
-		sprintf(command_str,"rm %s",dot_filename);
-		assert(system(command_str)==0);
-
-		/* free memory */
 		gprc_free_population(&population);
-
 	}
 
 	printf("Ok\n");
@@ -1462,6 +2540,15 @@ static void test_gprc_save_load()
 						 &random_seed,
 						 instruction_set, no_of_instructions);
 
+	/* put something into the data stores */
+	for (i = 0; i < population.size; i++) {
+		for (j = 0; j < data_size-1; j++) {
+			gpr_data_set_head(&population.individual[i].data,
+							  1, i+j, -j);
+			gpr_data_push(&population.individual[i].data);
+		}
+	}
+
 	sprintf(filename,"%stestpopulation.dat",GPR_TEMP_DIRECTORY);
 
 	/* save to file */
@@ -1508,6 +2595,10 @@ static void test_gprc_save_load()
 		assert(f1->random_seed == f2->random_seed);
 		assert(f1->data.size == f2->data.size);
 		assert(f1->data.fields == f2->data.fields);
+		for (j = 0; j < data_size*data_fields; j++) {
+			assert(f1->data.block[j] == f2->data.block[j]);
+			assert(f1->data.imaginary[j] == f2->data.imaginary[j]);
+		}
 		for (j = 0;
 			 j < (rows*columns) + sensors + actuators; j++) {
 			if (f1->genome[0].used[j] != f2->genome[0].used[j]) {
@@ -1659,6 +2750,261 @@ static void test_gprc_save_load_system()
 	printf("Ok\n");
 }
 
+static void test_gprc_save_load_system_binary()
+{
+	int islands=4;
+	gprc_system system, system2;
+	gprc_population *p1, *p2;
+	gprc_function *f1, *f2;
+	int population_per_island = 64;
+	int rows = 20, columns = 40, sensors = 5, actuators = 5;
+	int connections_per_gene = 2;
+	int chromosomes=2;
+	int m,modules=1;
+	float min_value = -5, max_value = 5;
+	int integers_only = 0, i, j, k, compress, retval;
+	char filename[256];
+	FILE * fp;
+	unsigned int random_seed = 123;
+	int no_of_sensor_sources = 120;
+	int no_of_actuator_destinations = 64;
+	int instruction_set[64], no_of_instructions=0;
+	int data_size = 8, data_fields = 2;
+
+	printf("test_gprc_save_load_system_binary...");
+
+	/* create an instruction set */
+	no_of_instructions =
+		gprc_default_instruction_set((int*)instruction_set);
+	assert(no_of_instructions>0);
+
+	/* create a population */
+	gprc_init_system(&system,islands,
+					 population_per_island,
+					 rows, columns,
+					 sensors, actuators,
+					 connections_per_gene,
+					 modules,
+					 chromosomes,
+					 min_value, max_value,
+					 integers_only,
+					 data_size, data_fields,
+					 &random_seed,
+					 instruction_set, no_of_instructions);
+
+	gprc_init_sensor_sources(&system,
+							 no_of_sensor_sources,
+							 &random_seed);
+	gprc_init_actuator_destinations(&system,
+									no_of_actuator_destinations,
+									&random_seed);
+	system.migration_tick=2;
+
+	/* put something into the data stores and fitness values */
+	for (i = 0; i < islands; i++) {
+		p1 = &system.island[i];
+		system.fitness[i] = i*10;
+		for (k = 0; k < p1->size; k++) {
+			p1->fitness[k] = k + (i*0.5f);
+			for (j = 0; j < data_size; j++) {
+				gpr_data_set_elem(&p1->individual[k].data,
+								  j, 1, j+k, -j);
+			}
+			gpr_data_push(&p1->individual[k].data);
+		}
+	}
+
+	sprintf(filename,"%stestsystem.bin",GPR_TEMP_DIRECTORY);
+
+	for (compress = 0; compress <= 1; compress++) {
+		/* save to file */
+		fp  = fopen(filename,"wb");
+		assert(fp!=0);
+		assert(gprc_save_system_binary(&system,fp,compress)==0);
+		fclose(fp);
+
+		/* load from file */
+		fp  = fopen(filename,"rb");
+		assert(fp!=0);
+		retval = gprc_load_system_binary(&system2,fp,
+										 instruction_set,
+										 no_of_instructions);
+		assert(retval==GPR_LOAD_OK);
+		fclose(fp);
+
+		/* check system parameters */
+		assert(system.size==system2.size);
+		assert(system.migration_tick==system2.migration_tick);
+
+		/* check that populations are the same */
+		for (i = 0; i < islands; i++) {
+			p1 = &system.island[i];
+			p2 = &system2.island[i];
+			assert(system.fitness[i]==system2.fitness[i]);
+			assert(p1->size==p2->size);
+			assert(p1->history.index==p2->history.index);
+
+			for (k = 0; k < p1->size; k++) {
+				f1 = &p1->individual[k];
+				f2 = &p2->individual[k];
+				assert(p1->fitness[k]==p2->fitness[k]);
+
+				for (m = 0; m < modules+1; m++) {
+					for (j = 0;
+						 j < (rows*columns*
+							  GPRC_GENE_SIZE(connections_per_gene))+
+							 gprc_get_actuators(m,actuators); j++) {
+						assert(f1->genome[m].gene[j] ==
+							   f2->genome[m].gene[j]);
+					}
+					for (j = 0;
+						 j < (rows*columns) +
+							 gprc_get_sensors(m,sensors) +
+							 gprc_get_actuators(m,actuators); j++) {
+						assert(f1->genome[m].used[j] ==
+							   f2->genome[m].used[j]);
+					}
+				}
+				assert(f1->random_seed == f2->random_seed);
+				assert(f1->age == f2->age);
+				assert(f1->no_of_sensor_sources ==
+					   f2->no_of_sensor_sources);
+				assert(f1->no_of_actuator_destinations ==
+					   f2->no_of_actuator_destinations);
+				for (j = 0; j < sensors; j++) {
+					assert(f1->sensor_source[j] == f2->sensor_source[j]);
+				}
+				for (j = 0; j < actuators; j++) {
+					assert(f1->actuator_destination[j] ==
+						   f2->actuator_destination[j]);
+				}
+
+				/* check the data store */
+				assert(f1->data.size == f2->data.size);
+				assert(f1->data.fields == f2->data.fields);
+				assert(f1->data.head == f2->data.head);
+				assert(f1->data.tail == f2->data.tail);
+				for (j = 0; j < data_size*data_fields*2; j++) {
+					assert(f1->data.block[j] == f2->data.block[j]);
+				}
+			}
+		}
+		gprc_free_system(&system2);
+	}
+
+	gprc_free_system(&system);
+
+	printf("Ok\n");
+}
+
+static void test_gprc_checkpoint()
+{
+	int islands=2;
+	gprc_system system, system2;
+	gprc_population *p1, *p2;
+	gpr_checkpoint checkpoint;
+	int population_per_island = 64;
+	int rows = 10, columns = 20, sensors = 5, actuators = 5;
+	int connections_per_gene = 2;
+	int chromosomes=2;
+	int m,modules=1;
+	float min_value = -5, max_value = 5;
+	int integers_only = 0, i, j, k, compress, retval;
+	char filename[256];
+	FILE * fp;
+	unsigned int random_seed = 123;
+	int instruction_set[64], no_of_instructions=0;
+	int data_size = 8, data_fields = 2;
+
+	printf("test_gprc_checkpoint...");
+
+	/* create an instruction set */
+	no_of_instructions =
+		gprc_default_instruction_set((int*)instruction_set);
+	assert(no_of_instructions>0);
+
+	/* create a population */
+	gprc_init_system(&system,islands,
+					 population_per_island,
+					 rows, columns,
+					 sensors, actuators,
+					 connections_per_gene,
+					 modules,
+					 chromosomes,
+					 min_value, max_value,
+					 integers_only,
+					 data_size, data_fields,
+					 &random_seed,
+					 instruction_set, no_of_instructions);
+
+	sprintf(filename,"%stestcheckpoint.bin",GPR_TEMP_DIRECTORY);
+
+	gpr_checkpoint_init(&checkpoint);
+	assert(gpr_checkpoint_done(&checkpoint)!=0);
+
+	for (compress = 0; compress <= 1; compress++) {
+		for (i = 0; i < islands; i++) {
+			p1 = &system.island[i];
+			for (k = 0; k < p1->size; k++) {
+				p1->fitness[k] = k + compress;
+			}
+		}
+
+		assert(gprc_checkpoint_system(&system, &checkpoint,
+									  filename, compress)==0);
+
+		/* changes made while the checkpoint is being written
+		   should not appear within it */
+		for (i = 0; i < islands; i++) {
+			p1 = &system.island[i];
+			for (k = 0; k < p1->size; k++) {
+				p1->fitness[k] = -1;
+			}
+		}
+
+		assert(gpr_checkpoint_wait(&checkpoint)==0);
+		assert(gpr_checkpoint_done(&checkpoint)!=0);
+
+		/* the temporary file should have been renamed */
+		sprintf(filename,"%stestcheckpoint.bin.tmp",GPR_TEMP_DIRECTORY);
+		fp = fopen(filename,"rb");
+		assert(fp==0);
+		sprintf(filename,"%stestcheckpoint.bin",GPR_TEMP_DIRECTORY);
+
+		/* load the checkpoint */
+		fp  = fopen(filename,"rb");
+		assert(fp!=0);
+		retval = gprc_load_system_binary(&system2,fp,
+										 instruction_set,
+										 no_of_instructions);
+		assert(retval==GPR_LOAD_OK);
+		fclose(fp);
+
+		for (i = 0; i < islands; i++) {
+			p1 = &system.island[i];
+			p2 = &system2.island[i];
+			for (k = 0; k < p1->size; k++) {
+				assert(p2->fitness[k] == k + compress);
+				for (m = 0; m < modules+1; m++) {
+					for (j = 0;
+						 j < (rows*columns*
+							  GPRC_GENE_SIZE(connections_per_gene))+
+							 gprc_get_actuators(m,actuators); j++) {
+						assert(p1->individual[k].genome[m].gene[j] ==
+							   p2->individual[k].genome[m].gene[j]);
+					}
+				}
+			}
+		}
+		gprc_free_system(&system2);
+	}
+
+	gpr_checkpoint_free(&checkpoint);
+	gprc_free_system(&system);
+
+	printf("Ok\n");
+}
+
 static void set_function(gprc_function * f,
 						 int ADF_module,
 						 int row, int col,						 
@@ -1968,6 +3314,12 @@ int run_tests_cartesian()
 	test_gprc_random();
 	test_gprc_copy();
 	test_gprc_run();
+	test_gprc_active_genes();
+	test_gprc_used_genes();
+	test_gprc_same_phenotype();
+	test_gprc_run_real();
+	test_gprc_run_batch();
+	test_gprc_jit();
 	test_gprc_run_dynamic();
 	test_gprc_mutate();
 	test_gprc_crossover();
@@ -1976,10 +3328,16 @@ int run_tests_cartesian()
 	test_gprc_mate();
 	test_gprc_generation();
 	test_gprc_generation_system();
+	test_gprc_generation_threads();
+	test_gprc_generation_double_buffer();
+	test_gprc_generation_lexicase();
 	test_gprc_save_load();
 	test_gprc_save_load_system();
+	test_gprc_save_load_system_binary();
+	test_gprc_checkpoint();
 	test_gprc_compress_ADF();
 	test_gprc_environment();
+	test_gprc_steady_state();
 	test_colour_conversion();
 
 	printf("All Cartesian tests completed\n");
@@ -842,6 +842,167 @@ static void test_gprcm_mate()
 	printf("Ok\n");
 }
 
+static void test_gprcm_morphology_cache()
+{
+	gprcm_function parent1, parent2, child1, child2;
+	gprcm_environment population;
+	int rows=10, columns=20, sensors=8, actuators=4;
+	int connections_per_gene=10, hit, i, gene_size;
+	float min_value=-10, max_value=10;
+	int instruction_set[64], no_of_instructions=0;
+	int integers_only=0;
+	int modules = 1;
+	int chromosomes = 2;
+	unsigned int random_seed = 5321;
+	int data_size = 8, data_fields = 2;
+	int no_of_outputs = rows*columns*GPRCM_MORPHOLOGY_ACTUATORS;
+
+	printf("test_gprcm_morphology_cache...");
+
+	no_of_instructions =
+		gprcm_default_instruction_set((int*)instruction_set);
+
+	gprcm_init(&parent1,
+			   rows, columns, sensors, actuators,
+			   connections_per_gene,
+			   modules, data_size, data_fields,
+			   &random_seed);
+	gprcm_init(&parent2,
+			   rows, columns, sensors, actuators,
+			   connections_per_gene,
+			   modules, data_size, data_fields,
+			   &random_seed);
+	gprcm_init(&child1,
+			   rows, columns, sensors, actuators,
+			   connections_per_gene,
+			   modules, data_size, data_fields,
+			   &random_seed);
+	gprcm_init(&child2,
+			   rows, columns, sensors, actuators,
+			   connections_per_gene,
+			   modules, data_size, data_fields,
+			   &random_seed);
+
+	/* nothing has been generated yet */
+	assert(parent1.morphology_hash == 0);
+
+	gprcm_random(&parent1, rows, columns,
+				 sensors, actuators,
+				 connections_per_gene,
+				 min_value, max_value,
+				 integers_only, &random_seed,
+				 instruction_set, no_of_instructions);
+	gprcm_random(&parent2, rows, columns,
+				 sensors, actuators,
+				 connections_per_gene,
+				 min_value, max_value,
+				 integers_only, &random_seed,
+				 instruction_set, no_of_instructions);
+	assert(parent1.morphology_hash != 0);
+	assert(parent2.morphology_hash != 0);
+	assert(parent1.morphology_hash != parent2.morphology_hash);
+
+	/* without mutation the child's morphology generator is a
+	   clone of one parent, so its outputs can be reused */
+	(&child1.morphology)->random_seed = 1234;
+	(&child1.program)->random_seed = 5678;
+	hit = gprcm_mate(&parent1, &parent2,
+					 rows, columns,
+					 sensors, actuators,
+					 connections_per_gene,
+					 min_value, max_value,
+					 integers_only,
+					 0, 0,
+					 chromosomes,
+					 instruction_set, no_of_instructions,
+					 0, modules, &child1);
+	assert(hit != 0);
+	assert((child1.morphology_hash == parent1.morphology_hash) ||
+		   (child1.morphology_hash == parent2.morphology_hash));
+
+	/* the same mating with nothing cached should run the morphology
+	   generator and produce an identical child */
+	parent1.morphology_hash = 0;
+	parent2.morphology_hash = 0;
+	(&child2.morphology)->random_seed = 1234;
+	(&child2.program)->random_seed = 5678;
+	hit = gprcm_mate(&parent1, &parent2,
+					 rows, columns,
+					 sensors, actuators,
+					 connections_per_gene,
+					 min_value, max_value,
+					 integers_only,
+					 0, 0,
+					 chromosomes,
+					 instruction_set, no_of_instructions,
+					 0, modules, &child2);
+	assert(hit == 0);
+	assert(child2.morphology_hash == child1.morphology_hash);
+	for (i = 0; i < no_of_outputs; i++) {
+		assert(child1.morphology_output[i] ==
+			   child2.morphology_output[i]);
+	}
+	for (i = 0; i < rows*columns*GPRC_GENE_SIZE(connections_per_gene) +
+			 actuators; i++) {
+		assert((&child1.program)->genome[0].gene[i] ==
+			   (&child2.program)->genome[0].gene[i]);
+	}
+
+	/* a morphology generator which uses its data store
+	   isn't cached */
+	gene_size = GPRC_GENE_SIZE(GPRCM_MORPHOLOGY_CONNECTIONS_PER_GENE);
+	for (i = 0; i < GPRCM_MORPHOLOGY_ROWS*GPRCM_MORPHOLOGY_COLUMNS; i++) {
+		if ((&parent1.morphology)->genome[0].used[
+				GPRCM_MORPHOLOGY_SENSORS + i] != 0) {
+			(&parent1.morphology)->genome[0].gene[
+				i*gene_size + GPRC_GENE_FUNCTION_TYPE] =
+				GPR_FUNCTION_DATA_GET;
+			break;
+		}
+	}
+	assert(child1.morphology_hash != 0);
+	hit = gprcm_mate(&parent1, &parent1,
+					 rows, columns,
+					 sensors, actuators,
+					 connections_per_gene,
+					 min_value, max_value,
+					 integers_only,
+					 0, 0,
+					 chromosomes,
+					 instruction_set, no_of_instructions,
+					 0, modules, &child1);
+	assert(hit == 0);
+	assert(child1.morphology_hash == 0);
+
+	/* matings within an environment are counted */
+	gprcm_init_environment(&population, 8, 4,
+						   rows, columns,
+						   sensors, actuators,
+						   connections_per_gene,
+						   modules, chromosomes,
+						   min_value, max_value,
+						   integers_only,
+						   data_size, data_fields,
+						   &random_seed,
+						   instruction_set, no_of_instructions);
+	assert(population.morphology_hits == 0);
+	population.matings = 0;
+	for (i = 0; i < 4; i++) {
+		gprcm_mate_environment(&population, i, (i+1)%4, 0, 0,
+							   instruction_set, no_of_instructions);
+	}
+	assert(population.morphology_hits == 4);
+	gprcm_free_environment(&population);
+
+	/* free memory */
+	gprcm_free(&parent1);
+	gprcm_free(&parent2);
+	gprcm_free(&child1);
+	gprcm_free(&child2);
+
+	printf("Ok\n");
+}
+
 static void test_gprcm_generation()
 {
 	int population_size = 512;
@@ -1167,6 +1328,180 @@ static void test_gprcm_save_load()
 	printf("Ok\n");
 }
 
+static void test_gprcm_save_load_binary()
+{
+	gprcm_population population, population2;
+	gprcm_function *f1, *f2;
+	int population_size = 256;
+	int rows = 20, columns = 40, sensors = 5, actuators = 5;
+	int connections_per_gene = 2;
+	int chromosomes=2;
+	int modules=1;
+	float min_value = -5, max_value = 5;
+	int integers_only = 0, i, j, retval;
+	char filename[256];
+	FILE * fp;
+	unsigned int random_seed = 123;
+	int instruction_set[64], no_of_instructions=0;
+	int data_size = 8, data_fields = 2;
+	unsigned long long length;
+	unsigned int byte_order;
+
+	printf("test_gprcm_save_load_binary...");
+
+	/* create an instruction set */
+	no_of_instructions =
+		gprcm_default_instruction_set((int*)instruction_set);
+	assert(no_of_instructions>0);
+
+	/* create a population */
+	gprcm_init_population(&population,
+						  population_size,
+						  rows, columns,
+						  sensors, actuators,
+						  connections_per_gene,
+						  modules,
+						  chromosomes,
+						  min_value, max_value,
+						  integers_only,
+						  data_size, data_fields,
+						  &random_seed,
+						  instruction_set, no_of_instructions);
+
+	for (i = 0; i < population.size; i++) {
+		population.fitness[i] = i*0.5f;
+	}
+
+	sprintf(filename,"%stestpopulation.bin",GPR_TEMP_DIRECTORY);
+
+	/* save to file */
+	fp  = fopen(filename,"wb");
+	assert(fp!=0);
+	assert(gprcm_save_population_binary(&population,fp,1)==0);
+	fclose(fp);
+
+	/* load from file */
+	fp  = fopen(filename,"rb");
+	assert(fp!=0);
+	retval = gprcm_load_population_binary(&population2,fp,
+										  instruction_set,
+										  no_of_instructions);
+	assert(retval==GPR_LOAD_OK);
+	fclose(fp);
+
+	/* check population parameters */
+	assert(population.history.index==population2.history.index);
+	assert(population.size==population2.size);
+	assert(population.rows==population2.rows);
+	assert(population.columns==population2.columns);
+	assert(population.connections_per_gene==
+		   population2.connections_per_gene);
+	assert(population.sensors==population2.sensors);
+	assert(population.actuators==population2.actuators);
+	assert(population.min_value==population2.min_value);
+	assert(population.max_value==population2.max_value);
+	assert(population.data_size==population2.data_size);
+	assert(population.data_fields==population2.data_fields);
+
+	/* check that individuals are the same */
+	for (i = 0; i < population.size; i++) {
+		f1 = &population.individual[i];
+		f2 = &population2.individual[i];
+		assert(population.fitness[i]==population2.fitness[i]);
+		for (j = 0;
+			 j < (rows*columns*GPRC_GENE_SIZE(connections_per_gene))+
+				 actuators; j++) {
+			assert(f1->program.genome[0].gene[j] ==
+				   f2->program.genome[0].gene[j]);
+		}
+		for (j = 0;
+			 j < (rows*columns) + sensors + actuators; j++) {
+			assert(f1->program.genome[0].used[j] ==
+				   f2->program.genome[0].used[j]);
+		}
+		assert(f1->program.random_seed == f2->program.random_seed);
+		assert(f1->morphology.random_seed == f2->morphology.random_seed);
+		for (j = 0;
+			 j < (GPRCM_MORPHOLOGY_ROWS*GPRCM_MORPHOLOGY_COLUMNS*
+				  GPRC_GENE_SIZE(GPRCM_MORPHOLOGY_CONNECTIONS_PER_GENE))+
+				 GPRCM_MORPHOLOGY_ACTUATORS; j++) {
+			assert(f1->morphology.genome[0].gene[j] ==
+				   f2->morphology.genome[0].gene[j]);
+		}
+	}
+	gprcm_free_population(&population2);
+
+	/* files with invalid parameters are rejected, and the
+	   population is left unallocated */
+	for (i = 0; i < 2; i++) {
+		if (i == 0) {
+			/* more chromosomes than rows */
+			population.chromosomes = rows+1;
+		}
+		else {
+			/* individuals with more ADF modules than the population */
+			population.chromosomes = chromosomes;
+			population.ADF_modules = 0;
+		}
+		fp  = fopen(filename,"wb");
+		assert(fp!=0);
+		assert(gprcm_save_population_binary(&population,fp,1)==0);
+		fclose(fp);
+
+		fp  = fopen(filename,"rb");
+		assert(fp!=0);
+		retval = gprcm_load_population_binary(&population2,fp,
+											  instruction_set,
+											  no_of_instructions);
+		assert(retval==GPR_LOAD_BINARY_SECTION);
+		fclose(fp);
+	}
+	population.ADF_modules = modules;
+
+	/* corrupt section lengths and byte orders are rejected */
+	for (i = 0; i < 2; i++) {
+		fp  = fopen(filename,"wb");
+		assert(fp!=0);
+		assert(gprcm_save_population_binary(&population,fp,1)==0);
+		fclose(fp);
+
+		fp  = fopen(filename,"r+b");
+		assert(fp!=0);
+		if (i == 0) {
+			/* uncompressed length of the first section */
+			length = 0xffffffffffffULL;
+			assert(fseek(fp, 16+8, SEEK_SET)==0);
+			assert(fwrite(&length, sizeof(unsigned long long),
+						  1, fp)==1);
+		}
+		else {
+			/* byte order marker */
+			byte_order = 0x04030201;
+			assert(fseek(fp, 4, SEEK_SET)==0);
+			assert(fwrite(&byte_order, sizeof(unsigned int),
+						  1, fp)==1);
+		}
+		fclose(fp);
+
+		fp  = fopen(filename,"rb");
+		assert(fp!=0);
+		retval = gprcm_load_population_binary(&population2,fp,
+											  instruction_set,
+											  no_of_instructions);
+		if (i == 0) {
+			assert(retval==GPR_LOAD_BINARY_SECTION);
+		}
+		else {
+			assert(retval==GPR_LOAD_BINARY_FORMAT);
+		}
+		fclose(fp);
+	}
+
+	gprcm_free_population(&population);
+
+	printf("Ok\n");
+}
+
 static void test_gprcm_save_load_system()
 {
 	int islands=4;
@@ -1596,9 +1931,11 @@ int run_tests_morphology()
 	test_gprcm_sort();
 	test_gprcm_sort_system();
 	test_gprcm_mate();
+	test_gprcm_morphology_cache();
 	test_gprcm_generation();
 	test_gprcm_generation_system();
 	test_gprcm_save_load();
+	test_gprcm_save_load_binary();
 	test_gprcm_save_load_system();
 	test_gprcm_compress_ADF();
 	test_gprcm_environment();
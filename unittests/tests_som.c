@@ -196,6 +196,127 @@ static void test_gpr_som_update()
 	printf("Ok\n");
 }
 
+/* returns the closest cell, comparing every weight with the sensors */
+static int test_gpr_som_closest(gpr_som * som, float * sensors,
+								float * min_distance)
+{
+	int i, s, winner = -1;
+	float dist, d;
+	gpr_som_element * elem;
+
+	for (i = 0; i < som->dimension*som->dimension; i++) {
+		elem = (gpr_som_element*)&som->weight[i];
+		dist = 0;
+		for (s = 0; s < som->no_of_sensors; s++) {
+			if ((elem->vect[s] != GPR_MISSING_VALUE) &&
+				(sensors[s] != GPR_MISSING_VALUE)) {
+				d = sensors[s] - elem->vect[s];
+				dist += d*d*som->sensor_scale[s];
+			}
+		}
+		if ((winner == -1) || (dist < *min_distance)) {
+			*min_distance = dist;
+			winner = i;
+		}
+	}
+	return winner;
+}
+
+static void test_gpr_som_missing_values()
+{
+	int dimension = 64;
+	int no_of_sensors = 103;
+	float sensors[103];
+	int i, s, itt, winner, closest;
+	gpr_som som1, som2;
+	float x=0, y=0, x2=0, y2=0, min_distance=0, dist, d;
+	unsigned int random_seed = 5623;
+	gpr_som_element * elem;
+	char filename[256];
+	FILE * fp;
+
+	printf("test_gpr_som_missing_values...");
+
+	gpr_som_init(dimension, no_of_sensors, &som1);
+	assert(som1.stride >= no_of_sensors);
+	assert((som1.stride*sizeof(float)) % GPR_SOM_ALIGNMENT == 0);
+	for (i = 0; i < dimension*dimension; i++) {
+		assert((size_t)som1.weight[i].vect % GPR_SOM_ALIGNMENT == 0);
+	}
+	for (s = 0; s < no_of_sensors; s++) {
+		assert(gpr_som_init_sensor(&som1, s, -10, 10,
+								   &random_seed)==0);
+	}
+
+	/* some weights are missing */
+	for (i = 0; i < dimension*dimension; i += 7) {
+		elem = (gpr_som_element*)&som1.weight[i];
+		elem->vect[i % no_of_sensors] = GPR_MISSING_VALUE;
+	}
+	gpr_som_mask_weights(&som1);
+	for (i = 0; i < dimension*dimension; i++) {
+		assert(som1.weight_mask[i*som1.stride + (i % no_of_sensors)] ==
+			   ((i % 7 == 0) ? 0 : 1));
+	}
+	sprintf(filename,"%slibgpr_som_missing.txt",GPR_TEMP_DIRECTORY);
+	fp = fopen(filename,"w");
+	assert(fp);
+	gpr_som_save(&som1, fp);
+	fclose(fp);
+	fp = fopen(filename,"r");
+	assert(fp);
+	gpr_som_load(&som2, fp);
+	fclose(fp);
+
+	for (itt = 0; itt < 20; itt++) {
+		/* some sensor values are missing */
+		for (s = 0; s < no_of_sensors; s++) {
+			sensors[s] = -10 + (rand_num(&random_seed)%20000)/1000.0f;
+			if (rand_num(&random_seed)%4 == 0) {
+				sensors[s] = GPR_MISSING_VALUE;
+			}
+		}
+
+		closest = test_gpr_som_closest(&som2, sensors, &min_distance);
+		winner = gpr_som_update(sensors, &som2, &x, &y);
+		assert(winner > -1);
+
+		/* the winner should be the closest, allowing for
+		   differences in the order of summation */
+		elem = (gpr_som_element*)&som2.weight[winner];
+		dist = 0;
+		for (s = 0; s < no_of_sensors; s++) {
+			if ((elem->vect[s] != GPR_MISSING_VALUE) &&
+				(sensors[s] != GPR_MISSING_VALUE)) {
+				d = sensors[s] - elem->vect[s];
+				dist += d*d;
+			}
+		}
+		assert(dist <= min_distance*1.0001f);
+		if (dist < min_distance*0.9999f) {
+			assert(winner == closest);
+		}
+		assert(som2.state[winner] == 1.0f);
+
+		/* running without altering state gives the same result */
+		gpr_som_run(sensors, &som2, &x2, &y2);
+		assert(x == x2);
+		assert(y == y2);
+
+		/* missing values are never learned */
+		gpr_som_learn(&som2, sensors, 8, 4, 0.1f);
+		for (i = 0; i < dimension*dimension; i += 7) {
+			elem = (gpr_som_element*)&som2.weight[i];
+			assert(elem->vect[i % no_of_sensors] == GPR_MISSING_VALUE);
+		}
+	}
+
+	gpr_som_free(&som1);
+	gpr_som_free(&som2);
+
+	printf("Ok\n");
+}
+
 static void test_gpr_som_learn()
 {
 	int dimension = 128;
@@ -256,6 +377,206 @@ static void test_gpr_som_learn()
 	printf("Ok\n");
 }
 
+/* returns the average distance from each sample to its closest cell */
+static float test_gpr_som_quantisation_error(gpr_som * som,
+											 float * data,
+											 int fields_per_sample,
+											 int * data_field_index,
+											 int no_of_samples)
+{
+	int i, s;
+	float sensors[8], min_distance = 0, total = 0;
+
+	for (i = 0; i < no_of_samples; i++) {
+		for (s = 0; s < som->no_of_sensors; s++) {
+			sensors[s] = data[i*fields_per_sample + data_field_index[s]];
+		}
+		test_gpr_som_closest(som, sensors, &min_distance);
+		total += min_distance;
+	}
+	return total / no_of_samples;
+}
+
+static void test_gpr_som_learn_batch()
+{
+	int dimension = 16, no_of_sensors = 2;
+	int no_of_samples = 2000, fields_per_sample = 3;
+	int data_field_index[2] = { 2, 0 };
+	int i, s, cluster;
+	float * data, initial_error, error;
+	gpr_som som1, som2;
+	unsigned int random_seed = 764;
+
+	printf("test_gpr_som_learn_batch...");
+
+	/* samples from four clusters, with some values missing */
+	data = (float*)malloc(no_of_samples*fields_per_sample*sizeof(float));
+	assert(data);
+	for (i = 0; i < no_of_samples; i++) {
+		cluster = rand_num(&random_seed)%4;
+		data[i*fields_per_sample] =
+			((cluster & 1) * 8) + (rand_num(&random_seed)%1000)/1000.0f;
+		data[i*fields_per_sample + 1] = 0;
+		data[i*fields_per_sample + 2] =
+			((cluster >> 1) * 8) + (rand_num(&random_seed)%1000)/1000.0f;
+		if (i % 50 == 0) {
+			data[i*fields_per_sample] = GPR_MISSING_VALUE;
+		}
+	}
+
+	gpr_som_init(dimension, no_of_sensors, &som1);
+	gpr_som_init(dimension, no_of_sensors, &som2);
+	for (s = 0; s < no_of_sensors; s++) {
+		random_seed = 43 + s;
+		assert(gpr_som_init_sensor(&som1, s, -20, 20, &random_seed)==0);
+		random_seed = 43 + s;
+		assert(gpr_som_init_sensor(&som2, s, -20, 20, &random_seed)==0);
+	}
+	initial_error =
+		test_gpr_som_quantisation_error(&som1, data, fields_per_sample,
+										data_field_index, no_of_samples);
+
+	gpr_som_learn_batch_from_data(&som1, data_field_index, data,
+								  fields_per_sample, no_of_samples,
+								  20, dimension/2, 0.5f, 1.0f, 0.5f, 0);
+	gpr_som_learn_batch_from_data(&som2, data_field_index, data,
+								  fields_per_sample, no_of_samples,
+								  20, dimension/2, 0.5f, 1.0f, 0.5f, 0);
+
+	/* the map should be much closer to the samples */
+	error =
+		test_gpr_som_quantisation_error(&som1, data, fields_per_sample,
+										data_field_index, no_of_samples);
+	assert(error < initial_error*0.1f);
+
+	/* the same data gives the same map */
+	for (i = 0; i < dimension*dimension; i++) {
+		for (s = 0; s < no_of_sensors; s++) {
+			assert(som1.weight[i].vect[s] == som2.weight[i].vect[s]);
+			assert(som1.weight[i].vect[s] > -20);
+			assert(som1.weight[i].vect[s] < 20);
+		}
+	}
+
+	gpr_som_free(&som1);
+	gpr_som_free(&som2);
+	free(data);
+
+	printf("Ok\n");
+}
+
+static void test_gpr_som_run_batch()
+{
+	int dimension = 32, no_of_sensors = 5, top_k = 4;
+	int no_of_samples = 300, fields_per_sample = 6;
+	int data_field_index[5] = { 5, 1, 2, 0, 4 };
+	int i, j, s, copy;
+	int * winner, * top_index, * winner_copy;
+	float * data, * result, * top_distance, * state;
+	float sensors[5], x, y, min_distance = 0;
+	gpr_som som;
+	unsigned int random_seed = 2357;
+
+	printf("test_gpr_som_run_batch...");
+
+	data = (float*)malloc(no_of_samples*fields_per_sample*sizeof(float));
+	result = (float*)malloc(no_of_samples*2*sizeof(float));
+	winner = (int*)malloc(no_of_samples*sizeof(int));
+	winner_copy = (int*)malloc(4*no_of_samples*sizeof(int));
+	top_index = (int*)malloc(no_of_samples*top_k*sizeof(int));
+	top_distance = (float*)malloc(no_of_samples*top_k*sizeof(float));
+	state = (float*)malloc(dimension*dimension*sizeof(float));
+	assert(data);
+	assert(result);
+	assert(winner);
+	assert(winner_copy);
+	assert(top_index);
+	assert(top_distance);
+	assert(state);
+
+	for (i = 0; i < no_of_samples*fields_per_sample; i++) {
+		data[i] = -10 + (rand_num(&random_seed)%20000)/1000.0f;
+		if (rand_num(&random_seed)%10 == 0) {
+			data[i] = GPR_MISSING_VALUE;
+		}
+	}
+
+	gpr_som_init(dimension, no_of_sensors, &som);
+	for (s = 0; s < no_of_sensors; s++) {
+		assert(gpr_som_init_sensor(&som, s, -10, 10, &random_seed)==0);
+	}
+	for (s = 0; s < no_of_sensors; s++) {
+		sensors[s] = data[data_field_index[s]];
+	}
+	gpr_som_update(sensors, &som, &x, &y);
+	memcpy((void*)state, (void*)som.state,
+		   dimension*dimension*sizeof(float));
+
+	gpr_som_run_batch(&som, data_field_index, data,
+					  fields_per_sample, no_of_samples,
+					  winner, result, top_k, top_index, top_distance);
+
+	for (i = 0; i < no_of_samples; i++) {
+		for (s = 0; s < no_of_sensors; s++) {
+			sensors[s] = data[i*fields_per_sample + data_field_index[s]];
+		}
+		/* the same as running each sample individually */
+		gpr_som_run(sensors, &som, &x, &y);
+		assert(result[i*2] == x);
+		assert(result[i*2+1] == y);
+		assert(winner[i] == (int)(y*dimension)*dimension +
+			   (int)(x*dimension));
+
+		/* the closest cells in order of distance */
+		assert(top_index[i*top_k] == winner[i]);
+		test_gpr_som_closest(&som, sensors, &min_distance);
+		assert(fabs(top_distance[i*top_k] - min_distance) <=
+			   min_distance*0.0001f);
+		for (j = 1; j < top_k; j++) {
+			assert(top_distance[i*top_k + j] >=
+				   top_distance[i*top_k + j - 1]);
+			assert(top_index[i*top_k + j] != top_index[i*top_k + j - 1]);
+		}
+	}
+
+	/* the SOM may be shared between threads */
+#pragma omp parallel for
+	for (copy = 0; copy < 4; copy++) {
+		gpr_som_run_batch(&som, data_field_index, data,
+						  fields_per_sample, no_of_samples,
+						  &winner_copy[copy*no_of_samples], 0, 0, 0, 0);
+	}
+	for (copy = 0; copy < 4; copy++) {
+		for (i = 0; i < no_of_samples; i++) {
+			assert(winner_copy[copy*no_of_samples + i] == winner[i]);
+		}
+	}
+
+	/* the state should not have changed */
+	for (i = 0; i < dimension*dimension; i++) {
+		assert(som.state[i] == state[i]);
+	}
+
+	/* outputs are the positions of the closest cells */
+	gpr_som_outputs_from_data(&som, data_field_index, data,
+							  fields_per_sample, no_of_samples,
+							  top_distance);
+	for (i = 0; i < no_of_samples*2; i++) {
+		assert(top_distance[i] == result[i]);
+	}
+
+	gpr_som_free(&som);
+	free(data);
+	free(result);
+	free(winner);
+	free(winner_copy);
+	free(top_index);
+	free(top_distance);
+	free(state);
+
+	printf("Ok\n");
+}
+
 static void test_gpr_som_save_load()
 {
 	int dimension = 128;
@@ -352,7 +673,10 @@ int run_tests_som()
 	test_gpr_som_init_sensor();
 	test_gpr_som_init_sensor_from_data();
 	test_gpr_som_update();
+	test_gpr_som_missing_values();
 	test_gpr_som_learn();
+	test_gpr_som_learn_batch();
+	test_gpr_som_run_batch();
 	test_gpr_som_save_load();
 
 	printf("All SOM tests completed\n");